@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_atomic.h"
+#include "../jsmnrpc_clock.h"
+#include "../jsmnrpc_coalesce.h"
+#include "../jsmnrpc_frame.h"
+#include "../jsmnrpc_pipeline.h"
+
+/*
+ * Write coalescing benchmark. Requests are submitted to a jsmnrpc_pipeline
+ * (one worker, one writer), 'depth' at a time, as a client pipelining on one
+ * connection would. The writer frames each response in place and either
+ * writes it with its own system call or adds it to a jsmnrpc_coalesce that is
+ * flushed after every batch of the write stage. A thread reads the responses
+ * from the other end of a socket pair. Reports calls/s and write calls per call.
+ *
+ * Usage: bench_coalesce [-t seconds_per_scenario]
+ */
+
+#define MAX_TOKENS 64
+#define RESPONSE_CAPACITY 256
+
+typedef struct stream
+{
+  int fd;
+  int coalesce;
+  jsmnrpc_coalesce_t out;
+  uint64_t writes;
+} stream_t;
+
+static jsmnrpc_handler_t handlers[4];
+static const char request[] = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [42], \"id\": 1}";
+static uint64_t received;
+
+static void echo(jsmnrpc_request_info_t* info)
+{
+  jsmnrpc_create_result("42", info);
+}
+
+static void write_response(jsmnrpc_pipeline_job_t* job, void* arg)
+{
+  stream_t* s = (stream_t*)arg;
+  char* message = job->data.response.data;
+  size_t length = jsmnrpc_frame_seal(jsmnrpc_framing_newline, message, job->data.response.length);
+  if (s->coalesce)
+  {
+    jsmnrpc_coalesce_add(&s->out, message, length);
+  }
+  else if (write(s->fd, message, length) == (ssize_t)length)
+  {
+    s->writes++;
+  }
+}
+
+static void flush_responses(void* arg)
+{
+  stream_t* s = (stream_t*)arg;
+  jsmnrpc_coalesce_flush(&s->out);
+}
+
+static void* reader_main(void* arg)
+{
+  int fd = *(int*)arg;
+  char buf[1 << 16];
+  ssize_t n, i;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  {
+    uint64_t lines = 0;
+    for (i = 0; i < n; i++)
+    {
+      lines += buf[i] == '\n';
+    }
+    JSMNRPC_ATOMIC_ADD(&received, lines);
+  }
+  return NULL;
+}
+
+static void run(jsmnrpc_instance_t* rpc, int coalesce, int depth, double seconds)
+{
+  jsmnrpc_pipeline_config_t config;
+  jsmnrpc_pipeline_t pipeline;
+  stream_t s;
+  pthread_t reader;
+  uint64_t start, now, calls = 0;
+  int sv[2], i;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+  {
+    perror("socketpair");
+    exit(1);
+  }
+  memset(&s, 0, sizeof(s));
+  s.fd = sv[0];
+  s.coalesce = coalesce;
+  jsmnrpc_coalesce_init(&s.out, sv[0], 0, 0);
+  jsmnrpc_pipeline_config_init(&config);
+  config.workers = 1;
+  config.writers = 1;
+  config.jobs = depth < 16 ? 16 : depth;
+  config.max_request = 256;
+  config.max_response = RESPONSE_CAPACITY;
+  config.max_tokens = MAX_TOKENS;
+  if (jsmnrpc_pipeline_init(&pipeline, rpc, &config, write_response, &s) != 0)
+  {
+    perror("jsmnrpc_pipeline_init");
+    exit(1);
+  }
+  pipeline.flush = coalesce ? flush_responses : NULL;
+  received = 0;
+  pthread_create(&reader, NULL, reader_main, &sv[1]);
+  jsmnrpc_pipeline_start(&pipeline);
+
+  start = jsmnrpc_clock_ns();
+  do
+  {
+    for (i = 0; i < depth; i++)
+    {
+      while (jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 0) != 0)
+      {
+        sched_yield();
+      }
+    }
+    calls += (uint64_t)depth;
+    while (JSMNRPC_ATOMIC_LOAD(&received) < calls)
+    {
+      sched_yield();
+    }
+    now = jsmnrpc_clock_ns();
+  } while (now - start < (uint64_t)(seconds * 1e9));
+
+  jsmnrpc_pipeline_stop(&pipeline);
+  shutdown(sv[0], SHUT_WR);
+  pthread_join(reader, NULL);
+  printf("%-10s depth %-4d %12.0f %10.3f\n", coalesce ? "coalesce" : "direct", depth, calls / ((now - start) / 1e9),
+         (double)(coalesce ? s.out.counters.writes : s.writes) / calls);
+  jsmnrpc_pipeline_close(&pipeline);
+  jsmnrpc_coalesce_close(&s.out);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+int main(int argc, char** argv)
+{
+  static const int depths[] = { 1, 16, 256 };
+  jsmnrpc_instance_t rpc;
+  double seconds = 0.5;
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      seconds = atof(argv[++i]);
+    }
+  }
+  jsmnrpc_init(&rpc, handlers, 4);
+  jsmnrpc_register_handler(&rpc, "echo", echo);
+  printf("%-21s %12s %10s\n", "writer", "calls/s", "writes");
+  for (i = 0; i < 3; i++)
+  {
+    run(&rpc, 0, depths[i], seconds);
+    run(&rpc, 1, depths[i], seconds);
+  }
+  printf("\n(writes: write/writev calls per call)\n");
+  return 0;
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../jsmn.h"
+#include "../jsmnrpc_clock.h"
+
+/*
+ * Tokenizer throughput benchmark. Runs jsmn_parse over a fixed, generated
+ * corpus and reports MB/s, tokens/s and TSC cycles per byte for the build
+ * configuration this file was compiled with (see 'make bench').
+ *
+ * Usage: bench_jsmn [-t seconds_per_document] [file.json ...]
+ */
+
+#define DOC_SIZE 16000 /* fits jsmn_size_t=int16_t with room to spare */
+
+typedef struct {
+	const char *name;
+	char *js;
+	size_t len;
+} bench_doc;
+
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t cap;
+	unsigned long long seed;
+} doc_writer;
+
+static unsigned long next_random(doc_writer *w) {
+	w->seed = w->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned long)(w->seed >> 33);
+}
+
+static void put(doc_writer *w, const char *s) {
+	size_t n = strlen(s);
+	if (w->len + n + 1 > w->cap) {
+		w->cap = (w->len + n + 1) * 2;
+		w->buf = realloc(w->buf, w->cap);
+	}
+	memcpy(w->buf + w->len, s, n + 1);
+	w->len += n;
+}
+
+/* parts are drawn left to right before formatting: argument evaluation order is unspecified */
+static void put_number(doc_writer *w) {
+	char tmp[32];
+	unsigned long a, b, c;
+	switch (next_random(w) % 3) {
+		case 0:
+			sprintf(tmp, "%lu", next_random(w) % 100000);
+			break;
+		case 1:
+			a = next_random(w) % 1000;
+			b = next_random(w) % 1000;
+			sprintf(tmp, "-%lu.%lu", a, b);
+			break;
+		default:
+			a = next_random(w) % 10;
+			b = next_random(w) % 100;
+			c = next_random(w) % 20;
+			sprintf(tmp, "%lu.%lue%d", a, b, (int)c - 10);
+			break;
+	}
+	put(w, tmp);
+}
+
+static void put_string(doc_writer *w, int max_len) {
+	static const char *pieces[] = { "lorem", "ipsum", " ", "dolor", "\\n", "sit", "\\\"", "amet", "\\u00e9", "_" };
+	int n = 1 + (int)(next_random(w) % max_len);
+	put(w, "\"");
+	while (n-- > 0) {
+		put(w, pieces[next_random(w) % 10]);
+	}
+	put(w, "\"");
+}
+
+static void gen_numbers(doc_writer *w) {
+	put(w, "[");
+	while (w->len < DOC_SIZE) {
+		put_number(w);
+		put(w, ",");
+	}
+	put(w, "0]");
+}
+
+static void gen_strings(doc_writer *w) {
+	put(w, "[");
+	while (w->len < DOC_SIZE) {
+		put_string(w, 12);
+		put(w, ",");
+	}
+	put(w, "\"\"]");
+}
+
+static void gen_nested(doc_writer *w) {
+	char stack[DOC_SIZE];
+	int depth = 0;
+	while (w->len < DOC_SIZE / 2) {
+		stack[depth] = (next_random(w) & 1) ? '{' : '[';
+		put(w, stack[depth] == '{' ? "{\"k\":" : "[");
+		depth++;
+	}
+	put(w, "1");
+	while (depth-- > 0) {
+		put(w, stack[depth] == '{' ? "}" : "]");
+	}
+}
+
+static void gen_wide(doc_writer *w) {
+	int key = 0;
+	char tmp[32];
+	put(w, "{");
+	while (w->len < DOC_SIZE) {
+		sprintf(tmp, "\"key_%d\": ", key++);
+		put(w, tmp);
+		switch (next_random(w) % 4) {
+			case 0: put_number(w); break;
+			case 1: put_string(w, 4); break;
+			case 2: put(w, next_random(w) & 1 ? "true" : "null"); break;
+			default: put(w, "[1, 2, 3]"); break;
+		}
+		put(w, ", ");
+	}
+	put(w, "\"last\": false}");
+}
+
+static void gen_pretty(doc_writer *w) {
+	int i;
+	char tmp[64];
+	put(w, "{\n  \"items\": [\n");
+	for (i = 0; w->len < DOC_SIZE; i++) {
+		sprintf(tmp, "%s    {\n      \"id\": %d,\n      \"name\": ", i ? ",\n" : "", i);
+		put(w, tmp);
+		put_string(w, 4);
+		put(w, ",\n      \"price\": ");
+		put_number(w);
+		put(w, ",\n      \"tags\": [\n        \"a\",\n        \"b\"\n      ],\n      \"active\": true\n    }");
+	}
+	put(w, "\n  ]\n}\n");
+}
+
+static void gen_rpc(doc_writer *w) {
+	int i;
+	char tmp[96];
+	put(w, "[");
+	for (i = 0; w->len < DOC_SIZE; i++) {
+		sprintf(tmp, "%s{\"jsonrpc\": \"2.0\", \"method\": \"search\", \"id\": %d, \"params\": ", i ? ", " : "", i);
+		put(w, tmp);
+		put(w, "[{\"last_name\": ");
+		put_string(w, 3);
+		put(w, ", \"age\": ");
+		put_number(w);
+		put(w, "}]}");
+	}
+	put(w, "]");
+}
+
+static bench_doc make_doc(const char *name, void (*gen)(doc_writer *), unsigned long seed) {
+	bench_doc d;
+	doc_writer w;
+	memset(&w, 0, sizeof(w));
+	w.seed = seed;
+	put(&w, "");
+	gen(&w);
+	d.name = name;
+	d.js = w.buf;
+	d.len = w.len;
+	return d;
+}
+
+static bench_doc load_doc(const char *path) {
+	bench_doc d;
+	FILE *f = fopen(path, "rb");
+	long n;
+	d.name = path;
+	d.js = NULL;
+	d.len = 0;
+	if (f == NULL) {
+		perror(path);
+		return d;
+	}
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	d.js = malloc(n + 1);
+	d.len = fread(d.js, 1, n, f);
+	d.js[d.len] = '\0';
+	fclose(f);
+	return d;
+}
+
+static void run(const bench_doc *d, double seconds) {
+	jsmn_parser p;
+	jsmntok_t *tokens;
+	jsmn_size_t num_tokens;
+	jsmn_size_t r = 0;
+	unsigned long iterations = 0;
+	uint64_t start_ns, elapsed_ns, start_ticks, ticks;
+	double bytes;
+
+	if ((size_t)(jsmn_size_t)d->len != d->len || (jsmn_size_t)d->len < 0) {
+		printf("%-10s %8lu  skipped: too large for jsmn_size_t\n", d->name, (unsigned long)d->len);
+		return;
+	}
+	jsmn_init(&p);
+	num_tokens = jsmn_parse(&p, d->js, (jsmn_size_t)d->len, NULL, 0);
+	if (num_tokens <= 0) {
+		printf("%-10s %8lu  skipped: jsmn_parse returned %d\n", d->name, (unsigned long)d->len, (int)num_tokens);
+		return;
+	}
+	tokens = malloc(sizeof(jsmntok_t) * num_tokens);
+
+	start_ns = jsmnrpc_clock_ns();
+	start_ticks = jsmnrpc_clock_ticks();
+	do {
+		int batch;
+		for (batch = 0; batch < 16; batch++) {
+			jsmn_init(&p);
+			r = jsmn_parse(&p, d->js, (jsmn_size_t)d->len, tokens, num_tokens);
+		}
+		iterations += 16;
+		elapsed_ns = jsmnrpc_clock_ns() - start_ns;
+	} while (elapsed_ns < (uint64_t)(seconds * 1e9));
+	ticks = jsmnrpc_clock_ticks() - start_ticks;
+
+	bytes = (double)d->len * iterations;
+	printf("%-10s %8lu %7d %10.1f %12.2f %10.2f%s\n", d->name, (unsigned long)d->len, (int)num_tokens,
+			bytes / elapsed_ns * 1e3,
+			(double)num_tokens * iterations / elapsed_ns * 1e3,
+			ticks / bytes, r == num_tokens ? "" : "  (parse failed)");
+	free(tokens);
+}
+
+int main(int argc, char **argv) {
+	double seconds = 0.2;
+	double ticks_per_ns;
+	int i;
+	int files = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		}
+	}
+	ticks_per_ns = jsmnrpc_clock_ticks_per_ns(20000000);
+
+	printf("config: %s, parent links %s, jsmn_size_t %d bits, TSC %.2f GHz\n",
+#ifdef JSMN_STRICT
+			"strict",
+#else
+			"non-strict",
+#endif
+			JSMN_PARENT_LINKS ? "on" : "off", (int)sizeof(jsmn_size_t) * 8, ticks_per_ns);
+	printf("%-10s %8s %7s %10s %12s %10s\n", "document", "bytes", "tokens", "MB/s", "Mtokens/s", "cycles/B");
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0) {
+			i++;
+		} else {
+			bench_doc d = load_doc(argv[i]);
+			if (d.js) {
+				run(&d, seconds);
+				free(d.js);
+			}
+			files++;
+		}
+	}
+	if (files == 0) {
+		bench_doc docs[6];
+		docs[0] = make_doc("numbers", gen_numbers, 1);
+		docs[1] = make_doc("strings", gen_strings, 2);
+		docs[2] = make_doc("nested", gen_nested, 3);
+		docs[3] = make_doc("wide", gen_wide, 4);
+		docs[4] = make_doc("pretty", gen_pretty, 5);
+		docs[5] = make_doc("rpc-batch", gen_rpc, 6);
+		for (i = 0; i < 6; i++) {
+			run(&docs[i], seconds);
+			free(docs[i].js);
+		}
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_clock.h"
+#include "../jsmnrpc_pipeline.h"
+
+/*
+ * Staged pipeline benchmark. Submits requests whose handler burns a given
+ * amount of CPU, first inline (jsmnrpc_handle_request on the submitting
+ * thread) and then through jsmnrpc_pipeline with a growing number of
+ * workers, and reports requests/s, how often workers stole work and how long
+ * requests waited in the execute and write queues.
+ *
+ * Usage: bench_pipeline [-t seconds_per_scenario] [-w work_iterations] [-W max_workers]
+ */
+
+#define MAX_TOKENS 64
+#define RESPONSE_CAPACITY 256
+
+static jsmnrpc_handler_t handlers[4];
+
+static void burn(jsmnrpc_request_info_t* info)
+{
+  jsmnrpc_token_list_t *tokens = &info->data->tokens;
+  int param_0_token = jsmnrpc_get_value(tokens, info->params_value_token, 0, NULL);
+  jsmnrpc_string_t work = jsmnrpc_get_string(tokens, param_0_token);
+  unsigned long long x = 1469598103934665603ULL;
+  long n = work.data ? strtol(work.data, NULL, 10) : 0;
+  long i;
+  char buffer[24];
+  for (i = 0; i < n; i++)
+  {
+    x = (x ^ (unsigned long long)i) * 1099511628211ULL;
+  }
+  if (jsmnrpc_create_result_prefix(info))
+  {
+    append_str_with_len(&info->data->response, i_to_str((int)(x & 0xffff), buffer), SIZE_MAX);
+  }
+}
+
+/* the responses are only counted (by the pipeline metrics) */
+static void drop_response(jsmnrpc_pipeline_job_t* job, void* arg)
+{
+  (void)job;
+  (void)arg;
+}
+
+static void run_inline(jsmnrpc_instance_t *rpc, const char *request, double seconds)
+{
+  static jsmntok_t tokens[MAX_TOKENS];
+  static char response[RESPONSE_CAPACITY];
+  static char copy[256];
+  size_t length = strlen(request);
+  uint64_t start = jsmnrpc_clock_ns(), now, calls = 0;
+  jsmnrpc_data_t data;
+  do
+  {
+    int i;
+    for (i = 0; i < 64; i++)
+    {
+      memcpy(copy, request, length + 1);
+      data.request.data = copy;
+      data.request.length = length;
+      data.response.data = response;
+      data.response.capacity = RESPONSE_CAPACITY;
+      data.tokens.data = tokens;
+      data.tokens.capacity = MAX_TOKENS;
+      data.arg = NULL;
+      jsmnrpc_handle_request(rpc, &data);
+    }
+    calls += 64;
+    now = jsmnrpc_clock_ns();
+  } while (now - start < (uint64_t)(seconds * 1e9));
+  printf("%-12s %12.0f %10s %10s %10s %10s %10s\n", "inline", calls / ((now - start) / 1e9), "-", "-", "-", "-", "-");
+}
+
+static void run_pipeline(jsmnrpc_instance_t *rpc, const char *request, double seconds, int workers)
+{
+  jsmnrpc_pipeline_config_t config;
+  jsmnrpc_pipeline_metrics_t m;
+  jsmnrpc_pipeline_t pipeline;
+  size_t length = strlen(request);
+  uint64_t start, now;
+  char name[32];
+
+  jsmnrpc_pipeline_config_init(&config);
+  config.workers = workers;
+  if (jsmnrpc_pipeline_init(&pipeline, rpc, &config, drop_response, NULL) != 0 ||
+      jsmnrpc_pipeline_start(&pipeline) != 0)
+  {
+    perror("pipeline");
+    exit(1);
+  }
+  start = jsmnrpc_clock_ns();
+  do
+  {
+    int i;
+    for (i = 0; i < 64; i++)
+    {
+      while (jsmnrpc_pipeline_submit(&pipeline, request, length, NULL, 0) != 0)
+      {
+        sched_yield(); /* all jobs in flight: let the stages catch up */
+      }
+    }
+    now = jsmnrpc_clock_ns();
+  } while (now - start < (uint64_t)(seconds * 1e9));
+  jsmnrpc_pipeline_stop(&pipeline);
+  now = jsmnrpc_clock_ns();
+  jsmnrpc_pipeline_metrics(&pipeline, &m);
+
+  sprintf(name, "%d worker%s", workers, workers == 1 ? "" : "s");
+  printf("%-12s %12.0f %9.1f%% %10llu %10llu %10llu %10llu\n", name, m.written / ((now - start) / 1e9),
+         m.executed ? 100.0 * m.stolen / m.executed : 0.0, (unsigned long long)m.execute_max_depth,
+         (unsigned long long)jsmnrpc_histogram_percentile(&m.execute_wait_ns, 50),
+         (unsigned long long)jsmnrpc_histogram_percentile(&m.execute_wait_ns, 99),
+         (unsigned long long)jsmnrpc_histogram_percentile(&m.write_wait_ns, 99));
+  jsmnrpc_pipeline_close(&pipeline);
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 0.5;
+  long work = 2000;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_workers = cpus > 0 ? (int)cpus : 1;
+  jsmnrpc_instance_t rpc;
+  char request[128];
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      seconds = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+    {
+      work = atol(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc)
+    {
+      max_workers = atoi(argv[++i]);
+    }
+  }
+  jsmnrpc_init(&rpc, handlers, 4);
+  jsmnrpc_register_handler(&rpc, "burn", burn);
+  sprintf(request, "{\"jsonrpc\": \"2.0\", \"method\": \"burn\", \"params\": [%ld], \"id\": 1}", work);
+
+  printf("handler work: %ld iterations, %d CPU(s)\n", work, cpus > 0 ? (int)cpus : 1);
+  printf("%-12s %12s %10s %10s %10s %10s %10s\n", "mode", "requests/s", "stolen", "max depth",
+         "exec p50", "exec p99", "write p99");
+  run_inline(&rpc, request, seconds);
+  for (i = 1; i <= max_workers; i *= 2)
+  {
+    run_pipeline(&rpc, request, seconds, i);
+  }
+  if ((max_workers & (max_workers - 1)) != 0)
+  {
+    run_pipeline(&rpc, request, seconds, max_workers);
+  }
+  printf("\n(exec/write: ns a request waited for a worker / a writer)\n");
+  return 0;
+}
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_clock.h"
+
+/*
+ * JSON-RPC dispatch benchmark. Drives jsmnrpc_handle_request with single
+ * requests, notifications and batches while scaling the number of registered
+ * handlers and the size of params, and reports calls/s and ns per call
+ * (untraced), then the ns per call of a traced run and its split between
+ * parse, handler lookup, handler and response building, which add up to it
+ * (taken from the request tracing ring less the cost of its clock reads, so
+ * build with JSMNRPC_TRACE=1).
+ *
+ * Usage: bench_rpc [-t seconds_per_scenario]
+ */
+
+#if !JSMNRPC_TRACE
+#error "bench_rpc needs JSMNRPC_TRACE=1 for the per-stage breakdown"
+#endif
+
+#define MAX_HANDLERS 1000
+#define NUM_REQUESTS 64 /* distinct requests cycled through for single calls */
+#define MAX_TOKENS (1 << 18)
+#define RESPONSE_CAPACITY (8 << 20)
+#define TRACE_CAPACITY (1 << 14)
+
+typedef enum { params_small, params_medium, params_large } params_size;
+static const char *params_names[] = { "small", "medium", "large" };
+
+static jsmnrpc_handler_t handlers[MAX_HANDLERS];
+static char handler_names[MAX_HANDLERS][16];
+static jsmntok_t tokens[MAX_TOKENS];
+static char response[RESPONSE_CAPACITY];
+static jsmnrpc_trace_record_t trace_records[TRACE_CAPACITY];
+static jsmnrpc_trace_record_t trace_out[TRACE_CAPACITY];
+static double ticks_per_ns;
+static double clock_read_ticks;   /* cost of one jsmnrpc_clock_ticks() */
+
+/* ========  handlers (adapted from z_example.cpp) ========== */
+
+/* uses named params */
+static void search(jsmnrpc_request_info_t* info)
+{
+  jsmnrpc_token_list_t *tokens = &info->data->tokens;
+  int param_0_token = jsmnrpc_get_value(tokens, info->params_value_token, 0, NULL);
+  int last_name_value_token = jsmnrpc_get_value(tokens, param_0_token, 0, "last_name");
+  int age_value_token = jsmnrpc_get_value(tokens, param_0_token, 0, "age");
+  jsmnrpc_string_t last_name = jsmnrpc_get_string(tokens, last_name_value_token);
+  jsmnrpc_string_t age = jsmnrpc_get_string(tokens, age_value_token);
+  if (last_name.data && age.data)
+  {
+    if (strncmp(last_name.data, "Python", last_name.length) == 0 && strncmp(age.data, "26", age.length) == 0)
+    {
+      jsmnrpc_create_result("\"Monty\"", info);
+    }
+    else
+    {
+      jsmnrpc_create_result("null", info);
+    }
+  }
+  else
+  {
+    jsmnrpc_create_error(jsmnrpc_err_invalid_params, NULL, info);
+  }
+}
+
+/* does not use any params */
+static void get_time_date(jsmnrpc_request_info_t* info)
+{
+  if (jsmnrpc_create_result_prefix(info))
+  {
+    char buffer[20];
+    jsmnrpc_string_t *response = &info->data->response;
+    append_str_with_len(response, "\"", SIZE_MAX);
+    append_str_with_len(response, i_to_str((int)(time(NULL) / 86400), buffer), SIZE_MAX);
+    append_str_with_len(response, "\"", SIZE_MAX);
+  }
+}
+
+/* sends params back */
+static void send_back(jsmnrpc_request_info_t* info)
+{
+  if (jsmnrpc_create_result_prefix(info))
+  {
+    append_str(&info->data->response, jsmnrpc_get_string(&info->data->tokens, info->params_value_token));
+  }
+}
+
+static jsmnrpc_handler_callback_t callbacks[] = { search, get_time_date, send_back };
+
+/* ========  request generation ========== */
+
+static unsigned long long seed = 42;
+
+static unsigned long next_random(void)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (unsigned long)(seed >> 33);
+}
+
+static size_t append_call(char *out, int method, int id, params_size params)
+{
+  size_t len = 0;
+  int i;
+  len += sprintf(out + len, "{\"jsonrpc\": \"2.0\", \"method\": \"%s\", \"params\": ", handler_names[method]);
+  switch (params)
+  {
+  case params_small:
+    len += sprintf(out + len, "[{\"last_name\": \"Python\", \"age\": 26}]");
+    break;
+  case params_medium:
+    len += sprintf(out + len, "[{\"last_name\": \"Python\", \"age\": 26");
+    for (i = 0; i < 14; i++)
+    {
+      len += sprintf(out + len, ", \"field_%d\": \"value %d\"", i, i);
+    }
+    len += sprintf(out + len, "}]");
+    break;
+  case params_large:
+    len += sprintf(out + len, "[");
+    for (i = 0; i < 256; i++)
+    {
+      len += sprintf(out + len, "%s%d", i ? ", " : "", (int)(next_random() % 100000));
+    }
+    len += sprintf(out + len, "]");
+    break;
+  }
+  if (id >= 0)
+  {
+    len += sprintf(out + len, ", \"id\": %d", id);
+  }
+  len += sprintf(out + len, "}");
+  return len;
+}
+
+/* ========  measurement ========== */
+
+typedef struct
+{
+  char* requests[NUM_REQUESTS];
+  size_t lengths[NUM_REQUESTS];
+  int num_requests;
+  int calls_per_request;
+} scenario_t;
+
+static void scenario_free(scenario_t *s)
+{
+  int i;
+  for (i = 0; i < s->num_requests; i++)
+  {
+    free(s->requests[i]);
+  }
+}
+
+static void scenario_single(scenario_t *s, int num_handlers, params_size params, int notification)
+{
+  int i;
+  s->num_requests = NUM_REQUESTS;
+  s->calls_per_request = 1;
+  for (i = 0; i < NUM_REQUESTS; i++)
+  {
+    s->requests[i] = malloc(4096);
+    s->lengths[i] = append_call(s->requests[i], (int)(next_random() % num_handlers), notification ? -1 : i, params);
+  }
+}
+
+static void scenario_batch(scenario_t *s, int num_handlers, int batch_size)
+{
+  int i;
+  size_t len = 0;
+  char *out = malloc((size_t)batch_size * 128 + 16);
+  s->num_requests = 1;
+  s->calls_per_request = batch_size;
+  out[len++] = '[';
+  for (i = 0; i < batch_size; i++)
+  {
+    if (i)
+    {
+      out[len++] = ',';
+    }
+    len += append_call(out + len, (int)(next_random() % num_handlers), i, params_small);
+  }
+  out[len++] = ']';
+  out[len] = 0;
+  s->requests[0] = out;
+  s->lengths[0] = len;
+}
+
+/* ns per traced call of a stage, less the clock reads it contains */
+static double stage_ns(double ticks, unsigned long reads, unsigned long traced_calls)
+{
+  double corrected = ticks - reads * clock_read_ticks;
+  return corrected > 0 ? corrected / ticks_per_ns / traced_calls : 0;
+}
+
+static void run(const char *name, jsmnrpc_instance_t *rpc, scenario_t *s, double seconds)
+{
+  jsmnrpc_data_t data;
+  jsmnrpc_trace_ring_t ring;
+  uint64_t start, elapsed;
+  unsigned long requests = 0;
+  double calls;
+  double parse = 0, lookup = 0, handler = 0, building = 0;
+  unsigned long reads[4] = { 0, 0, 0, 0 }; /* clock reads inside the parse, lookup, handler and response spans */
+  unsigned long traced_calls = 0;
+  int i;
+
+  memset(&data, 0, sizeof(data));
+  data.tokens.data = tokens;
+  data.tokens.capacity = MAX_TOKENS;
+  data.response.data = response;
+  data.response.capacity = RESPONSE_CAPACITY;
+
+  /* throughput, with tracing detached */
+  jsmnrpc_trace_attach(NULL);
+  start = jsmnrpc_clock_ns();
+  do
+  {
+    data.request.data = s->requests[requests % s->num_requests];
+    data.request.length = s->lengths[requests % s->num_requests];
+    jsmnrpc_handle_request(rpc, &data);
+    requests++;
+    elapsed = jsmnrpc_clock_ns() - start;
+  } while (elapsed < (uint64_t)(seconds * 1e9));
+  if (data.response.length > data.response.capacity)
+  {
+    printf("%s: response buffer too small\n", name);
+  }
+  calls = (double)requests * s->calls_per_request;
+
+  /* per-stage breakdown, with tracing attached */
+  jsmnrpc_trace_ring_init(&ring, trace_records, TRACE_CAPACITY);
+  jsmnrpc_trace_attach(&ring);
+  for (i = 0; i < s->num_requests * 4 || traced_calls < 1000; i++)
+  {
+    uint64_t cursor = ring.head;
+    uint64_t previous_complete = 0;
+    int n, r;
+    data.request.data = s->requests[i % s->num_requests];
+    data.request.length = s->lengths[i % s->num_requests];
+    jsmnrpc_handle_request(rpc, &data);
+    n = jsmnrpc_trace_read(&ring, &cursor, trace_out, TRACE_CAPACITY);
+    for (r = 0; r < n; r++)
+    {
+      jsmnrpc_trace_record_t *t = trace_out + r;
+      uint64_t lookup_start = r == 0 ? t->t_parsed : previous_complete;
+      uint64_t dispatch = t->t_dispatch ? t->t_dispatch : t->t_complete;
+      uint64_t handler_done = t->t_handler_done ? t->t_handler_done : dispatch;
+      if (r == 0)
+      {
+        parse += (double)(t->t_parsed - t->t_receive);
+        reads[0]++;
+      }
+      lookup += (double)(dispatch - lookup_start);
+      handler += (double)(handler_done - dispatch);
+      building += (double)(t->t_complete - handler_done);
+      reads[1] += t->t_dispatch != 0;
+      reads[2] += t->t_handler_done != 0;
+      reads[3]++;
+      previous_complete = t->t_complete;
+    }
+    traced_calls += n;
+  }
+  jsmnrpc_trace_attach(NULL);
+
+  /* each span ends with a clock read of its own: take its cost out */
+  parse = stage_ns(parse, reads[0], traced_calls);
+  lookup = stage_ns(lookup, reads[1], traced_calls);
+  handler = stage_ns(handler, reads[2], traced_calls);
+  building = stage_ns(building, reads[3], traced_calls);
+  printf("%-34s %12.0f %10.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", name,
+         calls / elapsed * 1e9, elapsed / calls, parse + lookup + handler + building,
+         parse, lookup, handler, building);
+}
+
+static double measure_clock_read(void)
+{
+  uint64_t start = jsmnrpc_clock_ticks();
+  uint64_t last = start;
+  int i;
+  for (i = 0; i < 1000000; i++)
+  {
+    last = jsmnrpc_clock_ticks();
+  }
+  return (double)(last - start) / 1000000;
+}
+
+static void register_handlers(jsmnrpc_instance_t *rpc, int num_handlers)
+{
+  int i;
+  jsmnrpc_init(rpc, handlers, MAX_HANDLERS);
+  for (i = 0; i < num_handlers; i++)
+  {
+    jsmnrpc_register_handler(rpc, handler_names[i], callbacks[i % 3]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static const int handler_counts[] = { 8, 64, 256, 1000 };
+  static const int batch_sizes[] = { 10, 100, 1000, 10000 };
+  double seconds = 0.2;
+  jsmnrpc_instance_t rpc;
+  scenario_t s;
+  char name[64];
+  int i, p;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      seconds = atof(argv[++i]);
+    }
+  }
+  for (i = 0; i < MAX_HANDLERS; i++)
+  {
+    sprintf(handler_names[i], "method_%d", i);
+  }
+  ticks_per_ns = jsmnrpc_clock_ticks_per_ns(20000000);
+  clock_read_ticks = measure_clock_read();
+
+  printf("%-34s %12s %10s %8s %8s %8s %8s %8s\n", "scenario", "calls/s", "ns/call",
+         "traced", "parse", "lookup", "handler", "response");
+
+  for (i = 0; i < 4; i++)
+  {
+    register_handlers(&rpc, handler_counts[i]);
+    scenario_single(&s, handler_counts[i], params_small, 0);
+    sprintf(name, "request, %d handlers", handler_counts[i]);
+    run(name, &rpc, &s, seconds);
+    scenario_free(&s);
+    scenario_single(&s, handler_counts[i], params_small, 1);
+    sprintf(name, "notification, %d handlers", handler_counts[i]);
+    run(name, &rpc, &s, seconds);
+    scenario_free(&s);
+  }
+
+  register_handlers(&rpc, 8);
+  for (p = params_small; p <= params_large; p++)
+  {
+    scenario_single(&s, 8, (params_size)p, 0);
+    sprintf(name, "request, %s params", params_names[p]);
+    run(name, &rpc, &s, seconds);
+    scenario_free(&s);
+  }
+
+  register_handlers(&rpc, 64);
+  for (i = 0; i < 4; i++)
+  {
+    scenario_batch(&s, 64, batch_sizes[i]);
+    sprintf(name, "batch of %d, 64 handlers", batch_sizes[i]);
+    run(name, &rpc, &s, seconds);
+    scenario_free(&s);
+  }
+  printf("\n(traced = parse + lookup + handler + response: average ns per call of a traced run, clock reads excluded)\n");
+  return 0;
+}
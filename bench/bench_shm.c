@@ -0,0 +1,218 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_clock.h"
+#include "../jsmnrpc_shm.h"
+
+/*
+ * Local IPC benchmark. A forked server process answers JSON-RPC calls over the
+ * shared-memory transport (jsmnrpc_shm) and, for comparison, over a Unix
+ * socket pair with one request per line. The client keeps 'depth' requests
+ * outstanding and reports calls/s and the mean round trip; for shm also the
+ * futex waits and wakes per call (0 while both sides stay busy).
+ *
+ * Usage: bench_shm [-t seconds_per_scenario]
+ */
+
+#define RING_SIZE (1 << 20)
+#define MAX_TOKENS 64
+#define RESPONSE_CAPACITY 256
+
+static jsmnrpc_handler_t handlers[4];
+static jsmntok_t tokens[MAX_TOKENS];
+static const char request[] = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [42], \"id\": 1}";
+
+static void echo(jsmnrpc_request_info_t* info)
+{
+  jsmnrpc_create_result("42", info);
+}
+
+static void server_setup(jsmnrpc_instance_t *rpc, jsmnrpc_data_t *data)
+{
+  jsmnrpc_init(rpc, handlers, 4);
+  jsmnrpc_register_handler(rpc, "echo", echo);
+  memset(data, 0, sizeof(*data));
+  data->tokens.data = tokens;
+  data->tokens.capacity = MAX_TOKENS;
+}
+
+static void shm_server(jsmnrpc_shm_t *shm)
+{
+  jsmnrpc_instance_t rpc;
+  jsmnrpc_data_t data;
+  server_setup(&rpc, &data);
+  while (jsmnrpc_shm_wait_readable(shm, -1) >= 0)
+  {
+    if (jsmnrpc_shm_serve(shm, &rpc, &data, RESPONSE_CAPACITY) == 0)
+    {
+      jsmnrpc_shm_wait_writable(shm, RESPONSE_CAPACITY, -1);
+    }
+  }
+  _exit(0);
+}
+
+static void socket_server(int fd)
+{
+  static char in[1 << 16], out[1 << 16];
+  char response[RESPONSE_CAPACITY + 1];
+  jsmnrpc_instance_t rpc;
+  jsmnrpc_data_t data;
+  size_t in_len = 0;
+  ssize_t n;
+  server_setup(&rpc, &data);
+  while ((n = read(fd, in + in_len, sizeof(in) - in_len)) > 0)
+  {
+    size_t start = 0, out_len = 0;
+    char *end;
+    in_len += (size_t)n;
+    while ((end = memchr(in + start, '\n', in_len - start)) != NULL)
+    {
+      data.request.data = in + start;
+      data.request.length = (size_t)(end - (in + start));
+      data.response.data = response;
+      data.response.capacity = RESPONSE_CAPACITY;
+      jsmnrpc_handle_request(&rpc, &data);
+      memcpy(out + out_len, response, data.response.length);
+      out_len += data.response.length;
+      out[out_len++] = '\n';
+      start = (size_t)(end - in) + 1;
+    }
+    memmove(in, in + start, in_len - start);
+    in_len -= start;
+    if (out_len > 0 && write(fd, out, out_len) != (ssize_t)out_len)
+    {
+      break;
+    }
+  }
+  _exit(0);
+}
+
+static void run_shm(int depth, double seconds)
+{
+  jsmnrpc_shm_t server, client;
+  uint64_t start, now, calls = 0, waits, wakes;
+  int outstanding = 0;
+  pid_t child;
+
+  if (jsmnrpc_shm_create(&server, RING_SIZE) != 0)
+  {
+    perror("jsmnrpc_shm_create");
+    exit(1);
+  }
+  child = fork();
+  if (child == 0)
+  {
+    shm_server(&server);
+  }
+  jsmnrpc_shm_attach(&client, server.fd);
+  start = jsmnrpc_clock_ns();
+  do
+  {
+    char *response;
+    size_t length;
+    while (outstanding < depth && jsmnrpc_shm_send(&client, request, sizeof(request) - 1) == 0)
+    {
+      outstanding++;
+    }
+    jsmnrpc_shm_wait_readable(&client, -1);
+    while ((response = jsmnrpc_shm_peek(&client, &length)) != NULL)
+    {
+      jsmnrpc_shm_release(&client);
+      outstanding--;
+      calls++;
+    }
+    now = jsmnrpc_clock_ns();
+  } while (now - start < (uint64_t)(seconds * 1e9));
+  waits = client.counters.waits;
+  wakes = client.counters.wakes;
+  jsmnrpc_shm_close(&client);
+  waitpid(child, NULL, 0);
+  jsmnrpc_shm_close(&server);
+
+  printf("shm, depth %-4d %14.0f %12.0f %10.3f %10.3f\n", depth, calls / ((now - start) / 1e9),
+         (double)(now - start) * depth / calls, (double)waits / calls, (double)wakes / calls);
+}
+
+static void run_socket(int depth, double seconds)
+{
+  static char out[1 << 16], in[1 << 16];
+  uint64_t start, now, calls = 0;
+  int fds[2], outstanding = 0;
+  pid_t child;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+  {
+    perror("socketpair");
+    exit(1);
+  }
+  child = fork();
+  if (child == 0)
+  {
+    close(fds[0]);
+    socket_server(fds[1]);
+  }
+  close(fds[1]);
+  start = jsmnrpc_clock_ns();
+  now = start;
+  do
+  {
+    size_t out_len = 0;
+    ssize_t n, i;
+    while (outstanding < depth)
+    {
+      memcpy(out + out_len, request, sizeof(request) - 1);
+      out_len += sizeof(request) - 1;
+      out[out_len++] = '\n';
+      outstanding++;
+    }
+    if (out_len > 0 && write(fds[0], out, out_len) != (ssize_t)out_len)
+    {
+      break;
+    }
+    n = read(fds[0], in, sizeof(in));
+    for (i = 0; i < n; i++)
+    {
+      if (in[i] == '\n')
+      {
+        outstanding--;
+        calls++;
+      }
+    }
+    now = jsmnrpc_clock_ns();
+  } while (now - start < (uint64_t)(seconds * 1e9));
+  close(fds[0]);
+  waitpid(child, NULL, 0);
+
+  printf("socket, depth %-4d %11.0f %12.0f %10s %10s\n", depth, calls / ((now - start) / 1e9),
+         (double)(now - start) * depth / calls, "-", "-");
+}
+
+int main(int argc, char **argv)
+{
+  static const int depths[] = { 1, 16, 256 };
+  double seconds = 0.5;
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      seconds = atof(argv[++i]);
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+  printf("%-19s %14s %12s %10s %10s\n", "transport", "calls/s", "ns/call", "waits", "wakes");
+  for (i = 0; i < 3; i++)
+  {
+    run_shm(depths[i], seconds);
+    run_socket(depths[i], seconds);
+  }
+  printf("\n(ns/call: mean round trip; waits/wakes: client futex calls per call)\n");
+  return 0;
+}
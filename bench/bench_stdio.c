@@ -0,0 +1,211 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_clock.h"
+#include "../jsmnrpc_stdio.h"
+
+/*
+ * stdio transport benchmark. A forked client writes Content-Length framed
+ * calls into the server's stdin pipe, 'depth' at a time, and reads the
+ * responses from its stdout pipe. The server is either jsmnrpc_stdio or the
+ * usual hand-written loop (fgets/fread the request, fwrite and fflush each
+ * response). Reports calls/s and the server's read and write calls per call
+ * (reads are not counted for the hand-written loop, which reads through a FILE).
+ *
+ * Usage: bench_stdio [-t seconds_per_scenario]
+ */
+
+#define MAX_TOKENS 64
+#define RESPONSE_CAPACITY 256
+
+static jsmnrpc_handler_t handlers[4];
+static jsmntok_t tokens[MAX_TOKENS];
+static const char request[] =
+  "Content-Length: 61\r\n\r\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [42], \"id\": 1}";
+
+typedef struct result
+{
+  uint64_t calls;
+  uint64_t reads;
+  uint64_t writes;
+} result_t;
+
+static void echo(jsmnrpc_request_info_t* info)
+{
+  jsmnrpc_create_result("42", info);
+}
+
+static void server_setup(jsmnrpc_instance_t *rpc, jsmnrpc_data_t *data)
+{
+  jsmnrpc_init(rpc, handlers, 4);
+  jsmnrpc_register_handler(rpc, "echo", echo);
+  memset(data, 0, sizeof(*data));
+  data->tokens.data = tokens;
+  data->tokens.capacity = MAX_TOKENS;
+}
+
+static void stdio_server(int in, int out, int report)
+{
+  jsmnrpc_instance_t rpc;
+  jsmnrpc_data_t data;
+  jsmnrpc_stdio_t stdio;
+  result_t result;
+  server_setup(&rpc, &data);
+  jsmnrpc_stdio_init(&stdio, in, out, jsmnrpc_framing_content_length, 4096, RESPONSE_CAPACITY);
+  jsmnrpc_stdio_serve(&stdio, &rpc, &data);
+  result.calls = stdio.counters.requests;
+  result.reads = stdio.counters.reads;
+  result.writes = stdio.counters.writes;
+  if (write(report, &result, sizeof(result)) != sizeof(result))
+  {
+    perror("write");
+  }
+  _exit(0);
+}
+
+/* the loop tools tend to write by hand */
+static void naive_server(int in, int out, int report)
+{
+  char line[256], body[4096], response_buffer[RESPONSE_CAPACITY];
+  FILE *fin = fdopen(in, "r");
+  FILE *fout = fdopen(out, "w");
+  jsmnrpc_instance_t rpc;
+  jsmnrpc_data_t data;
+  result_t result = { 0, 0, 0 };
+  server_setup(&rpc, &data);
+  for (;;)
+  {
+    size_t length = 0;
+    while (fgets(line, sizeof(line), fin) != NULL && strcmp(line, "\r\n") != 0)
+    {
+      if (strncmp(line, "Content-Length:", 15) == 0)
+      {
+        length = strtoul(line + 15, NULL, 10);
+      }
+    }
+    if (length == 0 || length > sizeof(body) || fread(body, 1, length, fin) != length)
+    {
+      break;
+    }
+    data.request.data = body;
+    data.request.length = length;
+    data.response.data = response_buffer;
+    data.response.capacity = RESPONSE_CAPACITY;
+    jsmnrpc_handle_request(&rpc, &data);
+    fprintf(fout, "Content-Length: %zu\r\n\r\n", data.response.length);
+    fwrite(response_buffer, 1, data.response.length, fout);
+    fflush(fout);
+    result.calls++;
+    result.writes++;
+  }
+  if (write(report, &result, sizeof(result)) != sizeof(result))
+  {
+    perror("write");
+  }
+  _exit(0);
+}
+
+static void run(const char *name, void (*server)(int, int, int), int depth, double seconds)
+{
+  static char out[1 << 16], in[1 << 16];
+  int to_server[2], from_server[2], report[2];
+  uint64_t start, now, calls = 0;
+  int outstanding = 0, i;
+  result_t result;
+  pid_t child;
+
+  if (pipe(to_server) != 0 || pipe(from_server) != 0 || pipe(report) != 0)
+  {
+    perror("pipe");
+    exit(1);
+  }
+  child = fork();
+  if (child == 0)
+  {
+    close(to_server[1]);
+    close(from_server[0]);
+    server(to_server[0], from_server[1], report[1]);
+  }
+  close(to_server[0]);
+  close(from_server[1]);
+  for (i = 0; i < depth; i++)
+  {
+    memcpy(out + i * (sizeof(request) - 1), request, sizeof(request) - 1);
+  }
+  start = jsmnrpc_clock_ns();
+  now = start;
+  do
+  {
+    ssize_t n, j;
+    if (outstanding == 0)
+    {
+      if (write(to_server[1], out, depth * (sizeof(request) - 1)) < 0)
+      {
+        break;
+      }
+      outstanding = depth;
+    }
+    n = read(from_server[0], in, sizeof(in));
+    if (n <= 0)
+    {
+      break;
+    }
+    for (j = 0; j < n; j++)
+    {
+      if (in[j] == '{') /* one per response */
+      {
+        outstanding--;
+        calls++;
+      }
+    }
+    now = jsmnrpc_clock_ns();
+  } while (outstanding > 0 || now - start < (uint64_t)(seconds * 1e9));
+  close(to_server[1]);
+  if (read(report[0], &result, sizeof(result)) != sizeof(result))
+  {
+    memset(&result, 0, sizeof(result));
+  }
+  waitpid(child, NULL, 0);
+  close(from_server[0]);
+  close(report[0]);
+  close(report[1]);
+
+  printf("%-8s depth %-4d %12.0f ", name, depth, calls / ((now - start) / 1e9));
+  if (result.reads > 0)
+  {
+    printf("%10.3f %10.3f\n", (double)result.reads / calls, (double)result.writes / calls);
+  }
+  else
+  {
+    printf("%10s %10.3f\n", "-", (double)result.writes / calls);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static const int depths[] = { 1, 16, 256 };
+  double seconds = 0.5;
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      seconds = atof(argv[++i]);
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+  printf("%-19s %12s %10s %10s\n", "server", "calls/s", "reads", "writes");
+  for (i = 0; i < 3; i++)
+  {
+    run("stdio", stdio_server, depths[i], seconds);
+    run("naive", naive_server, depths[i], seconds);
+  }
+  printf("\n(reads/writes: server system calls per call)\n");
+  return 0;
+}
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Deterministic JSON / JSON-RPC corpus generator for benchmarks.
+ *
+ * The same seed and options always produce the same bytes, so performance
+ * runs can be reproduced without shipping real payloads. Documents are written
+ * to stdout one per line (compact or random whitespace) or, with -o, each to
+ * its own file (e.g. for bench_jsmn).
+ *
+ * Usage: jsongen [options]
+ *   -s seed          random seed (default 1)
+ *   -n count         number of documents or request lines (default 1)
+ *   -d depth         maximum nesting depth (default 4)
+ *   -f fanout        members per object/array (default 4)
+ *   -l length        maximum string length in characters (default 16)
+ *   -e density       probability (0..1) of an escape sequence per string character (default 0.05)
+ *   -m i,f,e         weights of integer, fractional and exponent numbers (default 6,3,1)
+ *   -p s,n,b         weights of string, number and true/false/null leaves (default 4,4,1)
+ *   -w style         whitespace: compact, pretty or random (default compact)
+ *   -r               generate JSON-RPC 2.0 requests; params use -d/-f as above
+ *   -M methods       number of distinct method names for -r (default 8)
+ *   -N ratio         fraction (0..1) of notifications for -r (default 0)
+ *   -b size          requests per batch for -r (default 1: no batches)
+ *   -o prefix        write document i to <prefix><i>.json instead of stdout
+ */
+
+typedef enum { ws_compact, ws_pretty, ws_random } ws_style;
+
+typedef struct {
+	unsigned long long seed;
+	int count;
+	int depth;
+	int fanout;
+	int max_string;
+	double escape_density;
+	int number_mix[3];
+	int leaf_mix[3];
+	ws_style whitespace;
+	int rpc;
+	int methods;
+	double notification_ratio;
+	int batch;
+	const char *prefix;
+} gen_options;
+
+static gen_options opt;
+static unsigned long long state;
+static FILE *out;
+
+static unsigned long next_random(void) {
+	/* splitmix64 */
+	unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (unsigned long)((z ^ (z >> 31)) >> 1);
+}
+
+static double next_unit(void) {
+	return (double)(next_random() & 0xffffff) / (double)0x1000000;
+}
+
+static int pick(const int *weights, int n) {
+	int i, total = 0, r;
+	for (i = 0; i < n; i++) total += weights[i];
+	if (total <= 0) return 0;
+	r = (int)(next_random() % total);
+	for (i = 0; i < n; i++) {
+		if (r < weights[i]) return i;
+		r -= weights[i];
+	}
+	return n - 1;
+}
+
+static void newline(int level) {
+	int i;
+	if (opt.whitespace == ws_pretty) {
+		fputc('\n', out);
+		for (i = 0; i < level; i++) fputs("  ", out);
+	} else if (opt.whitespace == ws_random) {
+		/* line breaks only when documents do not share a stream */
+		static const char *spaces[] = { "", "", " ", "\t", "  ", "\n", "\r\n " };
+		fputs(spaces[next_random() % (opt.prefix ? 7 : 5)], out);
+	}
+}
+
+static void separator(const char *s) {
+	fputs(s, out);
+	if (opt.whitespace != ws_compact && s[0] == ':') fputc(' ', out);
+}
+
+static void gen_string(void) {
+	static const char escapes[][7] = { "\\n", "\\\"", "\\\\", "\\t", "\\/", "\\u00e9", "\\u20ac" };
+	int n = (int)(next_random() % (opt.max_string + 1));
+	fputc('"', out);
+	while (n-- > 0) {
+		if (next_unit() < opt.escape_density) {
+			fputs(escapes[next_random() % 7], out);
+		} else {
+			fputc("abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-"[next_random() % 64], out);
+		}
+	}
+	fputc('"', out);
+}
+
+/* the parts are drawn one by one, left to right: the order in which function
+   arguments are evaluated is unspecified and would make the output compiler dependent */
+static void gen_number(void) {
+	unsigned long a, b, c, d;
+	switch (pick(opt.number_mix, 3)) {
+		case 0:
+			a = next_random() & 1;
+			b = next_random() % 1000000;
+			fprintf(out, "%s%lu", a ? "-" : "", b);
+			break;
+		case 1:
+			a = next_random() & 1;
+			b = next_random() % 10000;
+			c = next_random() % 1000;
+			fprintf(out, "%s%lu.%03lu", a ? "-" : "", b, c);
+			break;
+		default:
+			a = next_random() % 10;
+			b = next_random() % 1000;
+			c = next_random() & 1;
+			d = next_random() % 300;
+			fprintf(out, "%lu.%luE%s%lu", a, b, c ? "-" : "+", d);
+			break;
+	}
+}
+
+static void gen_value(int level, int depth_left, int container) {
+	int i;
+	if (depth_left > 0 && (container || next_random() % 3 != 0)) {
+		int object = next_random() & 1;
+		fputc(object ? '{' : '[', out);
+		for (i = 0; i < opt.fanout; i++) {
+			if (i) separator(",");
+			newline(level + 1);
+			if (object) {
+				fprintf(out, "\"key_%d\"", i);
+				separator(":");
+			}
+			gen_value(level + 1, depth_left - 1, 0);
+		}
+		newline(level);
+		fputc(object ? '}' : ']', out);
+		return;
+	}
+	switch (pick(opt.leaf_mix, 3)) {
+		case 0: gen_string(); break;
+		case 1: gen_number(); break;
+		default: fputs(next_random() % 3 == 0 ? "null" : (next_random() & 1 ? "true" : "false"), out); break;
+	}
+}
+
+static void gen_request(int level, long id) {
+	fputc('{', out);
+	newline(level + 1);
+	fputs("\"jsonrpc\"", out);
+	separator(":");
+	fputs("\"2.0\"", out);
+	separator(",");
+	newline(level + 1);
+	fputs("\"method\"", out);
+	separator(":");
+	fprintf(out, "\"method_%lu\"", next_random() % opt.methods);
+	separator(",");
+	newline(level + 1);
+	fputs("\"params\"", out);
+	separator(":");
+	gen_value(level + 1, opt.depth > 0 ? opt.depth : 1, 1); /* params are structured */
+	if (next_unit() >= opt.notification_ratio) {
+		separator(",");
+		newline(level + 1);
+		fputs("\"id\"", out);
+		separator(":");
+		fprintf(out, "%ld", id);
+	}
+	newline(level);
+	fputc('}', out);
+}
+
+static void parse_weights(const char *s, int *weights) {
+	sscanf(s, "%d,%d,%d", &weights[0], &weights[1], &weights[2]);
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: jsongen [-s seed] [-n count] [-d depth] [-f fanout] [-l length] [-e density]\n"
+			"               [-m int,frac,exp] [-p str,num,lit] [-w compact|pretty|random]\n"
+			"               [-r [-M methods] [-N ratio] [-b batch]] [-o prefix]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	int i, j;
+	long id = 1;
+
+	opt.seed = 1;
+	opt.count = 1;
+	opt.depth = 4;
+	opt.fanout = 4;
+	opt.max_string = 16;
+	opt.escape_density = 0.05;
+	opt.number_mix[0] = 6; opt.number_mix[1] = 3; opt.number_mix[2] = 1;
+	opt.leaf_mix[0] = 4; opt.leaf_mix[1] = 4; opt.leaf_mix[2] = 1;
+	opt.whitespace = ws_compact;
+	opt.methods = 8;
+	opt.batch = 1;
+
+	for (i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (strcmp(arg, "-r") == 0) {
+			opt.rpc = 1;
+			continue;
+		}
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 >= argc) usage();
+		arg = argv[++i];
+		switch (argv[i - 1][1]) {
+			case 's': opt.seed = strtoull(arg, NULL, 0); break;
+			case 'n': opt.count = atoi(arg); break;
+			case 'd': opt.depth = atoi(arg); break;
+			case 'f': opt.fanout = atoi(arg); break;
+			case 'l': opt.max_string = atoi(arg); break;
+			case 'e': opt.escape_density = atof(arg); break;
+			case 'm': parse_weights(arg, opt.number_mix); break;
+			case 'p': parse_weights(arg, opt.leaf_mix); break;
+			case 'w':
+				if (strcmp(arg, "compact") == 0) opt.whitespace = ws_compact;
+				else if (strcmp(arg, "pretty") == 0) opt.whitespace = ws_pretty;
+				else if (strcmp(arg, "random") == 0) opt.whitespace = ws_random;
+				else usage();
+				break;
+			case 'M': opt.methods = atoi(arg) > 0 ? atoi(arg) : 1; break;
+			case 'N': opt.notification_ratio = atof(arg); break;
+			case 'b': opt.batch = atoi(arg) > 0 ? atoi(arg) : 1; break;
+			case 'o': opt.prefix = arg; break;
+			default: usage();
+		}
+	}
+	if (opt.whitespace == ws_pretty && opt.prefix == NULL && (opt.rpc || opt.count > 1)) {
+		fprintf(stderr, "jsongen: pretty output of several documents needs -o (one document per file)\n");
+		return 1;
+	}
+
+	state = opt.seed;
+	out = stdout;
+	for (i = 0; i < opt.count; i++) {
+		if (opt.prefix) {
+			char path[4096];
+			snprintf(path, sizeof(path), "%s%d.json", opt.prefix, i);
+			out = fopen(path, "w");
+			if (out == NULL) {
+				perror(path);
+				return 1;
+			}
+		}
+		if (!opt.rpc) {
+			gen_value(0, opt.depth, 1);
+		} else if (opt.batch <= 1) {
+			gen_request(0, id++);
+		} else {
+			fputc('[', out);
+			for (j = 0; j < opt.batch; j++) {
+				if (j) separator(",");
+				newline(1);
+				gen_request(1, id++);
+			}
+			newline(0);
+			fputc(']', out);
+		}
+		fputc('\n', out);
+		if (opt.prefix) {
+			fclose(out);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,763 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../jsmn.h"
+#include "../jsmnrpc_clock.h"
+#include "../jsmnrpc_stats.h"
+
+/*
+ * JSON-RPC load generator (Linux). Opens many connections to a TCP or Unix
+ * socket endpoint and sends requests either in closed loop (every connection
+ * keeps 'pipeline' requests outstanding) or at a fixed aggregate rate.
+ *
+ * In fixed-rate mode every request has an intended send time on a fixed
+ * schedule, and latency is measured from that time rather than from the moment
+ * the request could actually be written. A stalled server therefore shows up in
+ * the percentiles instead of silently slowing the generator down (coordinated
+ * omission). Requests still unsent or unanswered at the end are recorded with
+ * their latency so far. The uncorrected service time is reported alongside.
+ *
+ * Responses are framed like requests. Each one is validated with jsmn_parse,
+ * checked for an "error" member and matched to its request by id (that of the
+ * first call for batches), so a server may answer the requests pipelined on a
+ * connection in any order. A response whose id matches no outstanding request
+ * (e.g. a null id) is taken as the answer to the oldest one.
+ *
+ * Usage: loadgen [options]
+ *   -a host:port     TCP endpoint (default 127.0.0.1:8080)
+ *   -u path          Unix domain socket endpoint instead of TCP
+ *   -c connections   number of connections (default 16)
+ *   -P depth         requests outstanding per connection (default 1)
+ *   -R rate          aggregate requests/s; 0 runs in closed loop (default 0)
+ *   -d seconds       test duration (default 10)
+ *   -F framing       newline or length (4-byte big-endian prefix) (default newline)
+ *   -m method        method of generated requests (default echo)
+ *   -p params        params of generated requests (default ["hello"])
+ *   -b size          calls per generated batch (default 1: no batches)
+ *   -f file          send the lines of 'file' (e.g. from jsongen -r) in turn
+ *                    instead of generated requests
+ */
+
+#define NUM_GENERATED 1024 /* distinct generated requests (ids) cycled through */
+#define MAX_TOKENS (1 << 16)
+#define BUFFER_SIZE (256 << 10)
+#define OUT_HIGH_WATER (BUFFER_SIZE / 2)
+#define DRAIN_NS 1000000000ull /* how long to wait for outstanding responses at the end */
+
+typedef enum { framing_newline, framing_length } framing_t;
+
+typedef struct
+{
+  char* data;
+  size_t length;
+  int expects_response; /* 0 for notifications (and batches of them) */
+  const char* id;       /* text of the id (of the first call with one, in a batch), in 'data' */
+  size_t id_length;
+} request_t;
+
+typedef struct
+{
+  uint64_t intended; /* scheduled send time */
+  uint64_t sent;     /* actual send time */
+  int request;       /* index in requests */
+} inflight_t;
+
+typedef struct
+{
+  int fd;
+  int index;
+  int writable_wait; /* EPOLLOUT is armed */
+  char* out;
+  size_t out_len;
+  size_t out_sent;
+  char* in;
+  size_t in_len;
+  size_t in_cap;
+  inflight_t* inflight; /* 'pipeline' entries, [0, inflight_count) in use, in no particular order */
+  int inflight_count;
+  uint64_t next_seq;    /* fixed rate: index of this connection's next scheduled request */
+} conn_t;
+
+typedef struct
+{
+  const char* host_port;
+  const char* unix_path;
+  int connections;
+  int pipeline;
+  double rate;
+  double seconds;
+  framing_t framing;
+  const char* method;
+  const char* params;
+  int batch;
+  const char* file;
+} loadgen_options_t;
+
+static loadgen_options_t opt;
+static request_t* requests;
+static int num_requests;
+static unsigned long request_cursor;
+static conn_t* conns;
+static int epoll_fd;
+static jsmntok_t tokens[MAX_TOKENS];
+
+static uint64_t start_ns;
+static double interval_ns;
+static jsmnrpc_histogram_t latency;      /* from intended send time */
+static jsmnrpc_histogram_t service_time; /* from actual send time */
+static unsigned long sent, notifications, responses, rpc_errors, invalid, unsent, unanswered, closed;
+
+/* ========  requests ========== */
+
+/* index of the token following the subtree starting at token i */
+static int skip_token(int i, int num_tokens)
+{
+  int end = tokens[i].end;
+  for (i++; i < num_tokens && tokens[i].start < end; i++)
+  {
+  }
+  return i;
+}
+
+/* returns the value token of the top-level member 'name' of the object at token 'object', or -1 */
+static int member_value(const char* js, int num_tokens, int object, const char* name)
+{
+  size_t len = strlen(name);
+  int i = object + 1;
+  while (i + 1 < num_tokens && tokens[i].start < tokens[object].end)
+  {
+    if ((size_t)(tokens[i].end - tokens[i].start) == len && strncmp(js + tokens[i].start, name, len) == 0)
+    {
+      return i + 1;
+    }
+    i = skip_token(i + 1, num_tokens);
+  }
+  return -1;
+}
+
+/* returns 1 if the object at token 'object' has a top-level member called 'name' */
+static int has_member(const char* js, int num_tokens, int object, const char* name)
+{
+  return member_value(js, num_tokens, object, name) >= 0;
+}
+
+/* id of a message (of its first element with one, for a batch), or NULL;
+   string ids without their quotes, since servers may echo them either way */
+static const char* message_id(const char* js, int num_tokens, size_t* length)
+{
+  int i = 0, value = -1;
+  if (tokens[0].type == JSMN_OBJECT)
+  {
+    value = member_value(js, num_tokens, 0, "id");
+  }
+  else if (tokens[0].type == JSMN_ARRAY)
+  {
+    for (i = 1; i < num_tokens && value < 0; i = skip_token(i, num_tokens))
+    {
+      value = tokens[i].type == JSMN_OBJECT ? member_value(js, num_tokens, i, "id") : -1;
+    }
+  }
+  if (value < 0)
+  {
+    return NULL;
+  }
+  *length = (size_t)(tokens[value].end - tokens[value].start);
+  return js + tokens[value].start;
+}
+
+/* number of top-level objects (the message itself, or batch elements) with a member 'name' */
+static int count_members(const char* js, int num_tokens, const char* name)
+{
+  int i, count = 0;
+  if (tokens[0].type == JSMN_OBJECT)
+  {
+    return has_member(js, num_tokens, 0, name);
+  }
+  for (i = 1; i < num_tokens; i = skip_token(i, num_tokens))
+  {
+    count += tokens[i].type == JSMN_OBJECT && has_member(js, num_tokens, i, name);
+  }
+  return count;
+}
+
+static int expects_response(const char* js, int r)
+{
+  if (r <= 0 || tokens[0].type != JSMN_ARRAY || tokens[0].size == 0)
+  {
+    return r <= 0 || tokens[0].type != JSMN_OBJECT || has_member(js, r, 0, "id"); /* invalid ones get an error */
+  }
+  return count_members(js, r, "id") > 0;
+}
+
+static void add_request(char* data, size_t length)
+{
+  jsmn_parser parser;
+  request_t* r;
+  int num_tokens;
+  jsmn_init(&parser);
+  num_tokens = (int)jsmn_parse(&parser, data, (jsmn_size_t)length, tokens, MAX_TOKENS);
+  requests = realloc(requests, sizeof(request_t) * (num_requests + 1));
+  r = &requests[num_requests++];
+  r->data = data;
+  r->length = length;
+  r->expects_response = expects_response(data, num_tokens);
+  r->id = num_tokens > 0 ? message_id(data, num_tokens, &r->id_length) : NULL;
+}
+
+static void generate_requests(void)
+{
+  int i, j;
+  unsigned long id = 1;
+  for (i = 0; i < NUM_GENERATED; i++)
+  {
+    size_t cap = (strlen(opt.method) + strlen(opt.params) + 64) * opt.batch + 2;
+    char* data = malloc(cap);
+    size_t len = 0;
+    if (opt.batch > 1)
+    {
+      data[len++] = '[';
+    }
+    for (j = 0; j < opt.batch; j++)
+    {
+      len += sprintf(data + len, "%s{\"jsonrpc\":\"2.0\",\"method\":\"%s\",\"params\":%s,\"id\":%lu}",
+                     j ? "," : "", opt.method, opt.params, id++);
+    }
+    if (opt.batch > 1)
+    {
+      data[len++] = ']';
+    }
+    data[len] = 0;
+    add_request(data, len);
+  }
+}
+
+static int load_requests(const char* path)
+{
+  FILE* f = fopen(path, "rb");
+  char* line = NULL;
+  size_t cap = 0;
+  ssize_t n;
+  if (f == NULL)
+  {
+    perror(path);
+    return -1;
+  }
+  while ((n = getline(&line, &cap, f)) > 0)
+  {
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+    {
+      line[--n] = 0;
+    }
+    if (n > 0)
+    {
+      add_request(strdup(line), (size_t)n);
+    }
+  }
+  free(line);
+  fclose(f);
+  return num_requests > 0 ? 0 : -1;
+}
+
+/* ========  connections ========== */
+
+static int connect_endpoint(void)
+{
+  int fd;
+  if (opt.unix_path)
+  {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, opt.unix_path, sizeof(addr.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+      perror(opt.unix_path);
+      return -1;
+    }
+  }
+  else
+  {
+    char host[256];
+    const char* colon = strrchr(opt.host_port, ':');
+    struct addrinfo hints, *res;
+    int one = 1;
+    if (colon == NULL || (size_t)(colon - opt.host_port) >= sizeof(host))
+    {
+      fprintf(stderr, "loadgen: expected host:port, got '%s'\n", opt.host_port);
+      return -1;
+    }
+    memcpy(host, opt.host_port, colon - opt.host_port);
+    host[colon - opt.host_port] = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0)
+    {
+      fprintf(stderr, "loadgen: cannot resolve '%s'\n", opt.host_port);
+      return -1;
+    }
+    fd = socket(res->ai_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+    {
+      perror(opt.host_port);
+      freeaddrinfo(res);
+      return -1;
+    }
+    freeaddrinfo(res);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static void conn_close(conn_t* c)
+{
+  uint64_t now = jsmnrpc_clock_ns();
+  fprintf(stderr, "loadgen: connection %d closed with %d requests outstanding\n", c->index, c->inflight_count);
+  for (; c->inflight_count > 0; c->inflight_count--)
+  {
+    jsmnrpc_histogram_record(&latency, now - c->inflight[c->inflight_count - 1].intended);
+    unanswered++;
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
+  closed++;
+}
+
+static void conn_set_writable_wait(conn_t* c, int wait)
+{
+  struct epoll_event ev;
+  if (c->writable_wait == wait)
+  {
+    return;
+  }
+  ev.events = EPOLLIN | (wait ? EPOLLOUT : 0);
+  ev.data.ptr = c;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+  c->writable_wait = wait;
+}
+
+static void conn_flush(conn_t* c)
+{
+  while (c->out_sent < c->out_len)
+  {
+    ssize_t n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+    if (n < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        conn_set_writable_wait(c, 1);
+        return;
+      }
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      conn_close(c);
+      return;
+    }
+    c->out_sent += (size_t)n;
+  }
+  c->out_len = c->out_sent = 0;
+  conn_set_writable_wait(c, 0);
+}
+
+static uint64_t conn_next_intended(const conn_t* c)
+{
+  /* connections take turns on the aggregate schedule */
+  return start_ns + (uint64_t)(((double)c->index + (double)c->next_seq * opt.connections) * interval_ns);
+}
+
+static void conn_fill(conn_t* c, uint64_t now)
+{
+  while (c->inflight_count < opt.pipeline && c->out_len < OUT_HIGH_WATER)
+  {
+    int request = (int)(request_cursor % num_requests);
+    const request_t* r = &requests[request];
+    uint64_t intended = now;
+    if (opt.rate > 0)
+    {
+      intended = conn_next_intended(c);
+      if (intended > now)
+      {
+        break;
+      }
+    }
+    if (c->out_len + r->length + 5 > BUFFER_SIZE)
+    {
+      break; /* the scheduled request stays due: it is sent (or counted unsent) later */
+    }
+    if (opt.framing == framing_length)
+    {
+      unsigned char* p = (unsigned char*)c->out + c->out_len;
+      p[0] = (unsigned char)(r->length >> 24);
+      p[1] = (unsigned char)(r->length >> 16);
+      p[2] = (unsigned char)(r->length >> 8);
+      p[3] = (unsigned char)r->length;
+      c->out_len += 4;
+    }
+    memcpy(c->out + c->out_len, r->data, r->length);
+    c->out_len += r->length;
+    if (opt.framing == framing_newline)
+    {
+      c->out[c->out_len++] = '\n';
+    }
+    request_cursor++;
+    c->next_seq += opt.rate > 0;
+    sent++;
+    if (r->expects_response)
+    {
+      inflight_t* slot = &c->inflight[c->inflight_count++];
+      slot->intended = intended;
+      slot->sent = now;
+      slot->request = request;
+    }
+    else
+    {
+      notifications++;
+    }
+  }
+}
+
+/* returns the number of tokens of a valid response, 0 otherwise */
+static int check_response(const char* js, size_t length)
+{
+  jsmn_parser parser;
+  int r;
+  jsmn_init(&parser);
+  r = (int)jsmn_parse(&parser, js, (jsmn_size_t)length, tokens, MAX_TOKENS);
+  if (r <= 0 || (tokens[0].type != JSMN_OBJECT && tokens[0].type != JSMN_ARRAY))
+  {
+    invalid++;
+    return 0;
+  }
+  rpc_errors += count_members(js, r, "error");
+  return r;
+}
+
+/* the outstanding request a response answers: the oldest one with its id, else the oldest one */
+static int conn_match(const conn_t* c, const char* id, size_t id_length)
+{
+  int i, oldest = 0, match = -1;
+  for (i = 0; i < c->inflight_count; i++)
+  {
+    const inflight_t* slot = &c->inflight[i];
+    const request_t* r = &requests[slot->request];
+    if (id && r->id && r->id_length == id_length && memcmp(r->id, id, id_length) == 0 &&
+        (match < 0 || slot->intended < c->inflight[match].intended))
+    {
+      match = i;
+    }
+    if (slot->intended < c->inflight[oldest].intended)
+    {
+      oldest = i;
+    }
+  }
+  return match >= 0 ? match : oldest;
+}
+
+static void conn_on_response(conn_t* c, const char* js, size_t length, uint64_t now)
+{
+  inflight_t* slot;
+  const char* id = NULL;
+  size_t id_length = 0;
+  int num_tokens = check_response(js, length);
+  if (c->inflight_count == 0)
+  {
+    invalid++; /* unsolicited */
+    return;
+  }
+  if (num_tokens > 0)
+  {
+    id = message_id(js, num_tokens, &id_length);
+  }
+  slot = &c->inflight[conn_match(c, id, id_length)];
+  jsmnrpc_histogram_record(&latency, now - slot->intended);
+  jsmnrpc_histogram_record(&service_time, now - slot->sent);
+  *slot = c->inflight[--c->inflight_count];
+  responses++;
+}
+
+static void conn_read(conn_t* c)
+{
+  for (;;)
+  {
+    size_t pos = 0;
+    uint64_t now;
+    ssize_t n;
+    if (c->in_len == c->in_cap)
+    {
+      c->in_cap *= 2;
+      c->in = realloc(c->in, c->in_cap);
+    }
+    n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+    if (n <= 0)
+    {
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      {
+        return;
+      }
+      conn_close(c);
+      return;
+    }
+    c->in_len += (size_t)n;
+    now = jsmnrpc_clock_ns();
+    for (;;)
+    {
+      size_t frame_start, frame_len;
+      if (opt.framing == framing_newline)
+      {
+        char* nl = memchr(c->in + pos, '\n', c->in_len - pos);
+        if (nl == NULL)
+        {
+          break;
+        }
+        frame_start = pos;
+        frame_len = (size_t)(nl - (c->in + pos));
+        pos = frame_len + pos + 1;
+      }
+      else
+      {
+        const unsigned char* p = (const unsigned char*)c->in + pos;
+        if (c->in_len - pos < 4)
+        {
+          break;
+        }
+        frame_len = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+        if (c->in_len - pos - 4 < frame_len)
+        {
+          break;
+        }
+        frame_start = pos + 4;
+        pos = frame_start + frame_len;
+      }
+      if (frame_len > 0)
+      {
+        conn_on_response(c, c->in + frame_start, frame_len, now);
+      }
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+  }
+}
+
+/* ========  main loop ========== */
+
+static void print_histogram(const char* name, const jsmnrpc_histogram_t* h)
+{
+  printf("%-14s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+         h->count ? (double)h->sum / h->count / 1e3 : 0.0,
+         jsmnrpc_histogram_percentile(h, 50.0) / 1e3, jsmnrpc_histogram_percentile(h, 90.0) / 1e3,
+         jsmnrpc_histogram_percentile(h, 99.0) / 1e3, jsmnrpc_histogram_percentile(h, 99.9) / 1e3,
+         h->max / 1e3);
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: loadgen [-a host:port | -u path] [-c connections] [-P pipeline] [-R rate]\n"
+                  "               [-d seconds] [-F newline|length] [-m method] [-p params] [-b batch] [-f file]\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  struct epoll_event events[256];
+  uint64_t end_ns, now, finished_ns;
+  int i, open_conns;
+
+  opt.host_port = "127.0.0.1:8080";
+  opt.connections = 16;
+  opt.pipeline = 1;
+  opt.seconds = 10;
+  opt.framing = framing_newline;
+  opt.method = "echo";
+  opt.params = "[\"hello\"]";
+  opt.batch = 1;
+
+  for (i = 1; i < argc; i++)
+  {
+    const char* arg;
+    if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 >= argc)
+    {
+      usage();
+    }
+    arg = argv[++i];
+    switch (argv[i - 1][1])
+    {
+    case 'a': opt.host_port = arg; break;
+    case 'u': opt.unix_path = arg; break;
+    case 'c': opt.connections = atoi(arg) > 0 ? atoi(arg) : 1; break;
+    case 'P': opt.pipeline = atoi(arg) > 0 ? atoi(arg) : 1; break;
+    case 'R': opt.rate = atof(arg); break;
+    case 'd': opt.seconds = atof(arg); break;
+    case 'F':
+      if (strcmp(arg, "newline") == 0) opt.framing = framing_newline;
+      else if (strcmp(arg, "length") == 0) opt.framing = framing_length;
+      else usage();
+      break;
+    case 'm': opt.method = arg; break;
+    case 'p': opt.params = arg; break;
+    case 'b': opt.batch = atoi(arg) > 0 ? atoi(arg) : 1; break;
+    case 'f': opt.file = arg; break;
+    default: usage();
+    }
+  }
+
+  if (opt.file)
+  {
+    if (load_requests(opt.file) != 0)
+    {
+      fprintf(stderr, "loadgen: no requests in '%s'\n", opt.file);
+      return 1;
+    }
+  }
+  else
+  {
+    generate_requests();
+  }
+  for (i = 0; i < num_requests; i++)
+  {
+    if (requests[i].length + 5 > BUFFER_SIZE)
+    {
+      fprintf(stderr, "loadgen: request %d is larger than the %d byte buffer\n", i, BUFFER_SIZE);
+      return 1;
+    }
+  }
+
+  epoll_fd = epoll_create1(0);
+  conns = calloc(opt.connections, sizeof(conn_t));
+  for (i = 0; i < opt.connections; i++)
+  {
+    conn_t* c = &conns[i];
+    struct epoll_event ev;
+    c->index = i;
+    c->fd = connect_endpoint();
+    if (c->fd < 0)
+    {
+      return 1;
+    }
+    c->out = malloc(BUFFER_SIZE);
+    c->in_cap = BUFFER_SIZE;
+    c->in = malloc(c->in_cap);
+    c->inflight = malloc(sizeof(inflight_t) * opt.pipeline);
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &ev);
+  }
+
+  interval_ns = opt.rate > 0 ? 1e9 / opt.rate : 0;
+  start_ns = jsmnrpc_clock_ns();
+  end_ns = start_ns + (uint64_t)(opt.seconds * 1e9);
+  open_conns = opt.connections;
+  for (;;)
+  {
+    int timeout_ms = 10;
+    int n, outstanding = 0;
+    now = jsmnrpc_clock_ns();
+    for (i = 0; i < opt.connections; i++)
+    {
+      conn_t* c = &conns[i];
+      if (c->fd < 0)
+      {
+        continue;
+      }
+      if (now < end_ns)
+      {
+        conn_fill(c, now);
+        if (opt.rate > 0 && c->inflight_count < opt.pipeline)
+        {
+          /* sleep until the next scheduled send, spinning for the last millisecond */
+          uint64_t next = conn_next_intended(c);
+          int ms = next > now ? (int)((next - now) / 1000000) : 0;
+          timeout_ms = ms < timeout_ms ? ms : timeout_ms;
+        }
+        else if (opt.rate <= 0 && c->inflight_count == 0 && c->out_len == 0)
+        {
+          timeout_ms = 0; /* only notifications: keep sending */
+        }
+      }
+      if (c->out_len > c->out_sent && !c->writable_wait)
+      {
+        conn_flush(c);
+      }
+      outstanding += c->fd >= 0 ? c->inflight_count : 0;
+    }
+    for (i = 0, open_conns = 0; i < opt.connections; i++)
+    {
+      open_conns += conns[i].fd >= 0;
+    }
+    if (open_conns == 0 || (now >= end_ns && (outstanding == 0 || now >= end_ns + DRAIN_NS)))
+    {
+      break;
+    }
+    n = epoll_wait(epoll_fd, events, 256, timeout_ms);
+    for (i = 0; i < n; i++)
+    {
+      conn_t* c = events[i].data.ptr;
+      if (c->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+      {
+        conn_read(c);
+      }
+      if (c->fd >= 0 && (events[i].events & EPOLLOUT))
+      {
+        conn_flush(c);
+      }
+    }
+  }
+  finished_ns = jsmnrpc_clock_ns();
+
+  /* requests that never got an answer, or were never sent, still count */
+  for (i = 0; i < opt.connections; i++)
+  {
+    conn_t* c = &conns[i];
+    if (c->fd >= 0)
+    {
+      for (; c->inflight_count > 0; c->inflight_count--)
+      {
+        jsmnrpc_histogram_record(&latency, finished_ns - c->inflight[c->inflight_count - 1].intended);
+        unanswered++;
+      }
+    }
+    while (opt.rate > 0 && conn_next_intended(c) < end_ns)
+    {
+      jsmnrpc_histogram_record(&latency, finished_ns - conn_next_intended(c));
+      c->next_seq++;
+      unsent++;
+    }
+  }
+
+  printf("target: %s, %d connections, pipeline %d, %s, %s framing, %.1f s\n",
+         opt.unix_path ? opt.unix_path : opt.host_port, opt.connections, opt.pipeline,
+         opt.rate > 0 ? "fixed rate" : "closed loop", opt.framing == framing_newline ? "newline" : "length",
+         opt.seconds);
+  if (opt.rate > 0)
+  {
+    printf("rate: %.0f requests/s requested\n", opt.rate);
+  }
+  printf("sent %lu (%lu notifications), responses %lu, rpc errors %lu, invalid %lu, unanswered %lu, unsent %lu, closed %lu\n",
+         sent, notifications, responses, rpc_errors, invalid, unanswered, unsent, closed);
+  printf("throughput: %.0f requests/s, %.0f responses/s\n",
+         sent / opt.seconds, responses / ((double)(finished_ns - start_ns) / 1e9));
+  printf("\n%-14s %10s %10s %10s %10s %10s %10s\n", "latency (us)", "mean", "p50", "p90", "p99", "p99.9", "max");
+  print_histogram(opt.rate > 0 ? "corrected" : "response", &latency);
+  if (opt.rate > 0)
+  {
+    print_histogram("service", &service_time);
+  }
+  return (invalid > 0 || closed > 0);
+}
@@ -0,0 +1,309 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_clock.h"
+
+/*
+ * Replays a request capture (written by an instance with a jsmnrpc_capture_t
+ * attached, see jsmnrpc_capture.h) through jsmnrpc_handle_request. Every method
+ * found in the capture gets a stub handler that returns null, or its params
+ * with -e, so the numbers cover parsing, dispatch and response building of
+ * real traffic. The capture is mmap()ed and requests are handled in place.
+ *
+ * By default requests are replayed back to back. With -x speed they follow
+ * the recorded timing (-x 1), or a multiple of it (-x 2 is twice as fast).
+ * The report shows throughput, request latency and per-method counters from
+ * jsmnrpc_stats.
+ *
+ * Usage: replay [-x speed] [-l loops] [-e] capture_file
+ */
+
+#if !JSMNRPC_STATS || !JSMNRPC_CAPTURE
+#error "replay needs JSMNRPC_STATS=1 and JSMNRPC_CAPTURE=1"
+#endif
+
+#define MAX_METHODS 4096
+#define MAX_TOKENS (1 << 20)
+#define RESPONSE_CAPACITY (16 << 20)
+
+static jsmnrpc_handler_t handlers[MAX_METHODS];
+static char* method_names[MAX_METHODS];
+static int num_methods;
+static jsmntok_t tokens[MAX_TOKENS];
+static char response[RESPONSE_CAPACITY];
+static jsmnrpc_method_stats_t method_stats[MAX_METHODS];
+static jsmnrpc_method_stats_t method_totals[MAX_METHODS];
+
+/* ========  stub handlers ========== */
+
+static void stub_null(jsmnrpc_request_info_t* info)
+{
+  jsmnrpc_create_result("null", info);
+}
+
+static void stub_echo(jsmnrpc_request_info_t* info)
+{
+  if (jsmnrpc_create_result_prefix(info))
+  {
+    if (info->params_value_token >= 0)
+    {
+      append_str(&info->data->response, jsmnrpc_get_string(&info->data->tokens, info->params_value_token));
+    }
+    else
+    {
+      append_str_with_len(&info->data->response, "null", SIZE_MAX);
+    }
+  }
+}
+
+/* ========  method discovery ========== */
+
+static int skip_token(int i, int num_tokens)
+{
+  int end = tokens[i].end;
+  for (i++; i < num_tokens && tokens[i].start < end; i++)
+  {
+  }
+  return i;
+}
+
+static void add_method(const char* js, int object, int num_tokens)
+{
+  int i = object + 1;
+  while (i + 1 < num_tokens && tokens[i].start < tokens[object].end)
+  {
+    int len = tokens[i].end - tokens[i].start;
+    if (len == 6 && strncmp(js + tokens[i].start, "method", 6) == 0 && tokens[i + 1].type == JSMN_STRING)
+    {
+      const char* name = js + tokens[i + 1].start;
+      int name_len = tokens[i + 1].end - tokens[i + 1].start;
+      int m;
+      for (m = 0; m < num_methods; m++)
+      {
+        if ((int)strlen(method_names[m]) == name_len && strncmp(method_names[m], name, name_len) == 0)
+        {
+          return;
+        }
+      }
+      if (num_methods < MAX_METHODS)
+      {
+        method_names[num_methods] = malloc(name_len + 1);
+        memcpy(method_names[num_methods], name, name_len);
+        method_names[num_methods][name_len] = 0;
+        num_methods++;
+      }
+      return;
+    }
+    i = skip_token(i + 1, num_tokens);
+  }
+}
+
+static void discover_methods(const char* js, size_t length)
+{
+  jsmn_parser parser;
+  int r, i;
+  jsmn_init(&parser);
+  r = (int)jsmn_parse(&parser, js, (jsmn_size_t)length, tokens, MAX_TOKENS);
+  if (r <= 0)
+  {
+    return;
+  }
+  if (tokens[0].type == JSMN_OBJECT)
+  {
+    add_method(js, 0, r);
+  }
+  else if (tokens[0].type == JSMN_ARRAY)
+  {
+    for (i = 1; i < r; i = skip_token(i, r))
+    {
+      if (tokens[i].type == JSMN_OBJECT)
+      {
+        add_method(js, i, r);
+      }
+    }
+  }
+}
+
+/* ========  replay ========== */
+
+static void wait_until(uint64_t target_ns)
+{
+  uint64_t now = jsmnrpc_clock_ns();
+  if (target_ns > now + 100000)
+  {
+    struct timespec ts;
+    uint64_t sleep_ns = target_ns - now - 50000; /* wake up early, then spin */
+    ts.tv_sec = (time_t)(sleep_ns / 1000000000u);
+    ts.tv_nsec = (long)(sleep_ns % 1000000000u);
+    nanosleep(&ts, NULL);
+  }
+  while (jsmnrpc_clock_ns() < target_ns)
+  {
+  }
+}
+
+static void print_latency(const char* name, const jsmnrpc_histogram_t* h, const char* suffix)
+{
+  printf("%-24.24s %10llu %9.2f %9.2f %9.2f %9.2f %9.2f%s\n", name, (unsigned long long)h->count,
+         h->count ? (double)h->sum / h->count / 1e3 : 0.0,
+         jsmnrpc_histogram_percentile(h, 50.0) / 1e3, jsmnrpc_histogram_percentile(h, 99.0) / 1e3,
+         jsmnrpc_histogram_percentile(h, 99.9) / 1e3, h->max / 1e3, suffix);
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: replay [-x speed] [-l loops] [-e] capture_file\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  const char* path = NULL;
+  double speed = 0.0;
+  int loops = 1, echo = 0;
+  int fd, i, loop;
+  struct stat st;
+  const char* capture;
+  size_t first, offset;
+  const jsmnrpc_capture_record_t* record;
+  jsmnrpc_instance_t rpc;
+  jsmnrpc_data_t data;
+  jsmnrpc_stats_t stats;
+  jsmnrpc_stats_shard_t shard, totals;
+  jsmnrpc_histogram_t latency, lag;
+  uint64_t start_ns, elapsed_ns, first_ts;
+  unsigned long long requests = 0, bytes = 0, overflows = 0;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-x") == 0 && i + 1 < argc)
+    {
+      speed = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+    {
+      loops = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-e") == 0)
+    {
+      echo = 1;
+    }
+    else if (argv[i][0] != '-' && path == NULL)
+    {
+      path = argv[i];
+    }
+    else
+    {
+      usage();
+    }
+  }
+  if (path == NULL)
+  {
+    usage();
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    perror(path);
+    return 1;
+  }
+  capture = st.st_size > 0 ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  if (capture == MAP_FAILED || (first = jsmnrpc_capture_first(capture, (size_t)st.st_size)) == 0)
+  {
+    fprintf(stderr, "replay: %s is not a jsmnrpc capture\n", path);
+    return 1;
+  }
+  madvise((void*)capture, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  offset = first;
+  while ((record = jsmnrpc_capture_next(capture, (size_t)st.st_size, &offset)) != NULL)
+  {
+    discover_methods((const char*)(record + 1), record->length);
+  }
+  jsmnrpc_init(&rpc, handlers, num_methods > 0 ? num_methods : 1);
+  for (i = 0; i < num_methods; i++)
+  {
+    jsmnrpc_register_handler(&rpc, method_names[i], echo ? stub_echo : stub_null);
+  }
+  shard.methods = method_stats;
+  jsmnrpc_stats_init(&stats, &shard, method_stats, 1, num_methods > 0 ? num_methods : 1);
+  jsmnrpc_set_stats(&rpc, &stats);
+
+  memset(&data, 0, sizeof(data));
+  data.tokens.data = tokens;
+  data.tokens.capacity = MAX_TOKENS;
+  data.response.data = response;
+  data.response.capacity = RESPONSE_CAPACITY;
+  memset(&latency, 0, sizeof(latency));
+  memset(&lag, 0, sizeof(lag));
+
+  offset = first;
+  record = jsmnrpc_capture_next(capture, (size_t)st.st_size, &offset);
+  first_ts = record ? record->timestamp_ns : 0;
+
+  start_ns = jsmnrpc_clock_ns();
+  for (loop = 0; loop < loops; loop++)
+  {
+    uint64_t loop_start = jsmnrpc_clock_ns();
+    offset = first;
+    while ((record = jsmnrpc_capture_next(capture, (size_t)st.st_size, &offset)) != NULL)
+    {
+      uint64_t t0;
+      if (speed > 0)
+      {
+        uint64_t target = loop_start + (uint64_t)((double)(record->timestamp_ns - first_ts) / speed);
+        wait_until(target);
+        t0 = jsmnrpc_clock_ns();
+        jsmnrpc_histogram_record(&lag, t0 - target);
+      }
+      else
+      {
+        t0 = jsmnrpc_clock_ns();
+      }
+      data.request.data = (char*)(record + 1);
+      data.request.length = record->length;
+      jsmnrpc_handle_request(&rpc, &data);
+      jsmnrpc_histogram_record(&latency, jsmnrpc_clock_ns() - t0);
+      overflows += data.response.length > data.response.capacity;
+      requests++;
+      bytes += record->length;
+    }
+  }
+  elapsed_ns = jsmnrpc_clock_ns() - start_ns;
+
+  totals.methods = method_totals;
+  jsmnrpc_stats_snapshot(&stats, &totals);
+  printf("capture: %s, %d methods, %d loop(s), %s\n", path, num_methods, loops,
+         speed > 0 ? "recorded pacing" : "as fast as possible");
+  if (speed > 0)
+  {
+    printf("pacing: x%.2f, scheduling lag p99 %.2f us, max %.2f us\n", speed,
+           jsmnrpc_histogram_percentile(&lag, 99.0) / 1e3, lag.max / 1e3);
+  }
+  printf("requests %llu, bytes %llu, parse errors %llu, unknown methods %llu, response overflows %llu\n",
+         requests, bytes, (unsigned long long)totals.parse_errors, (unsigned long long)totals.unknown_methods,
+         overflows);
+  printf("throughput: %.0f requests/s, %.1f MB/s\n\n", requests / (elapsed_ns / 1e9), bytes / (elapsed_ns / 1e3));
+  printf("%-24s %10s %9s %9s %9s %9s %9s\n", "latency (us)", "count", "mean", "p50", "p99", "p99.9", "max");
+  print_latency("request", &latency, "");
+  print_latency("parse", &totals.parse_ns, "");
+  printf("\n%-24s %10s %9s %9s %9s %9s %9s   %s\n", "handler (us)", "calls", "mean", "p50", "p99", "p99.9", "max",
+         "errors");
+  for (i = 0; i < num_methods; i++)
+  {
+    char errors[32];
+    sprintf(errors, "   %llu", (unsigned long long)method_totals[i].errors);
+    print_latency(method_names[i], &method_totals[i].latency_ns, errors);
+  }
+  munmap((void*)capture, (size_t)st.st_size);
+  close(fd);
+  return 0;
+}
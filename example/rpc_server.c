@@ -0,0 +1,156 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../jsmnrpc_server_group.h"
+
+/*
+ * A JSON-RPC server built on jsmnrpc_server, e.g. for benchmarking with
+ * bench/loadgen. Methods: "echo" returns its params, "ping" returns "pong"
+ * and "sleep" waits for params[0] microseconds before returning.
+ *
+ * Usage: rpc_server [-p port | -u path] [-F newline|length|raw|http|ws] [-B epoll|io_uring] [-t threads]
+ *                   [-w workers [-o 1] [-q max_queued] [-b bulk_workers]] [-d timeout_ms]
+ *
+ * With -t, that many event loop threads (0: one per CPU) share the port. With
+ * -w, handlers run on that many worker threads per event loop, and requests
+ * pipelined on a connection run concurrently; -o 1 keeps responses in order
+ * and -q answers requests finding that many others queued "Server busy". The
+ * time requests waited for a worker is printed on exit. With -d, calls not
+ * started within that many milliseconds of their request are answered with a
+ * timeout error.
+ *
+ * "ping" is registered as a high priority handler and "sleep" as a bulk one,
+ * so with -w pings overtake queued sleeps; -b limits the workers running
+ * sleeps at a time. The queue wait of each class is printed on exit.
+ */
+
+static jsmnrpc_server_group_t group;
+
+static void echo(jsmnrpc_request_info_t *info) {
+	if (jsmnrpc_create_result_prefix(info)) {
+		if (info->params_value_token >= 0) {
+			append_str(&info->data->response, jsmnrpc_get_string(&info->data->tokens, info->params_value_token));
+		} else {
+			append_str_with_len(&info->data->response, "null", SIZE_MAX);
+		}
+	}
+}
+
+static void ping(jsmnrpc_request_info_t *info) {
+	jsmnrpc_create_result("\"pong\"", info);
+}
+
+static void sleep_us(jsmnrpc_request_info_t *info) {
+	jsmnrpc_token_list_t *tokens = &info->data->tokens;
+	jsmnrpc_string_t arg = jsmnrpc_get_string(tokens, jsmnrpc_get_value(tokens, info->params_value_token, 0, NULL));
+	int us;
+	if (arg.data == NULL || !str_to_i(arg.data, arg.length, &us) || us < 0) {
+		jsmnrpc_create_error(jsmnrpc_err_invalid_params, NULL, info);
+		return;
+	}
+	usleep(us);
+	jsmnrpc_create_result("null", info);
+}
+
+static void on_signal(int sig) {
+	(void)sig;
+	jsmnrpc_server_group_stop(&group);
+}
+
+int main(int argc, char **argv) {
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_handler_t handlers[3];
+	jsmnrpc_server_config_t config;
+	jsmnrpc_server_counters_t counters;
+	jsmnrpc_pipeline_metrics_t queues;
+	static const char *const priorities[] = { "high", "normal", "bulk" };
+	const char *unix_path = NULL;
+	int port = 8080;
+	int threads = 1;
+	int i, r;
+
+	jsmnrpc_server_config_init(&config);
+	for (i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-p") == 0) {
+			port = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-u") == 0) {
+			unix_path = argv[i + 1];
+		} else if (strcmp(argv[i], "-F") == 0) {
+			if (strcmp(argv[i + 1], "length") == 0) {
+				config.framing = jsmnrpc_framing_length_prefix;
+			} else if (strcmp(argv[i + 1], "raw") == 0) {
+				config.framing = jsmnrpc_framing_raw;
+			} else if (strcmp(argv[i + 1], "http") == 0) {
+				config.framing = jsmnrpc_framing_http;
+			} else if (strcmp(argv[i + 1], "ws") == 0) {
+				config.framing = jsmnrpc_framing_websocket;
+			}
+		} else if (strcmp(argv[i], "-B") == 0) {
+			config.backend = strcmp(argv[i + 1], "epoll") == 0 ? jsmnrpc_server_backend_epoll
+									 : jsmnrpc_server_backend_io_uring;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			threads = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-w") == 0) {
+			config.workers = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-o") == 0) {
+			config.in_order = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-q") == 0) {
+			config.max_queued = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-b") == 0) {
+			config.bulk_workers = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-d") == 0) {
+			config.timeout_ms = atoi(argv[i + 1]);
+		}
+	}
+
+	jsmnrpc_init(&rpc, handlers, 3);
+	jsmnrpc_register_handler(&rpc, "echo", echo);
+	jsmnrpc_register_handler_ex(&rpc, "ping", ping, jsmnrpc_priority_high);
+	jsmnrpc_register_handler_ex(&rpc, "sleep", sleep_us, jsmnrpc_priority_bulk);
+
+	if (jsmnrpc_server_group_init(&group, &rpc, &config, threads) != 0) {
+		perror("jsmnrpc_server_group_init");
+		return 1;
+	}
+	r = unix_path ? jsmnrpc_server_group_listen_unix(&group, unix_path)
+		      : jsmnrpc_server_group_listen_tcp(&group, NULL, port);
+	if (r < 0) {
+		perror(unix_path ? unix_path : "listen");
+		return 1;
+	}
+	fprintf(stderr, "serving with %d %s thread(s)\n", group.num_of_shards,
+			group.shards[0].backend == jsmnrpc_server_backend_io_uring ? "io_uring" : "epoll");
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (jsmnrpc_server_group_start(&group) != 0) {
+		perror("jsmnrpc_server_group_start");
+		return 1;
+	}
+	jsmnrpc_server_group_wait(&group);
+
+	jsmnrpc_server_group_counters(&group, &counters);
+	printf("connections %llu, requests %llu, reads %llu, writes %llu, bytes in %llu, out %llu\n",
+			(unsigned long long)counters.accepted, (unsigned long long)counters.requests,
+			(unsigned long long)counters.reads, (unsigned long long)counters.writes,
+			(unsigned long long)counters.bytes_received, (unsigned long long)counters.bytes_sent);
+	if (config.workers > 0) {
+		jsmnrpc_server_group_queue_metrics(&group, &queues);
+		printf("queued %llu, busy %llu, refused %llu, cancelled %llu, queue wait p50 %.1f us, p99 %.1f us\n",
+				(unsigned long long)queues.submitted, (unsigned long long)queues.busy,
+				(unsigned long long)queues.rejected, (unsigned long long)queues.cancelled,
+				jsmnrpc_histogram_percentile(&queues.execute_wait_ns, 50.0) / 1e3,
+				jsmnrpc_histogram_percentile(&queues.execute_wait_ns, 99.0) / 1e3);
+		for (i = 0; i < jsmnrpc_priority_count; i++) {
+			printf("  %-6s queue wait p50 %.1f us, p99 %.1f us\n", priorities[i],
+					jsmnrpc_histogram_percentile(&queues.priority_wait_ns[i], 50.0) / 1e3,
+					jsmnrpc_histogram_percentile(&queues.priority_wait_ns[i], 99.0) / 1e3);
+		}
+	}
+	jsmnrpc_server_group_close(&group);
+	if (unix_path) {
+		unlink(unix_path);
+	}
+	return 0;
+}
@@ -1,4 +1,12 @@
 #include "jsmn.h"
+#include "jsmn_probes.h"
+
+#if JSMN_STATS
+#define JSMN_STAT(parser, expr) \
+	do { if ((parser)->stats != NULL) { jsmn_stats *stats = (parser)->stats; expr; } } while (0)
+#else
+#define JSMN_STAT(parser, expr)
+#endif
 
 /**
  * Allocates a fresh unused token from the token pull.
@@ -61,19 +69,20 @@ static jsmn_size_t jsmn_parse_primitive(jsmn_parser *parser, const char *js,
 #endif
 
 found:
-	if (tokens == NULL) {
-		parser->pos--;
-		return 0;
-	}
-	token = jsmn_alloc_token(parser, tokens, num_tokens);
-	if (token == NULL) {
-		parser->pos = start;
-		return JSMN_ERROR_NOMEM;
-	}
-	jsmn_fill_token(token, JSMN_PRIMITIVE, start, parser->pos);
+	if (tokens != NULL) {
+		token = jsmn_alloc_token(parser, tokens, num_tokens);
+		if (token == NULL) {
+			parser->pos = start;
+			return JSMN_ERROR_NOMEM;
+		}
+		jsmn_fill_token(token, JSMN_PRIMITIVE, start, parser->pos);
 #if JSMN_PARENT_LINKS
-	token->parent = parser->toksuper;
+		token->parent = parser->toksuper;
 #endif
+	}
+	/* counted once the token exists: a parse resumed after JSMN_ERROR_NOMEM sees it again */
+	JSMN_STAT(parser, if (parser->pos - start > stats->longest_primitive)
+			stats->longest_primitive = parser->pos - start);
 	parser->pos--;
 	return 0;
 }
@@ -86,6 +95,9 @@ static jsmn_size_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 	jsmntok_t *token;
 
 	jsmn_size_t start = parser->pos;
+#if JSMN_STATS
+	unsigned long escapes = 0;
+#endif
 
 	parser->pos++;
 
@@ -95,18 +107,20 @@ static jsmn_size_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 
 		/* Quote: end of string */
 		if (c == '\"') {
-			if (tokens == NULL) {
-				return 0;
-			}
-			token = jsmn_alloc_token(parser, tokens, num_tokens);
-			if (token == NULL) {
-				parser->pos = start;
-				return JSMN_ERROR_NOMEM;
-			}
-			jsmn_fill_token(token, JSMN_STRING, start+1, parser->pos);
+			if (tokens != NULL) {
+				token = jsmn_alloc_token(parser, tokens, num_tokens);
+				if (token == NULL) {
+					parser->pos = start;
+					return JSMN_ERROR_NOMEM;
+				}
+				jsmn_fill_token(token, JSMN_STRING, start+1, parser->pos);
 #if JSMN_PARENT_LINKS
-			token->parent = parser->toksuper;
+				token->parent = parser->toksuper;
 #endif
+			}
+			JSMN_STAT(parser, stats->escapes += escapes;
+					if (parser->pos - start - 1 > stats->longest_string)
+						stats->longest_string = parser->pos - start - 1);
 			return 0;
 		}
 
@@ -114,6 +128,9 @@ static jsmn_size_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 		if (c == '\\' && parser->pos + 1 < len) {
 			jsmn_size_t i;
 			parser->pos++;
+#if JSMN_STATS
+			escapes++;
+#endif
 			switch (js[parser->pos]) {
 				/* Allowed escaped symbols */
 				case '\"': case '/' : case '\\' : case 'b' :
@@ -148,7 +165,7 @@ static jsmn_size_t jsmn_parse_string(jsmn_parser *parser, const char *js,
 /**
  * Parse JSON string and fill tokens.
  */
-jsmn_size_t jsmn_parse(jsmn_parser *parser, const char *js, jsmn_size_t len,
+static jsmn_size_t jsmn_parse_tokens(jsmn_parser *parser, const char *js, jsmn_size_t len,
 		jsmntok_t *tokens, jsmn_size_t num_tokens) {
 	jsmn_size_t r;
 	jsmn_size_t i;
@@ -163,23 +180,29 @@ jsmn_size_t jsmn_parse(jsmn_parser *parser, const char *js, jsmn_size_t len,
 		switch (c) {
 			case '{': case '[':
 				count++;
-				if (tokens == NULL) {
-					break;
-				}
-				token = jsmn_alloc_token(parser, tokens, num_tokens);
-				if (token == NULL)
-					return JSMN_ERROR_NOMEM;
-				if (parser->toksuper != -1) {
-					tokens[parser->toksuper].size++;
+				if (tokens != NULL) {
+					token = jsmn_alloc_token(parser, tokens, num_tokens);
+					if (token == NULL)
+						return JSMN_ERROR_NOMEM;
+					if (parser->toksuper != -1) {
+						tokens[parser->toksuper].size++;
 #if JSMN_PARENT_LINKS
-					token->parent = parser->toksuper;
+						token->parent = parser->toksuper;
 #endif
+					}
+					token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
+					token->start = parser->pos;
+					parser->toksuper = parser->toknext - 1;
 				}
-				token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
-				token->start = parser->pos;
-				parser->toksuper = parser->toknext - 1;
+				JSMN_STAT(parser, stats->tokens[c == '{' ? JSMN_OBJECT : JSMN_ARRAY]++;
+						if (++parser->depth > stats->max_depth)
+							stats->max_depth = parser->depth);
 				break;
 			case '}': case ']':
+#if JSMN_STATS
+				if (parser->stats != NULL && parser->depth > 0)
+					parser->depth--;
+#endif
 				if (tokens == NULL)
 					break;
 				type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
@@ -232,6 +255,7 @@ jsmn_size_t jsmn_parse(jsmn_parser *parser, const char *js, jsmn_size_t len,
 				r = jsmn_parse_string(parser, js, len, tokens, num_tokens);
 				if (r < 0) return r;
 				count++;
+				JSMN_STAT(parser, stats->tokens[JSMN_STRING]++);
 				if (parser->toksuper != -1 && tokens != NULL)
 					tokens[parser->toksuper].size++;
 				break;
@@ -278,6 +302,7 @@ jsmn_size_t jsmn_parse(jsmn_parser *parser, const char *js, jsmn_size_t len,
 				r = jsmn_parse_primitive(parser, js, len, tokens, num_tokens);
 				if (r < 0) return r;
 				count++;
+				JSMN_STAT(parser, stats->tokens[JSMN_PRIMITIVE]++);
 				if (parser->toksuper != -1 && tokens != NULL)
 					tokens[parser->toksuper].size++;
 				break;
@@ -302,6 +327,24 @@ jsmn_size_t jsmn_parse(jsmn_parser *parser, const char *js, jsmn_size_t len,
 	return count;
 }
 
+/**
+ * Parse JSON string and fill tokens, updating statistics when enabled.
+ */
+jsmn_size_t jsmn_parse(jsmn_parser *parser, const char *js, jsmn_size_t len,
+		jsmntok_t *tokens, jsmn_size_t num_tokens) {
+	jsmn_size_t r;
+#if JSMN_STATS
+	jsmn_size_t start = parser->pos;
+#endif
+	JSMN_PROBE3(jsmn, parse__start, js, len, parser->pos);
+	r = jsmn_parse_tokens(parser, js, len, tokens, num_tokens);
+	JSMN_STAT(parser, stats->parses++;
+			if (parser->pos > start) stats->bytes += parser->pos - start;
+			if (r < 0 && r >= JSMN_ERROR_PART) stats->errors[-1 - r]++);
+	JSMN_PROBE3(jsmn, parse__done, js, len, r);
+	return r;
+}
+
 /**
  * Creates a new parser based over a given  buffer with an array of tokens
  * available.
@@ -310,5 +353,9 @@ void jsmn_init(jsmn_parser *parser) {
 	parser->pos = 0;
 	parser->toknext = 0;
 	parser->toksuper = -1;
+#if JSMN_STATS
+	parser->depth = 0;
+	parser->stats = NULL;
+#endif
 }
 
@@ -6,7 +6,12 @@
 #ifndef JSMN_PARENT_LINKS
 #define JSMN_PARENT_LINKS 1
 #endif
+#if !defined(JSMN_STRICT) && !defined(JSMN_NON_STRICT)
 #define JSMN_STRICT
+#endif
+#ifndef JSMN_STATS
+#define JSMN_STATS 0
+#endif
 #ifndef JSMN_SIZE_T
 typedef int16_t jsmn_size_t;
 #else
@@ -57,6 +62,24 @@ typedef struct {
 #endif
 } jsmntok_t;
 
+#if JSMN_STATS
+/**
+ * Parse statistics (only with JSMN_STATS=1). Counters are accumulated by every
+ * jsmn_parse call made with a parser whose stats pointer is set, so one block
+ * can be shared by many parsers (from a single thread) and sampled at will.
+ */
+typedef struct {
+	unsigned long parses; /* calls to jsmn_parse */
+	unsigned long bytes; /* bytes scanned */
+	unsigned long tokens[5]; /* tokens found, indexed by jsmntype_t */
+	unsigned long escapes; /* escape sequences inside strings */
+	unsigned long errors[3]; /* errors returned, indexed by (-1 - jsmnerr) */
+	jsmn_size_t max_depth; /* deepest object/array nesting */
+	jsmn_size_t longest_string;
+	jsmn_size_t longest_primitive;
+} jsmn_stats;
+#endif
+
 /**
  * JSON parser. Contains an array of token blocks available. Also stores
  * the string being parsed now and current position in that string
@@ -65,6 +88,10 @@ typedef struct {
 	jsmn_size_t pos; /* offset in the JSON string */
 	jsmn_size_t toknext; /* next token to allocate */
 	jsmn_size_t toksuper; /* superior token node, e.g parent object or array */
+#if JSMN_STATS
+	jsmn_size_t depth; /* current object/array nesting */
+	jsmn_stats *stats; /* statistics to update, NULL when not sampling */
+#endif
 } jsmn_parser;
 
 /**
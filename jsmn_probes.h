@@ -0,0 +1,40 @@
+#ifndef __JSMN_PROBES_H_
+#define __JSMN_PROBES_H_
+
+/**
+ * SystemTap/USDT static probes for jsmn and jsmnrpc.
+ *
+ * Probes are compiled in when <sys/sdt.h> is available (or JSMN_USDT=1 is
+ * defined) and can be switched off with JSMN_USDT=0. An unattached probe is a
+ * single nop, so they are safe to leave in production builds:
+ *
+ * 	bpftrace -e 'usdt:./app:jsmnrpc:handler__entry { @[str(arg0)] = count(); }'
+ */
+
+#ifndef JSMN_USDT
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define JSMN_USDT 1
+#endif
+#endif
+#endif
+
+#ifndef JSMN_USDT
+#define JSMN_USDT 0
+#endif
+
+#if JSMN_USDT
+#include <sys/sdt.h>
+#define JSMN_PROBE1(provider, name, a1) \
+	DTRACE_PROBE1(provider, name, a1)
+#define JSMN_PROBE2(provider, name, a1, a2) \
+	DTRACE_PROBE2(provider, name, a1, a2)
+#define JSMN_PROBE3(provider, name, a1, a2, a3) \
+	DTRACE_PROBE3(provider, name, a1, a2, a3)
+#else
+#define JSMN_PROBE1(provider, name, a1)
+#define JSMN_PROBE2(provider, name, a1, a2)
+#define JSMN_PROBE3(provider, name, a1, a2, a3)
+#endif
+
+#endif /* __JSMN_PROBES_H_ */
@@ -32,6 +32,16 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdint.h>
 
 #include "jsmnrpc.h"
+#include "jsmn_probes.h"
+#if JSMNRPC_STATS || JSMNRPC_TRACE || (JSMNRPC_DEADLINES && !defined(JSMNRPC_CLOCK_NS))
+#include "jsmnrpc_clock.h"
+#endif
+#if JSMNRPC_DEADLINES && !defined(JSMNRPC_CLOCK_NS)
+#define JSMNRPC_CLOCK_NS() jsmnrpc_clock_ns()
+#endif
+#if JSMNRPC_STATS
+#include "jsmnrpc_atomic.h"
+#endif
 
 
 /* Private types and definitions ------------------------------------------------------- */
@@ -51,7 +61,9 @@ jsmnrpc_error_code_t jsmnrpc_err_codes[] =
   { -32600, "Invalid Request" },   /* The JSON sent is not a valid Request object */
   { -32601, "Method not found" },   /* The method does not exist / is not available */
   { -32602, "Invalid params" },   /* Invalid method parameter(s) */
-  { -32603, "Internal error" }    /* Internal JSON-RPC error */
+  { -32603, "Internal error" },   /* Internal JSON-RPC error */
+  { -32001, "Request timeout" },  /* Not started before the request's deadline */
+  { -32800, "Request cancelled" } /* Cancelled by the client */
 };
 
 enum jsmnrpc_key_ids
@@ -75,9 +87,6 @@ const char* jsmnrpc_keys[] =
   "error",
 };
 
-/* Private function declarations ------------------------------------------------------- */
-static int str_len(const char* str);
-
 /* Exported functions ------------------------------------------------------- */
 void jsmnrpc_init(jsmnrpc_instance_t* self, jsmnrpc_handler_t* table_for_handlers, int max_num_of_handlers)
 {
@@ -85,27 +94,60 @@ void jsmnrpc_init(jsmnrpc_instance_t* self, jsmnrpc_handler_t* table_for_handler
   self->handlers = table_for_handlers;
   self->num_of_handlers = 0;
   self->max_num_of_handlers = max_num_of_handlers;
+  self->has_priorities = false;
+#if JSMNRPC_STATS
+  self->stats = NULL;
+#endif
+#if JSMNRPC_CAPTURE
+  self->capture = NULL;
+#endif
 
   for (i = 0; i < self->max_num_of_handlers; i++)
   {
     self->handlers[i].handler_name = 0;
     self->handlers[i].handler = 0;
+    self->handlers[i].priority = jsmnrpc_priority_normal;
   }
 }
 
 void jsmnrpc_register_handler(jsmnrpc_instance_t* self, const char* handler_name, jsmnrpc_handler_callback_t handler)
+{
+  jsmnrpc_register_handler_ex(self, handler_name, handler, jsmnrpc_priority_normal);
+}
+
+void jsmnrpc_register_handler_ex(jsmnrpc_instance_t* self, const char* handler_name, jsmnrpc_handler_callback_t handler,
+                                 int priority)
 {
   if (self->num_of_handlers < self->max_num_of_handlers)
   {
-    if (handler_name && handler)
+    if (handler_name && handler && priority >= 0 && priority < jsmnrpc_priority_count)
     {
       self->handlers[self->num_of_handlers].handler_name = handler_name;
       self->handlers[self->num_of_handlers].handler = handler;
+      self->handlers[self->num_of_handlers].priority = priority;
       self->num_of_handlers++;
+      if (priority != jsmnrpc_priority_normal)
+      {
+        self->has_priorities = true;
+      }
     }
   }
 }
 
+#if JSMNRPC_STATS
+void jsmnrpc_set_stats(jsmnrpc_instance_t* self, jsmnrpc_stats_t* stats)
+{
+  self->stats = stats;
+}
+#endif
+
+#if JSMNRPC_CAPTURE
+void jsmnrpc_set_capture(jsmnrpc_instance_t* self, jsmnrpc_capture_t* capture)
+{
+  self->capture = capture;
+}
+#endif
+
 static int jsmnrpc_get_handler_id(jsmnrpc_instance_t* table, const jsmnrpc_string_t name)
 {
   int result = -1;
@@ -119,6 +161,42 @@ static int jsmnrpc_get_handler_id(jsmnrpc_instance_t* table, const jsmnrpc_strin
   return result;
 }
 
+static int jsmnrpc_call_priority(jsmnrpc_instance_t* self, jsmnrpc_token_list_t* tokens, int token_id)
+{
+  int method_value_token = -1;
+  if (tokens->data[token_id].type == JSMN_OBJECT) {
+    method_value_token = jsmnrpc_get_value(tokens, token_id, -1, jsmnrpc_keys[jsmnrpc_key_method]);
+  }
+  if (method_value_token >= 0 && tokens->data[method_value_token].type == JSMN_STRING) {
+    int handler_id = jsmnrpc_get_handler_id(self, jsmnrpc_get_string(tokens, method_value_token));
+    if (handler_id >= 0) {
+      return self->handlers[handler_id].priority;
+    }
+  }
+  return jsmnrpc_priority_normal;
+}
+
+int jsmnrpc_request_priority(jsmnrpc_instance_t* self, jsmnrpc_token_list_t* tokens)
+{
+  int priority = jsmnrpc_priority_high;
+  if (!self->has_priorities || tokens->length < 1) {
+    return jsmnrpc_priority_normal;
+  }
+  if (tokens->data[0].type != JSMN_ARRAY) {
+    return jsmnrpc_call_priority(self, tokens, 0);
+  }
+  for (int i = 1; i < tokens->length && priority < jsmnrpc_priority_bulk; ++i) {
+    if (tokens->data[i].parent == 0) {
+      int call_priority = jsmnrpc_call_priority(self, tokens, i);
+      if (call_priority > priority) {
+        priority = call_priority;
+      }
+    }
+  }
+  /* an empty batch is an invalid request, not an urgent one */
+  return tokens->data[0].size > 0 ? priority : jsmnrpc_priority_normal;
+}
+
 void jsmnrpc_handle_request_single(jsmnrpc_instance_t* self, jsmnrpc_request_info_t* request_info, int token_id)
 {
   jsmnrpc_token_list_t *tokens = &request_info->data->tokens;
@@ -184,8 +262,43 @@ void jsmnrpc_handle_request_single(jsmnrpc_instance_t* self, jsmnrpc_request_inf
     if (method_value_token >= 0 && tokens->data[method_value_token].type == JSMN_STRING) {
       jsmnrpc_string_t str = jsmnrpc_get_string(tokens, method_value_token);
       int handler_id = jsmnrpc_get_handler_id(self, str);
-      if (handler_id >= 0) {
+      if (handler_id >= 0 && jsmnrpc_request_cancelled(request_info)) {
+        jsmnrpc_create_error(jsmnrpc_err_cancelled, NULL, request_info);
+      }
+      else if (handler_id >= 0 && jsmnrpc_request_expired(request_info)) {
+        jsmnrpc_create_error(jsmnrpc_err_timeout, NULL, request_info);
+      }
+      else if (handler_id >= 0) {
+#if JSMNRPC_STATS
+        uint64_t handler_start = self->stats ? jsmnrpc_clock_ns() : 0;
+#endif
+#if JSMNRPC_TRACE
+        if (request_info->trace) {
+          request_info->trace->method_id = handler_id;
+          request_info->trace->t_dispatch = jsmnrpc_clock_ticks();
+        }
+#endif
+        JSMN_PROBE3(jsmnrpc, handler__entry, self->handlers[handler_id].handler_name, handler_id,
+                    request_info->params_value_token < 0 ? 0 :
+                    tokens->data[request_info->params_value_token].end - tokens->data[request_info->params_value_token].start);
         self->handlers[handler_id].handler(request_info);
+        JSMN_PROBE3(jsmnrpc, handler__return, self->handlers[handler_id].handler_name, handler_id,
+                    request_info->info_flags);
+#if JSMNRPC_TRACE
+        if (request_info->trace) {
+          request_info->trace->t_handler_done = jsmnrpc_clock_ticks();
+        }
+#endif
+#if JSMNRPC_STATS
+        if (self->stats) {
+          jsmnrpc_method_stats_t *method = jsmnrpc_stats_local_shard(self->stats)->methods + handler_id;
+          jsmnrpc_histogram_record(&method->latency_ns, jsmnrpc_clock_ns() - handler_start);
+          JSMNRPC_ATOMIC_ADD(&method->calls, 1);
+          if (request_info->info_flags & jsmnrpc_response_is_error) {
+            JSMNRPC_ATOMIC_ADD(&method->errors, 1);
+          }
+        }
+#endif
         if (request_info->info_flags & jsmnrpc_response_is_result)
         {
           append_str_with_len(&(request_info->data->response), "}", SIZE_MAX);
@@ -193,6 +306,11 @@ void jsmnrpc_handle_request_single(jsmnrpc_instance_t* self, jsmnrpc_request_inf
       }
       else
       {
+#if JSMNRPC_STATS
+        if (self->stats) {
+          JSMNRPC_ATOMIC_ADD(&jsmnrpc_stats_local_shard(self->stats)->unknown_methods, 1);
+        }
+#endif
         jsmnrpc_create_error(jsmnrpc_err_method_not_found, NULL, request_info);
       }
     }
@@ -203,6 +321,24 @@ void jsmnrpc_handle_request_single(jsmnrpc_instance_t* self, jsmnrpc_request_inf
   }
 }
 
+#if JSMNRPC_TRACE
+static void jsmnrpc_trace_call(jsmnrpc_instance_t* self, jsmnrpc_request_info_t* request_info, int token_id)
+{
+  jsmnrpc_trace_record_t *record = request_info->trace;
+  jsmntok_t *token = request_info->data->tokens.data + token_id;
+  size_t response_start = request_info->data->response.length;
+  record->t_dispatch = 0;
+  record->t_handler_done = 0;
+  record->method_id = -1;
+  record->request_bytes = (uint32_t)(token->end - token->start);
+  jsmnrpc_handle_request_single(self, request_info, token_id);
+  record->t_complete = jsmnrpc_clock_ticks();
+  record->response_bytes = (uint32_t)(request_info->data->response.length - response_start);
+  record->info_flags = request_info->info_flags;
+  jsmnrpc_trace_commit(jsmnrpc_trace_current(), record);
+}
+#endif
+
 bool jsmnrpc_parse(jsmnrpc_token_list_t* tokens, jsmnrpc_string_t *str)
 {
   if (tokens) {
@@ -217,51 +353,116 @@ bool jsmnrpc_parse(jsmnrpc_token_list_t* tokens, jsmnrpc_string_t *str)
   return false;
 }
 
-void jsmnrpc_handle_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data)
+/* stages of jsmnrpc_handle_request, also run separately by jsmnrpc_parse_request / jsmnrpc_dispatch_request */
+static void jsmnrpc_request_begin(jsmnrpc_data_t* request_data, jsmnrpc_request_info_t* request_info)
 {
-  jsmnrpc_request_info_t request_info;
-  request_info.data = request_data;
-  const int root_token_id = 0;
-  jsmnrpc_token_list_t *tokens = &request_data->tokens;
-  jsmnrpc_string_t *request = &request_data->request;
-  jsmntok_t *root_token = tokens->data + root_token_id;
+  request_info->data = request_data;
+  request_info->id_value_token = -1;
+  request_info->params_value_token = -1;
+  request_info->info_flags = 0;
+  request_info->deadline = 0;
+  request_info->cancelled = NULL;
+#if JSMNRPC_TRACE
+  request_info->trace = NULL;
+#endif
   request_data->response.length = 0;
-  request_info.id_value_token = -1;
-  request_info.params_value_token = -1;
-  request_info.info_flags = 0;
-
-  do {
-    if (!jsmnrpc_parse(tokens, request)) {
-      jsmnrpc_create_error(jsmnrpc_err_parse_error, NULL, &request_info);
-      break;
-    }
+}
 
-    if (root_token->type != JSMN_ARRAY && root_token->type != JSMN_OBJECT) {
-      jsmnrpc_create_error(jsmnrpc_err_invalid_request, NULL, &request_info);
-      break;
-    }
+static bool jsmnrpc_request_parse(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, jsmnrpc_request_info_t* request_info)
+{
+  jsmnrpc_token_list_t *tokens = &request_data->tokens;
+  jsmntok_t *root_token = tokens->data;
+#if JSMNRPC_STATS
+  jsmnrpc_stats_shard_t *stats = self->stats ? jsmnrpc_stats_local_shard(self->stats) : NULL;
+  uint64_t parse_start = stats ? jsmnrpc_clock_ns() : 0;
+#endif
+  (void)self; /* used with JSMNRPC_STATS or JSMNRPC_CAPTURE */
+  JSMN_PROBE2(jsmnrpc, dispatch__start, request_data->request.data, request_data->request.length);
+#if JSMNRPC_CAPTURE
+  if (self->capture) {
+    jsmnrpc_capture_write(self->capture, request_data->request.data, request_data->request.length);
+  }
+#endif
+#if JSMNRPC_TRACE
+  if (request_info->trace) {
+    request_info->trace->t_receive = jsmnrpc_clock_ticks();
+    request_info->trace->t_parsed = 0;
+  }
+#endif
+
+  if (!jsmnrpc_parse(tokens, &request_data->request)) {
+#if JSMNRPC_STATS
+    if (stats) {
+      JSMNRPC_ATOMIC_ADD(&stats->parse_errors, 1);
+    }
+#endif
+    jsmnrpc_create_error(jsmnrpc_err_parse_error, NULL, request_info);
+    return false;
+  }
+#if JSMNRPC_TRACE
+  if (request_info->trace) {
+    request_info->trace->t_parsed = jsmnrpc_clock_ticks();
+  }
+#endif
+#if JSMNRPC_STATS
+  if (stats) {
+    jsmnrpc_histogram_record(&stats->parse_ns, jsmnrpc_clock_ns() - parse_start);
+  }
+#endif
+
+  if (root_token->type != JSMN_ARRAY && root_token->type != JSMN_OBJECT) {
+    jsmnrpc_create_error(jsmnrpc_err_invalid_request, NULL, request_info);
+    return false;
+  }
+
+  if (root_token->type == JSMN_ARRAY && root_token->size < 1) {
+    jsmnrpc_create_error(jsmnrpc_err_invalid_request, NULL, request_info);
+    return false;
+  }
+  return true;
+}
 
-    if (root_token->type == JSMN_ARRAY && root_token->size < 1) {
-      jsmnrpc_create_error(jsmnrpc_err_invalid_request, NULL, &request_info);
-      break;
-    }
+static void jsmnrpc_request_dispatch(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, jsmnrpc_request_info_t* request_info)
+{
+  const int root_token_id = 0;
+  jsmnrpc_token_list_t *tokens = &request_data->tokens;
+  jsmntok_t *root_token = tokens->data + root_token_id;
 
-    if (root_token->type == JSMN_ARRAY)
-    {
-      append_str_with_len(&request_data->response, "[", SIZE_MAX);
-      for (int i = 1; i < tokens->length; ++i) {
-        if (tokens->data[i].parent == root_token_id) {
-          jsmnrpc_handle_request_single(self, &request_info, i);
+  if (root_token->type == JSMN_ARRAY)
+  {
+    append_str_with_len(&request_data->response, "[", SIZE_MAX);
+    for (int i = 1; i < tokens->length; ++i) {
+      if (tokens->data[i].parent == root_token_id) {
+#if JSMNRPC_TRACE
+        if (request_info->trace) {
+          jsmnrpc_trace_call(self, request_info, i);
+          continue;
         }
+#endif
+        jsmnrpc_handle_request_single(self, request_info, i);
       }
-      append_str_with_len(&request_data->response, "]", SIZE_MAX);
-      request_info.info_flags = jsmnrpc_response_is_array;
     }
-    else
-    {
-      jsmnrpc_handle_request_single(self, &request_info, 0);
+    append_str_with_len(&request_data->response, "]", SIZE_MAX);
+    request_info->info_flags = jsmnrpc_response_is_array;
+  }
+  else
+  {
+#if JSMNRPC_TRACE
+    if (request_info->trace) {
+      jsmnrpc_trace_call(self, request_info, 0);
+      return;
     }
-  } while (0);
+#endif
+    jsmnrpc_handle_request_single(self, request_info, 0);
+  }
+}
+
+static void jsmnrpc_request_finish(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, jsmnrpc_request_info_t* request_info)
+{
+#if JSMNRPC_STATS
+  jsmnrpc_stats_shard_t *stats = self->stats ? jsmnrpc_stats_local_shard(self->stats) : NULL;
+#endif
+  (void)self; /* used with JSMNRPC_STATS */
   if (request_data->response.capacity > 0)
   {
     if (request_data->response.length < request_data->response.capacity)
@@ -269,7 +470,117 @@ void jsmnrpc_handle_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_da
       request_data->response.data[request_data->response.length] = 0;
     }
   }
-  request_data->info_flags = request_info.info_flags;
+  request_data->info_flags = request_info->info_flags;
+  JSMN_PROBE3(jsmnrpc, dispatch__done, request_data->response.data, request_data->response.length,
+              request_info->info_flags);
+#if JSMNRPC_STATS
+  if (stats) {
+    JSMNRPC_ATOMIC_ADD(&stats->requests, 1);
+    jsmnrpc_histogram_record(&stats->response_bytes, request_data->response.length);
+  }
+#endif
+}
+
+#if JSMNRPC_TRACE
+/* commits a record for a request rejected before any call was dispatched (e.g. parse error) */
+static void jsmnrpc_trace_rejected(jsmnrpc_trace_ring_t* trace_ring, jsmnrpc_trace_record_t* trace_record,
+                                   jsmnrpc_data_t* request_data, jsmnrpc_request_info_t* request_info)
+{
+  trace_record->t_dispatch = trace_record->t_handler_done = 0;
+  trace_record->t_complete = jsmnrpc_clock_ticks();
+  trace_record->method_id = -1;
+  trace_record->request_bytes = (uint32_t)request_data->request.length;
+  trace_record->response_bytes = (uint32_t)request_data->response.length;
+  trace_record->info_flags = request_info->info_flags;
+  jsmnrpc_trace_commit(trace_ring, trace_record);
+}
+#endif
+
+void jsmnrpc_handle_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data)
+{
+  jsmnrpc_handle_request_until(self, request_data, 0);
+}
+
+void jsmnrpc_handle_request_until(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, uint64_t deadline)
+{
+  jsmnrpc_request_info_t request_info;
+  jsmnrpc_request_begin(request_data, &request_info);
+  request_info.deadline = deadline;
+#if JSMNRPC_TRACE
+  jsmnrpc_trace_ring_t *trace_ring = jsmnrpc_trace_current();
+  jsmnrpc_trace_record_t trace_record;
+  uint64_t trace_head = trace_ring ? trace_ring->head : 0;
+  if (trace_ring) {
+    request_info.trace = &trace_record;
+  }
+#endif
+
+  if (jsmnrpc_request_parse(self, request_data, &request_info)) {
+    jsmnrpc_request_dispatch(self, request_data, &request_info);
+  }
+#if JSMNRPC_TRACE
+  if (trace_ring && trace_ring->head == trace_head) {
+    jsmnrpc_trace_rejected(trace_ring, &trace_record, request_data, &request_info);
+  }
+#endif
+  jsmnrpc_request_finish(self, request_data, &request_info);
+}
+
+bool jsmnrpc_parse_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data)
+{
+  jsmnrpc_request_info_t request_info;
+  jsmnrpc_request_begin(request_data, &request_info);
+  if (jsmnrpc_request_parse(self, request_data, &request_info)) {
+    request_data->info_flags = 0;
+    return true;
+  }
+  jsmnrpc_request_finish(self, request_data, &request_info);
+  return false;
+}
+
+void jsmnrpc_dispatch_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data)
+{
+  jsmnrpc_dispatch_request_until(self, request_data, 0);
+}
+
+void jsmnrpc_dispatch_request_until(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, uint64_t deadline)
+{
+  jsmnrpc_dispatch_request_cancellable(self, request_data, deadline, NULL);
+}
+
+void jsmnrpc_dispatch_request_cancellable(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, uint64_t deadline,
+                                          const volatile uint64_t* cancelled)
+{
+  jsmnrpc_request_info_t request_info;
+  jsmnrpc_request_begin(request_data, &request_info);
+  request_info.deadline = deadline;
+  request_info.cancelled = cancelled;
+#if JSMNRPC_TRACE
+  jsmnrpc_trace_ring_t *trace_ring = jsmnrpc_trace_current();
+  jsmnrpc_trace_record_t trace_record;
+  if (trace_ring) {
+    /* parsed earlier, possibly on another thread: the record starts at dispatch */
+    trace_record.t_receive = trace_record.t_parsed = jsmnrpc_clock_ticks();
+    request_info.trace = &trace_record;
+  }
+#endif
+  jsmnrpc_request_dispatch(self, request_data, &request_info);
+  jsmnrpc_request_finish(self, request_data, &request_info);
+}
+
+bool jsmnrpc_request_cancelled(const jsmnrpc_request_info_t* info)
+{
+  return info->cancelled != NULL && *info->cancelled != 0;
+}
+
+bool jsmnrpc_request_expired(const jsmnrpc_request_info_t* info)
+{
+#if JSMNRPC_DEADLINES
+  return info->deadline != 0 && JSMNRPC_CLOCK_NS() >= info->deadline;
+#else
+  (void)info;
+  return false;
+#endif
 }
 
 bool jsmnrpc_create_result_prefix(jsmnrpc_request_info_t* info)
@@ -329,6 +640,7 @@ void jsmnrpc_create_error(int err, const char* err_msg, jsmnrpc_request_info_t*
     err_code = -1;
   }
   info->info_flags |= jsmnrpc_response_is_error;
+  JSMN_PROBE2(jsmnrpc, error, err_code, err_msg);
 
   if (response->length > 2) // not the beginning of a batch response
   {
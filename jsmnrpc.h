@@ -35,6 +35,38 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "jsmn.h"
 
+#ifndef JSMNRPC_STATS
+#define JSMNRPC_STATS 0
+#endif
+
+#if JSMNRPC_STATS
+#include "jsmnrpc_stats.h"
+#endif
+
+#ifndef JSMNRPC_TRACE
+#define JSMNRPC_TRACE 0
+#endif
+
+#if JSMNRPC_TRACE
+#include "jsmnrpc_trace.h"
+#endif
+
+#ifndef JSMNRPC_CAPTURE
+#define JSMNRPC_CAPTURE 0
+#endif
+
+#if JSMNRPC_CAPTURE
+#include "jsmnrpc_capture.h"
+#endif
+
+/* Request deadlines (jsmnrpc_handle_request_until) are only checked with
+   JSMNRPC_DEADLINES, against jsmnrpc_clock_ns() or, if defined, JSMNRPC_CLOCK_NS()
+   (e.g. a tick counter on a target without POSIX time). Otherwise the core reads
+   no clock: handlers still see info->deadline, but calls never time out. */
+#ifndef JSMNRPC_DEADLINES
+#define JSMNRPC_DEADLINES 0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -78,6 +110,12 @@ typedef struct jsmnrpc_request_info
   jsmn_size_t params_value_token;
   jsmn_size_t id_value_token;
   uint16_t info_flags;
+  uint64_t deadline;         /* jsmnrpc_clock_ns() by which the request (one call, or all calls of a batch)
+                                should be done, 0: none (see jsmnrpc_handle_request_until) */
+  const volatile uint64_t *cancelled;  /* non-zero once the client cancelled the request (NULL: cannot be) */
+#if JSMNRPC_TRACE
+  jsmnrpc_trace_record_t *trace;  /* record being filled for this call (NULL if not tracing) */
+#endif
 } jsmnrpc_request_info_t;
 
 /**
@@ -92,6 +130,19 @@ typedef struct jsmnrpc_request_info
 */
 typedef void (*jsmnrpc_handler_callback_t)(jsmnrpc_request_info_t* info);
 
+/**
+* @brief Priority classes of handlers, most urgent first. Schedulers that run
+*        requests on worker threads (jsmnrpc_pipeline, jsmnrpc_server with workers)
+*        queue each class separately; jsmnrpc_handle_request ignores them.
+*/
+enum jsmnrpc_priorities
+{
+  jsmnrpc_priority_high = 0,         /* health checks, control methods */
+  jsmnrpc_priority_normal,           /* default */
+  jsmnrpc_priority_bulk,             /* long-running work (exports, scans) */
+  jsmnrpc_priority_count,
+};
+
 /**
 * @brief Structure used to define a storage for the service/function handler.
 *        It should be used to define storage for the JSON-RPC instance
@@ -101,6 +152,7 @@ typedef struct jsmnrpc_handler
 {
   jsmnrpc_handler_callback_t handler;
   const char* handler_name;
+  int priority;              /* one of jsmnrpc_priorities */
 } jsmnrpc_handler_t;
 
 /**
@@ -113,6 +165,13 @@ typedef struct jsmnrpc_instance
   jsmnrpc_handler_t* handlers;
   int num_of_handlers;
   int max_num_of_handlers;
+  bool has_priorities;       /* a handler was registered with a priority other than normal */
+#if JSMNRPC_STATS
+  jsmnrpc_stats_t* stats;
+#endif
+#if JSMNRPC_CAPTURE
+  jsmnrpc_capture_t* capture;
+#endif
 } jsmnrpc_instance_t;
 
 /**
@@ -125,6 +184,8 @@ enum jsmnrpc_20_errors
   jsmnrpc_err_method_not_found,      /* The method does not exist / is not available */
   jsmnrpc_err_invalid_params,        /* Invalid method parameter(s) */
   jsmnrpc_err_internal_error,        /* Internal JSON-RPC error */
+  jsmnrpc_err_timeout,               /* Not started before the request's deadline (server error range) */
+  jsmnrpc_err_cancelled,             /* Cancelled by the client (as in LSP's RequestCancelled) */
   jsmnrpc_err_count,                   /* JSON RPC 20 error count*/
 };
 
@@ -159,6 +220,43 @@ bool jsmnrpc_parse(jsmnrpc_token_list_t* tokens, jsmnrpc_string_t *str);
 */
 void jsmnrpc_register_handler(jsmnrpc_instance_t* self, const char* handler_name, jsmnrpc_handler_callback_t handler);
 
+/**
+* @brief Registers a new handler in a priority class (jsmnrpc_register_handler uses
+*        jsmnrpc_priority_normal).
+* @param priority one of jsmnrpc_priorities.
+*/
+void jsmnrpc_register_handler_ex(jsmnrpc_instance_t* self, const char* handler_name, jsmnrpc_handler_callback_t handler,
+                                 int priority);
+
+/**
+* @brief Priority class of a request tokenized by jsmnrpc_parse_request(): that of its
+*        method's handler, the least urgent one of its calls for a batch, normal
+*        for unknown methods and empty batches.
+*/
+int jsmnrpc_request_priority(jsmnrpc_instance_t* self, jsmnrpc_token_list_t* tokens);
+
+#if JSMNRPC_STATS
+/**
+* @brief Attaches (or detaches, if stats is NULL) per-method instrumentation.
+*        Once attached, jsmnrpc_handle_request records call/error counts and latency
+*        for each handler, as well as parse time and response size. Use
+*        jsmnrpc_stats_snapshot() to read the counters at any time.
+* @param self pointer to the jsmnrpc_instance_t object.
+* @param stats storage initialised with jsmnrpc_stats_init() (for the same max_num_of_handlers).
+*/
+void jsmnrpc_set_stats(jsmnrpc_instance_t* self, jsmnrpc_stats_t* stats);
+#endif
+
+#if JSMNRPC_CAPTURE
+/**
+* @brief Attaches (or detaches, if capture is NULL) a request capture. Once attached,
+*        jsmnrpc_handle_request appends every request to it before parsing.
+* @param self pointer to the jsmnrpc_instance_t object.
+* @param capture capture opened with jsmnrpc_capture_open().
+*/
+void jsmnrpc_set_capture(jsmnrpc_instance_t* self, jsmnrpc_capture_t* capture);
+#endif
+
 
 /**
 * @brief Method to handle RPC request. As a result, one of the registered handlers might be executed
@@ -172,6 +270,59 @@ void jsmnrpc_register_handler(jsmnrpc_instance_t* self, const char* handler_name
 */
 void jsmnrpc_handle_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data);
 
+/**
+* @brief First half of jsmnrpc_handle_request, for running the two halves on different
+*        threads (see jsmnrpc_pipeline.h): tokenizes request_data->request into
+*        request_data->tokens. The request string must stay valid until dispatched.
+* @return true if jsmnrpc_dispatch_request() must follow, false if the request was
+*         rejected (the error response is in request_data->response).
+*/
+bool jsmnrpc_parse_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data);
+
+/**
+* @brief Second half of jsmnrpc_handle_request: calls the handlers for a request
+*        accepted by jsmnrpc_parse_request() and builds the response.
+*/
+void jsmnrpc_dispatch_request(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data);
+
+/**
+* @brief jsmnrpc_handle_request with a deadline (jsmnrpc_clock_ns(), 0: none) that handlers
+*        see as info->deadline. With JSMNRPC_DEADLINES, calls not started by then, e.g. the
+*        rest of a long batch, are answered with a "Request timeout" error (-32001) instead
+*        of running.
+*/
+void jsmnrpc_handle_request_until(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, uint64_t deadline);
+
+/**
+* @brief jsmnrpc_dispatch_request with a deadline (see jsmnrpc_handle_request_until), e.g.
+*        taken when the request was received, so that time spent queued counts against it.
+*/
+void jsmnrpc_dispatch_request_until(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, uint64_t deadline);
+
+/**
+* @brief jsmnrpc_dispatch_request_until for a request the client may cancel (see
+*        jsmnrpc_pipeline.h): once '*cancelled' is non-zero, calls not started yet are
+*        answered with a "Request cancelled" error (-32800), and running handlers can
+*        notice with jsmnrpc_request_cancelled().
+*/
+void jsmnrpc_dispatch_request_cancellable(jsmnrpc_instance_t* self, jsmnrpc_data_t* request_data, uint64_t deadline,
+                                          const volatile uint64_t* cancelled);
+
+/**
+* @brief For long-running handlers: true once the request was cancelled (one load).
+*        The handler should then give up, e.g. with
+*        jsmnrpc_create_error(jsmnrpc_err_cancelled, NULL, info).
+*/
+bool jsmnrpc_request_cancelled(const jsmnrpc_request_info_t* info);
+
+/**
+* @brief For long-running handlers: true once info->deadline has passed (one clock read;
+*        always false without a deadline or without JSMNRPC_DEADLINES). The handler should
+*        then give up, e.g. with
+*        jsmnrpc_create_error(jsmnrpc_err_timeout, NULL, info).
+*/
+bool jsmnrpc_request_expired(const jsmnrpc_request_info_t* info);
+
 bool jsmnrpc_create_result_prefix(jsmnrpc_request_info_t* info);
 
 
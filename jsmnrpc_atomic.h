@@ -0,0 +1,59 @@
+/**
+@file    jsmnrpc_atomic.h
+@brief   Minimal atomic helpers shared by the optional jsmnrpc modules.
+         Structures keep plain integer fields, so headers stay usable from C++.
+*/
+#pragma once
+#ifndef _jsmnrpc_atomic_h_
+#define _jsmnrpc_atomic_h_
+
+#include <stdint.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define JSMNRPC_THREAD_LOCAL __declspec(thread)
+#define JSMNRPC_ATOMIC_ADD(ptr, val) _InterlockedExchangeAdd64((volatile __int64*)(ptr), (__int64)(val))
+#define JSMNRPC_ATOMIC_LOAD(ptr) (*(volatile uint64_t*)(ptr))
+#define JSMNRPC_ATOMIC_STORE(ptr, val) (*(volatile uint64_t*)(ptr) = (val))
+#define JSMNRPC_ATOMIC_CAS(ptr, expected, desired) \
+  (_InterlockedCompareExchange64((volatile __int64*)(ptr), (__int64)(desired), (__int64)*(expected)) == (__int64)*(expected))
+#define JSMNRPC_ATOMIC_LOAD_ACQUIRE(ptr) (_ReadWriteBarrier(), *(volatile uint64_t*)(ptr))
+#define JSMNRPC_ATOMIC_STORE_RELEASE(ptr, val) do { _ReadWriteBarrier(); *(volatile uint64_t*)(ptr) = (val); } while (0)
+#define JSMNRPC_ATOMIC_CAS_PTR(ptr, expected, desired) \
+  (_InterlockedCompareExchangePointer((void* volatile*)(ptr), (void*)(desired), (void*)*(expected)) == (void*)*(expected))
+#define JSMNRPC_ATOMIC_LOAD_PTR(ptr) (_ReadWriteBarrier(), *(void* volatile*)(ptr))
+#define JSMNRPC_FENCE_ACQUIRE() _ReadWriteBarrier()
+#define JSMNRPC_FENCE_RELEASE() _ReadWriteBarrier()
+#define JSMNRPC_FENCE_SEQ_CST() __faststorefence()
+#else
+#define JSMNRPC_THREAD_LOCAL __thread
+#define JSMNRPC_ATOMIC_ADD(ptr, val) __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+#define JSMNRPC_ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define JSMNRPC_ATOMIC_STORE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+#define JSMNRPC_ATOMIC_CAS(ptr, expected, desired) \
+  __atomic_compare_exchange_n((ptr), (expected), (desired), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define JSMNRPC_ATOMIC_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define JSMNRPC_ATOMIC_STORE_RELEASE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define JSMNRPC_ATOMIC_CAS_PTR(ptr, expected, desired) \
+  __atomic_compare_exchange_n((ptr), (expected), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define JSMNRPC_ATOMIC_LOAD_PTR(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define JSMNRPC_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define JSMNRPC_FENCE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define JSMNRPC_FENCE_SEQ_CST() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+* @brief Raises *ptr to val if val is greater (relaxed, lock-free).
+*/
+static inline void jsmnrpc_atomic_max(uint64_t* ptr, uint64_t val)
+{
+  uint64_t cur = JSMNRPC_ATOMIC_LOAD(ptr);
+  while (val > cur && !JSMNRPC_ATOMIC_CAS(ptr, &cur, val))
+  {
+#if defined(_MSC_VER) && !defined(__clang__)
+    cur = JSMNRPC_ATOMIC_LOAD(ptr);
+#endif
+  }
+}
+
+#endif /* _jsmnrpc_atomic_h_ */
@@ -0,0 +1,164 @@
+/**
+@file    jsmnrpc_capture.c
+@brief   Optional request capture for jsmnrpc (see jsmnrpc_capture.h).
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "jsmnrpc_atomic.h"
+#include "jsmnrpc_capture.h"
+#include "jsmnrpc_clock.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define CAPTURE_ALIGN 8
+
+static const char capture_padding[CAPTURE_ALIGN] = { 0 };
+
+static size_t capture_padded(size_t length)
+{
+  return (length + CAPTURE_ALIGN - 1) & ~(size_t)(CAPTURE_ALIGN - 1);
+}
+
+static uint64_t capture_realtime_ns(void)
+{
+#if defined(_WIN32)
+  return (uint64_t)time(NULL) * 1000000000u;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+#if defined(_WIN32)
+/* no writev(): records from concurrent threads may interleave, capture from one thread */
+static int capture_append(int fd, const void* header, size_t header_len, const void* data, size_t len, size_t pad)
+{
+  if (_write(fd, header, (unsigned)header_len) != (int)header_len ||
+      _write(fd, data, (unsigned)len) != (int)len ||
+      _write(fd, capture_padding, (unsigned)pad) != (int)pad)
+  {
+    return -1;
+  }
+  return 0;
+}
+#else
+static int capture_append(int fd, const void* header, size_t header_len, const void* data, size_t len, size_t pad)
+{
+  struct iovec iov[3];
+  ssize_t written;
+  iov[0].iov_base = (void*)header;
+  iov[0].iov_len = header_len;
+  iov[1].iov_base = (void*)data;
+  iov[1].iov_len = len;
+  iov[2].iov_base = (void*)capture_padding;
+  iov[2].iov_len = pad;
+  do
+  {
+    written = writev(fd, iov, 3);
+  } while (written < 0 && errno == EINTR);
+  return written == (ssize_t)(header_len + len + pad) ? 0 : -1;
+}
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_capture_open(jsmnrpc_capture_t* self, const char* path)
+{
+  jsmnrpc_capture_header_t header;
+#if defined(_WIN32)
+  self->fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_APPEND | _O_BINARY, 0644);
+#else
+  self->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+#endif
+  if (self->fd < 0)
+  {
+    return -1;
+  }
+  self->start_ns = jsmnrpc_clock_ns();
+  self->records = 0;
+  self->errors = 0;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, JSMNRPC_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = JSMNRPC_CAPTURE_VERSION;
+  header.header_bytes = sizeof(header);
+  header.start_realtime_ns = capture_realtime_ns();
+  if (capture_append(self->fd, &header, sizeof(header), NULL, 0, 0) != 0)
+  {
+    jsmnrpc_capture_close(self);
+    return -1;
+  }
+  return 0;
+}
+
+void jsmnrpc_capture_close(jsmnrpc_capture_t* self)
+{
+  if (self->fd >= 0)
+  {
+#if defined(_WIN32)
+    _close(self->fd);
+#else
+    close(self->fd);
+#endif
+    self->fd = -1;
+  }
+}
+
+void jsmnrpc_capture_write(jsmnrpc_capture_t* self, const char* request, size_t length)
+{
+  jsmnrpc_capture_record_t record;
+  if (self->fd < 0 || length > UINT32_MAX)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->errors, 1);
+    return;
+  }
+  record.timestamp_ns = jsmnrpc_clock_ns() - self->start_ns;
+  record.length = (uint32_t)length;
+  record.reserved = 0;
+  if (capture_append(self->fd, &record, sizeof(record), request, length, capture_padded(length) - length) == 0)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->records, 1);
+  }
+  else
+  {
+    JSMNRPC_ATOMIC_ADD(&self->errors, 1);
+  }
+}
+
+size_t jsmnrpc_capture_first(const char* data, size_t size)
+{
+  const jsmnrpc_capture_header_t* header = (const jsmnrpc_capture_header_t*)data;
+  if (size < sizeof(*header) || memcmp(header->magic, JSMNRPC_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != JSMNRPC_CAPTURE_VERSION || header->header_bytes < sizeof(*header) ||
+      header->header_bytes > size)
+  {
+    return 0;
+  }
+  return header->header_bytes;
+}
+
+const jsmnrpc_capture_record_t* jsmnrpc_capture_next(const char* data, size_t size, size_t* offset)
+{
+  const jsmnrpc_capture_record_t* record;
+  if (*offset + sizeof(*record) > size)
+  {
+    return NULL;
+  }
+  record = (const jsmnrpc_capture_record_t*)(data + *offset);
+  if (record->length > size - *offset - sizeof(*record))
+  {
+    return NULL;
+  }
+  *offset += sizeof(*record) + capture_padded(record->length);
+  return record;
+}
@@ -0,0 +1,86 @@
+/**
+@file    jsmnrpc_capture.h
+@brief   Optional request capture for jsmnrpc (enabled with JSMNRPC_CAPTURE=1).
+         When a capture is attached to an instance, jsmnrpc_handle_request appends
+         every request it receives to a file, before parsing it, so that production
+         traffic can be replayed offline (see bench/replay.c).
+
+         File format (native byte order): a jsmnrpc_capture_header_t, followed by
+         records, each a jsmnrpc_capture_record_t and 'length' bytes of request,
+         padded with zeros to a multiple of 8 bytes. Each record is written with a
+         single writev() on a file opened with O_APPEND, so several threads can
+         share one capture.
+*/
+#pragma once
+#ifndef _jsmnrpc_capture_h_
+#define _jsmnrpc_capture_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSMNRPC_CAPTURE_MAGIC "JRPCCAP1"
+#define JSMNRPC_CAPTURE_VERSION 1
+
+typedef struct jsmnrpc_capture_header
+{
+  char magic[8];             /* JSMNRPC_CAPTURE_MAGIC (not null-terminated) */
+  uint32_t version;
+  uint32_t header_bytes;     /* sizeof(jsmnrpc_capture_header_t), records start here */
+  uint64_t start_realtime_ns; /* wall clock time of the capture start (0 if unknown) */
+} jsmnrpc_capture_header_t;
+
+typedef struct jsmnrpc_capture_record
+{
+  uint64_t timestamp_ns;     /* time since the capture was opened (monotonic) */
+  uint32_t length;           /* request bytes following this header */
+  uint32_t reserved;
+} jsmnrpc_capture_record_t;
+
+/**
+* @brief Capture destination attached to a jsmnrpc_instance_t (see jsmnrpc_set_capture()).
+*/
+typedef struct jsmnrpc_capture
+{
+  int fd;
+  uint64_t start_ns;
+  uint64_t records;          /* records written */
+  uint64_t errors;           /* records lost because the write failed */
+} jsmnrpc_capture_t;
+
+/**
+* @brief Creates (or truncates) a capture file and writes its header.
+* @param self pointer to the jsmnrpc_capture_t object.
+* @param path file to write to.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_capture_open(jsmnrpc_capture_t* self, const char* path);
+
+void jsmnrpc_capture_close(jsmnrpc_capture_t* self);
+
+/**
+* @brief Appends one request record (used by jsmnrpc_handle_request).
+*/
+void jsmnrpc_capture_write(jsmnrpc_capture_t* self, const char* request, size_t length);
+
+/**
+* @brief Validates the header of a capture held in memory (e.g. mmap()ed).
+* @return offset of the first record, or 0 if 'data' is not a capture.
+*/
+size_t jsmnrpc_capture_first(const char* data, size_t size);
+
+/**
+* @brief Returns the record at *offset and advances the offset past it, or NULL
+*        at the end of the capture (a truncated last record is ignored).
+*        The request bytes follow the returned header.
+*/
+const jsmnrpc_capture_record_t* jsmnrpc_capture_next(const char* data, size_t size, size_t* offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_capture_h_ */
@@ -0,0 +1,87 @@
+/**
+@file    jsmnrpc_clock.h
+@brief   Monotonic clock helpers used by the optional jsmnrpc instrumentation and
+         request deadlines (JSMNRPC_DEADLINES), and by the POSIX transports.
+*/
+#pragma once
+#ifndef _jsmnrpc_clock_h_
+#define _jsmnrpc_clock_h_
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Returns monotonic time in nanoseconds (arbitrary epoch).
+*/
+static inline uint64_t jsmnrpc_clock_ns(void)
+{
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (freq.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+* @brief Returns a raw, cheap timestamp (TSC on x86, virtual counter on ARMv8,
+*        jsmnrpc_clock_ns() elsewhere). Only differences between two ticks are meaningful.
+*/
+static inline uint64_t jsmnrpc_clock_ticks(void)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t val;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(val));
+  return val;
+#else
+  return jsmnrpc_clock_ns();
+#endif
+}
+
+/**
+* @brief Measures how many jsmnrpc_clock_ticks() happen per nanosecond.
+*        Spins for about 'calibration_ns'; callers should cache the result.
+*/
+static inline double jsmnrpc_clock_ticks_per_ns(uint64_t calibration_ns)
+{
+  uint64_t start_ns = jsmnrpc_clock_ns();
+  uint64_t start_ticks = jsmnrpc_clock_ticks();
+  uint64_t now_ns;
+  do
+  {
+    now_ns = jsmnrpc_clock_ns();
+  } while (now_ns - start_ns < calibration_ns);
+  return (double)(jsmnrpc_clock_ticks() - start_ticks) / (double)(now_ns - start_ns);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_clock_h_ */
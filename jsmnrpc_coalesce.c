@@ -0,0 +1,192 @@
+/**
+@file    jsmnrpc_coalesce.c
+@brief   Write coalescing for responses produced one at a time (see jsmnrpc_coalesce.h).
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jsmnrpc_clock.h"
+#include "jsmnrpc_coalesce.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+/* drops the pending responses and the backlog after a failed write */
+static int coalesce_fail(jsmnrpc_coalesce_t* self, int error)
+{
+  self->error = error;
+  self->iov_count = 0;
+  self->pending = 0;
+  self->backlog_start = self->backlog_len = 0;
+  errno = error;
+  return -1;
+}
+
+/* copies what a short write left of iov[0, count) behind the backlog */
+static int coalesce_keep(jsmnrpc_coalesce_t* self, const struct iovec* iov, int count)
+{
+  size_t length = 0;
+  int i;
+  if (count > 0 && iov == self->iov)
+  {
+    /* the backlog was not written completely: it stays in place */
+    self->backlog_start = (size_t)((char*)iov->iov_base - self->backlog);
+    iov++;
+    count--;
+  }
+  else
+  {
+    self->backlog_start = self->backlog_len = 0;
+  }
+  for (i = 0; i < count; i++)
+  {
+    length += iov[i].iov_len;
+  }
+  if (length == 0)
+  {
+    return 0;
+  }
+  if (self->backlog_start > 0)
+  {
+    memmove(self->backlog, self->backlog + self->backlog_start, self->backlog_len - self->backlog_start);
+    self->backlog_len -= self->backlog_start;
+    self->backlog_start = 0;
+  }
+  if (self->backlog_cap - self->backlog_len < length)
+  {
+    size_t cap = self->backlog_len + length;
+    char* backlog;
+    if (cap < self->backlog_cap * 2)
+    {
+      cap = self->backlog_cap * 2;
+    }
+    backlog = (char*)realloc(self->backlog, cap);
+    if (backlog == NULL)
+    {
+      return -1;
+    }
+    self->backlog = backlog;
+    self->backlog_cap = cap;
+  }
+  for (i = 0; i < count; i++)
+  {
+    memcpy(self->backlog + self->backlog_len, iov[i].iov_base, iov[i].iov_len);
+    self->backlog_len += iov[i].iov_len;
+  }
+  self->counters.copied += length;
+  return 0;
+}
+
+/* Exported functions ------------------------------------------------------- */
+void jsmnrpc_coalesce_init(jsmnrpc_coalesce_t* self, int fd, size_t max_bytes, uint64_t max_delay_ns)
+{
+  memset(self, 0, sizeof(*self));
+  self->fd = fd;
+  self->max_bytes = max_bytes;
+  self->max_delay_ns = max_delay_ns;
+}
+
+void jsmnrpc_coalesce_close(jsmnrpc_coalesce_t* self)
+{
+  free(self->backlog);
+  self->backlog = NULL;
+  self->backlog_start = self->backlog_len = self->backlog_cap = 0;
+  self->iov_count = 0;
+  self->pending = 0;
+}
+
+int jsmnrpc_coalesce_add(jsmnrpc_coalesce_t* self, const char* data, size_t length)
+{
+  uint64_t now = 0;
+  if (self->error)
+  {
+    errno = self->error;
+    return -1;
+  }
+  if (self->iov_count == JSMNRPC_COALESCE_IOV && jsmnrpc_coalesce_flush(self) != 0)
+  {
+    return -1;
+  }
+  if (self->max_delay_ns)
+  {
+    now = jsmnrpc_clock_ns();
+    if (self->iov_count == 0)
+    {
+      self->t_first = now;
+    }
+  }
+  self->iov[1 + self->iov_count].iov_base = (void*)data;
+  self->iov[1 + self->iov_count].iov_len = length;
+  self->iov_count++;
+  self->pending += length;
+  self->counters.responses++;
+  if ((self->max_bytes && self->pending >= self->max_bytes) ||
+      (self->max_delay_ns && now - self->t_first >= self->max_delay_ns))
+  {
+    return jsmnrpc_coalesce_flush(self);
+  }
+  return 0;
+}
+
+int jsmnrpc_coalesce_flush(jsmnrpc_coalesce_t* self)
+{
+  struct iovec* iov = self->iov;
+  int count = self->iov_count + 1;
+  size_t left;
+  if (self->error)
+  {
+    return coalesce_fail(self, self->error);
+  }
+  iov[0].iov_base = self->backlog + self->backlog_start;
+  iov[0].iov_len = self->backlog_len - self->backlog_start;
+  left = iov[0].iov_len + self->pending;
+  if (iov[0].iov_len == 0)
+  {
+    iov++;
+    count--;
+  }
+  while (left > 0)
+  {
+    ssize_t n = writev(self->fd, iov, count);
+    self->counters.writes++;
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        break;
+      }
+      return coalesce_fail(self, errno);
+    }
+    self->counters.bytes += (uint64_t)n;
+    left -= (size_t)n;
+    while (n > 0)
+    {
+      if ((size_t)n >= iov->iov_len)
+      {
+        n -= (ssize_t)iov->iov_len;
+        iov++;
+        count--;
+      }
+      else
+      {
+        iov->iov_base = (char*)iov->iov_base + n;
+        iov->iov_len -= (size_t)n;
+        n = 0;
+      }
+    }
+  }
+  /* the responses may be reused once this returns: keep what is left of them */
+  if (coalesce_keep(self, iov, left > 0 ? count : 0) != 0)
+  {
+    return coalesce_fail(self, ENOMEM);
+  }
+  self->iov_count = 0;
+  self->pending = 0;
+  return 0;
+}
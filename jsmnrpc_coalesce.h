@@ -0,0 +1,91 @@
+/**
+@file    jsmnrpc_coalesce.h
+@brief   Write coalescing for responses produced one at a time (e.g. by the
+         jsmnrpc_pipeline write stage): responses added to a stream are gathered
+         and written together with a single writev, at the end of an event loop
+         iteration or once a byte or time threshold is reached.
+
+         Responses are referenced, not copied: their buffers must stay valid
+         until the next flush. jsmnrpc_coalesce_flush returns only when it no
+         longer needs them; output a non-blocking descriptor could not take is
+         copied into a backlog, which is written first by the next flush.
+
+         A coalescer belongs to one stream and must only be used by one thread
+         at a time.
+*/
+#pragma once
+#ifndef _jsmnrpc_coalesce_h_
+#define _jsmnrpc_coalesce_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* responses gathered per writev (at most IOV_MAX - 1) */
+#ifndef JSMNRPC_COALESCE_IOV
+#define JSMNRPC_COALESCE_IOV 64
+#endif
+
+typedef struct jsmnrpc_coalesce_counters
+{
+  uint64_t responses;        /* responses added */
+  uint64_t writes;           /* writev calls */
+  uint64_t bytes;            /* bytes written */
+  uint64_t copied;           /* bytes moved to the backlog after a short write */
+} jsmnrpc_coalesce_counters_t;
+
+typedef struct jsmnrpc_coalesce
+{
+  int fd;
+  size_t max_bytes;          /* flush once this much output is pending (0: no limit) */
+  uint64_t max_delay_ns;     /* flush once the oldest pending response waited this long (0: no limit) */
+  struct iovec iov[JSMNRPC_COALESCE_IOV + 1];   /* [0]: the backlog, then pending responses */
+  int iov_count;             /* pending responses */
+  size_t pending;            /* their bytes */
+  uint64_t t_first;          /* when the first of them was added (with max_delay_ns) */
+  char* backlog;             /* unwritten output: [backlog_start, backlog_len) */
+  size_t backlog_start;
+  size_t backlog_len;
+  size_t backlog_cap;
+  int error;                 /* errno of a failed write; later output is dropped */
+  jsmnrpc_coalesce_counters_t counters;
+} jsmnrpc_coalesce_t;
+
+/**
+* @brief Sets up a coalescer for 'fd' (blocking or not).
+* @param max_bytes pending bytes that trigger a flush (0: only explicit flushes and a full iovec).
+* @param max_delay_ns age of the oldest pending response that triggers a flush when
+*        another one is added (0: none).
+*/
+void jsmnrpc_coalesce_init(jsmnrpc_coalesce_t* self, int fd, size_t max_bytes, uint64_t max_delay_ns);
+
+/**
+* @brief Frees the backlog (unwritten output is dropped).
+*/
+void jsmnrpc_coalesce_close(jsmnrpc_coalesce_t* self);
+
+/**
+* @brief Adds a framed response, which must stay valid until the next flush.
+*        Flushes first if the iovec is full, and afterwards if a threshold is reached.
+* @return 0 on success, -1 if writing failed (errno is set; see error).
+*/
+int jsmnrpc_coalesce_add(jsmnrpc_coalesce_t* self, const char* data, size_t length);
+
+/**
+* @brief Writes the backlog and the pending responses, with one writev unless the
+*        descriptor takes less. Output left over on a non-blocking descriptor
+*        (EAGAIN) goes to the backlog; flush again once it is writable.
+* @return 0 on success (check backlog_len - backlog_start for output still
+*         waiting), -1 if writing failed or the backlog could not grow (errno is set).
+*/
+int jsmnrpc_coalesce_flush(jsmnrpc_coalesce_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_coalesce_h_ */
@@ -0,0 +1,500 @@
+/**
+@file    jsmnrpc_conn.c
+@brief   JSON-RPC connection state machine without I/O (see jsmnrpc_conn.h).
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsmnrpc_clock.h"
+#include "jsmnrpc_conn.h"
+#include "jsmnrpc_http.h"
+#include "jsmnrpc_ws.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+static const char conn_response_too_large[] =
+  "{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32603, \"message\": \"Response too large\"}, \"id\": null}";
+
+/* receive buffer needed beyond the largest request */
+static size_t conn_receive_overhead(jsmnrpc_framing_t framing)
+{
+  switch (framing)
+  {
+  case jsmnrpc_framing_http:
+    return JSMNRPC_HTTP_MAX_OVERHEAD;
+  case jsmnrpc_framing_websocket:
+    return JSMNRPC_HTTP_MAX_HEADER + JSMNRPC_WS_MAX_OVERHEAD; /* the handshake, then frame headers */
+  case jsmnrpc_framing_content_length:
+    return JSMNRPC_FRAME_MAX_HEADER;
+  default:
+    return JSMNRPC_FRAME_MAX_PREFIX;
+  }
+}
+
+/* room the send buffer must have before another request is handled */
+static size_t conn_reserve(const jsmnrpc_conn_t* self)
+{
+  return self->max_response + JSMNRPC_FRAME_MAX_PREFIX + JSMNRPC_FRAME_MAX_SUFFIX;
+}
+
+static void conn_handle_request(jsmnrpc_conn_t* self, char* request, size_t length, unsigned flags)
+{
+  jsmnrpc_framing_t framing = self->framer.framing;
+  char* message = self->out + self->out_len + jsmnrpc_frame_prefix_size(framing);
+  size_t response_length;
+
+  self->data.request.data = request;
+  self->data.request.length = length;
+  self->data.response.data = message;
+  self->data.response.capacity = self->max_response;
+  jsmnrpc_handle_request_until(self->rpc, &self->data, self->timeout_ns ? jsmnrpc_clock_ns() + self->timeout_ns : 0);
+  self->requests++;
+
+  response_length = self->data.response.length;
+  if (response_length > self->data.response.capacity)
+  {
+    response_length = sizeof(conn_response_too_large) - 1;
+    memcpy(message, conn_response_too_large, response_length);
+  }
+  if (framing == jsmnrpc_framing_http)
+  {
+    self->out_len += jsmnrpc_http_seal(message, response_length, flags); /* notifications get 204 */
+  }
+  else if (response_length > 0)
+  {
+    self->out_len += jsmnrpc_frame_seal(framing, message, response_length);
+  }
+}
+
+/* appends a reply that is not a response (HTTP 100 Continue or 400, WebSocket close) */
+static void conn_append(jsmnrpc_conn_t* self, const char* reply)
+{
+  size_t length = strlen(reply);
+  memcpy(self->out + self->out_len, reply, length);
+  self->out_len += length;
+}
+
+/* frames the completed responses that are next in writing order into the send buffer */
+static void conn_drain(jsmnrpc_conn_t* self)
+{
+  size_t reserve = conn_reserve(self);
+  while (self->order_count > 0)
+  {
+    unsigned index = self->order[self->order_head];
+    jsmnrpc_conn_slot_t* slot = &self->slots[index];
+    if (!slot->done || (!self->discard && self->out_cap - self->out_len < reserve))
+    {
+      break;
+    }
+    if (!self->discard)
+    {
+      jsmnrpc_framing_t framing = self->framer.framing;
+      char* message = self->out + self->out_len + jsmnrpc_frame_prefix_size(framing);
+      size_t length = slot->length;
+      if (length > self->max_response)
+      {
+        slot->response = conn_response_too_large;
+        length = sizeof(conn_response_too_large) - 1;
+      }
+      memcpy(message, slot->response, length);
+      if (framing == jsmnrpc_framing_http)
+      {
+        self->out_len += jsmnrpc_http_seal(message, length, slot->flags);
+      }
+      else if (length > 0)
+      {
+        self->out_len += jsmnrpc_frame_seal(framing, message, length);
+      }
+      self->requests++;
+    }
+    slot->done = 0;
+    self->release(self, slot->token);
+    self->free_slots[self->num_free++] = index;
+    self->order_head = (self->order_head + 1) % self->max_in_flight;
+    self->order_count--;
+    self->in_flight--;
+  }
+  if (self->in_flight == 0 && self->final_reply && self->out_cap - self->out_len >= reserve)
+  {
+    conn_append(self, self->final_reply);
+    self->final_reply = NULL;
+  }
+}
+
+/* passes a request to the submit callback; -1 if it was refused */
+static int conn_submit(jsmnrpc_conn_t* self, const char* request, size_t length, unsigned flags)
+{
+  unsigned index = self->free_slots[self->num_free - 1];
+  if (self->submit(self, request, length, index) != 0)
+  {
+    return -1;
+  }
+  self->num_free--;
+  self->in_flight++;
+  self->slots[index].flags = flags;
+  self->slots[index].done = 0;
+  if (self->in_order)
+  {
+    self->order[(self->order_head + self->order_count++) % self->max_in_flight] = index;
+  }
+  return 0;
+}
+
+/* handles or submits a framed request, or answers a control frame; -1 if it has to wait */
+static int conn_dispatch(jsmnrpc_conn_t* self, char* request, size_t length, unsigned flags)
+{
+  if (flags & jsmnrpc_frame_control)
+  {
+    if (self->in_flight > 0)
+    {
+      return -1; /* WebSocket replies, a close frame in particular, go after the responses in flight */
+    }
+    self->out_len += jsmnrpc_ws_reply(request, length, flags, self->out + self->out_len);
+    return 0;
+  }
+  if (length == 0 && self->framer.framing != jsmnrpc_framing_http)
+  {
+    return 0;
+  }
+  if (self->submit)
+  {
+    return conn_submit(self, request, length, flags);
+  }
+  conn_handle_request(self, request, length, flags);
+  return 0;
+}
+
+/* an error reply ends the output, after the responses still in flight */
+static void conn_fail(jsmnrpc_conn_t* self, const char* reply)
+{
+  if (self->in_flight > 0)
+  {
+    self->final_reply = reply;
+  }
+  else
+  {
+    conn_append(self, reply);
+  }
+}
+
+/* frames and handles the requests at the start of 'buf' in place, while the send
+   buffer has room for their responses (and, in concurrent mode, a slot is free);
+   returns the number of bytes consumed */
+static size_t conn_consume(jsmnrpc_conn_t* self, char* buf, size_t len)
+{
+  size_t reserve = conn_reserve(self);
+  size_t pos = 0;
+  if (self->held)
+  {
+    if (self->out_cap - self->out_len < reserve ||
+        conn_dispatch(self, buf + self->held_offset, self->held_length, self->held_flags) != 0)
+    {
+      return 0;
+    }
+    self->held = 0;
+    pos = self->held_consumed;
+    if (self->held_flags & jsmnrpc_frame_close)
+    {
+      self->closed = 1;
+      return len;
+    }
+  }
+  while (pos < len && self->out_cap - self->out_len >= reserve &&
+         (self->submit == NULL || self->in_flight < self->max_in_flight))
+  {
+    jsmnrpc_frame_t frame;
+    int http = self->framer.framing == jsmnrpc_framing_http;
+    int r = jsmnrpc_framer_next(&self->framer, buf + pos, len - pos, &frame);
+    char* request;
+    if (r == 0)
+    {
+      /* an interim response must not overtake the responses in flight: asked for again later */
+      const char* reply = http && self->in_flight == 0 ? jsmnrpc_http_continue(&self->framer) : NULL;
+      if (reply)
+      {
+        conn_append(self, reply);
+      }
+      break;
+    }
+    if (r < 0)
+    {
+      self->protocol_errors++;
+      if (http)
+      {
+        conn_fail(self, JSMNRPC_HTTP_BAD_REQUEST);
+      }
+      else if (self->framer.framing == jsmnrpc_framing_websocket)
+      {
+        conn_fail(self, jsmnrpc_ws_error(&self->framer));
+      }
+      self->closed = 1;
+      return len;
+    }
+    request = buf + pos + frame.offset;
+    if (frame.flags & jsmnrpc_frame_control)
+    {
+      /* WebSocket handshake, ping or close: answered by conn_dispatch */
+    }
+    else if (frame.flags & jsmnrpc_frame_chunked)
+    {
+      request = jsmnrpc_http_dechunk(request, &frame.length);
+    }
+    else if (self->framer.framing == jsmnrpc_framing_websocket)
+    {
+      request = jsmnrpc_ws_decode(request, &frame.length, frame.flags);
+    }
+    if (conn_dispatch(self, request, frame.length, frame.flags) != 0)
+    {
+      /* already framed (and decoded in place): kept where it is, for conn_consume to dispatch again */
+      self->held = 1;
+      self->held_offset = (size_t)(request - (buf + pos));
+      self->held_length = frame.length;
+      self->held_consumed = frame.consumed;
+      self->held_flags = frame.flags;
+      break;
+    }
+    pos += frame.consumed;
+    if (frame.flags & jsmnrpc_frame_close)
+    {
+      self->closed = 1; /* requests after "Connection: close" or a close frame are dropped */
+      return len;
+    }
+  }
+  return pos;
+}
+
+/* frames and handles the requests in the receive buffer */
+static void conn_process(jsmnrpc_conn_t* self)
+{
+  self->in_start += conn_consume(self, self->in + self->in_start, self->in_len - self->in_start);
+  if (self->in_start == self->in_len)
+  {
+    self->in_start = self->in_len = 0;
+  }
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_conn_init(jsmnrpc_conn_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_framing_t framing, size_t max_request,
+                      size_t max_response, jsmn_size_t max_tokens)
+{
+  memset(self, 0, sizeof(*self));
+  self->rpc = rpc;
+  self->max_response = max_response;
+  jsmnrpc_framer_init(&self->framer, framing, max_request);
+  self->in_cap = max_request + 2 + conn_receive_overhead(framing);
+  if (self->in_cap < JSMNRPC_CONN_MIN_BUFFER)
+  {
+    self->in_cap = JSMNRPC_CONN_MIN_BUFFER;
+  }
+  self->out_cap = 2 * conn_reserve(self);
+  self->in = (char*)malloc(self->in_cap);
+  self->out = (char*)malloc(self->out_cap);
+  self->data.tokens.data = (jsmntok_t*)malloc(sizeof(jsmntok_t) * max_tokens);
+  self->data.tokens.capacity = max_tokens;
+  if (self->in == NULL || self->out == NULL || self->data.tokens.data == NULL)
+  {
+    jsmnrpc_conn_close(self);
+    return -1;
+  }
+  return 0;
+}
+
+void jsmnrpc_conn_reset(jsmnrpc_conn_t* self)
+{
+  jsmnrpc_framer_init(&self->framer, self->framer.framing, self->framer.max_frame);
+  self->in_start = self->in_len = 0;
+  self->out_start = self->out_len = 0;
+  self->closed = 0;
+  self->held = 0;
+  self->final_reply = NULL;
+  self->discard = 0;
+  self->in_flight = 0;
+  self->order_head = self->order_count = 0;
+  for (self->num_free = 0; self->num_free < self->max_in_flight; self->num_free++)
+  {
+    self->free_slots[self->num_free] = self->num_free;
+  }
+}
+
+void jsmnrpc_conn_close(jsmnrpc_conn_t* self)
+{
+  free(self->in);
+  free(self->out);
+  free(self->data.tokens.data);
+  free(self->slots);
+  free(self->free_slots);
+  free(self->order);
+  self->in = self->out = NULL;
+  self->data.tokens.data = NULL;
+  self->slots = NULL;
+  self->free_slots = self->order = NULL;
+  self->max_in_flight = self->num_free = 0;
+  self->in_start = self->in_len = self->in_cap = 0;
+  self->out_start = self->out_len = self->out_cap = 0;
+}
+
+int jsmnrpc_conn_set_concurrent(jsmnrpc_conn_t* self, unsigned max_in_flight, int in_order,
+                                jsmnrpc_conn_submit_t submit, jsmnrpc_conn_release_t release, void* arg)
+{
+  if (max_in_flight == 0)
+  {
+    max_in_flight = 1;
+  }
+  self->slots = (jsmnrpc_conn_slot_t*)calloc(max_in_flight, sizeof(jsmnrpc_conn_slot_t));
+  self->free_slots = (unsigned*)malloc(max_in_flight * sizeof(unsigned));
+  self->order = (unsigned*)malloc(max_in_flight * sizeof(unsigned));
+  if (self->slots == NULL || self->free_slots == NULL || self->order == NULL)
+  {
+    jsmnrpc_conn_close(self);
+    return -1;
+  }
+  self->submit = submit;
+  self->release = release;
+  self->arg = arg;
+  self->in_order = in_order || self->framer.framing == jsmnrpc_framing_http; /* HTTP/1.1 answers in order */
+  self->max_in_flight = max_in_flight;
+  jsmnrpc_conn_reset(self);
+  return 0;
+}
+
+void jsmnrpc_conn_complete(jsmnrpc_conn_t* self, uint64_t tag, const char* response, size_t length, void* token)
+{
+  jsmnrpc_conn_slot_t* slot = &self->slots[tag];
+  slot->response = response;
+  slot->length = length;
+  slot->token = token;
+  slot->done = 1;
+  if (!self->in_order)
+  {
+    self->order[(self->order_head + self->order_count++) % self->max_in_flight] = (unsigned)tag;
+  }
+  conn_drain(self);
+  if (self->in_start < self->in_len)
+  {
+    conn_process(self); /* requests that were waiting for a slot */
+  }
+}
+
+void jsmnrpc_conn_resume(jsmnrpc_conn_t* self)
+{
+  if (self->in_start < self->in_len)
+  {
+    conn_process(self);
+  }
+}
+
+void jsmnrpc_conn_abort(jsmnrpc_conn_t* self)
+{
+  self->closed = 1;
+  self->discard = 1;
+  self->held = 0;
+  self->final_reply = NULL;
+  self->in_start = self->in_len = 0;
+  self->out_start = self->out_len = 0;
+  if (self->in_flight > 0)
+  {
+    conn_drain(self); /* responses that were waiting for room */
+  }
+}
+
+size_t jsmnrpc_conn_feed(jsmnrpc_conn_t* self, char* data, size_t length)
+{
+  size_t used = 0;
+  size_t room;
+  if (self->closed)
+  {
+    return length;
+  }
+  if (self->in_start == self->in_len)
+  {
+    /* the common case: requests are framed and handled in the caller's buffer */
+    used = conn_consume(self, data, length);
+    if (used == length)
+    {
+      return length;
+    }
+  }
+  if (self->in_start > 0)
+  {
+    memmove(self->in, self->in + self->in_start, self->in_len - self->in_start);
+    self->in_len -= self->in_start;
+    self->in_start = 0;
+  }
+  room = self->in_cap - self->in_len;
+  if (room > length - used)
+  {
+    room = length - used;
+  }
+  memcpy(self->in + self->in_len, data + used, room);
+  self->in_len += room;
+  conn_process(self);
+  return used + room;
+}
+
+char* jsmnrpc_conn_input_buffer(jsmnrpc_conn_t* self, size_t* room)
+{
+  if (self->in_start > 0 && self->in_cap - self->in_len < self->in_cap / 4)
+  {
+    memmove(self->in, self->in + self->in_start, self->in_len - self->in_start);
+    self->in_len -= self->in_start;
+    self->in_start = 0;
+  }
+  *room = self->in_cap - self->in_len;
+  return self->in + self->in_len;
+}
+
+void jsmnrpc_conn_input_done(jsmnrpc_conn_t* self, size_t length)
+{
+  self->in_len += length;
+  conn_process(self);
+}
+
+void jsmnrpc_conn_eof(jsmnrpc_conn_t* self)
+{
+  self->closed = 1;
+}
+
+const char* jsmnrpc_conn_next_output(jsmnrpc_conn_t* self, size_t* length)
+{
+  *length = self->out_len - self->out_start;
+  return *length > 0 ? self->out + self->out_start : NULL;
+}
+
+void jsmnrpc_conn_output_done(jsmnrpc_conn_t* self, size_t length)
+{
+  self->out_start += length;
+  if (self->out_start == self->out_len)
+  {
+    self->out_start = self->out_len = 0;
+  }
+  else if (self->out_cap - self->out_len < conn_reserve(self))
+  {
+    memmove(self->out, self->out + self->out_start, self->out_len - self->out_start);
+    self->out_len -= self->out_start;
+    self->out_start = 0;
+  }
+  if (self->in_flight > 0 || self->final_reply)
+  {
+    conn_drain(self); /* completed responses that were waiting for room */
+  }
+  if (self->in_start < self->in_len)
+  {
+    conn_process(self); /* requests held back while the send buffer was full */
+  }
+}
+
+int jsmnrpc_conn_wants_input(const jsmnrpc_conn_t* self)
+{
+  /* a full receive buffer with consumed bytes in front is compacted by jsmnrpc_conn_input_buffer */
+  return !self->closed && !self->held && (self->in_start > 0 || self->in_len < self->in_cap) &&
+         self->out_cap - self->out_len >= conn_reserve(self) &&
+         (self->submit == NULL || self->in_flight < self->max_in_flight);
+}
+
+int jsmnrpc_conn_finished(const jsmnrpc_conn_t* self)
+{
+  /* what is left of the input is incomplete */
+  return self->closed && !self->held && self->in_flight == 0 && self->final_reply == NULL &&
+         self->out_start == self->out_len;
+}
@@ -0,0 +1,234 @@
+/**
+@file    jsmnrpc_conn.h
+@brief   JSON-RPC connection state machine without I/O, for embedding in an
+         existing event loop. The loop passes the bytes it receives in and
+         writes out the bytes the connection hands back; the connection frames
+         the requests, calls jsmnrpc_handle_request and frames the responses.
+         jsmnrpc_server runs its connections through it.
+
+         Requests are handled in place, either in the caller's buffer
+         (jsmnrpc_conn_feed) or in the receive buffer the loop reads into
+         (jsmnrpc_conn_input_buffer). Only an incomplete request left at the end
+         of a fed buffer is copied. Responses are built in the send buffer and
+         framed there, and pending output comes back as a single contiguous
+         block (jsmnrpc_conn_next_output).
+
+         When the send buffer has no room for another response, requests stay
+         buffered until the loop reports output as written; jsmnrpc_conn_wants_input
+         tells when to stop reading from the peer.
+
+         In concurrent mode (jsmnrpc_conn_set_concurrent) requests are not handled
+         by the caller: each framed request is passed to a submit callback, e.g.
+         to queue it for worker threads, and framing goes on with the next one
+         while it runs. Up to max_in_flight requests of the connection are in
+         flight at a time. The loop hands every response back with
+         jsmnrpc_conn_complete; responses are written as they complete (JSON-RPC
+         ids let clients match them), or in request order with in_order (always
+         with HTTP). A request the submit callback refuses is kept, and submitted
+         again by jsmnrpc_conn_resume or once a response completes.
+
+         A typical readiness-based loop:
+
+           buf = jsmnrpc_conn_input_buffer(&conn, &room);
+           n = read(fd, buf, room);      (0: jsmnrpc_conn_eof)
+           jsmnrpc_conn_input_done(&conn, n);
+           while ((out = jsmnrpc_conn_next_output(&conn, &length)) != NULL
+                  && (n = write(fd, out, length)) > 0)
+             jsmnrpc_conn_output_done(&conn, n);
+           if (jsmnrpc_conn_finished(&conn)) close the connection
+*/
+#pragma once
+#ifndef _jsmnrpc_conn_h_
+#define _jsmnrpc_conn_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsmnrpc.h"
+#include "jsmnrpc_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* smallest receive buffer */
+#ifndef JSMNRPC_CONN_MIN_BUFFER
+#define JSMNRPC_CONN_MIN_BUFFER (64 << 10)
+#endif
+
+typedef struct jsmnrpc_conn jsmnrpc_conn_t;
+
+/**
+* @brief Concurrent mode: takes a framed request (which is only valid during the
+*        call) and returns 0 once it is queued, or -1 to submit it again later.
+*        Its response is handed back with jsmnrpc_conn_complete(..., tag, ...),
+*        which must not be called from the callback itself.
+*/
+typedef int (*jsmnrpc_conn_submit_t)(jsmnrpc_conn_t* conn, const char* request, size_t length, uint64_t tag);
+
+/**
+* @brief Concurrent mode: the response passed with 'token' to jsmnrpc_conn_complete
+*        was copied to the send buffer (or discarded) and may be reused.
+*/
+typedef void (*jsmnrpc_conn_release_t)(jsmnrpc_conn_t* conn, void* token);
+
+/**
+* @brief A request in flight (concurrent mode).
+*/
+typedef struct jsmnrpc_conn_slot
+{
+  const char* response;      /* set by jsmnrpc_conn_complete */
+  size_t length;
+  void* token;
+  unsigned flags;            /* framing flags of the request (HTTP: keep-alive) */
+  int done;                  /* the response is waiting for its turn or for room */
+} jsmnrpc_conn_slot_t;
+
+struct jsmnrpc_conn
+{
+  jsmnrpc_instance_t* rpc;
+  jsmnrpc_framer_t framer;
+  size_t max_response;       /* larger responses become an error */
+  char* in;                  /* received bytes: [in_start, in_len) not yet framed */
+  size_t in_start;
+  size_t in_len;
+  size_t in_cap;
+  char* out;                 /* framed responses: [out_start, out_len) not yet written */
+  size_t out_start;
+  size_t out_len;
+  size_t out_cap;
+  jsmnrpc_data_t data;       /* tokens and arg passed to the handlers */
+  uint64_t timeout_ns;       /* deadline of a request handled inline, from when it is handled, e.g. to cut
+                                long batches short (0: none; see jsmnrpc_handle_request_until) */
+  int closed;                /* no further input is taken (end of stream, close request or malformed framing) */
+  uint64_t requests;         /* framed requests handled */
+  uint64_t protocol_errors;  /* malformed framing (the connection is then closed) */
+
+  /* concurrent mode (jsmnrpc_conn_set_concurrent) */
+  jsmnrpc_conn_submit_t submit;
+  jsmnrpc_conn_release_t release;
+  void* arg;                 /* for the callbacks */
+  int in_order;              /* responses are written in request order */
+  unsigned max_in_flight;
+  unsigned in_flight;        /* submitted requests whose response was not written yet */
+  jsmnrpc_conn_slot_t* slots;           /* [max_in_flight], indexed by tag */
+  unsigned* free_slots;      /* stack of unused slot indices */
+  unsigned num_free;
+  unsigned* order;           /* ring of slot indices in writing order (in_order: as submitted, else as completed) */
+  unsigned order_head;
+  unsigned order_count;
+  int held;                  /* a framed request waits at in_start: refused by submit, or a control frame */
+  size_t held_offset;        /* its request or payload, from in_start */
+  size_t held_length;
+  size_t held_consumed;
+  unsigned held_flags;
+  const char* final_reply;   /* appended once the requests in flight are written (HTTP 400, WebSocket close) */
+  int discard;               /* aborted: responses still completing are dropped */
+};
+
+/**
+* @brief Allocates the buffers of a connection.
+* @param rpc instance whose handlers serve the requests.
+* @param max_request largest request accepted (bytes, without framing).
+* @param max_response largest response produced (at least 160).
+* @param max_tokens tokens available to parse one request.
+* @return 0 on success, -1 if out of memory.
+*/
+int jsmnrpc_conn_init(jsmnrpc_conn_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_framing_t framing, size_t max_request,
+                      size_t max_response, jsmn_size_t max_tokens);
+
+/**
+* @brief Prepares the connection for a new stream, keeping its buffers (and data.arg, timeout_ns).
+*/
+void jsmnrpc_conn_reset(jsmnrpc_conn_t* self);
+
+/**
+* @brief Frees the buffers.
+*/
+void jsmnrpc_conn_close(jsmnrpc_conn_t* self);
+
+/**
+* @brief Switches to concurrent mode: requests go to 'submit' instead of being
+*        handled by the caller (see above). Call after jsmnrpc_conn_init.
+* @param max_in_flight requests of the connection in flight at most (at least 1).
+* @param in_order write the responses in request order (forced with HTTP).
+* @param arg stored in self->arg for the callbacks.
+* @return 0 on success, -1 if out of memory.
+*/
+int jsmnrpc_conn_set_concurrent(jsmnrpc_conn_t* self, unsigned max_in_flight, int in_order,
+                                jsmnrpc_conn_submit_t submit, jsmnrpc_conn_release_t release, void* arg);
+
+/**
+* @brief Concurrent mode: hands back the response of the request submitted with
+*        'tag' (empty for notifications). It must stay valid until 'release' is
+*        called with 'token'. Writable responses are framed into the send buffer,
+*        then requests that were waiting for a slot are submitted.
+*/
+void jsmnrpc_conn_complete(jsmnrpc_conn_t* self, uint64_t tag, const char* response, size_t length, void* token);
+
+/**
+* @brief Concurrent mode: submits buffered requests again after the submit
+*        callback refused one (e.g. once the workers have room).
+*/
+void jsmnrpc_conn_resume(jsmnrpc_conn_t* self);
+
+/**
+* @brief Drops buffered input and pending output and closes the connection; the
+*        responses of requests still in flight are released as they complete.
+*/
+void jsmnrpc_conn_abort(jsmnrpc_conn_t* self);
+
+/**
+* @brief Handles the requests in 'data' in place (the buffer is modified), and
+*        copies what is left into the receive buffer as far as it fits. Once the
+*        connection is closed, input is dropped.
+* @return number of bytes taken; the caller passes the rest again after output
+*         has been written.
+*/
+size_t jsmnrpc_conn_feed(jsmnrpc_conn_t* self, char* data, size_t length);
+
+/**
+* @brief Free space at the end of the receive buffer, to read into directly.
+* @param room set to its size (0 while the buffer is full).
+*/
+char* jsmnrpc_conn_input_buffer(jsmnrpc_conn_t* self, size_t* room);
+
+/**
+* @brief Handles the requests after 'length' bytes were read into jsmnrpc_conn_input_buffer().
+*/
+void jsmnrpc_conn_input_done(jsmnrpc_conn_t* self, size_t length);
+
+/**
+* @brief Marks the end of the input stream (buffered requests are still handled).
+*/
+void jsmnrpc_conn_eof(jsmnrpc_conn_t* self);
+
+/**
+* @brief Output waiting to be written.
+* @param length set to its length.
+* @return the output, or NULL if there is none.
+*/
+const char* jsmnrpc_conn_next_output(jsmnrpc_conn_t* self, size_t* length);
+
+/**
+* @brief Drops 'length' written bytes from the output, and handles the requests
+*        that were waiting for room in the send buffer.
+*/
+void jsmnrpc_conn_output_done(jsmnrpc_conn_t* self, size_t length);
+
+/**
+* @brief Whether more input can be taken now (reading may pause while it cannot).
+*/
+int jsmnrpc_conn_wants_input(const jsmnrpc_conn_t* self);
+
+/**
+* @brief Whether the connection is closed, has no request in flight and all its
+*        output was written.
+*/
+int jsmnrpc_conn_finished(const jsmnrpc_conn_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_conn_h_ */
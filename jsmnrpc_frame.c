@@ -0,0 +1,323 @@
+/**
+@file    jsmnrpc_frame.c
+@brief   Message framing for stream transports (see jsmnrpc_frame.h).
+*/
+
+#include <string.h>
+#include <strings.h>
+
+#include "jsmnrpc_frame.h"
+#include "jsmnrpc_http.h"
+#include "jsmnrpc_ws.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define FRAME_CONTENT_LENGTH_PREFIX 30   /* "Content-Length:", 11 columns for the value, "\r\n\r\n" */
+
+static void framer_reset(jsmnrpc_framer_t* self)
+{
+  self->scanned = 0;
+  self->depth = 0;
+  self->in_string = 0;
+  self->escape = 0;
+  self->http_flags = 0;
+  self->header_length = 0;
+  self->content_length = 0;
+  self->chunk_pos = 0;
+}
+
+static int frame_newline(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  const char* nl = (const char*)memchr(buf + self->scanned, '\n', len - self->scanned);
+  size_t length;
+  if (nl == NULL)
+  {
+    self->scanned = len;
+    return len > self->max_frame ? -1 : 0;
+  }
+  length = (size_t)(nl - buf);
+  frame->offset = 0;
+  frame->consumed = length + 1;
+  if (length > 0 && buf[length - 1] == '\r')
+  {
+    length--;
+  }
+  frame->length = length;
+  return length > self->max_frame ? -1 : 1;
+}
+
+static int frame_length_prefix(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  const unsigned char* p = (const unsigned char*)buf;
+  size_t length;
+  if (len < 4)
+  {
+    return 0;
+  }
+  length = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | (size_t)p[3];
+  if (length > self->max_frame)
+  {
+    return -1;
+  }
+  if (len - 4 < length)
+  {
+    return 0;
+  }
+  frame->offset = 4;
+  frame->length = length;
+  frame->consumed = 4 + length;
+  return 1;
+}
+
+static int frame_raw(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  size_t i = self->scanned;
+  size_t start;
+
+  /* whitespace between messages is dropped with the next message */
+  for (start = 0; start < len && (buf[start] == ' ' || buf[start] == '\t' || buf[start] == '\r' || buf[start] == '\n');
+       start++)
+  {
+  }
+  if (i < start)
+  {
+    i = start;
+  }
+  for (; i < len; i++)
+  {
+    char c = buf[i];
+    if (self->in_string)
+    {
+      if (self->escape)
+      {
+        self->escape = 0;
+      }
+      else if (c == '\\')
+      {
+        self->escape = 1;
+      }
+      else if (c == '"')
+      {
+        self->in_string = 0;
+      }
+      continue;
+    }
+    if (c == '"')
+    {
+      self->in_string = 1;
+    }
+    else if (c == '{' || c == '[')
+    {
+      self->depth++;
+    }
+    else if (c == '}' || c == ']')
+    {
+      if (--self->depth <= 0)
+      {
+        i++;
+        break;
+      }
+    }
+    else if (self->depth == 0 && i > start && (c == ' ' || c == '\t' || c == '\r' || c == '\n'))
+    {
+      break; /* end of a top-level primitive */
+    }
+  }
+  if (self->depth < 0)
+  {
+    return -1; /* unbalanced closing bracket */
+  }
+  if (i == len && (self->depth > 0 || self->in_string || i == start || (buf[start] != '{' && buf[start] != '[')))
+  {
+    /* incomplete (a top-level primitive is only complete once whitespace follows) */
+    self->scanned = len;
+    return len - start > self->max_frame ? -1 : 0;
+  }
+  frame->offset = start;
+  frame->length = i - start;
+  frame->consumed = i;
+  return frame->length > self->max_frame ? -1 : 1;
+}
+
+/* "Content-Length: n\r\n" (other header fields are ignored), "\r\n", then n bytes */
+static int frame_content_length(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  if (self->header_length == 0)
+  {
+    size_t i = self->scanned > 3 ? self->scanned - 3 : 0;
+    const char* line;
+    const char* eol;
+    int have_length = 0;
+    for (;;)
+    {
+      const char* nl = (const char*)memchr(buf + i, '\n', len - i);
+      if (nl == NULL)
+      {
+        self->scanned = len;
+        return len > JSMNRPC_FRAME_MAX_HEADER ? -1 : 0;
+      }
+      i = (size_t)(nl - buf) + 1;
+      if (i >= 4 && memcmp(nl - 3, "\r\n\r\n", 4) == 0)
+      {
+        break;
+      }
+    }
+    if (i > JSMNRPC_FRAME_MAX_HEADER)
+    {
+      return -1;
+    }
+    for (line = buf; line < buf + i - 2; line = eol + 1)
+    {
+      eol = (const char*)memchr(line, '\n', (size_t)(buf + i - line));
+      if (eol - line > 15 && strncasecmp(line, "content-length:", 15) == 0)
+      {
+        const char* p = line + 15;
+        size_t length = 0;
+        while (*p == ' ' || *p == '\t')
+        {
+          p++;
+        }
+        if (*p < '0' || *p > '9')
+        {
+          return -1;
+        }
+        for (; *p >= '0' && *p <= '9'; p++)
+        {
+          length = length * 10 + (size_t)(*p - '0');
+          if (length > self->max_frame)
+          {
+            return -1;
+          }
+        }
+        while (*p == ' ' || *p == '\t')
+        {
+          p++;
+        }
+        if (*p != '\r')
+        {
+          return -1;
+        }
+        self->content_length = length;
+        have_length = 1;
+      }
+    }
+    if (!have_length)
+    {
+      return -1;
+    }
+    self->header_length = i;
+  }
+  if (len - self->header_length < self->content_length)
+  {
+    return 0;
+  }
+  frame->offset = self->header_length;
+  frame->length = self->content_length;
+  frame->consumed = self->header_length + self->content_length;
+  return 1;
+}
+
+/* writes the header in front of 'message'; the value is right aligned after spaces (OWS) */
+static size_t seal_content_length(char* message, size_t length)
+{
+  char* digit = message - 4;
+  memcpy(message - FRAME_CONTENT_LENGTH_PREFIX, "Content-Length:", 15);
+  memcpy(message - 4, "\r\n\r\n", 4);
+  do
+  {
+    *--digit = (char)('0' + length % 10);
+    length /= 10;
+  } while (length > 0);
+  while (digit > message - FRAME_CONTENT_LENGTH_PREFIX + 15)
+  {
+    *--digit = ' ';
+  }
+  return FRAME_CONTENT_LENGTH_PREFIX;
+}
+
+/* Exported functions ------------------------------------------------------- */
+void jsmnrpc_framer_init(jsmnrpc_framer_t* self, jsmnrpc_framing_t framing, size_t max_frame)
+{
+  self->framing = framing;
+  self->max_frame = max_frame;
+  self->ws_open = 0;
+  self->ws_pos = 0;
+  self->ws_length = 0;
+  framer_reset(self);
+}
+
+int jsmnrpc_framer_next(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  int result;
+  frame->flags = 0;
+  switch (self->framing)
+  {
+  case jsmnrpc_framing_newline:
+    result = frame_newline(self, buf, len, frame);
+    break;
+  case jsmnrpc_framing_length_prefix:
+    result = frame_length_prefix(self, buf, len, frame);
+    break;
+  case jsmnrpc_framing_http:
+    result = jsmnrpc_http_next(self, buf, len, frame);
+    break;
+  case jsmnrpc_framing_websocket:
+    result = jsmnrpc_ws_next(self, buf, len, frame);
+    break;
+  case jsmnrpc_framing_content_length:
+    result = frame_content_length(self, buf, len, frame);
+    break;
+  default:
+    result = frame_raw(self, buf, len, frame);
+    break;
+  }
+  if (result != 0)
+  {
+    framer_reset(self);
+  }
+  return result;
+}
+
+size_t jsmnrpc_frame_prefix_size(jsmnrpc_framing_t framing)
+{
+  switch (framing)
+  {
+  case jsmnrpc_framing_length_prefix:
+    return 4;
+  case jsmnrpc_framing_http:
+    return JSMNRPC_HTTP_PREFIX;
+  case jsmnrpc_framing_websocket:
+    return JSMNRPC_WS_PREFIX;
+  case jsmnrpc_framing_content_length:
+    return FRAME_CONTENT_LENGTH_PREFIX;
+  default:
+    return 0;
+  }
+}
+
+size_t jsmnrpc_frame_seal(jsmnrpc_framing_t framing, char* message, size_t length)
+{
+  if (framing == jsmnrpc_framing_length_prefix)
+  {
+    unsigned char* p = (unsigned char*)message - 4;
+    p[0] = (unsigned char)(length >> 24);
+    p[1] = (unsigned char)(length >> 16);
+    p[2] = (unsigned char)(length >> 8);
+    p[3] = (unsigned char)length;
+    return length + 4;
+  }
+  if (framing == jsmnrpc_framing_http)
+  {
+    return jsmnrpc_http_seal(message, length, 0);
+  }
+  if (framing == jsmnrpc_framing_websocket)
+  {
+    return jsmnrpc_ws_seal(message, length);
+  }
+  if (framing == jsmnrpc_framing_content_length)
+  {
+    return seal_content_length(message, length) + length;
+  }
+  message[length] = '\n';
+  return length + 1;
+}
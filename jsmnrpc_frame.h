@@ -0,0 +1,111 @@
+/**
+@file    jsmnrpc_frame.h
+@brief   Message framing for stream transports (sockets, pipes) carrying JSON-RPC.
+         The framer finds complete requests in a receive buffer without copying
+         them, so they can be passed to jsmnrpc_handle_request in place. It is
+         resumable: when a read ends in the middle of a message, the bytes already
+         scanned are not scanned again once more data arrives.
+*/
+#pragma once
+#ifndef _jsmnrpc_frame_h_
+#define _jsmnrpc_frame_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum jsmnrpc_framing
+{
+  jsmnrpc_framing_newline = 0,       /* one message per line (compact JSON) */
+  jsmnrpc_framing_length_prefix,     /* 4-byte big-endian length, then the message */
+  jsmnrpc_framing_raw,               /* concatenated JSON values, delimited by their brackets */
+  jsmnrpc_framing_http,              /* HTTP/1.1 POST requests and responses (jsmnrpc_http.h) */
+  jsmnrpc_framing_websocket,         /* WebSocket messages after an HTTP upgrade (jsmnrpc_ws.h) */
+  jsmnrpc_framing_content_length,    /* "Content-Length: n" header, empty line, message (LSP style) */
+} jsmnrpc_framing_t;
+
+/* bytes reserved in front of / behind each outgoing message */
+#define JSMNRPC_FRAME_MAX_PREFIX 104
+#define JSMNRPC_FRAME_MAX_SUFFIX 6
+
+/* content-length framing: longest header accepted */
+#define JSMNRPC_FRAME_MAX_HEADER 1024
+
+typedef enum jsmnrpc_frame_flags
+{
+  jsmnrpc_frame_close = 0x01,        /* http: close the connection after the response */
+  jsmnrpc_frame_chunked = 0x02,      /* http: the body is chunk-encoded (see jsmnrpc_http_dechunk) */
+  jsmnrpc_frame_control = 0x04,      /* websocket: not a request, answer with jsmnrpc_ws_reply */
+  jsmnrpc_frame_upgrade = 0x08,      /* websocket: the handshake (with jsmnrpc_frame_control) */
+  jsmnrpc_frame_fragmented = 0x10,   /* websocket: a message in several frames (see jsmnrpc_ws_decode) */
+} jsmnrpc_frame_flags_t;
+
+/**
+* @brief Framer state for one direction of one connection.
+*/
+typedef struct jsmnrpc_framer
+{
+  jsmnrpc_framing_t framing;
+  size_t max_frame;          /* longer messages are rejected */
+  size_t scanned;            /* bytes of the current message already scanned */
+  int depth;                 /* raw framing: bracket nesting */
+  uint8_t in_string;         /* raw framing: inside a string */
+  uint8_t escape;            /* raw framing: previous character was a backslash */
+  uint8_t http_flags;        /* http framing: jsmnrpc_frame_flags_t and Expect state of the request */
+  size_t header_length;      /* http, content-length framing: header bytes, 0 until complete */
+  size_t content_length;     /* http, content-length framing: body bytes (chunked: decoded so far) */
+  size_t chunk_pos;          /* http framing: next chunk-size line */
+  uint8_t ws_open;           /* websocket framing: the handshake is done */
+  size_t ws_pos;             /* websocket framing: next frame of a fragmented message, 0 if none */
+  size_t ws_length;          /* websocket framing: payload bytes of that message so far */
+} jsmnrpc_framer_t;
+
+/**
+* @brief Location of a complete message within the buffer passed to jsmnrpc_framer_next().
+*/
+typedef struct jsmnrpc_frame
+{
+  size_t offset;             /* first byte of the message */
+  size_t length;             /* message bytes (0 for an empty line or message) */
+  size_t consumed;           /* bytes to drop from the buffer, framing included */
+  unsigned flags;            /* jsmnrpc_frame_flags_t */
+} jsmnrpc_frame_t;
+
+/**
+* @brief initialise a framer.
+* @param self pointer to the jsmnrpc_framer_t object.
+* @param framing one of jsmnrpc_framing_t.
+* @param max_frame maximum message length accepted.
+*/
+void jsmnrpc_framer_init(jsmnrpc_framer_t* self, jsmnrpc_framing_t framing, size_t max_frame);
+
+/**
+* @brief Looks for a complete message at the start of 'buf'. Between calls the
+*        buffer may grow or move, but it must keep starting at the same message
+*        until that message is returned (and its 'consumed' bytes dropped).
+* @return 1 if a message was found (see 'frame'), 0 if more data is needed,
+*         -1 if the stream is malformed or the message is longer than max_frame.
+*/
+int jsmnrpc_framer_next(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame);
+
+/**
+* @brief Number of bytes to reserve in front of an outgoing message.
+*/
+size_t jsmnrpc_frame_prefix_size(jsmnrpc_framing_t framing);
+
+/**
+* @brief Frames an outgoing message in place: writes the prefix into the
+*        jsmnrpc_frame_prefix_size() bytes reserved in front of 'message' and
+*        the suffix (at most JSMNRPC_FRAME_MAX_SUFFIX bytes) behind it.
+* @return total size of the framed message, starting at the reserved prefix.
+*/
+size_t jsmnrpc_frame_seal(jsmnrpc_framing_t framing, char* message, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_frame_h_ */
@@ -0,0 +1,357 @@
+/**
+@file    jsmnrpc_http.c
+@brief   HTTP/1.1 framing for JSON-RPC over POST (see jsmnrpc_http.h).
+*/
+
+#include <string.h>
+#include <strings.h>
+
+#include "jsmnrpc_http.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+/* framer->http_flags beyond jsmnrpc_frame_flags_t */
+#define HTTP_EXPECT_CONTINUE 0x10    /* the client waits for 100 Continue before sending the body */
+#define HTTP_CONTINUE_SENT 0x20
+
+#define HTTP_LENGTH_WIDTH 11         /* Content-Length value, right aligned after spaces (OWS) */
+
+static const char http_ok_keep_alive[] =
+  "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length:";
+static const char http_ok_close[] =
+  "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close     \r\nContent-Length:";
+static const char http_no_content_keep_alive[] = "HTTP/1.1 204 No Content\r\nConnection: keep-alive\r\n\r\n";
+static const char http_no_content_close[] = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+
+/* whether a header field name (not zero terminated) is 'name', ignoring case */
+static int http_field_is(const char* line, size_t name_length, const char* name)
+{
+  return strlen(name) == name_length && strncasecmp(line, name, name_length) == 0;
+}
+
+/* whether the comma separated field value contains 'token' (case-insensitive) */
+static int http_has_token(const char* value, size_t length, const char* token)
+{
+  size_t token_length = strlen(token);
+  size_t i = 0;
+  while (i < length)
+  {
+    size_t start, end;
+    while (i < length && (value[i] == ' ' || value[i] == '\t' || value[i] == ','))
+    {
+      i++;
+    }
+    start = i;
+    while (i < length && value[i] != ',')
+    {
+      i++;
+    }
+    end = i;
+    while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t'))
+    {
+      end--;
+    }
+    if (end - start == token_length && strncasecmp(value + start, token, token_length) == 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* parses the request line and header fields of buf[start, end), end being just past the empty line */
+static int http_parse_header(jsmnrpc_framer_t* self, const char* buf, size_t start, size_t end)
+{
+  const char* line = buf + start;
+  const char* eol = (const char*)memchr(line, '\n', end - start);
+  int have_length = 0;
+  size_t length = 0;
+
+  /* request line: POST <target> HTTP/1.x */
+  if (eol == NULL || eol - line < 15 || memcmp(line, "POST ", 5) != 0 || memcmp(eol - 10, " HTTP/1.", 8) != 0 ||
+      eol[-1] != '\r' || (eol[-2] != '0' && eol[-2] != '1'))
+  {
+    return -1;
+  }
+  self->http_flags = eol[-2] == '0' ? jsmnrpc_frame_close : 0;
+
+  for (line = eol + 1; line < buf + end - 2; line = eol + 1)
+  {
+    const char* colon;
+    const char* value;
+    size_t value_length;
+    eol = (const char*)memchr(line, '\n', (size_t)(buf + end - line));
+    colon = (const char*)memchr(line, ':', (size_t)(eol - line));
+    if (colon == NULL || eol[-1] != '\r')
+    {
+      return -1;
+    }
+    value = colon + 1;
+    while (value < eol && (*value == ' ' || *value == '\t'))
+    {
+      value++;
+    }
+    value_length = (size_t)(eol - 1 - value);
+    while (value_length > 0 && (value[value_length - 1] == ' ' || value[value_length - 1] == '\t'))
+    {
+      value_length--;
+    }
+    switch (line[0] | 0x20)
+    {
+    case 'c':
+      if (http_field_is(line, (size_t)(colon - line), "content-length"))
+      {
+        size_t i, n = 0;
+        if (value_length == 0 || value_length > 10)
+        {
+          return -1;
+        }
+        for (i = 0; i < value_length; i++)
+        {
+          if (value[i] < '0' || value[i] > '9')
+          {
+            return -1;
+          }
+          n = n * 10 + (size_t)(value[i] - '0');
+        }
+        if (have_length && n != length)
+        {
+          return -1;
+        }
+        have_length = 1;
+        length = n;
+      }
+      else if (http_field_is(line, (size_t)(colon - line), "connection"))
+      {
+        if (http_has_token(value, value_length, "close"))
+        {
+          self->http_flags |= jsmnrpc_frame_close;
+        }
+        else if (http_has_token(value, value_length, "keep-alive"))
+        {
+          self->http_flags &= ~jsmnrpc_frame_close;
+        }
+      }
+      break;
+    case 't':
+      if (http_field_is(line, (size_t)(colon - line), "transfer-encoding"))
+      {
+        if (value_length != 7 || strncasecmp(value, "chunked", 7) != 0)
+        {
+          return -1; /* no other coding is supported */
+        }
+        self->http_flags |= jsmnrpc_frame_chunked;
+      }
+      break;
+    case 'e':
+      if (http_field_is(line, (size_t)(colon - line), "expect"))
+      {
+        if (value_length != 12 || strncasecmp(value, "100-continue", 12) != 0)
+        {
+          return -1;
+        }
+        self->http_flags |= HTTP_EXPECT_CONTINUE;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  if (have_length && (self->http_flags & jsmnrpc_frame_chunked))
+  {
+    return -1; /* ambiguous framing (request smuggling) */
+  }
+  if (length > self->max_frame)
+  {
+    return -1;
+  }
+  self->header_length = end;
+  self->content_length = length;
+  self->chunk_pos = end;
+  return 0;
+}
+
+/* walks the chunks from self->chunk_pos; on success sets the frame (the body is still encoded) */
+static int http_parse_chunks(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  for (;;)
+  {
+    size_t pos = self->chunk_pos;
+    const char* eol = (const char*)memchr(buf + pos, '\n', len - pos);
+    size_t size = 0;
+    size_t i;
+    if (eol == NULL)
+    {
+      return len - pos > 64 ? -1 : 0;
+    }
+    for (i = pos; buf + i < eol && buf[i] != ';' && buf[i] != '\r'; i++)
+    {
+      char c = buf[i] | 0x20;
+      int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+      if (digit < 0 || size > self->max_frame)
+      {
+        return -1;
+      }
+      size = size * 16 + (size_t)digit;
+    }
+    if (i == pos || eol[-1] != '\r')
+    {
+      return -1;
+    }
+    i = (size_t)(eol - buf) + 1;
+    if (size == 0)
+    {
+      /* last chunk: skip the trailer fields up to the empty line */
+      for (;;)
+      {
+        eol = (const char*)memchr(buf + i, '\n', len - i);
+        if (eol == NULL)
+        {
+          return len - pos > JSMNRPC_HTTP_MAX_HEADER ? -1 : 0;
+        }
+        if (eol == buf + i + 1 && buf[i] == '\r')
+        {
+          break;
+        }
+        i = (size_t)(eol - buf) + 1;
+      }
+      frame->offset = self->header_length;
+      frame->length = pos - self->header_length;
+      frame->consumed = (size_t)(eol - buf) + 1;
+      return 1;
+    }
+    if (self->content_length + size > self->max_frame)
+    {
+      return -1;
+    }
+    if (len - i < size + 2)
+    {
+      return len - self->header_length > self->max_frame + JSMNRPC_HTTP_MAX_HEADER ? -1 : 0;
+    }
+    if (buf[i + size] != '\r' || buf[i + size + 1] != '\n')
+    {
+      return -1;
+    }
+    self->content_length += size;
+    self->chunk_pos = i + size + 2;
+  }
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_http_next(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  int result;
+  if (self->header_length == 0)
+  {
+    size_t start = 0;
+    size_t i;
+    /* empty lines between requests are ignored (RFC 9112, 2.2) */
+    while (start < len && (buf[start] == '\r' || buf[start] == '\n'))
+    {
+      start++;
+    }
+    i = self->scanned > start + 3 ? self->scanned - 3 : start;
+    for (;;)
+    {
+      const char* nl = (const char*)memchr(buf + i, '\n', len - i);
+      if (nl == NULL)
+      {
+        self->scanned = len;
+        return len - start > JSMNRPC_HTTP_MAX_HEADER ? -1 : 0;
+      }
+      i = (size_t)(nl - buf) + 1;
+      if (i - start >= 4 && memcmp(nl - 3, "\r\n\r\n", 4) == 0)
+      {
+        break;
+      }
+    }
+    if (i - start > JSMNRPC_HTTP_MAX_HEADER || http_parse_header(self, buf, start, i) != 0)
+    {
+      return -1;
+    }
+  }
+
+  if (self->http_flags & jsmnrpc_frame_chunked)
+  {
+    result = http_parse_chunks(self, buf, len, frame);
+  }
+  else if (len - self->header_length >= self->content_length)
+  {
+    frame->offset = self->header_length;
+    frame->length = self->content_length;
+    frame->consumed = self->header_length + self->content_length;
+    result = 1;
+  }
+  else
+  {
+    result = 0;
+  }
+  frame->flags = self->http_flags & (jsmnrpc_frame_close | jsmnrpc_frame_chunked);
+  return result;
+}
+
+char* jsmnrpc_http_dechunk(char* body, size_t* length)
+{
+  char* out = NULL;
+  size_t out_length = 0;
+  size_t pos = 0;
+  while (pos < *length)
+  {
+    char* eol = (char*)memchr(body + pos, '\n', *length - pos);
+    size_t size = 0;
+    size_t i;
+    for (i = pos; body[i] != ';' && body[i] != '\r'; i++)
+    {
+      char c = body[i] | 0x20;
+      size = size * 16 + (size_t)(c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+    if (out == NULL)
+    {
+      out = eol + 1; /* the first chunk stays where it is */
+    }
+    else
+    {
+      memmove(out + out_length, eol + 1, size);
+    }
+    out_length += size;
+    pos = (size_t)(eol - body) + 1 + size + 2;
+  }
+  *length = out_length;
+  return out ? out : body;
+}
+
+const char* jsmnrpc_http_continue(jsmnrpc_framer_t* self)
+{
+  if ((self->http_flags & (HTTP_EXPECT_CONTINUE | HTTP_CONTINUE_SENT)) != HTTP_EXPECT_CONTINUE)
+  {
+    return NULL;
+  }
+  self->http_flags |= HTTP_CONTINUE_SENT;
+  return JSMNRPC_HTTP_CONTINUE;
+}
+
+size_t jsmnrpc_http_seal(char* message, size_t length, unsigned flags)
+{
+  char* header = message - JSMNRPC_HTTP_PREFIX;
+  char* digit = message - 4;
+  int close = (flags & jsmnrpc_frame_close) != 0;
+  size_t value;
+  if (length == 0)
+  {
+    const char* reply = close ? http_no_content_close : http_no_content_keep_alive;
+    size_t reply_length = close ? sizeof(http_no_content_close) - 1 : sizeof(http_no_content_keep_alive) - 1;
+    memcpy(header, reply, reply_length);
+    return reply_length;
+  }
+  memcpy(header, close ? http_ok_close : http_ok_keep_alive, sizeof(http_ok_keep_alive) - 1);
+  memcpy(message - 4, "\r\n\r\n", 4);
+  for (value = length; value > 0 || digit == message - 4; value /= 10)
+  {
+    *--digit = (char)('0' + value % 10);
+  }
+  while (digit > message - 4 - HTTP_LENGTH_WIDTH)
+  {
+    *--digit = ' ';
+  }
+  return JSMNRPC_HTTP_PREFIX + length;
+}
@@ -0,0 +1,85 @@
+/**
+@file    jsmnrpc_http.h
+@brief   HTTP/1.1 framing for JSON-RPC over POST (jsmnrpc_framing_http), so the
+         server can face HTTP clients without a separate HTTP front end.
+
+         Requests are recognised in the receive buffer without copying: the
+         header is scanned in place for the few fields that matter
+         (Content-Length, Transfer-Encoding: chunked, Connection, Expect), and
+         the body is passed to jsmnrpc_handle_request where it lies. Chunked
+         bodies are joined in place (jsmnrpc_http_dechunk; a single chunk is
+         not moved). Connections are kept alive (HTTP/1.1, or HTTP/1.0 with
+         "Connection: keep-alive") and pipelined requests are answered in order.
+
+         Responses get a precomputed header whose Content-Length field has a
+         fixed width, so it is written in front of the response built in the
+         send buffer without measuring or moving the body. Notifications are
+         answered with 204 No Content.
+*/
+#pragma once
+#ifndef _jsmnrpc_http_h_
+#define _jsmnrpc_http_h_
+
+#include <stddef.h>
+
+#include "jsmnrpc_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* longest request header (request line and fields) accepted */
+#ifndef JSMNRPC_HTTP_MAX_HEADER
+#define JSMNRPC_HTTP_MAX_HEADER 8192
+#endif
+
+/* receive buffer needed beyond the body: the header, and chunk encoding overhead */
+#define JSMNRPC_HTTP_MAX_OVERHEAD (2 * JSMNRPC_HTTP_MAX_HEADER)
+
+/* bytes of the response header written in front of each response */
+#define JSMNRPC_HTTP_PREFIX 103
+
+/* interim response to "Expect: 100-continue" */
+#define JSMNRPC_HTTP_CONTINUE "HTTP/1.1 100 Continue\r\n\r\n"
+
+/* sent before closing the connection on a malformed or unsupported request */
+#define JSMNRPC_HTTP_BAD_REQUEST "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+
+/**
+* @brief jsmnrpc_framer_next() for jsmnrpc_framing_http: finds the next complete
+*        POST request. 'frame' locates its body; frame->flags tells whether the
+*        body is chunk-encoded and whether the connection must close after the
+*        response.
+* @return 1 if a request was found, 0 if more data is needed, -1 if the request
+*         is malformed, is not a POST, uses an unsupported transfer coding, or
+*         its header or body is too long.
+*/
+int jsmnrpc_http_next(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame);
+
+/**
+* @brief Decodes a chunked body (frame offset and length from jsmnrpc_http_next)
+*        in place: the data of later chunks is moved behind the first chunk's.
+* @param length in: encoded length, out: decoded length.
+* @return start of the decoded body.
+*/
+char* jsmnrpc_http_dechunk(char* body, size_t* length);
+
+/**
+* @brief Returns JSMNRPC_HTTP_CONTINUE once if the request being received asked for
+*        it ("Expect: 100-continue") and its body has not arrived yet, else NULL.
+*/
+const char* jsmnrpc_http_continue(jsmnrpc_framer_t* self);
+
+/**
+* @brief Writes the response header into the JSMNRPC_HTTP_PREFIX bytes in front of
+*        'message' (200 with the message as JSON body, or 204 if 'length' is 0).
+* @param flags frame->flags of the request (jsmnrpc_frame_close adds "Connection: close").
+* @return bytes to send, starting JSMNRPC_HTTP_PREFIX bytes before 'message'.
+*/
+size_t jsmnrpc_http_seal(char* message, size_t length, unsigned flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_http_h_ */
@@ -0,0 +1,890 @@
+/**
+@file    jsmnrpc_pipeline.c
+@brief   Staged execution of jsmnrpc_handle_request (see jsmnrpc_pipeline.h).
+*/
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jsmnrpc_clock.h"
+#include "jsmnrpc_frame.h"
+#include "jsmnrpc_pipeline.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define PIPELINE_SPINS 64            /* empty polls (with sched_yield) before a thread sleeps */
+#define PIPELINE_PARK_NS 100000000   /* sleep at most 100 ms (a safety net, wakeups are explicit) */
+#define PIPELINE_WRITE_BATCH 64      /* responses taken from one worker before the next one */
+
+struct jsmnrpc_pipeline_worker
+{
+  jsmnrpc_mpmc_queue_t queues[jsmnrpc_priority_count];   /* parsed requests by priority class (pushed by
+                                                           submitters, popped by all workers) */
+  jsmnrpc_spsc_queue_t done;         /* built responses, for writer (index % writers) */
+  jsmnrpc_pipeline_t* pipeline;
+  jsmnrpc_mpmc_cell_t* cells;        /* of all queues */
+  void** done_slots;
+  int index;
+  int current;               /* priority class being served */
+  int credit;                /* requests it may still take from that class in this round */
+  pthread_t thread;
+  uint64_t queue_max_depth;
+  uint64_t done_max_depth;
+  uint64_t executed;
+  uint64_t stolen;
+  jsmnrpc_histogram_t wait_ns[jsmnrpc_priority_count];
+  char padding[64];
+};
+
+struct jsmnrpc_pipeline_writer_thread
+{
+  jsmnrpc_pipeline_t* pipeline;
+  int index;
+  pthread_t thread;
+  jsmnrpc_pipeline_parker_t parker;
+  uint64_t written;
+  jsmnrpc_histogram_t wait_ns;
+  char padding[64];
+};
+
+static const char pipeline_response_too_large[] =
+  "{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32603, \"message\": \"Response too large\"}, \"id\": null}";
+static const char pipeline_busy_prefix[] = "{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32000, \"message\": \"Server busy\"}, \"id\": ";
+
+/* worker a submitting thread queues its next request for (round robin per thread) */
+static JSMNRPC_THREAD_LOCAL unsigned pipeline_next_worker = 0;
+
+static void parker_init(jsmnrpc_pipeline_parker_t* parker)
+{
+  pthread_mutex_init(&parker->lock, NULL);
+  pthread_cond_init(&parker->cond, NULL);
+  parker->idle = 0;
+}
+
+static void parker_destroy(jsmnrpc_pipeline_parker_t* parker)
+{
+  pthread_mutex_destroy(&parker->lock);
+  pthread_cond_destroy(&parker->cond);
+}
+
+/* sleeps unless has_work() finds something after announcing the sleep: together
+   with the fence in parker_wake this cannot miss a wakeup */
+static void parker_wait(jsmnrpc_pipeline_parker_t* parker, int (*has_work)(void*), void* arg)
+{
+  struct timespec deadline;
+  pthread_mutex_lock(&parker->lock);
+  JSMNRPC_ATOMIC_ADD(&parker->idle, 1);
+  JSMNRPC_FENCE_SEQ_CST();
+  if (!has_work(arg))
+  {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += PIPELINE_PARK_NS;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&parker->cond, &parker->lock, &deadline);
+  }
+  JSMNRPC_ATOMIC_ADD(&parker->idle, (uint64_t)-1);
+  pthread_mutex_unlock(&parker->lock);
+}
+
+static void parker_wake(jsmnrpc_pipeline_parker_t* parker, int all)
+{
+  JSMNRPC_FENCE_SEQ_CST();
+  if (JSMNRPC_ATOMIC_LOAD(&parker->idle) > 0)
+  {
+    pthread_mutex_lock(&parker->lock);
+    if (all)
+    {
+      pthread_cond_broadcast(&parker->cond);
+    }
+    else
+    {
+      pthread_cond_signal(&parker->cond);
+    }
+    pthread_mutex_unlock(&parker->lock);
+  }
+}
+
+/* bulk requests are only taken while fewer than config.bulk_workers run */
+static int pipeline_bulk_allowed(jsmnrpc_pipeline_t* self)
+{
+  return self->config.bulk_workers <= 0 ||
+         JSMNRPC_ATOMIC_LOAD(&self->bulk_running) < (uint64_t)self->config.bulk_workers;
+}
+
+static int pipeline_workers_have_work(void* arg)
+{
+  jsmnrpc_pipeline_t* self = (jsmnrpc_pipeline_t*)arg;
+  int i, c;
+  if (JSMNRPC_ATOMIC_LOAD(&self->stopping))
+  {
+    return 1;
+  }
+  for (i = 0; i < self->config.workers; i++)
+  {
+    for (c = 0; c < jsmnrpc_priority_count; c++)
+    {
+      if (jsmnrpc_mpmc_size(&self->workers[i].queues[c]) > 0 &&
+          (c != jsmnrpc_priority_bulk || pipeline_bulk_allowed(self)))
+      {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int pipeline_writer_has_work(void* arg)
+{
+  jsmnrpc_pipeline_writer_thread_t* t = (jsmnrpc_pipeline_writer_thread_t*)arg;
+  jsmnrpc_pipeline_t* self = t->pipeline;
+  int i;
+  if (JSMNRPC_ATOMIC_LOAD(&self->writers_stopping) || jsmnrpc_mpmc_size(&self->answered) > 0)
+  {
+    return 1;
+  }
+  for (i = t->index; i < self->config.workers; i += self->config.writers)
+  {
+    if (jsmnrpc_spsc_size(&self->workers[i].done) > 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* write stage on the calling thread (no writer threads) */
+static void pipeline_write_now(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_job_t* job)
+{
+  self->writer(job, self->writer_arg);
+  if (self->flush)
+  {
+    self->flush(self->writer_arg);
+  }
+  if (!self->keep_jobs)
+  {
+    jsmnrpc_pipeline_release(self, job);
+  }
+}
+
+/* answers a parsed request "Server busy" instead of queueing it: with its id, with
+   a null id for a batch, not at all for a notification */
+static void pipeline_answer_busy(jsmnrpc_pipeline_job_t* job)
+{
+  jsmnrpc_token_list_t* tokens = &job->data.tokens;
+  jsmnrpc_string_t* response = &job->data.response;
+  int id = -1;
+  response->length = 0;
+  if (tokens->data[0].type == JSMN_OBJECT)
+  {
+    id = jsmnrpc_get_value(tokens, 0, -1, "id");
+    if (id < 0)
+    {
+      response->data[0] = 0;
+      return;
+    }
+  }
+  append_str_with_len(response, pipeline_busy_prefix, sizeof(pipeline_busy_prefix) - 1);
+  if (id < 0)
+  {
+    append_str_with_len(response, "null", 4);
+  }
+  else if (tokens->data[id].type == JSMN_STRING)
+  {
+    append_str_with_len(response, "\"", 1);
+    append_str(response, jsmnrpc_get_string(tokens, id));
+    append_str_with_len(response, "\"", 1);
+  }
+  else
+  {
+    append_str(response, jsmnrpc_get_string(tokens, id));
+  }
+  append_str_with_len(response, "}", 1);
+  if (response->length > response->capacity)
+  {
+    response->length = sizeof(pipeline_response_too_large) - 1;
+    memcpy(response->data, pipeline_response_too_large, sizeof(pipeline_response_too_large));
+  }
+  else if (response->length < response->capacity)
+  {
+    response->data[response->length] = 0;
+  }
+}
+
+/* hands a request the parse stage answered straight to the write stage */
+static void pipeline_answered(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_job_t* job)
+{
+  JSMNRPC_ATOMIC_ADD(&self->answered_early, 1);
+  if (self->config.writers == 0)
+  {
+    pipeline_write_now(self, job);
+    return;
+  }
+  jsmnrpc_mpmc_push(&self->answered, job); /* never full: it has room for every job */
+  parker_wake(&self->writers[pipeline_next_worker++ % (unsigned)self->config.writers].parker, 0);
+}
+
+/* runs a cancel notification (config.cancel_method), which needs no response
+   @return 0 if the request is something else */
+static int pipeline_handle_cancel(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_job_t* job)
+{
+  jsmnrpc_token_list_t* tokens = &job->data.tokens;
+  jsmnrpc_string_t name;
+  int method, params, id;
+  if (tokens->data[0].type != JSMN_OBJECT || jsmnrpc_get_value(tokens, 0, -1, "id") >= 0)
+  {
+    return 0;
+  }
+  method = jsmnrpc_get_value(tokens, 0, -1, "method");
+  if (method < 0 || tokens->data[method].type != JSMN_STRING)
+  {
+    return 0;
+  }
+  name = jsmnrpc_get_string(tokens, method);
+  if (!str_are_equal(name.data, name.length, self->config.cancel_method))
+  {
+    return 0;
+  }
+  params = jsmnrpc_get_value(tokens, 0, -1, "params");
+  id = params >= 0 && tokens->data[params].type == JSMN_OBJECT ? jsmnrpc_get_value(tokens, params, -1, "id") : -1;
+  if (id >= 0 && (tokens->data[id].type == JSMN_STRING || tokens->data[id].type == JSMN_PRIMITIVE))
+  {
+    jsmnrpc_string_t value = jsmnrpc_get_string(tokens, id);
+    jsmnrpc_pipeline_cancel(self, job->context, value.data, value.length, tokens->data[id].type == JSMN_STRING);
+  }
+  job->data.response.length = 0;
+  job->data.response.data[0] = 0;
+  return 1;
+}
+
+/* whether a job's request has the id 'id' (any request if 'id' is NULL) */
+static int pipeline_has_id(jsmnrpc_pipeline_job_t* job, const char* id, size_t length, int is_string)
+{
+  jsmnrpc_token_list_t* tokens = &job->data.tokens;
+  jsmnrpc_string_t value;
+  int token;
+  if (id == NULL)
+  {
+    return 1;
+  }
+  token = tokens->data[0].type == JSMN_OBJECT ? jsmnrpc_get_value(tokens, 0, -1, "id") : -1;
+  if (token < 0 || (tokens->data[token].type == JSMN_STRING) != (is_string != 0))
+  {
+    return 0;
+  }
+  value = jsmnrpc_get_string(tokens, token);
+  return value.length == length && memcmp(value.data, id, length) == 0;
+}
+
+/* takes a request of class 'c' queued for another worker */
+static jsmnrpc_pipeline_job_t* pipeline_steal(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_worker_t* w, int c)
+{
+  int i;
+  for (i = 1; i < self->config.workers; i++)
+  {
+    jsmnrpc_pipeline_worker_t* victim = &self->workers[(w->index + i) % self->config.workers];
+    jsmnrpc_pipeline_job_t* job = (jsmnrpc_pipeline_job_t*)jsmnrpc_mpmc_pop(&victim->queues[c]);
+    if (job)
+    {
+      w->stolen++;
+      return job;
+    }
+  }
+  return NULL;
+}
+
+/* takes the next request, serving the priority classes in weighted round robin
+   (deficit round robin where every request costs 1): up to weights[c] requests
+   of class c, own queue first, before moving on to the next class; a bulk request
+   taken counts in bulk_running */
+static jsmnrpc_pipeline_job_t* pipeline_next(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_worker_t* w)
+{
+  int i;
+  for (i = 0; i <= jsmnrpc_priority_count; i++)
+  {
+    int c = w->current;
+    int bulk = c == jsmnrpc_priority_bulk && self->config.bulk_workers > 0;
+    if (w->credit > 0 && (!bulk || pipeline_bulk_allowed(self)))
+    {
+      jsmnrpc_pipeline_job_t* job;
+      if (bulk)
+      {
+        JSMNRPC_ATOMIC_ADD(&self->bulk_running, 1); /* may briefly exceed the limit when workers race */
+      }
+      job = (jsmnrpc_pipeline_job_t*)jsmnrpc_mpmc_pop(&w->queues[c]);
+      if (job == NULL)
+      {
+        job = pipeline_steal(self, w, c);
+      }
+      if (job)
+      {
+        if (self->config.max_queued > 0)
+        {
+          JSMNRPC_ATOMIC_ADD(&self->queued, (uint64_t)-1);
+        }
+        w->credit--;
+        return job;
+      }
+      if (bulk)
+      {
+        JSMNRPC_ATOMIC_ADD(&self->bulk_running, (uint64_t)-1);
+      }
+    }
+    w->current = (c + 1) % jsmnrpc_priority_count;
+    w->credit = self->config.weights[w->current];
+  }
+  return NULL;
+}
+
+static void pipeline_execute(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_worker_t* w, jsmnrpc_pipeline_job_t* job)
+{
+  jsmnrpc_data_t* data = &job->data;
+  uint64_t depth;
+  jsmnrpc_histogram_record(&w->wait_ns[job->priority], jsmnrpc_clock_ns() - job->t_queued);
+  if (job->parsed)
+  {
+    jsmnrpc_dispatch_request_cancellable(self->rpc, data, job->deadline, &job->cancelled);
+    w->executed++;
+    if (data->response.length > data->response.capacity)
+    {
+      data->response.length = sizeof(pipeline_response_too_large) - 1;
+      memcpy(data->response.data, pipeline_response_too_large, sizeof(pipeline_response_too_large));
+    }
+  }
+  if (self->config.writers == 0)
+  {
+    pipeline_write_now(self, job);
+    return;
+  }
+  job->t_queued = jsmnrpc_clock_ns();
+  while (!jsmnrpc_spsc_push(&w->done, job))
+  {
+    sched_yield(); /* cannot happen while the queue has room for every job */
+  }
+  depth = jsmnrpc_spsc_size(&w->done);
+  if (depth > w->done_max_depth)
+  {
+    w->done_max_depth = depth;
+  }
+  parker_wake(&self->writers[w->index % self->config.writers].parker, 0);
+}
+
+static void* pipeline_worker_main(void* arg)
+{
+  jsmnrpc_pipeline_worker_t* w = (jsmnrpc_pipeline_worker_t*)arg;
+  jsmnrpc_pipeline_t* self = w->pipeline;
+  int spins = 0;
+  for (;;)
+  {
+    uint64_t stopping = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&self->stopping); /* before looking for work, not after */
+    jsmnrpc_pipeline_job_t* job = pipeline_next(self, w);
+    if (job)
+    {
+      int bulk = job->priority == jsmnrpc_priority_bulk && self->config.bulk_workers > 0;
+      pipeline_execute(self, w, job); /* the job may be recycled by then */
+      if (bulk)
+      {
+        JSMNRPC_ATOMIC_ADD(&self->bulk_running, (uint64_t)-1);
+      }
+      spins = 0;
+      continue;
+    }
+    if (stopping)
+    {
+      break; /* nothing left to do or to steal */
+    }
+    if (++spins < PIPELINE_SPINS)
+    {
+      sched_yield();
+      continue;
+    }
+    parker_wait(&self->worker_parker, pipeline_workers_have_work, self);
+    spins = 0;
+  }
+  return NULL;
+}
+
+/* ends a batch of writer callbacks: their jobs are recycled once the flush callback returns */
+static void pipeline_flush(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_job_t** held, int* num_held)
+{
+  int i;
+  self->flush(self->writer_arg);
+  for (i = 0; i < *num_held; i++)
+  {
+    jsmnrpc_pipeline_release(self, held[i]);
+  }
+  *num_held = 0;
+}
+
+/* writer callback for one job; with a flush callback the job is held until the batch is flushed */
+static void pipeline_write(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_writer_thread_t* t, jsmnrpc_pipeline_job_t* job,
+                           jsmnrpc_pipeline_job_t** held, int* num_held)
+{
+  jsmnrpc_histogram_record(&t->wait_ns, jsmnrpc_clock_ns() - job->t_queued);
+  self->writer(job, self->writer_arg);
+  t->written++;
+  if (self->keep_jobs)
+  {
+    return;
+  }
+  if (self->flush == NULL)
+  {
+    jsmnrpc_pipeline_release(self, job);
+    return;
+  }
+  held[(*num_held)++] = job;
+  if (*num_held == PIPELINE_WRITE_BATCH)
+  {
+    pipeline_flush(self, held, num_held);
+  }
+}
+
+static void* pipeline_writer_main(void* arg)
+{
+  jsmnrpc_pipeline_writer_thread_t* t = (jsmnrpc_pipeline_writer_thread_t*)arg;
+  jsmnrpc_pipeline_t* self = t->pipeline;
+  jsmnrpc_pipeline_job_t* held[PIPELINE_WRITE_BATCH];
+  int num_held = 0;
+  int spins = 0;
+  for (;;)
+  {
+    uint64_t stopping = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&self->writers_stopping);
+    int found = 0;
+    int i, n;
+    for (i = t->index; i < self->config.workers; i += self->config.writers)
+    {
+      jsmnrpc_pipeline_job_t* job;
+      for (n = 0; n < PIPELINE_WRITE_BATCH && (job = (jsmnrpc_pipeline_job_t*)jsmnrpc_spsc_pop(&self->workers[i].done)); n++)
+      {
+        pipeline_write(self, t, job, held, &num_held);
+        found = 1;
+      }
+    }
+    for (n = 0; n < PIPELINE_WRITE_BATCH; n++)
+    {
+      jsmnrpc_pipeline_job_t* job = (jsmnrpc_pipeline_job_t*)jsmnrpc_mpmc_pop(&self->answered);
+      if (job == NULL)
+      {
+        break;
+      }
+      pipeline_write(self, t, job, held, &num_held);
+      found = 1;
+    }
+    if (num_held > 0)
+    {
+      pipeline_flush(self, held, &num_held);
+    }
+    if (found)
+    {
+      spins = 0;
+      continue;
+    }
+    if (stopping)
+    {
+      break; /* the workers have exited, so their queues stay empty */
+    }
+    if (++spins < PIPELINE_SPINS)
+    {
+      sched_yield();
+      continue;
+    }
+    parker_wait(&t->parker, pipeline_writer_has_work, t);
+    spins = 0;
+  }
+  return NULL;
+}
+
+static size_t pipeline_round_up_pow2(size_t value)
+{
+  size_t result = 1;
+  while (result < value)
+  {
+    result <<= 1;
+  }
+  return result;
+}
+
+/* Exported functions ------------------------------------------------------- */
+void jsmnrpc_pipeline_config_init(jsmnrpc_pipeline_config_t* config)
+{
+  uint64_t jsmn_max = ((uint64_t)1 << (sizeof(jsmn_size_t) * 8 - 1)) - 1;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  config->workers = cpus > 0 ? (int)cpus : 1;
+  config->writers = 1;
+  config->jobs = 256;
+  config->max_request = jsmn_max < (16 << 10) ? (size_t)jsmn_max : (16 << 10);
+  config->max_response = 16 << 10;
+  config->max_tokens = (jsmn_size_t)(jsmn_max < 1024 ? jsmn_max : 1024);
+  config->max_queued = 0;
+  config->timeout_ns = 0;
+  config->cancel_method = NULL;
+  config->weights[jsmnrpc_priority_high] = 16;
+  config->weights[jsmnrpc_priority_normal] = 4;
+  config->weights[jsmnrpc_priority_bulk] = 1;
+  config->bulk_workers = 0;
+}
+
+int jsmnrpc_pipeline_init(jsmnrpc_pipeline_t* self, jsmnrpc_instance_t* rpc, const jsmnrpc_pipeline_config_t* config,
+                          jsmnrpc_pipeline_writer_t writer, void* writer_arg)
+{
+  int i;
+  memset(self, 0, sizeof(*self));
+  self->rpc = rpc;
+  self->writer = writer;
+  self->writer_arg = writer_arg;
+  if (config)
+  {
+    self->config = *config;
+  }
+  else
+  {
+    jsmnrpc_pipeline_config_init(&self->config);
+  }
+  if (self->config.workers <= 0)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    self->config.workers = cpus > 0 ? (int)cpus : 1;
+  }
+  if (self->config.writers > self->config.workers)
+  {
+    self->config.writers = self->config.workers; /* a writer serves whole workers */
+  }
+  if (self->config.writers < 0 || self->config.jobs <= 0 ||
+      self->config.max_response < sizeof(pipeline_response_too_large))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  parker_init(&self->worker_parker);
+  self->queue_capacity = pipeline_round_up_pow2((size_t)self->config.jobs);
+  self->jobs = (jsmnrpc_pipeline_job_t*)calloc((size_t)self->config.jobs, sizeof(jsmnrpc_pipeline_job_t));
+  self->free_cells = (jsmnrpc_mpmc_cell_t*)malloc(self->queue_capacity * sizeof(jsmnrpc_mpmc_cell_t));
+  self->answered_cells = (jsmnrpc_mpmc_cell_t*)malloc(self->queue_capacity * sizeof(jsmnrpc_mpmc_cell_t));
+  self->workers = (jsmnrpc_pipeline_worker_t*)calloc((size_t)self->config.workers, sizeof(jsmnrpc_pipeline_worker_t));
+  self->writers = (jsmnrpc_pipeline_writer_thread_t*)calloc((size_t)self->config.writers + 1,
+                                                             sizeof(jsmnrpc_pipeline_writer_thread_t));
+  if (self->jobs == NULL || self->free_cells == NULL || self->answered_cells == NULL || self->workers == NULL ||
+      self->writers == NULL)
+  {
+    jsmnrpc_pipeline_close(self);
+    errno = ENOMEM;
+    return -1;
+  }
+  jsmnrpc_mpmc_init(&self->free_jobs, self->free_cells, self->queue_capacity);
+  jsmnrpc_mpmc_init(&self->answered, self->answered_cells, self->queue_capacity);
+  for (i = 0; i < self->config.jobs; i++)
+  {
+    jsmnrpc_pipeline_job_t* job = &self->jobs[i];
+    char* response = (char*)malloc(JSMNRPC_FRAME_MAX_PREFIX + self->config.max_response + JSMNRPC_FRAME_MAX_SUFFIX);
+    job->data.request.data = (char*)malloc(self->config.max_request + 1);
+    job->data.response.data = response ? response + JSMNRPC_FRAME_MAX_PREFIX : NULL; /* room to seal it in place */
+    job->data.tokens.data = (jsmntok_t*)malloc(sizeof(jsmntok_t) * self->config.max_tokens);
+    job->data.tokens.capacity = self->config.max_tokens;
+    if (job->data.request.data == NULL || job->data.response.data == NULL || job->data.tokens.data == NULL)
+    {
+      jsmnrpc_pipeline_close(self);
+      errno = ENOMEM;
+      return -1;
+    }
+    jsmnrpc_pipeline_release(self, job);
+  }
+  for (i = 0; i < jsmnrpc_priority_count; i++)
+  {
+    if (self->config.weights[i] <= 0)
+    {
+      self->config.weights[i] = 1;
+    }
+  }
+  for (i = 0; i < self->config.workers; i++)
+  {
+    jsmnrpc_pipeline_worker_t* w = &self->workers[i];
+    int c;
+    w->pipeline = self;
+    w->index = i;
+    w->current = jsmnrpc_priority_high;
+    w->credit = self->config.weights[jsmnrpc_priority_high];
+    w->cells = (jsmnrpc_mpmc_cell_t*)malloc(jsmnrpc_priority_count * self->queue_capacity *
+                                            sizeof(jsmnrpc_mpmc_cell_t));
+    w->done_slots = (void**)malloc(self->queue_capacity * sizeof(void*));
+    if (w->cells == NULL || w->done_slots == NULL)
+    {
+      jsmnrpc_pipeline_close(self);
+      errno = ENOMEM;
+      return -1;
+    }
+    for (c = 0; c < jsmnrpc_priority_count; c++)
+    {
+      jsmnrpc_mpmc_init(&w->queues[c], w->cells + c * self->queue_capacity, self->queue_capacity);
+    }
+    jsmnrpc_spsc_init(&w->done, w->done_slots, self->queue_capacity);
+  }
+  for (i = 0; i < self->config.writers; i++)
+  {
+    self->writers[i].pipeline = self;
+    self->writers[i].index = i;
+    parker_init(&self->writers[i].parker);
+  }
+  return 0;
+}
+
+int jsmnrpc_pipeline_start(jsmnrpc_pipeline_t* self)
+{
+  int i, r = 0;
+  self->stopping = 0;
+  self->writers_stopping = 0;
+  for (i = 0; i < self->config.writers && r == 0; i++)
+  {
+    r = pthread_create(&self->writers[i].thread, NULL, pipeline_writer_main, &self->writers[i]);
+    self->num_of_threads += r == 0;
+  }
+  for (i = 0; i < self->config.workers && r == 0; i++)
+  {
+    r = pthread_create(&self->workers[i].thread, NULL, pipeline_worker_main, &self->workers[i]);
+    self->num_of_threads += r == 0;
+  }
+  if (r != 0)
+  {
+    jsmnrpc_pipeline_stop(self);
+    errno = r;
+    return -1;
+  }
+  return 0;
+}
+
+int jsmnrpc_pipeline_submit(jsmnrpc_pipeline_t* self, const char* request, size_t length, void* context,
+                            uint64_t tag)
+{
+  jsmnrpc_pipeline_job_t* job;
+  unsigned start;
+  int i;
+  if (length > self->config.max_request)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  job = (jsmnrpc_pipeline_job_t*)jsmnrpc_mpmc_pop(&self->free_jobs);
+  if (job == NULL)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->rejected, 1);
+    errno = EAGAIN;
+    return -1;
+  }
+  JSMNRPC_FENCE_SEQ_CST(); /* pairs with the one in jsmnrpc_pipeline_cancel */
+  while (JSMNRPC_ATOMIC_LOAD(&job->pins) != 0)
+  {
+    sched_yield(); /* a cancel scan still reads the previous request */
+  }
+  memcpy(job->data.request.data, request, length);
+  job->data.request.data[length] = 0;
+  job->data.request.length = length;
+  job->data.response.capacity = self->config.max_response;
+  job->data.arg = self->arg;
+  job->context = context;
+  job->tag = tag;
+  job->deadline = self->config.timeout_ns ? jsmnrpc_clock_ns() + self->config.timeout_ns : 0;
+  job->cancelled = 0;
+  job->parsed = jsmnrpc_parse_request(self->rpc, &job->data);
+  JSMNRPC_ATOMIC_STORE_RELEASE(&job->active, 1); /* scans read the tokens from here on */
+  job->priority = jsmnrpc_priority_normal;
+  if (!job->parsed)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->parse_errors, 1); /* still goes through the workers, to keep one path to the writers */
+  }
+  else if (self->rpc->has_priorities)
+  {
+    job->priority = jsmnrpc_request_priority(self->rpc, &job->data.tokens);
+  }
+
+  job->t_queued = jsmnrpc_clock_ns();
+  if (job->parsed && self->config.cancel_method && pipeline_handle_cancel(self, job))
+  {
+    pipeline_answered(self, job);
+    return 0;
+  }
+  if (job->parsed && job->priority != jsmnrpc_priority_high && self->config.max_queued > 0 &&
+      JSMNRPC_ATOMIC_LOAD(&self->queued) >= (uint64_t)self->config.max_queued)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->busy, 1);
+    pipeline_answer_busy(job);
+    pipeline_answered(self, job);
+    return 0;
+  }
+  if (self->config.max_queued > 0)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->queued, 1); /* before the push, so that the worker taking it cannot go below 0 */
+  }
+  start = pipeline_next_worker++;
+  for (i = 0; i < self->config.workers; i++)
+  {
+    jsmnrpc_pipeline_worker_t* w = &self->workers[(start + (unsigned)i) % (unsigned)self->config.workers];
+    if (jsmnrpc_mpmc_push(&w->queues[job->priority], job))
+    {
+      jsmnrpc_atomic_max(&w->queue_max_depth, jsmnrpc_mpmc_size(&w->queues[job->priority]));
+      parker_wake(&self->worker_parker, 0);
+      return 0;
+    }
+  }
+  if (self->config.max_queued > 0)
+  {
+    JSMNRPC_ATOMIC_ADD(&self->queued, (uint64_t)-1);
+  }
+  jsmnrpc_pipeline_release(self, job); /* cannot happen: every queue has room for every job */
+  errno = EAGAIN;
+  return -1;
+}
+
+int jsmnrpc_pipeline_cancel(jsmnrpc_pipeline_t* self, void* context, const char* id, size_t length, int is_string)
+{
+  int i, flagged = 0;
+  for (i = 0; i < self->config.jobs; i++)
+  {
+    jsmnrpc_pipeline_job_t* job = &self->jobs[i];
+    /* the pin keeps a submitter from reusing the job while its tokens are read */
+    JSMNRPC_ATOMIC_ADD(&job->pins, 1);
+    JSMNRPC_FENCE_SEQ_CST();
+    if (JSMNRPC_ATOMIC_LOAD_ACQUIRE(&job->active) && job->context == context && job->parsed &&
+        !JSMNRPC_ATOMIC_LOAD(&job->cancelled) && pipeline_has_id(job, id, length, is_string))
+    {
+      JSMNRPC_ATOMIC_STORE(&job->cancelled, 1);
+      flagged++;
+    }
+    JSMNRPC_ATOMIC_ADD(&job->pins, (uint64_t)-1);
+  }
+  JSMNRPC_ATOMIC_ADD(&self->cancelled, (uint64_t)flagged);
+  return flagged;
+}
+
+void jsmnrpc_pipeline_release(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_job_t* job)
+{
+  JSMNRPC_ATOMIC_STORE(&job->active, 0);
+  job->parsed = 0;
+  jsmnrpc_mpmc_push(&self->free_jobs, job); /* never full: it has room for every job */
+}
+
+void jsmnrpc_pipeline_stop(jsmnrpc_pipeline_t* self)
+{
+  int i;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&self->stopping, 1);
+  parker_wake(&self->worker_parker, 1);
+  for (i = 0; i < self->config.workers; i++)
+  {
+    if (self->workers[i].thread)
+    {
+      pthread_join(self->workers[i].thread, NULL);
+      self->workers[i].thread = 0;
+    }
+  }
+  JSMNRPC_ATOMIC_STORE_RELEASE(&self->writers_stopping, 1);
+  for (i = 0; i < self->config.writers; i++)
+  {
+    parker_wake(&self->writers[i].parker, 1);
+    if (self->writers[i].thread)
+    {
+      pthread_join(self->writers[i].thread, NULL);
+      self->writers[i].thread = 0;
+    }
+  }
+  self->num_of_threads = 0;
+}
+
+void jsmnrpc_pipeline_close(jsmnrpc_pipeline_t* self)
+{
+  int i;
+  if (self->jobs)
+  {
+    for (i = 0; i < self->config.jobs; i++)
+    {
+      free(self->jobs[i].data.request.data);
+      if (self->jobs[i].data.response.data)
+      {
+        free(self->jobs[i].data.response.data - JSMNRPC_FRAME_MAX_PREFIX);
+      }
+      free(self->jobs[i].data.tokens.data);
+    }
+  }
+  if (self->workers)
+  {
+    for (i = 0; i < self->config.workers; i++)
+    {
+      free(self->workers[i].cells);
+      free(self->workers[i].done_slots);
+    }
+  }
+  if (self->writers)
+  {
+    for (i = 0; i < self->config.writers; i++)
+    {
+      if (self->writers[i].pipeline)
+      {
+        parker_destroy(&self->writers[i].parker);
+      }
+    }
+  }
+  if (self->free_cells)
+  {
+    parker_destroy(&self->worker_parker);
+  }
+  free(self->jobs);
+  free(self->free_cells);
+  free(self->answered_cells);
+  free(self->workers);
+  free(self->writers);
+  self->jobs = NULL;
+  self->free_cells = NULL;
+  self->answered_cells = NULL;
+  self->workers = NULL;
+  self->writers = NULL;
+}
+
+void jsmnrpc_pipeline_metrics(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_metrics_t* metrics)
+{
+  int i;
+  memset(metrics, 0, sizeof(*metrics));
+  for (i = 0; i < self->config.workers; i++)
+  {
+    jsmnrpc_pipeline_worker_t* w = &self->workers[i];
+    uint64_t done_max_depth = w->done_max_depth;
+    uint64_t queue_max_depth = JSMNRPC_ATOMIC_LOAD(&w->queue_max_depth);
+    int c;
+    for (c = 0; c < jsmnrpc_priority_count; c++)
+    {
+      metrics->submitted += JSMNRPC_ATOMIC_LOAD(&w->queues[c].enqueue_pos);
+      metrics->execute_depth += jsmnrpc_mpmc_size(&w->queues[c]);
+      jsmnrpc_histogram_merge(&metrics->execute_wait_ns, &w->wait_ns[c]);
+      jsmnrpc_histogram_merge(&metrics->priority_wait_ns[c], &w->wait_ns[c]);
+    }
+    metrics->executed += w->executed;
+    metrics->stolen += w->stolen;
+    metrics->write_depth += jsmnrpc_spsc_size(&w->done);
+    if (queue_max_depth > metrics->execute_max_depth)
+    {
+      metrics->execute_max_depth = queue_max_depth;
+    }
+    if (done_max_depth > metrics->write_max_depth)
+    {
+      metrics->write_max_depth = done_max_depth;
+    }
+  }
+  for (i = 0; i < self->config.writers; i++)
+  {
+    metrics->written += self->writers[i].written;
+    jsmnrpc_histogram_merge(&metrics->write_wait_ns, &self->writers[i].wait_ns);
+  }
+  metrics->busy = JSMNRPC_ATOMIC_LOAD(&self->busy);
+  metrics->cancelled = JSMNRPC_ATOMIC_LOAD(&self->cancelled);
+  metrics->submitted += JSMNRPC_ATOMIC_LOAD(&self->answered_early);
+  if (self->config.writers == 0)
+  {
+    metrics->written = metrics->submitted - metrics->execute_depth; /* written by the workers */
+  }
+  metrics->rejected = JSMNRPC_ATOMIC_LOAD(&self->rejected);
+  metrics->parse_errors = JSMNRPC_ATOMIC_LOAD(&self->parse_errors);
+  metrics->in_flight = (uint64_t)self->config.jobs - jsmnrpc_mpmc_size(&self->free_jobs);
+}
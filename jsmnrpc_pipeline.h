@@ -0,0 +1,250 @@
+/**
+@file    jsmnrpc_pipeline.h
+@brief   Staged execution of jsmnrpc_handle_request for expensive handlers:
+
+           1. parse   - on the submitting (I/O) thread: jsmnrpc_pipeline_submit()
+                        copies the framed request into a pooled job and tokenizes it;
+           2. execute - on a pool of worker threads: the handlers run and the
+                        response is built in the job (an idle worker steals
+                        requests queued for a busy one);
+           3. write   - on writer threads (or the worker itself): the writer
+                        callback flushes the response, then the job is recycled.
+
+         Stages hand jobs over through bounded lock-free queues (jsmnrpc_queue.h):
+         an MPMC queue per worker (submitters push, the owner and thieves pop), an
+         SPSC queue from each worker to its writer, and an MPMC pool of free jobs.
+         The number of jobs bounds the requests in flight; submit fails when all
+         are in use. Idle threads sleep and are woken by the stage feeding them.
+
+         With config.max_queued, a request that finds that many requests waiting
+         for a worker is not queued: the parse stage answers it at once with a
+         "Server busy" error (code -32000, the request's id; nothing for a
+         notification) and hands it straight to the write stage, so a client
+         learns about the overload instead of waiting behind it.
+
+         With config.cancel_method (e.g. "$/cancelRequest"), a notification of
+         that method, {"params": {"id": ...}}, is handled by the parse stage: it
+         flags the request with that id submitted with the same context, if
+         still in flight. A flagged request that has not started is answered
+         "Request cancelled" (-32800) without running; a running handler can
+         notice with jsmnrpc_request_cancelled(). The job pool is the lookup
+         table (a scan pins each job it reads, so a submitter cannot reuse it
+         meanwhile); cancelling assumes that one thread submits for a context.
+
+         Once handlers were registered with a priority class
+         (jsmnrpc_register_handler_ex), each worker has a queue per class and
+         serves them in weighted round robin: up to config.weights[c] requests of
+         class c, then the next class, so bulk requests cannot starve "high" ones
+         and still progress under load. High priority requests bypass max_queued,
+         and config.bulk_workers bounds the workers running bulk requests at a time.
+
+         Responses are written in completion order, which may differ from the
+         submission order, also for requests of the same client. Each job's
+         response buffer has JSMNRPC_FRAME_MAX_PREFIX bytes in front of it and
+         JSMNRPC_FRAME_MAX_SUFFIX behind it, so writers can frame it in place
+         (jsmnrpc_frame_seal).
+
+         Like jsmnrpc_server, the pipeline allocates its jobs with malloc (once,
+         in jsmnrpc_pipeline_init) and needs POSIX threads.
+*/
+#pragma once
+#ifndef _jsmnrpc_pipeline_h_
+#define _jsmnrpc_pipeline_h_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "jsmnrpc.h"
+#include "jsmnrpc_queue.h"
+#include "jsmnrpc_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Pipeline settings (see jsmnrpc_pipeline_config_init() for defaults).
+*/
+typedef struct jsmnrpc_pipeline_config
+{
+  int workers;               /* handler threads (0: one per CPU) */
+  int writers;               /* writer threads (0: workers call the writer callback) */
+  int jobs;                  /* requests in flight at most */
+  size_t max_request;        /* largest request accepted (bytes) */
+  size_t max_response;       /* response buffer of each job */
+  jsmn_size_t max_tokens;    /* tokens available to parse one request */
+  int max_queued;            /* requests waiting for a worker before submit answers "Server busy" (0: no limit) */
+  uint64_t timeout_ns;       /* deadline of each request, from its submit (0: none): calls that did not
+                                start by then are answered "Request timeout" (-32001) */
+  const char* cancel_method; /* notification cancelling a request by id (NULL: none) */
+  int weights[jsmnrpc_priority_count];   /* requests of each class a worker takes per round (<= 0: 1) */
+  int bulk_workers;          /* workers running bulk requests at most (0: any) */
+} jsmnrpc_pipeline_config_t;
+
+/**
+* @brief One request travelling through the stages.
+*/
+typedef struct jsmnrpc_pipeline_job
+{
+  jsmnrpc_data_t data;       /* request (a copy), tokens and response */
+  void* context;             /* from jsmnrpc_pipeline_submit, e.g. the connection */
+  uint64_t tag;              /* from jsmnrpc_pipeline_submit, e.g. a sequence number */
+  uint64_t t_queued;         /* when the job entered its current queue (jsmnrpc_clock_ns) */
+  uint64_t deadline;         /* passed to jsmnrpc_dispatch_request_cancellable (0: none) */
+  uint64_t cancelled;        /* set by jsmnrpc_pipeline_cancel */
+  uint64_t active;           /* out of the pool and tokenized */
+  uint64_t pins;             /* jsmnrpc_pipeline_cancel scans reading it: not reused before 0 */
+  int parsed;                /* 0 if the parse stage already answered (parse error) */
+  int priority;              /* queue it waits in (jsmnrpc_request_priority) */
+} jsmnrpc_pipeline_job_t;
+
+/**
+* @brief Called by the write stage for every job whose response is ready (an empty
+*        response for notifications). The job is recycled when it returns, unless
+*        keep_jobs is set.
+*/
+typedef void (*jsmnrpc_pipeline_writer_t)(jsmnrpc_pipeline_job_t* job, void* arg);
+
+/**
+* @brief Optional: called by the write stage after a batch of writer callbacks
+*        (at most 64, or what its queues held), e.g. to flush the output they
+*        gathered with jsmnrpc_coalesce. Until it returns, the batch's jobs are not
+*        recycled, so writers may reference their responses instead of copying them.
+*/
+typedef void (*jsmnrpc_pipeline_flush_t)(void* arg);
+
+/**
+* @brief Where requests wait, summed over the threads of each stage.
+*/
+typedef struct jsmnrpc_pipeline_metrics
+{
+  uint64_t submitted;        /* requests accepted by jsmnrpc_pipeline_submit */
+  uint64_t rejected;         /* submits refused because all jobs were in flight */
+  uint64_t parse_errors;     /* answered by the parse stage */
+  uint64_t busy;             /* answered by the parse stage because max_queued requests were waiting */
+  uint64_t cancelled;        /* requests flagged by jsmnrpc_pipeline_cancel */
+  uint64_t executed;         /* requests run by workers */
+  uint64_t stolen;           /* ... of which taken from another worker's queue */
+  uint64_t written;          /* responses passed to the writer callback */
+  uint64_t in_flight;        /* jobs out of the pool */
+  uint64_t execute_depth;    /* requests waiting for a worker */
+  uint64_t execute_max_depth;   /* highest depth seen by one worker queue */
+  uint64_t write_depth;      /* responses waiting for a writer */
+  uint64_t write_max_depth;  /* highest depth seen by one writer queue */
+  jsmnrpc_histogram_t execute_wait_ns;   /* parse done -> worker picks the request up */
+  jsmnrpc_histogram_t write_wait_ns;     /* response built -> writer picks it up */
+  jsmnrpc_histogram_t priority_wait_ns[jsmnrpc_priority_count];   /* execute_wait_ns by priority class */
+} jsmnrpc_pipeline_metrics_t;
+
+typedef struct jsmnrpc_pipeline_worker jsmnrpc_pipeline_worker_t;
+typedef struct jsmnrpc_pipeline_writer_thread jsmnrpc_pipeline_writer_thread_t;
+
+/**
+* @brief Threads of one stage sleep here when they run out of work.
+*/
+typedef struct jsmnrpc_pipeline_parker
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint64_t idle;             /* threads about to sleep or sleeping */
+} jsmnrpc_pipeline_parker_t;
+
+typedef struct jsmnrpc_pipeline
+{
+  jsmnrpc_instance_t* rpc;
+  jsmnrpc_pipeline_config_t config;
+  jsmnrpc_pipeline_writer_t writer;
+  void* writer_arg;
+  jsmnrpc_pipeline_flush_t flush;       /* optional, set before jsmnrpc_pipeline_start (called with writer_arg) */
+  int keep_jobs;             /* the writer takes the jobs over and recycles them with jsmnrpc_pipeline_release */
+  void* arg;                 /* passed to handlers as info->data->arg */
+  jsmnrpc_pipeline_job_t* jobs;
+  jsmnrpc_mpmc_queue_t free_jobs;
+  jsmnrpc_mpmc_cell_t* free_cells;
+  jsmnrpc_mpmc_queue_t answered;     /* answered by the parse stage ("Server busy", cancellations), for any writer */
+  jsmnrpc_mpmc_cell_t* answered_cells;
+  size_t queue_capacity;     /* slots per worker (and priority class) and writer queue */
+  jsmnrpc_pipeline_worker_t* workers;
+  jsmnrpc_pipeline_writer_thread_t* writers;
+  jsmnrpc_pipeline_parker_t worker_parker;
+  int num_of_threads;        /* workers and writers started */
+  uint64_t stopping;         /* workers drain their queues and exit */
+  uint64_t writers_stopping;
+  uint64_t rejected;
+  uint64_t parse_errors;
+  uint64_t busy;
+  uint64_t cancelled;
+  uint64_t answered_early;   /* jobs pushed to 'answered' or written by the submitter */
+  uint64_t bulk_running;     /* bulk requests taken by workers (with config.bulk_workers) */
+  uint64_t queued;           /* requests waiting for a worker (with config.max_queued) */
+} jsmnrpc_pipeline_t;
+
+/**
+* @brief Fills 'config' with defaults: one worker per CPU, one writer, 256 jobs of
+*        16 KiB requests, 16 KiB responses and 1024 tokens (bounded by jsmn_size_t),
+*        weights 16/4/1 for the high/normal/bulk priority classes.
+*/
+void jsmnrpc_pipeline_config_init(jsmnrpc_pipeline_config_t* config);
+
+/**
+* @brief Allocates the jobs and queues (threads are started by jsmnrpc_pipeline_start).
+* @param rpc instance shared by all workers; its handler table must not change
+*        while the pipeline runs.
+* @param config settings, or NULL for defaults.
+* @param writer callback of the write stage.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_pipeline_init(jsmnrpc_pipeline_t* self, jsmnrpc_instance_t* rpc, const jsmnrpc_pipeline_config_t* config,
+                          jsmnrpc_pipeline_writer_t writer, void* writer_arg);
+
+/**
+* @return 0 on success, -1 on error (threads already started are stopped).
+*/
+int jsmnrpc_pipeline_start(jsmnrpc_pipeline_t* self);
+
+/**
+* @brief Parse stage: copies and tokenizes a framed request, then queues it for the
+*        workers. Safe to call from several threads.
+* @return 0 if queued (or answered "Server busy", see max_queued), -1 if all jobs
+*         are in flight (errno EAGAIN: retry once responses were written) or the
+*         request exceeds max_request (EMSGSIZE).
+*/
+int jsmnrpc_pipeline_submit(jsmnrpc_pipeline_t* self, const char* request, size_t length, void* context,
+                            uint64_t tag);
+
+/**
+* @brief Flags the requests in flight submitted with 'context' whose id is 'id' (the
+*        text of the id token, 'is_string' if it was a JSON string), or all of them
+*        if 'id' is NULL, e.g. when the client went away. Call it from the thread
+*        that submits for 'context'.
+* @return number of requests flagged.
+*/
+int jsmnrpc_pipeline_cancel(jsmnrpc_pipeline_t* self, void* context, const char* id, size_t length, int is_string);
+
+/**
+* @brief Recycles a job the writer kept (with keep_jobs), e.g. once another thread
+*        has written its response. Safe to call from any thread.
+*/
+void jsmnrpc_pipeline_release(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_job_t* job);
+
+/**
+* @brief Lets the workers finish the queued requests and the writers write their
+*        responses, then joins all threads. Submit nothing while it runs.
+*/
+void jsmnrpc_pipeline_stop(jsmnrpc_pipeline_t* self);
+
+/**
+* @brief Frees the jobs and queues (stop first).
+*/
+void jsmnrpc_pipeline_close(jsmnrpc_pipeline_t* self);
+
+/**
+* @brief Takes a snapshot of the counters and queue depths while the pipeline runs.
+*/
+void jsmnrpc_pipeline_metrics(jsmnrpc_pipeline_t* self, jsmnrpc_pipeline_metrics_t* metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_pipeline_h_ */
@@ -0,0 +1,214 @@
+/**
+@file    jsmnrpc_queue.h
+@brief   Bounded lock-free queues of pointers for passing work between threads:
+         a single-producer/single-consumer ring and Dmitry Vyukov's bounded
+         multi-producer/multi-consumer queue. Neither allocates: the caller
+         provides the slot storage, whose size must be a power of 2.
+*/
+#pragma once
+#ifndef _jsmnrpc_queue_h_
+#define _jsmnrpc_queue_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsmnrpc_atomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Single-producer/single-consumer ring. Each side keeps a cached copy of
+*        the other side's index, so it only touches the other's cache line when
+*        the ring looks full (or empty).
+*/
+typedef struct jsmnrpc_spsc_queue
+{
+  uint64_t head;             /* next slot to pop (written by the consumer) */
+  uint64_t cached_tail;      /* consumer's last view of tail */
+  char padding1[48];
+  uint64_t tail;             /* next slot to push (written by the producer) */
+  uint64_t cached_head;      /* producer's last view of head */
+  char padding2[48];
+  void** slots;
+  uint64_t mask;
+} jsmnrpc_spsc_queue_t;
+
+typedef struct jsmnrpc_mpmc_cell
+{
+  uint64_t sequence;
+  void* item;
+} jsmnrpc_mpmc_cell_t;
+
+/**
+* @brief Multi-producer/multi-consumer queue: each cell carries a sequence number
+*        telling producers and consumers whose turn it is, so the only contended
+*        writes are the position updates (one CAS per push or pop).
+*/
+typedef struct jsmnrpc_mpmc_queue
+{
+  jsmnrpc_mpmc_cell_t* cells;
+  uint64_t mask;
+  char padding0[48];
+  uint64_t enqueue_pos;
+  char padding1[56];
+  uint64_t dequeue_pos;
+  char padding2[56];
+} jsmnrpc_mpmc_queue_t;
+
+static inline void jsmnrpc_spsc_init(jsmnrpc_spsc_queue_t* q, void** slots, size_t capacity)
+{
+  q->head = q->cached_tail = 0;
+  q->tail = q->cached_head = 0;
+  q->slots = slots;
+  q->mask = capacity - 1;
+}
+
+/**
+* @return 1 if pushed, 0 if the queue is full.
+*/
+static inline int jsmnrpc_spsc_push(jsmnrpc_spsc_queue_t* q, void* item)
+{
+  uint64_t tail = JSMNRPC_ATOMIC_LOAD(&q->tail);
+  if (tail - q->cached_head > q->mask)
+  {
+    q->cached_head = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&q->head);
+    if (tail - q->cached_head > q->mask)
+    {
+      return 0;
+    }
+  }
+  q->slots[tail & q->mask] = item;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&q->tail, tail + 1);
+  return 1;
+}
+
+/**
+* @return the oldest item, or NULL if the queue is empty.
+*/
+static inline void* jsmnrpc_spsc_pop(jsmnrpc_spsc_queue_t* q)
+{
+  uint64_t head = JSMNRPC_ATOMIC_LOAD(&q->head);
+  void* item;
+  if (head == q->cached_tail)
+  {
+    q->cached_tail = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&q->tail);
+    if (head == q->cached_tail)
+    {
+      return NULL;
+    }
+  }
+  item = q->slots[head & q->mask];
+  JSMNRPC_ATOMIC_STORE_RELEASE(&q->head, head + 1);
+  return item;
+}
+
+/**
+* @brief Items in the queue (a snapshot; may be stale by the time it is used).
+*/
+static inline uint64_t jsmnrpc_spsc_size(jsmnrpc_spsc_queue_t* q)
+{
+  uint64_t head = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&q->head);
+  uint64_t tail = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&q->tail);
+  return tail > head ? tail - head : 0;
+}
+
+static inline void jsmnrpc_mpmc_init(jsmnrpc_mpmc_queue_t* q, jsmnrpc_mpmc_cell_t* cells, size_t capacity)
+{
+  size_t i;
+  for (i = 0; i < capacity; i++)
+  {
+    cells[i].sequence = i;
+    cells[i].item = NULL;
+  }
+  q->cells = cells;
+  q->mask = capacity - 1;
+  q->enqueue_pos = 0;
+  q->dequeue_pos = 0;
+}
+
+/**
+* @return 1 if pushed, 0 if the queue is full.
+*/
+static inline int jsmnrpc_mpmc_push(jsmnrpc_mpmc_queue_t* q, void* item)
+{
+  uint64_t pos = JSMNRPC_ATOMIC_LOAD(&q->enqueue_pos);
+  jsmnrpc_mpmc_cell_t* cell;
+  for (;;)
+  {
+    int64_t dif;
+    cell = &q->cells[pos & q->mask];
+    dif = (int64_t)(JSMNRPC_ATOMIC_LOAD_ACQUIRE(&cell->sequence) - pos);
+    if (dif == 0)
+    {
+      if (JSMNRPC_ATOMIC_CAS(&q->enqueue_pos, &pos, pos + 1))
+      {
+        break;
+      }
+      pos = JSMNRPC_ATOMIC_LOAD(&q->enqueue_pos);
+    }
+    else if (dif < 0)
+    {
+      return 0; /* the cell still holds an item from one lap ago */
+    }
+    else
+    {
+      pos = JSMNRPC_ATOMIC_LOAD(&q->enqueue_pos);
+    }
+  }
+  cell->item = item;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&cell->sequence, pos + 1);
+  return 1;
+}
+
+/**
+* @return the oldest item, or NULL if the queue is empty.
+*/
+static inline void* jsmnrpc_mpmc_pop(jsmnrpc_mpmc_queue_t* q)
+{
+  uint64_t pos = JSMNRPC_ATOMIC_LOAD(&q->dequeue_pos);
+  jsmnrpc_mpmc_cell_t* cell;
+  void* item;
+  for (;;)
+  {
+    int64_t dif;
+    cell = &q->cells[pos & q->mask];
+    dif = (int64_t)(JSMNRPC_ATOMIC_LOAD_ACQUIRE(&cell->sequence) - (pos + 1));
+    if (dif == 0)
+    {
+      if (JSMNRPC_ATOMIC_CAS(&q->dequeue_pos, &pos, pos + 1))
+      {
+        break;
+      }
+      pos = JSMNRPC_ATOMIC_LOAD(&q->dequeue_pos);
+    }
+    else if (dif < 0)
+    {
+      return NULL;
+    }
+    else
+    {
+      pos = JSMNRPC_ATOMIC_LOAD(&q->dequeue_pos);
+    }
+  }
+  item = cell->item;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&cell->sequence, pos + q->mask + 1);
+  return item;
+}
+
+/**
+* @brief Items in the queue (a snapshot; may be stale by the time it is used).
+*/
+static inline uint64_t jsmnrpc_mpmc_size(jsmnrpc_mpmc_queue_t* q)
+{
+  uint64_t dequeue_pos = JSMNRPC_ATOMIC_LOAD(&q->dequeue_pos);
+  uint64_t enqueue_pos = JSMNRPC_ATOMIC_LOAD(&q->enqueue_pos);
+  return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_queue_h_ */
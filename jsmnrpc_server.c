@@ -0,0 +1,826 @@
+/**
+@file    jsmnrpc_server.c
+@brief   Reference non-blocking JSON-RPC server (see jsmnrpc_server.h).
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* accept4 */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "jsmnrpc_atomic.h"
+#include "jsmnrpc_server_priv.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define SERVER_MAX_EVENTS 64
+
+static int server_set_nonblocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int server_add_listener(jsmnrpc_server_t* self, int fd)
+{
+  jsmnrpc_server_handle_t* handle;
+  struct epoll_event ev;
+  if (self->num_of_listeners >= JSMNRPC_SERVER_MAX_LISTENERS)
+  {
+    close(fd);
+    errno = ENOSPC;
+    return -1;
+  }
+  handle = &self->listeners[self->num_of_listeners];
+  handle->kind = server_handle_listener;
+  handle->fd = fd;
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE; /* a listener shared by several loops wakes one of them, not all */
+  ev.data.ptr = handle;
+  if (listen(fd, self->config.listen_backlog) != 0 || server_set_nonblocking(fd) != 0 ||
+      (self->uring ? jsmnrpc_server_uring_add_listener(self, handle)
+                   : epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  self->num_of_listeners++;
+  return 0;
+}
+
+/* ========  worker threads ========== */
+
+static jsmnrpc_server_conn_t* server_conn_of(jsmnrpc_conn_t* conn)
+{
+  return (jsmnrpc_server_conn_t*)((char*)conn - offsetof(jsmnrpc_server_conn_t, conn));
+}
+
+/* jsmnrpc_conn submit callback: queues the request for the workers */
+static int server_submit(jsmnrpc_conn_t* conn, const char* request, size_t length, uint64_t tag)
+{
+  jsmnrpc_server_t* self = (jsmnrpc_server_t*)conn->arg;
+  jsmnrpc_server_workers_t* w = self->workers;
+  jsmnrpc_server_conn_t* c = server_conn_of(conn);
+  w->pipeline.arg = self->arg; /* may be set after jsmnrpc_server_init */
+  if (jsmnrpc_pipeline_submit(&w->pipeline, request, length, c, tag) == 0)
+  {
+    return 0;
+  }
+  if (!c->stalled)
+  {
+    /* all jobs are in flight: submitted again once some are recycled */
+    c->stalled = 1;
+    c->next_stalled = w->stalled;
+    w->stalled = c;
+  }
+  return -1;
+}
+
+/* jsmnrpc_conn release callback: the response was copied to the send buffer */
+static void server_release(jsmnrpc_conn_t* conn, void* token)
+{
+  jsmnrpc_server_t* self = (jsmnrpc_server_t*)conn->arg;
+  jsmnrpc_pipeline_release(&self->workers->pipeline, (jsmnrpc_pipeline_job_t*)token);
+}
+
+/* pipeline writer callback, on a worker thread: hands the job over to the event loop */
+static void server_on_response(jsmnrpc_pipeline_job_t* job, void* arg)
+{
+  jsmnrpc_server_t* self = (jsmnrpc_server_t*)arg;
+  jsmnrpc_server_workers_t* w = self->workers;
+  uint64_t idle = 0;
+  uint64_t one = 1;
+  jsmnrpc_mpmc_push(&w->completed, job); /* never full: it has room for every job */
+  JSMNRPC_FENCE_SEQ_CST();
+  /* one eventfd write per drain of the queue, whichever worker comes first */
+  if (JSMNRPC_ATOMIC_LOAD(&w->wake_pending) == 0 && JSMNRPC_ATOMIC_CAS(&w->wake_pending, &idle, 1) &&
+      write(self->wakeup.fd, &one, sizeof(one)) < 0)
+  {
+    /* the counter is already non-zero: the loop wakes up anyway */
+  }
+}
+
+static int server_start_workers(jsmnrpc_server_t* self)
+{
+  jsmnrpc_pipeline_config_t config;
+  jsmnrpc_server_workers_t* w = (jsmnrpc_server_workers_t*)calloc(1, sizeof(*w));
+  size_t capacity = 1;
+  if (w == NULL)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  self->workers = w;
+  jsmnrpc_pipeline_config_init(&config);
+  config.workers = self->config.workers;
+  config.writers = 0;
+  config.jobs = self->config.jobs;
+  config.max_request = self->config.max_request;
+  config.max_response = self->config.max_response;
+  config.max_tokens = self->config.max_tokens;
+  config.max_queued = self->config.max_queued;
+  config.timeout_ns = (uint64_t)self->config.timeout_ms * 1000000u;
+  config.cancel_method = self->config.cancel_method;
+  config.bulk_workers = self->config.bulk_workers;
+  while (capacity < (size_t)config.jobs)
+  {
+    capacity <<= 1;
+  }
+  w->cells = (jsmnrpc_mpmc_cell_t*)malloc(capacity * sizeof(jsmnrpc_mpmc_cell_t));
+  if (w->cells == NULL)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  jsmnrpc_mpmc_init(&w->completed, w->cells, capacity);
+  if (jsmnrpc_pipeline_init(&w->pipeline, self->rpc, &config, server_on_response, self) != 0)
+  {
+    return -1;
+  }
+  w->pipeline.keep_jobs = 1;
+  return jsmnrpc_pipeline_start(&w->pipeline);
+}
+
+static void server_stop_workers(jsmnrpc_server_t* self)
+{
+  jsmnrpc_server_workers_t* w = self->workers;
+  jsmnrpc_pipeline_job_t* job;
+  if (w->pipeline.workers)
+  {
+    jsmnrpc_pipeline_stop(&w->pipeline); /* the queued requests still run */
+  }
+  while (w->cells && (job = (jsmnrpc_pipeline_job_t*)jsmnrpc_mpmc_pop(&w->completed)) != NULL)
+  {
+    jsmnrpc_pipeline_release(&w->pipeline, job);
+  }
+  jsmnrpc_pipeline_close(&w->pipeline);
+  free(w->cells);
+  free(w);
+  self->workers = NULL;
+}
+
+/* ========  connections ========== */
+
+static jsmnrpc_server_conn_t* conn_alloc(jsmnrpc_server_t* self)
+{
+  jsmnrpc_server_conn_t* c = self->free_connections;
+  if (c)
+  {
+    self->free_connections = c->next;
+    return c;
+  }
+  c = (jsmnrpc_server_conn_t*)calloc(1, sizeof(*c));
+  if (c == NULL)
+  {
+    return NULL;
+  }
+  if (jsmnrpc_conn_init(&c->conn, self->rpc, self->config.framing, self->config.max_request,
+                        self->config.max_response, self->config.max_tokens) != 0)
+  {
+    free(c);
+    return NULL;
+  }
+  c->conn.timeout_ns = (uint64_t)self->config.timeout_ms * 1000000u;
+  if (self->workers && jsmnrpc_conn_set_concurrent(&c->conn, (unsigned)self->config.max_in_flight,
+                                                   self->config.in_order, server_submit, server_release, self) != 0)
+  {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+static void conn_free(jsmnrpc_server_conn_t* c)
+{
+  jsmnrpc_conn_close(&c->conn);
+  free(c);
+}
+
+static int conn_open(jsmnrpc_server_t* self, int fd)
+{
+  jsmnrpc_server_conn_t* c = jsmnrpc_server_conn_open(self, fd);
+  struct epoll_event ev;
+  if (c == NULL)
+  {
+    return -1;
+  }
+  if (self->uring)
+  {
+    if (jsmnrpc_server_uring_add_conn(self, c) != 0)
+    {
+      jsmnrpc_server_conn_release(self, c);
+      return -1;
+    }
+    return 0;
+  }
+  c->events = EPOLLIN;
+  ev.events = c->events;
+  ev.data.ptr = &c->handle;
+  if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+  {
+    jsmnrpc_server_conn_release(self, c);
+    return -1;
+  }
+  return 0;
+}
+
+static void conn_close(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, c->handle.fd, NULL);
+  if (c->conn.in_flight > 0)
+  {
+    /* workers still run requests of the connection: the slot is released after them,
+       and those that have not started are dropped */
+    jsmnrpc_pipeline_cancel(&self->workers->pipeline, c, NULL, 0, 0);
+    jsmnrpc_conn_abort(&c->conn);
+    shutdown(c->handle.fd, SHUT_RDWR);
+    c->closing = 1;
+    return;
+  }
+  jsmnrpc_server_conn_release(self, c);
+}
+
+/* writes the pending output (handling the requests it held back); returns -1 if the connection broke */
+static int conn_flush(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  const char* out;
+  size_t length;
+  while ((out = jsmnrpc_conn_next_output(&c->conn, &length)) != NULL)
+  {
+    ssize_t n = send(c->handle.fd, out, length, MSG_NOSIGNAL);
+    self->counters.writes++;
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        break;
+      }
+      return -1;
+    }
+    self->counters.bytes_sent += (uint64_t)n;
+    jsmnrpc_conn_output_done(&c->conn, (size_t)n);
+  }
+  return 0;
+}
+
+/* reads into the receive buffer and handles the requests */
+static int conn_read(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  size_t room;
+  char* in = jsmnrpc_conn_input_buffer(&c->conn, &room);
+  ssize_t n;
+  if (c->conn.closed || room == 0)
+  {
+    return 0; /* done, or still waiting for room in the send buffer */
+  }
+  do
+  {
+    n = read(c->handle.fd, in, room);
+    self->counters.reads++;
+  } while (n < 0 && errno == EINTR);
+  if (n < 0)
+  {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+  if (n == 0)
+  {
+    jsmnrpc_conn_eof(&c->conn);
+    return 0;
+  }
+  self->counters.bytes_received += (uint64_t)n;
+  jsmnrpc_conn_input_done(&c->conn, (size_t)n);
+  return 0;
+}
+
+/* registers the events the connection waits for, or closes it once it is done */
+static void conn_update(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  uint32_t events = 0;
+  struct epoll_event ev;
+  size_t pending;
+  jsmnrpc_server_conn_collect(self, c);
+  if (jsmnrpc_conn_finished(&c->conn))
+  {
+    conn_close(self, c);
+    return;
+  }
+  if (jsmnrpc_conn_wants_input(&c->conn))
+  {
+    events |= EPOLLIN;
+  }
+  if (jsmnrpc_conn_next_output(&c->conn, &pending) != NULL)
+  {
+    events |= EPOLLOUT;
+  }
+  if (events != c->events)
+  {
+    /* waiting for the workers only: deregistered, or a hang-up would be reported over and over */
+    int op = c->events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    ev.events = events;
+    ev.data.ptr = &c->handle;
+    epoll_ctl(self->epoll_fd, op, c->handle.fd, &ev);
+    c->events = events;
+  }
+}
+
+static void conn_on_event(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c, uint32_t events)
+{
+  if (events & EPOLLERR)
+  {
+    conn_close(self, c);
+    return;
+  }
+  if ((events & (EPOLLIN | EPOLLHUP)) && conn_read(self, c) != 0)
+  {
+    conn_close(self, c);
+    return;
+  }
+  if (conn_flush(self, c) != 0)
+  {
+    conn_close(self, c);
+    return;
+  }
+  conn_update(self, c);
+}
+
+/* writes the responses the workers delivered */
+static void conn_refresh(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  if (self->uring)
+  {
+    jsmnrpc_server_uring_update(self, c);
+    return;
+  }
+  if (c->closing)
+  {
+    if (c->conn.in_flight == 0)
+    {
+      jsmnrpc_server_conn_release(self, c);
+    }
+    return;
+  }
+  if (conn_flush(self, c) != 0)
+  {
+    conn_close(self, c);
+    return;
+  }
+  conn_update(self, c);
+}
+
+static void server_accept(jsmnrpc_server_t* self, jsmnrpc_server_handle_t* listener)
+{
+  for (;;)
+  {
+    int one = 1;
+    int fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+      if ((errno == EMFILE || errno == ENFILE) && jsmnrpc_server_shed(self, listener->fd) == 0)
+      {
+        continue;
+      }
+      return; /* EAGAIN */
+    }
+    if (self->num_of_connections >= self->config.max_connections)
+    {
+      close(fd);
+      self->counters.rejected++;
+      continue;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); /* fails harmlessly on Unix sockets */
+    conn_open(self, fd);
+  }
+}
+
+/* ========  shared with the io_uring backend ========== */
+
+int jsmnrpc_server_shed(jsmnrpc_server_t* self, int listener_fd)
+{
+  int fd;
+  if (self->spare_fd < 0)
+  {
+    return -1;
+  }
+  close(self->spare_fd);
+  fd = accept4(listener_fd, NULL, NULL, SOCK_CLOEXEC);
+  if (fd >= 0)
+  {
+    close(fd);
+    self->counters.rejected++;
+  }
+  self->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  return fd >= 0 ? 0 : -1;
+}
+
+jsmnrpc_server_conn_t* jsmnrpc_server_conn_open(jsmnrpc_server_t* self, int fd)
+{
+  jsmnrpc_server_conn_t* c = conn_alloc(self);
+  if (c == NULL)
+  {
+    close(fd);
+    return NULL;
+  }
+  c->handle.kind = server_handle_connection;
+  c->handle.fd = fd;
+  c->events = 0;
+  c->pending_ops = 0;
+  c->receiving = c->cancelling = c->sending = c->closing = 0;
+  c->stalled = c->completing = 0;
+  c->next_stalled = c->next_completing = NULL;
+  jsmnrpc_conn_reset(&c->conn);
+  c->conn.data.arg = self->arg;
+  c->prev = NULL;
+  c->next = self->connections;
+  if (c->next)
+  {
+    c->next->prev = c;
+  }
+  self->connections = c;
+  self->num_of_connections++;
+  self->counters.accepted++;
+  return c;
+}
+
+void jsmnrpc_server_conn_release(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  jsmnrpc_server_conn_collect(self, c);
+  if (c->stalled)
+  {
+    jsmnrpc_server_conn_t** p = &self->workers->stalled;
+    while (*p != c)
+    {
+      p = &(*p)->next_stalled;
+    }
+    *p = c->next_stalled;
+    c->stalled = 0;
+  }
+  close(c->handle.fd);
+  c->handle.fd = -1;
+  if (c->prev)
+  {
+    c->prev->next = c->next;
+  }
+  else
+  {
+    self->connections = c->next;
+  }
+  if (c->next)
+  {
+    c->next->prev = c->prev;
+  }
+  c->next = self->free_connections;
+  self->free_connections = c;
+  self->num_of_connections--;
+  self->counters.closed++;
+}
+
+void jsmnrpc_server_conn_collect(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  self->counters.requests += c->conn.requests;
+  self->counters.protocol_errors += c->conn.protocol_errors;
+  c->conn.requests = c->conn.protocol_errors = 0;
+}
+
+void jsmnrpc_server_complete(jsmnrpc_server_t* self)
+{
+  jsmnrpc_server_workers_t* w = self->workers;
+  jsmnrpc_server_conn_t* completing = NULL;
+  jsmnrpc_server_conn_t* stalled;
+  jsmnrpc_server_conn_t* c;
+  jsmnrpc_pipeline_job_t* job;
+  if (w == NULL)
+  {
+    return;
+  }
+  JSMNRPC_ATOMIC_STORE(&w->wake_pending, 0);
+  JSMNRPC_FENCE_SEQ_CST(); /* a job queued after the drain below writes the eventfd again */
+  while ((job = (jsmnrpc_pipeline_job_t*)jsmnrpc_mpmc_pop(&w->completed)) != NULL)
+  {
+    c = (jsmnrpc_server_conn_t*)job->context;
+    jsmnrpc_conn_complete(&c->conn, job->tag, job->data.response.data, job->data.response.length, job);
+    if (!c->completing)
+    {
+      c->completing = 1;
+      c->next_completing = completing;
+      completing = c;
+    }
+  }
+  /* jobs were recycled: connections that found none submit again (and may stall again) */
+  stalled = w->stalled;
+  w->stalled = NULL;
+  while (stalled)
+  {
+    c = stalled;
+    stalled = c->next_stalled;
+    c->stalled = 0;
+    jsmnrpc_conn_resume(&c->conn);
+    if (!c->completing)
+    {
+      c->completing = 1;
+      c->next_completing = completing;
+      completing = c;
+    }
+  }
+  /* one write per connection for all the responses it got */
+  while (completing)
+  {
+    c = completing;
+    completing = c->next_completing;
+    c->completing = 0;
+    conn_refresh(self, c);
+  }
+}
+
+/* Exported functions ------------------------------------------------------- */
+void jsmnrpc_server_config_init(jsmnrpc_server_config_t* config)
+{
+  uint64_t jsmn_max = ((uint64_t)1 << (sizeof(jsmn_size_t) * 8 - 1)) - 1;
+  config->framing = jsmnrpc_framing_newline;
+  config->backend = jsmnrpc_server_backend_auto;
+  config->max_request = jsmn_max < (1 << 20) ? (size_t)jsmn_max : (1 << 20);
+  config->max_response = 1 << 20;
+  config->max_tokens = (jsmn_size_t)(jsmn_max < 4096 ? jsmn_max : 4096);
+  config->max_connections = 1024;
+  config->listen_backlog = 512;
+  config->reuse_port = 0;
+  config->workers = 0;
+  config->max_in_flight = 16;
+  config->in_order = 0;
+  config->jobs = 256;
+  config->max_queued = 0;
+  config->timeout_ms = 0;
+  config->cancel_method = "$/cancelRequest";
+  config->bulk_workers = 0;
+}
+
+int jsmnrpc_server_init(jsmnrpc_server_t* self, jsmnrpc_instance_t* rpc, const jsmnrpc_server_config_t* config)
+{
+  struct epoll_event ev;
+  memset(self, 0, sizeof(*self));
+  self->rpc = rpc;
+  if (config)
+  {
+    self->config = *config;
+  }
+  else
+  {
+    jsmnrpc_server_config_init(&self->config);
+  }
+  self->wakeup.kind = server_handle_wakeup;
+  self->epoll_fd = -1;
+  self->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  self->wakeup.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->spare_fd < 0 || self->wakeup.fd < 0)
+  {
+    jsmnrpc_server_close(self);
+    return -1;
+  }
+  if (self->config.workers > 0 && server_start_workers(self) != 0)
+  {
+    jsmnrpc_server_close(self);
+    return -1;
+  }
+  if (self->config.backend != jsmnrpc_server_backend_epoll)
+  {
+    if (jsmnrpc_server_uring_init(self) == 0)
+    {
+      self->backend = jsmnrpc_server_backend_io_uring;
+      return 0;
+    }
+    if (self->config.backend == jsmnrpc_server_backend_io_uring)
+    {
+      jsmnrpc_server_close(self);
+      return -1;
+    }
+  }
+  self->backend = jsmnrpc_server_backend_epoll;
+  self->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (self->epoll_fd < 0)
+  {
+    jsmnrpc_server_close(self);
+    return -1;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = &self->wakeup;
+  if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, self->wakeup.fd, &ev) != 0)
+  {
+    jsmnrpc_server_close(self);
+    return -1;
+  }
+  return 0;
+}
+
+int jsmnrpc_server_listen_tcp(jsmnrpc_server_t* self, const char* host, int port)
+{
+  struct addrinfo hints, *res;
+  char service[16];
+  int fd, one = 1;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &res) != 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    freeaddrinfo(res);
+    return -1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (self->config.reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+  {
+    freeaddrinfo(res);
+    close(fd);
+    return -1;
+  }
+  if (bind(fd, res->ai_addr, res->ai_addrlen) != 0)
+  {
+    freeaddrinfo(res);
+    close(fd);
+    return -1;
+  }
+  freeaddrinfo(res);
+  return server_add_listener(self, fd);
+}
+
+int jsmnrpc_server_listen_unix(jsmnrpc_server_t* self, const char* path)
+{
+  struct sockaddr_un addr;
+  int fd;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return server_add_listener(self, fd);
+}
+
+int jsmnrpc_server_listen_fd(jsmnrpc_server_t* self, int fd)
+{
+  return server_add_listener(self, fd);
+}
+
+int jsmnrpc_server_adopt(jsmnrpc_server_t* self, int fd)
+{
+  if (server_set_nonblocking(fd) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return conn_open(self, fd);
+}
+
+int jsmnrpc_server_poll(jsmnrpc_server_t* self, int timeout_ms)
+{
+  struct epoll_event events[SERVER_MAX_EVENTS];
+  int n, i;
+  if (self->uring)
+  {
+    return jsmnrpc_server_uring_poll(self, timeout_ms);
+  }
+  n = epoll_wait(self->epoll_fd, events, SERVER_MAX_EVENTS, timeout_ms);
+  if (n < 0)
+  {
+    return errno == EINTR ? 0 : -1;
+  }
+  for (i = 0; i < n; i++)
+  {
+    jsmnrpc_server_handle_t* handle = (jsmnrpc_server_handle_t*)events[i].data.ptr;
+    if (handle->kind == server_handle_connection)
+    {
+      conn_on_event(self, (jsmnrpc_server_conn_t*)handle, events[i].events);
+    }
+    else if (handle->kind == server_handle_listener)
+    {
+      server_accept(self, handle);
+    }
+    else
+    {
+      uint64_t value;
+      if (read(handle->fd, &value, sizeof(value)) < 0)
+      {
+        /* already drained */
+      }
+      jsmnrpc_server_complete(self);
+    }
+  }
+  return n;
+}
+
+int jsmnrpc_server_run(jsmnrpc_server_t* self)
+{
+  while (!self->stopping)
+  {
+    if (jsmnrpc_server_poll(self, -1) < 0)
+    {
+      return -1;
+    }
+  }
+  self->stopping = 0;
+  return 0;
+}
+
+void jsmnrpc_server_stop(jsmnrpc_server_t* self)
+{
+  uint64_t one = 1;
+  self->stopping = 1;
+  if (write(self->wakeup.fd, &one, sizeof(one)) < 0)
+  {
+    /* the counter is already non-zero: the loop wakes up anyway */
+  }
+}
+
+void jsmnrpc_server_queue_metrics(jsmnrpc_server_t* self, jsmnrpc_pipeline_metrics_t* metrics)
+{
+  if (self->workers && self->workers->pipeline.workers)
+  {
+    jsmnrpc_pipeline_metrics(&self->workers->pipeline, metrics);
+  }
+  else
+  {
+    memset(metrics, 0, sizeof(*metrics));
+  }
+}
+
+void jsmnrpc_server_close(jsmnrpc_server_t* self)
+{
+  int i;
+  if (self->uring)
+  {
+    jsmnrpc_server_uring_close(self); /* cancels the operations still in flight */
+  }
+  if (self->workers)
+  {
+    server_stop_workers(self); /* before the connections their jobs point to */
+  }
+  while (self->connections)
+  {
+    jsmnrpc_server_conn_release(self, self->connections);
+  }
+  while (self->free_connections)
+  {
+    jsmnrpc_server_conn_t* c = self->free_connections;
+    self->free_connections = c->next;
+    conn_free(c);
+  }
+  for (i = 0; i < self->num_of_listeners; i++)
+  {
+    close(self->listeners[i].fd);
+  }
+  self->num_of_listeners = 0;
+  if (self->wakeup.fd >= 0)
+  {
+    close(self->wakeup.fd);
+    self->wakeup.fd = -1;
+  }
+  if (self->epoll_fd >= 0)
+  {
+    close(self->epoll_fd);
+    self->epoll_fd = -1;
+  }
+  if (self->spare_fd >= 0)
+  {
+    close(self->spare_fd);
+    self->spare_fd = -1;
+  }
+}
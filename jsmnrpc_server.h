@@ -0,0 +1,253 @@
+/**
+@file    jsmnrpc_server.h
+@brief   Reference non-blocking JSON-RPC server (Linux, epoll or io_uring) for TCP
+         and Unix domain sockets. A single thread runs the event loop and calls
+         jsmnrpc_handle_request for each framed request.
+
+         Every connection owns a receive buffer, a send buffer and a jsmnrpc_data_t
+         that are reused for all its requests (and recycled for later connections).
+         Requests are tokenized in place in the receive buffer, and responses are
+         built directly in the send buffer, framed and written out without copies.
+         Unlike the rest of jsmnrpc, the server allocates its buffers (once per
+         connection slot) with malloc. With jsmnrpc_framing_http it speaks
+         HTTP/1.1 (keep-alive, pipelining) to clients POSTing requests, and with
+         jsmnrpc_framing_websocket it accepts WebSocket connections. Framing and
+         request handling are done by jsmnrpc_conn (jsmnrpc_conn.h), which other
+         event loops can use without the server.
+
+         With config.workers, handlers run on a pool of worker threads (a
+         jsmnrpc_pipeline) instead of the event loop thread: the loop keeps
+         framing and submitting the requests of a connection, up to
+         max_in_flight at a time, while earlier ones run, and writes each
+         response when a worker hands it back through the wakeup eventfd, in
+         completion order or, with in_order, in request order.
+
+         Load is bounded at three levels: max_in_flight per connection and jobs
+         over all connections stop the loop from reading further requests until
+         responses were written (the client's TCP window closes instead), and
+         max_queued turns requests that would wait behind that many others for
+         a worker into an immediate "Server busy" error (-32000). With
+         timeout_ms, calls that could not start within that time of their
+         request being read are answered "Request timeout" (-32001).
+
+         With workers, a client can cancel a request it no longer waits for
+         with a "$/cancelRequest" notification ({"id": ...} as params, see
+         cancel_method). If the request has not started, it is answered
+         "Request cancelled" (-32800) without running. A running handler can
+         check jsmnrpc_request_cancelled(). Requests of a connection that
+         closes are cancelled the same way.
+
+         Handlers registered with a priority class (jsmnrpc_register_handler_ex)
+         wait for a worker in a queue of their class; workers serve the classes
+         in weighted round robin (see jsmnrpc_pipeline.h), high priority requests
+         are never answered "Server busy", and bulk_workers keeps workers free of
+         bulk requests for the others.
+
+         The io_uring backend (Linux 6.0+) accepts and receives with multishot
+         operations into a ring of provided buffers registered with the kernel,
+         frames requests straight out of those buffers, and sends responses from
+         the send buffer; all operations of one loop iteration are submitted with
+         a single system call. It is compiled in when <linux/io_uring.h> is found
+         (or with -DJSMNRPC_IO_URING=1), and the server falls back to epoll when
+         the running kernel does not support it.
+*/
+#pragma once
+#ifndef _jsmnrpc_server_h_
+#define _jsmnrpc_server_h_
+
+#include <stdint.h>
+
+#include "jsmnrpc.h"
+#include "jsmnrpc_frame.h"
+#include "jsmnrpc_pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JSMNRPC_IO_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define JSMNRPC_IO_URING 1
+#endif
+#endif
+#endif
+#ifndef JSMNRPC_IO_URING
+#define JSMNRPC_IO_URING 0
+#endif
+
+#define JSMNRPC_SERVER_MAX_LISTENERS 8
+
+/* io_uring backend: provided receive buffers (count must be a power of 2) */
+#ifndef JSMNRPC_SERVER_URING_BUFFERS
+#define JSMNRPC_SERVER_URING_BUFFERS 1024
+#endif
+#ifndef JSMNRPC_SERVER_URING_BUFFER_SIZE
+#define JSMNRPC_SERVER_URING_BUFFER_SIZE (16 << 10)
+#endif
+
+typedef enum jsmnrpc_server_backend
+{
+  jsmnrpc_server_backend_auto = 0,   /* io_uring if the kernel supports it, else epoll */
+  jsmnrpc_server_backend_epoll,
+  jsmnrpc_server_backend_io_uring,   /* jsmnrpc_server_init fails if unavailable */
+} jsmnrpc_server_backend_t;
+
+/**
+* @brief Server settings (see jsmnrpc_server_config_init() for defaults).
+*/
+typedef struct jsmnrpc_server_config
+{
+  jsmnrpc_framing_t framing;
+  jsmnrpc_server_backend_t backend;
+  size_t max_request;        /* largest request accepted (bytes, without framing) */
+  size_t max_response;       /* largest response produced; larger ones become an error */
+  jsmn_size_t max_tokens;    /* tokens available to parse one request */
+  int max_connections;       /* further connections are accepted and closed at once */
+  int listen_backlog;
+  int reuse_port;            /* TCP listeners set SO_REUSEPORT (several servers share a port) */
+  int workers;               /* handler threads (0: handlers run on the event loop thread) */
+  int max_in_flight;         /* with workers: requests of one connection running or queued at a time */
+  int in_order;              /* with workers: responses are written in request order (always with HTTP) */
+  int jobs;                  /* with workers: requests in flight over all connections */
+  int max_queued;            /* with workers: requests waiting for a worker before new ones are answered
+                                "Server busy" (0: no limit) */
+  int timeout_ms;            /* deadline of each request from when it is framed (0: none): calls of it
+                                not started by then, e.g. in a long batch or a worker queue, time out
+                                (jsmnrpc.c built with JSMNRPC_DEADLINES, as in libjsmnrpc.a) */
+  const char* cancel_method; /* with workers: notification cancelling a request of the connection by id
+                                (NULL: none) */
+  int bulk_workers;          /* with workers: workers running bulk priority requests at most (0: any) */
+} jsmnrpc_server_config_t;
+
+/**
+* @brief Counters maintained by the event loop (read them from the loop thread,
+*        or accept slightly stale values from other threads).
+*/
+typedef struct jsmnrpc_server_counters
+{
+  uint64_t accepted;
+  uint64_t rejected;         /* connections over max_connections, or while out of descriptors */
+  uint64_t closed;
+  uint64_t requests;         /* framed requests handled */
+  uint64_t protocol_errors;  /* connections closed because of malformed framing */
+  uint64_t bytes_received;
+  uint64_t bytes_sent;
+  uint64_t reads;            /* read() calls (io_uring: receive completions) */
+  uint64_t writes;           /* write() calls (io_uring: sends submitted) */
+} jsmnrpc_server_counters_t;
+
+typedef struct jsmnrpc_server_conn jsmnrpc_server_conn_t;
+typedef struct jsmnrpc_server_uring jsmnrpc_server_uring_t;
+typedef struct jsmnrpc_server_workers jsmnrpc_server_workers_t;
+
+/**
+* @brief Handle registered with epoll (listening socket, wakeup eventfd or connection).
+*/
+typedef struct jsmnrpc_server_handle
+{
+  int kind;
+  int fd;
+} jsmnrpc_server_handle_t;
+
+typedef struct jsmnrpc_server
+{
+  jsmnrpc_instance_t* rpc;
+  jsmnrpc_server_config_t config;
+  void* arg;                 /* passed to handlers as info->data->arg */
+  jsmnrpc_server_backend_t backend;     /* backend in use (never auto) */
+  int epoll_fd;
+  int spare_fd;              /* reserved for shedding connections when out of descriptors */
+  jsmnrpc_server_uring_t* uring;
+  jsmnrpc_server_workers_t* workers;    /* with config.workers */
+  jsmnrpc_server_handle_t wakeup;
+  jsmnrpc_server_handle_t listeners[JSMNRPC_SERVER_MAX_LISTENERS];
+  int num_of_listeners;
+  jsmnrpc_server_conn_t* connections;   /* open connections */
+  jsmnrpc_server_conn_t* free_connections;
+  int num_of_connections;
+  volatile int stopping;
+  jsmnrpc_server_counters_t counters;
+} jsmnrpc_server_t;
+
+/**
+* @brief Fills 'config' with defaults: automatic backend, newline framing, requests up to the largest
+*        size jsmn_size_t can index (at most 1 MiB), 1 MiB responses, 1024 connections,
+*        handlers on the loop thread (with workers: 16 requests in flight per connection,
+*        256 in all, responses in completion order, cancellation by "$/cancelRequest").
+*/
+void jsmnrpc_server_config_init(jsmnrpc_server_config_t* config);
+
+/**
+* @brief initialise a server for an rpc instance.
+* @param self pointer to the jsmnrpc_server_t object.
+* @param rpc instance whose handlers serve the requests; it must outlive the server.
+* @param config settings, or NULL for defaults.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_server_init(jsmnrpc_server_t* self, jsmnrpc_instance_t* rpc, const jsmnrpc_server_config_t* config);
+
+/**
+* @brief Listens on a TCP port. 'host' may be NULL (any address).
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_server_listen_tcp(jsmnrpc_server_t* self, const char* host, int port);
+
+/**
+* @brief Listens on a Unix domain socket, replacing any stale socket file at 'path'.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_server_listen_unix(jsmnrpc_server_t* self, const char* path);
+
+/**
+* @brief Accepts connections on an already bound stream socket (e.g. one passed
+*        by the service manager, or shared by several servers: a connection wakes
+*        only one of them). The server takes ownership of 'fd'.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_server_listen_fd(jsmnrpc_server_t* self, int fd);
+
+/**
+* @brief Serves an already connected stream socket (or socketpair end).
+*        The server takes ownership of 'fd'.
+* @return 0 on success, -1 on error.
+*/
+int jsmnrpc_server_adopt(jsmnrpc_server_t* self, int fd);
+
+/**
+* @brief Runs one event loop iteration, waiting at most 'timeout_ms' (-1: forever).
+*        A server may be set up by one thread and run by another, but only one
+*        thread may run it (with io_uring, the first thread that polls).
+* @return number of events processed, or -1 on error.
+*/
+int jsmnrpc_server_poll(jsmnrpc_server_t* self, int timeout_ms);
+
+/**
+* @brief Runs the event loop until jsmnrpc_server_stop() is called.
+* @return 0 when stopped, -1 on error.
+*/
+int jsmnrpc_server_run(jsmnrpc_server_t* self);
+
+/**
+* @brief Makes jsmnrpc_server_run() return. Safe to call from other threads and
+*        from signal handlers.
+*/
+void jsmnrpc_server_stop(jsmnrpc_server_t* self);
+
+/**
+* @brief Takes a snapshot of the worker queues (requests submitted, refused for
+*        lack of jobs, answered "Server busy", time spent waiting for a worker).
+*        All zero without workers. Safe to call from other threads.
+*/
+void jsmnrpc_server_queue_metrics(jsmnrpc_server_t* self, jsmnrpc_pipeline_metrics_t* metrics);
+
+/**
+* @brief Closes all connections and listeners and frees the buffers.
+*/
+void jsmnrpc_server_close(jsmnrpc_server_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_server_h_ */
@@ -0,0 +1,264 @@
+/**
+@file    jsmnrpc_server_group.c
+@brief   Thread-per-core mode for jsmnrpc_server (see jsmnrpc_server_group.h).
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* sched_getaffinity, pthread_setaffinity_np */
+#endif
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "jsmnrpc_server_group.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+/* the n-th CPU (modulo their number) the process may run on, or -1 */
+static int group_cpu(int n)
+{
+  cpu_set_t set;
+  int count, cpu;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0 || (count = CPU_COUNT(&set)) == 0)
+  {
+    return -1;
+  }
+  n %= count;
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+  {
+    if (CPU_ISSET(cpu, &set) && n-- == 0)
+    {
+      return cpu;
+    }
+  }
+  return -1;
+}
+
+static void* group_thread_main(void* arg)
+{
+  jsmnrpc_server_group_thread_t* t = (jsmnrpc_server_group_thread_t*)arg;
+  jsmnrpc_server_group_t* self = t->group;
+  if (self->pin_threads)
+  {
+    int cpu = group_cpu(t->index);
+    if (cpu >= 0)
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+  }
+#if JSMNRPC_STATS
+  jsmnrpc_stats_set_thread_shard(t->index);
+#endif
+  if (jsmnrpc_server_run(&self->shards[t->index]) != 0)
+  {
+    self->failed = 1;
+  }
+  return NULL;
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_server_group_init(jsmnrpc_server_group_t* self, jsmnrpc_instance_t* rpc,
+                              const jsmnrpc_server_config_t* config, int num_of_shards)
+{
+  jsmnrpc_server_config_t shard_config;
+  int i;
+  memset(self, 0, sizeof(*self));
+  if (num_of_shards <= 0)
+  {
+    cpu_set_t set;
+    num_of_shards = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set) : 1;
+  }
+  if (config)
+  {
+    shard_config = *config;
+  }
+  else
+  {
+    jsmnrpc_server_config_init(&shard_config);
+  }
+  shard_config.reuse_port = 1;
+  self->pin_threads = 1;
+  self->shards = (jsmnrpc_server_t*)calloc((size_t)num_of_shards, sizeof(jsmnrpc_server_t));
+  self->threads = (jsmnrpc_server_group_thread_t*)calloc((size_t)num_of_shards, sizeof(jsmnrpc_server_group_thread_t));
+  if (self->shards == NULL || self->threads == NULL)
+  {
+    jsmnrpc_server_group_close(self);
+    errno = ENOMEM;
+    return -1;
+  }
+  for (i = 0; i < num_of_shards; i++)
+  {
+    if (jsmnrpc_server_init(&self->shards[i], rpc, &shard_config) != 0)
+    {
+      int error = errno;
+      jsmnrpc_server_group_close(self);
+      errno = error;
+      return -1;
+    }
+    self->num_of_shards++;
+  }
+  return 0;
+}
+
+int jsmnrpc_server_group_listen_tcp(jsmnrpc_server_group_t* self, const char* host, int port)
+{
+  int i;
+  for (i = 0; i < self->num_of_shards; i++)
+  {
+    jsmnrpc_server_t* shard = &self->shards[i];
+    if (jsmnrpc_server_listen_tcp(shard, host, port) != 0)
+    {
+      return -1;
+    }
+    if (port == 0)
+    {
+      struct sockaddr_storage addr;
+      socklen_t len = sizeof(addr);
+      if (getsockname(shard->listeners[shard->num_of_listeners - 1].fd, (struct sockaddr*)&addr, &len) != 0)
+      {
+        return -1;
+      }
+      port = ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6*)&addr)->sin6_port
+                                             : ((struct sockaddr_in*)&addr)->sin_port);
+    }
+  }
+  return port;
+}
+
+int jsmnrpc_server_group_listen_unix(jsmnrpc_server_group_t* self, const char* path)
+{
+  jsmnrpc_server_t* first = &self->shards[0];
+  int i;
+  if (jsmnrpc_server_listen_unix(first, path) != 0)
+  {
+    return -1;
+  }
+  for (i = 1; i < self->num_of_shards; i++)
+  {
+    int fd = dup(first->listeners[first->num_of_listeners - 1].fd);
+    if (fd < 0 || jsmnrpc_server_listen_fd(&self->shards[i], fd) != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int jsmnrpc_server_group_start(jsmnrpc_server_group_t* self)
+{
+  int i;
+  for (i = 0; i < self->num_of_shards; i++)
+  {
+    jsmnrpc_server_group_thread_t* t = &self->threads[i];
+    int r;
+    t->group = self;
+    t->index = i;
+    r = pthread_create(&t->thread, NULL, group_thread_main, t);
+    if (r != 0)
+    {
+      jsmnrpc_server_group_stop(self);
+      jsmnrpc_server_group_wait(self);
+      errno = r;
+      return -1;
+    }
+    self->num_of_threads++;
+  }
+  return 0;
+}
+
+void jsmnrpc_server_group_stop(jsmnrpc_server_group_t* self)
+{
+  int i;
+  for (i = 0; i < self->num_of_shards; i++)
+  {
+    jsmnrpc_server_stop(&self->shards[i]);
+  }
+}
+
+int jsmnrpc_server_group_wait(jsmnrpc_server_group_t* self)
+{
+  int i;
+  for (i = 0; i < self->num_of_threads; i++)
+  {
+    pthread_join(self->threads[i].thread, NULL);
+  }
+  self->num_of_threads = 0;
+  return self->failed ? -1 : 0;
+}
+
+void jsmnrpc_server_group_counters(const jsmnrpc_server_group_t* self, jsmnrpc_server_counters_t* totals)
+{
+  int i;
+  memset(totals, 0, sizeof(*totals));
+  for (i = 0; i < self->num_of_shards; i++)
+  {
+    const jsmnrpc_server_counters_t* c = &self->shards[i].counters;
+    totals->accepted += c->accepted;
+    totals->rejected += c->rejected;
+    totals->closed += c->closed;
+    totals->requests += c->requests;
+    totals->protocol_errors += c->protocol_errors;
+    totals->bytes_received += c->bytes_received;
+    totals->bytes_sent += c->bytes_sent;
+    totals->reads += c->reads;
+    totals->writes += c->writes;
+  }
+}
+
+void jsmnrpc_server_group_queue_metrics(jsmnrpc_server_group_t* self, jsmnrpc_pipeline_metrics_t* totals)
+{
+  jsmnrpc_pipeline_metrics_t m;
+  int i, c;
+  memset(totals, 0, sizeof(*totals));
+  for (i = 0; i < self->num_of_shards; i++)
+  {
+    jsmnrpc_server_queue_metrics(&self->shards[i], &m);
+    totals->submitted += m.submitted;
+    totals->rejected += m.rejected;
+    totals->parse_errors += m.parse_errors;
+    totals->busy += m.busy;
+    totals->cancelled += m.cancelled;
+    totals->executed += m.executed;
+    totals->stolen += m.stolen;
+    totals->written += m.written;
+    totals->in_flight += m.in_flight;
+    totals->execute_depth += m.execute_depth;
+    totals->write_depth += m.write_depth;
+    if (m.execute_max_depth > totals->execute_max_depth)
+    {
+      totals->execute_max_depth = m.execute_max_depth;
+    }
+    if (m.write_max_depth > totals->write_max_depth)
+    {
+      totals->write_max_depth = m.write_max_depth;
+    }
+    jsmnrpc_histogram_merge(&totals->execute_wait_ns, &m.execute_wait_ns);
+    jsmnrpc_histogram_merge(&totals->write_wait_ns, &m.write_wait_ns);
+    for (c = 0; c < jsmnrpc_priority_count; c++)
+    {
+      jsmnrpc_histogram_merge(&totals->priority_wait_ns[c], &m.priority_wait_ns[c]);
+    }
+  }
+}
+
+void jsmnrpc_server_group_close(jsmnrpc_server_group_t* self)
+{
+  int i;
+  for (i = 0; i < self->num_of_shards; i++)
+  {
+    jsmnrpc_server_close(&self->shards[i]);
+  }
+  free(self->shards);
+  free(self->threads);
+  self->shards = NULL;
+  self->threads = NULL;
+  self->num_of_shards = 0;
+}
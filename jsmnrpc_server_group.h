@@ -0,0 +1,108 @@
+/**
+@file    jsmnrpc_server_group.h
+@brief   Thread-per-core mode for jsmnrpc_server: a group of independent servers
+         (shards), each run by its own thread, optionally pinned to its own CPU.
+
+         Every shard has its own event loop, connection slots (buffers and
+         jsmnrpc_data_t) and counters. On TCP each shard binds its own listening
+         socket with SO_REUSEPORT, so the kernel spreads new connections over the
+         shards; a connection then stays on its shard. Nothing mutable is shared
+         on the request path: the jsmnrpc_instance_t (handler table) is only read,
+         so all handlers must be registered before jsmnrpc_server_group_start().
+         With JSMNRPC_STATS, shard i records into statistics shard i; give the
+         jsmnrpc_stats_t (at least) as many shards as the group has.
+*/
+#pragma once
+#ifndef _jsmnrpc_server_group_h_
+#define _jsmnrpc_server_group_h_
+
+#include <pthread.h>
+
+#include "jsmnrpc_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct jsmnrpc_server_group jsmnrpc_server_group_t;
+
+typedef struct jsmnrpc_server_group_thread
+{
+  jsmnrpc_server_group_t* group;
+  int index;                 /* shard run by the thread */
+  pthread_t thread;
+} jsmnrpc_server_group_thread_t;
+
+struct jsmnrpc_server_group
+{
+  jsmnrpc_server_t* shards;
+  int num_of_shards;
+  int pin_threads;           /* pin shard i to the i-th CPU the process may use (default: 1) */
+  jsmnrpc_server_group_thread_t* threads;
+  int num_of_threads;        /* threads started */
+  volatile int failed;       /* a shard's event loop returned an error */
+};
+
+/**
+* @brief Creates the shards.
+* @param rpc instance shared (read-only) by all shards.
+* @param config settings of every shard, or NULL for defaults (reuse_port is forced on).
+* @param num_of_shards number of shards, or 0 for one per CPU the process may use.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_server_group_init(jsmnrpc_server_group_t* self, jsmnrpc_instance_t* rpc,
+                              const jsmnrpc_server_config_t* config, int num_of_shards);
+
+/**
+* @brief Gives every shard a listening socket on the same TCP port (SO_REUSEPORT).
+*        With port 0 the first shard picks a free port and the others follow.
+* @return the port, or -1 on error (errno is set).
+*/
+int jsmnrpc_server_group_listen_tcp(jsmnrpc_server_group_t* self, const char* host, int port);
+
+/**
+* @brief Listens on a Unix domain socket, shared by all shards (whichever is idle
+*        accepts the connection). Each shard registers it exclusively (EPOLLEXCLUSIVE;
+*        io_uring accepts wait exclusively too), so a connection wakes one shard
+*        rather than all of them.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_server_group_listen_unix(jsmnrpc_server_group_t* self, const char* path);
+
+/**
+* @brief Starts one thread per shard running jsmnrpc_server_run().
+* @return 0 on success, -1 on error (threads already started are stopped).
+*/
+int jsmnrpc_server_group_start(jsmnrpc_server_group_t* self);
+
+/**
+* @brief Asks every shard to stop. Safe to call from signal handlers.
+*/
+void jsmnrpc_server_group_stop(jsmnrpc_server_group_t* self);
+
+/**
+* @brief Waits for the shard threads to finish.
+* @return 0, or -1 if a shard's event loop failed.
+*/
+int jsmnrpc_server_group_wait(jsmnrpc_server_group_t* self);
+
+/**
+* @brief Sums the counters of all shards (values of running shards may be slightly stale).
+*/
+void jsmnrpc_server_group_counters(const jsmnrpc_server_group_t* self, jsmnrpc_server_counters_t* totals);
+
+/**
+* @brief Sums the worker queue metrics of all shards (see jsmnrpc_server_queue_metrics).
+*/
+void jsmnrpc_server_group_queue_metrics(jsmnrpc_server_group_t* self, jsmnrpc_pipeline_metrics_t* totals);
+
+/**
+* @brief Closes all shards and frees the group (stop and wait first).
+*/
+void jsmnrpc_server_group_close(jsmnrpc_server_group_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_server_group_h_ */
@@ -0,0 +1,101 @@
+/**
+@file    jsmnrpc_server_priv.h
+@brief   jsmnrpc_server internals shared by its event loop backends (epoll in
+         jsmnrpc_server.c, io_uring in jsmnrpc_server_uring.c). Not installed.
+*/
+#pragma once
+#ifndef _jsmnrpc_server_priv_h_
+#define _jsmnrpc_server_priv_h_
+
+#include "jsmnrpc_conn.h"
+#include "jsmnrpc_pipeline.h"
+#include "jsmnrpc_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum jsmnrpc_server_handle_kinds
+{
+  server_handle_listener = 1,
+  server_handle_wakeup,
+  server_handle_connection,
+};
+
+struct jsmnrpc_server_conn
+{
+  jsmnrpc_server_handle_t handle;    /* registered with epoll, must stay first */
+  jsmnrpc_server_conn_t* next;
+  jsmnrpc_server_conn_t* prev;
+  jsmnrpc_conn_t conn;               /* framing, buffers and request handling */
+  uint32_t events;                   /* events currently registered with epoll (0: not registered) */
+  int pending_ops;                   /* io_uring: submitted operations not yet completed */
+  uint8_t receiving;                 /* io_uring: a multishot receive is armed */
+  uint8_t cancelling;                /* io_uring: the receive is being cancelled */
+  uint8_t sending;                   /* io_uring: a send of the pending output is in flight */
+  uint8_t closing;                   /* released once pending_ops (io_uring) and conn.in_flight drop to 0 */
+  uint8_t stalled;                   /* on the workers' stalled list */
+  uint8_t completing;                /* on the list of connections a wakeup delivered responses to */
+  jsmnrpc_server_conn_t* next_stalled;
+  jsmnrpc_server_conn_t* next_completing;
+};
+
+/**
+* @brief Worker threads (config.workers): requests are submitted to the pipeline,
+*        whose writer callback queues the finished jobs for the event loop and
+*        writes the wakeup eventfd.
+*/
+struct jsmnrpc_server_workers
+{
+  jsmnrpc_pipeline_t pipeline;
+  jsmnrpc_mpmc_queue_t completed;    /* jobs whose response is ready */
+  jsmnrpc_mpmc_cell_t* cells;
+  uint64_t wake_pending;             /* the eventfd was written since the loop last drained 'completed' */
+  jsmnrpc_server_conn_t* stalled;    /* connections whose submit found no free job */
+};
+
+/**
+* @brief Takes a connection slot for 'fd' and links it into the connection list
+*        (the backend still has to start receiving on it).
+* @return the connection, or NULL (then 'fd' is closed).
+*/
+jsmnrpc_server_conn_t* jsmnrpc_server_conn_open(jsmnrpc_server_t* self, int fd);
+
+/**
+* @brief Out of descriptors: gives up the spare descriptor to accept one pending
+*        connection and close it at once (counted as rejected), so a level-triggered
+*        listener does not keep the loop spinning until a descriptor is freed.
+* @return 0 if a connection was shed, -1 if there was none or no spare descriptor.
+*/
+int jsmnrpc_server_shed(jsmnrpc_server_t* self, int listener_fd);
+
+/**
+* @brief Closes the descriptor and returns the connection slot to the free list.
+*/
+void jsmnrpc_server_conn_release(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c);
+
+/**
+* @brief Adds the requests handled and protocol errors seen on the connection
+*        since the last call to the server counters.
+*/
+void jsmnrpc_server_conn_collect(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c);
+
+/**
+* @brief Hands the responses the workers finished to their connections (called
+*        by the backends when the wakeup eventfd fires).
+*/
+void jsmnrpc_server_complete(jsmnrpc_server_t* self);
+
+/* io_uring backend (jsmnrpc_server_uring.c); init fails with ENOSYS when unsupported */
+int jsmnrpc_server_uring_init(jsmnrpc_server_t* self);
+void jsmnrpc_server_uring_close(jsmnrpc_server_t* self);
+int jsmnrpc_server_uring_add_listener(jsmnrpc_server_t* self, jsmnrpc_server_handle_t* listener);
+int jsmnrpc_server_uring_add_conn(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c);
+void jsmnrpc_server_uring_update(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c);
+int jsmnrpc_server_uring_poll(jsmnrpc_server_t* self, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_server_priv_h_ */
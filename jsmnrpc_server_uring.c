@@ -0,0 +1,643 @@
+/**
+@file    jsmnrpc_server_uring.c
+@brief   io_uring event loop backend of jsmnrpc_server (see jsmnrpc_server.h).
+         Uses the raw system calls, so liburing is not needed.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+
+#include "jsmnrpc_server_priv.h"
+
+#if JSMNRPC_IO_URING
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "jsmnrpc_atomic.h"
+#endif
+
+#if JSMNRPC_IO_URING && defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define URING_ENTRIES 1024
+#define URING_BUFFER_GROUP 0
+
+/* operation kind, kept in the low bits of user_data (the rest is the object pointer) */
+enum uring_ops
+{
+  uring_op_wakeup = 1,
+  uring_op_accept,
+  uring_op_recv,
+  uring_op_send,
+  uring_op_cancel,
+  uring_op_mask = 7,
+};
+
+struct jsmnrpc_server_uring
+{
+  int fd;
+  void* rings;                       /* SQ and CQ rings (single mapping) */
+  size_t rings_size;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_array;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  struct io_uring_cqe* cqes;
+  unsigned cq_mask;
+  struct io_uring_buf_ring* buf_ring;   /* provided receive buffers */
+  size_t buf_ring_size;
+  char* buffers;
+  unsigned buf_count;
+  unsigned buf_size;
+  uint16_t buf_tail;
+  uint64_t wakeup_value;
+  int disabled;                      /* created with IORING_SETUP_R_DISABLED, not enabled yet */
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params* p)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t size)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, size);
+}
+
+static int uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static unsigned uring_unsubmitted(const jsmnrpc_server_uring_t* u)
+{
+  return *u->sq_tail - JSMNRPC_ATOMIC_LOAD_ACQUIRE(u->sq_head);
+}
+
+/* a single issuer ring belongs to the thread that enables it: the first one to poll */
+static int uring_enable(jsmnrpc_server_uring_t* u)
+{
+  if (u->disabled)
+  {
+    if (uring_register(u->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) != 0)
+    {
+      return -1;
+    }
+    u->disabled = 0;
+  }
+  return 0;
+}
+
+/* next free submission entry, already queued (the kernel only reads it on io_uring_enter) */
+static struct io_uring_sqe* uring_sqe(jsmnrpc_server_uring_t* u, uint64_t user_data)
+{
+  unsigned tail = *u->sq_tail;
+  struct io_uring_sqe* sqe;
+  if (uring_unsubmitted(u) >= u->sq_entries &&
+      (uring_enable(u) != 0 || uring_enter(u->fd, u->sq_entries, 0, 0, NULL, 0) < 0))
+  {
+    return NULL;
+  }
+  sqe = &u->sqes[tail & u->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = user_data;
+  u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+  JSMNRPC_ATOMIC_STORE_RELEASE(u->sq_tail, tail + 1);
+  return sqe;
+}
+
+static void uring_recycle_buffer(jsmnrpc_server_uring_t* u, unsigned bid)
+{
+  struct io_uring_buf* buf = &u->buf_ring->bufs[u->buf_tail & (u->buf_count - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(u->buffers + (size_t)bid * u->buf_size);
+  buf->len = u->buf_size;
+  buf->bid = (uint16_t)bid;
+  u->buf_tail++;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&u->buf_ring->tail, u->buf_tail);
+}
+
+static int uring_arm_wakeup(jsmnrpc_server_t* self)
+{
+  jsmnrpc_server_uring_t* u = self->uring;
+  struct io_uring_sqe* sqe = uring_sqe(u, (uint64_t)(uintptr_t)&self->wakeup | uring_op_wakeup);
+  if (sqe == NULL)
+  {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = self->wakeup.fd;
+  sqe->addr = (uint64_t)(uintptr_t)&u->wakeup_value;
+  sqe->len = sizeof(u->wakeup_value);
+  return 0;
+}
+
+static int uring_arm_accept(jsmnrpc_server_t* self, jsmnrpc_server_handle_t* listener)
+{
+  struct io_uring_sqe* sqe = uring_sqe(self->uring, (uint64_t)(uintptr_t)listener | uring_op_accept);
+  if (sqe == NULL)
+  {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listener->fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  return 0;
+}
+
+static int uring_arm_recv(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  struct io_uring_sqe* sqe = uring_sqe(self->uring, (uint64_t)(uintptr_t)c | uring_op_recv);
+  if (sqe == NULL)
+  {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = c->handle.fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  c->receiving = 1;
+  c->pending_ops++;
+  return 0;
+}
+
+static void uring_cancel_recv(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  struct io_uring_sqe* sqe;
+  if (!c->receiving || c->cancelling)
+  {
+    return;
+  }
+  sqe = uring_sqe(self->uring, uring_op_cancel);
+  if (sqe)
+  {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)c | uring_op_recv;
+    c->cancelling = 1;
+  }
+}
+
+/* sends the pending output straight from the send buffer */
+static int uring_send(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  struct io_uring_sqe* sqe = uring_sqe(self->uring, (uint64_t)(uintptr_t)c | uring_op_send);
+  size_t length;
+  const char* out = jsmnrpc_conn_next_output(&c->conn, &length);
+  if (sqe == NULL)
+  {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = c->handle.fd;
+  sqe->addr = (uint64_t)(uintptr_t)out;
+  sqe->len = (uint32_t)length;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  c->sending = 1;
+  c->pending_ops++;
+  self->counters.writes++;
+  return 0;
+}
+
+/* aborts the pending operations; the slot is released once they (and the requests
+   on the workers) have completed */
+static void uring_conn_close(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  if (!c->closing)
+  {
+    c->closing = 1;
+    shutdown(c->handle.fd, SHUT_RDWR);
+    uring_cancel_recv(self, c);
+    if (c->conn.in_flight > 0)
+    {
+      jsmnrpc_pipeline_cancel(&self->workers->pipeline, c, NULL, 0, 0); /* nobody waits for them */
+    }
+    jsmnrpc_conn_abort(&c->conn); /* responses of requests still on the workers are dropped */
+  }
+  if (c->pending_ops == 0 && c->conn.in_flight == 0)
+  {
+    jsmnrpc_server_conn_release(self, c);
+  }
+}
+
+/* starts the operations the connection waits for, or closes it once it is done */
+static void uring_conn_update(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  size_t pending;
+  jsmnrpc_server_conn_collect(self, c);
+  if (c->closing || (jsmnrpc_conn_finished(&c->conn) && !c->sending))
+  {
+    uring_conn_close(self, c);
+    return;
+  }
+  if (!c->sending && jsmnrpc_conn_next_output(&c->conn, &pending) != NULL && uring_send(self, c) != 0)
+  {
+    uring_conn_close(self, c);
+    return;
+  }
+  if (!jsmnrpc_conn_wants_input(&c->conn))
+  {
+    uring_cancel_recv(self, c); /* the data still in flight is kept in the receive buffer */
+  }
+  else if (!c->receiving && uring_arm_recv(self, c) != 0)
+  {
+    uring_conn_close(self, c);
+  }
+}
+
+/* keeps bytes the connection could not take; its receive buffer grows if a
+   cancelled receive still delivers more than it can hold */
+static int uring_conn_keep(jsmnrpc_server_conn_t* c, const char* data, size_t len)
+{
+  jsmnrpc_conn_t* conn = &c->conn;
+  if (conn->in_start > 0)
+  {
+    memmove(conn->in, conn->in + conn->in_start, conn->in_len - conn->in_start);
+    conn->in_len -= conn->in_start;
+    conn->in_start = 0;
+  }
+  if (conn->in_cap - conn->in_len < len)
+  {
+    size_t cap = conn->in_cap * 2 > conn->in_len + len ? conn->in_cap * 2 : conn->in_len + len;
+    char* in = (char*)realloc(conn->in, cap);
+    if (in == NULL)
+    {
+      return -1;
+    }
+    conn->in = in;
+    conn->in_cap = cap;
+  }
+  memcpy(conn->in + conn->in_len, data, len);
+  jsmnrpc_conn_input_done(conn, len);
+  return 0;
+}
+
+static void uring_on_recv(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c, int res, unsigned flags)
+{
+  jsmnrpc_server_uring_t* u = self->uring;
+  char* buf = NULL;
+  unsigned bid = 0;
+  if (!(flags & IORING_CQE_F_MORE))
+  {
+    c->receiving = c->cancelling = 0;
+    c->pending_ops--;
+  }
+  if (flags & IORING_CQE_F_BUFFER)
+  {
+    bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    buf = u->buffers + (size_t)bid * u->buf_size;
+  }
+  if (res > 0 && buf && !c->closing && !c->conn.closed)
+  {
+    /* requests are framed and handled in the provided buffer */
+    size_t len = (size_t)res;
+    size_t used = jsmnrpc_conn_feed(&c->conn, buf, len);
+    self->counters.reads++;
+    self->counters.bytes_received += (uint64_t)res;
+    if (used < len && uring_conn_keep(c, buf + used, len - used) != 0)
+    {
+      jsmnrpc_conn_eof(&c->conn);
+    }
+  }
+  else if (res == 0)
+  {
+    jsmnrpc_conn_eof(&c->conn);
+  }
+  else if (res < 0 && res != -ENOBUFS && res != -ECANCELED)
+  {
+    jsmnrpc_conn_eof(&c->conn); /* a broken connection also fails the pending send */
+  }
+  if (buf)
+  {
+    uring_recycle_buffer(u, bid);
+  }
+  uring_conn_update(self, c);
+}
+
+static void uring_on_send(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c, int res)
+{
+  c->sending = 0;
+  c->pending_ops--;
+  if (c->closing)
+  {
+    uring_conn_close(self, c);
+    return;
+  }
+  if (res < 0)
+  {
+    if (res != -EINTR && res != -EAGAIN)
+    {
+      uring_conn_close(self, c);
+      return;
+    }
+  }
+  else
+  {
+    self->counters.bytes_sent += (uint64_t)res;
+    jsmnrpc_conn_output_done(&c->conn, (size_t)res); /* also handles the requests held back */
+  }
+  uring_conn_update(self, c);
+}
+
+static void uring_on_accept(jsmnrpc_server_t* self, jsmnrpc_server_handle_t* listener, int res, unsigned flags)
+{
+  if (res == -EMFILE || res == -ENFILE)
+  {
+    jsmnrpc_server_shed(self, listener->fd); /* else the re-armed accept fails at once again */
+  }
+  else if (res >= 0)
+  {
+    int one = 1;
+    if (self->num_of_connections >= self->config.max_connections)
+    {
+      close(res);
+      self->counters.rejected++;
+    }
+    else
+    {
+      jsmnrpc_server_conn_t* c;
+      setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); /* fails harmlessly on Unix sockets */
+      c = jsmnrpc_server_conn_open(self, res);
+      if (c && uring_arm_recv(self, c) != 0)
+      {
+        jsmnrpc_server_conn_release(self, c);
+      }
+    }
+  }
+  if (!(flags & IORING_CQE_F_MORE) && res != -EBADF && res != -EINVAL)
+  {
+    uring_arm_accept(self, listener);
+  }
+}
+
+static void uring_free(jsmnrpc_server_uring_t* u)
+{
+  if (u->fd >= 0)
+  {
+    close(u->fd);
+  }
+  if (u->rings && u->rings != MAP_FAILED)
+  {
+    munmap(u->rings, u->rings_size);
+  }
+  if (u->sqes && (void*)u->sqes != MAP_FAILED)
+  {
+    munmap(u->sqes, u->sqes_size);
+  }
+  if (u->buf_ring && (void*)u->buf_ring != MAP_FAILED)
+  {
+    munmap(u->buf_ring, u->buf_ring_size);
+  }
+  free(u->buffers);
+  free(u);
+}
+
+/* true if the kernel knows IORING_OP_SEND_ZC, i.e. is 6.0+ like multishot receive */
+static int uring_probe(int fd)
+{
+  size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+  int supported = 0;
+  if (probe && uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+  {
+    supported = probe->last_op >= IORING_OP_SEND_ZC && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+  }
+  free(probe);
+  return supported;
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_server_uring_init(jsmnrpc_server_t* self)
+{
+  jsmnrpc_server_uring_t* u = (jsmnrpc_server_uring_t*)calloc(1, sizeof(*u));
+  struct io_uring_params p;
+  struct io_uring_buf_reg reg;
+  unsigned i;
+  if (u == NULL)
+  {
+    return -1;
+  }
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+  u->fd = uring_setup(URING_ENTRIES, &p);
+  u->disabled = u->fd >= 0;
+  if (u->fd < 0 && errno == EINVAL)
+  {
+    memset(&p, 0, sizeof(p)); /* kernel older than 6.1 */
+    u->fd = uring_setup(URING_ENTRIES, &p);
+  }
+  if (u->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG) ||
+      !uring_probe(u->fd))
+  {
+    int error = u->fd < 0 ? errno : ENOSYS;
+    uring_free(u);
+    errno = error;
+    return -1;
+  }
+
+  u->rings_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  if (u->rings_size < p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe))
+  {
+    u->rings_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  }
+  u->rings = mmap(NULL, u->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = (struct io_uring_sqe*)mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                                       IORING_OFF_SQES);
+  u->buf_count = JSMNRPC_SERVER_URING_BUFFERS;
+  u->buf_size = JSMNRPC_SERVER_URING_BUFFER_SIZE;
+  u->buf_ring_size = u->buf_count * sizeof(struct io_uring_buf);
+  u->buf_ring = (struct io_uring_buf_ring*)mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  u->buffers = (char*)malloc((size_t)u->buf_count * u->buf_size);
+  if (u->rings == MAP_FAILED || (void*)u->sqes == MAP_FAILED || (void*)u->buf_ring == MAP_FAILED ||
+      u->buffers == NULL)
+  {
+    uring_free(u);
+    errno = ENOMEM;
+    return -1;
+  }
+  u->sq_head = (unsigned*)((char*)u->rings + p.sq_off.head);
+  u->sq_tail = (unsigned*)((char*)u->rings + p.sq_off.tail);
+  u->sq_array = (unsigned*)((char*)u->rings + p.sq_off.array);
+  u->sq_mask = *(unsigned*)((char*)u->rings + p.sq_off.ring_mask);
+  u->sq_entries = p.sq_entries;
+  u->cq_head = (unsigned*)((char*)u->rings + p.cq_off.head);
+  u->cq_tail = (unsigned*)((char*)u->rings + p.cq_off.tail);
+  u->cqes = (struct io_uring_cqe*)((char*)u->rings + p.cq_off.cqes);
+  u->cq_mask = *(unsigned*)((char*)u->rings + p.cq_off.ring_mask);
+
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+  reg.ring_entries = u->buf_count;
+  reg.bgid = URING_BUFFER_GROUP;
+  if (uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+  {
+    int error = errno;
+    uring_free(u);
+    errno = error;
+    return -1;
+  }
+  for (i = 0; i < u->buf_count; i++)
+  {
+    uring_recycle_buffer(u, i);
+  }
+  self->uring = u;
+  if (uring_arm_wakeup(self) != 0)
+  {
+    jsmnrpc_server_uring_close(self);
+    return -1;
+  }
+  return 0;
+}
+
+void jsmnrpc_server_uring_close(jsmnrpc_server_t* self)
+{
+  if (self->uring)
+  {
+    uring_free(self->uring); /* closing the ring cancels everything still in flight */
+    self->uring = NULL;
+  }
+}
+
+int jsmnrpc_server_uring_add_listener(jsmnrpc_server_t* self, jsmnrpc_server_handle_t* listener)
+{
+  return uring_arm_accept(self, listener);
+}
+
+int jsmnrpc_server_uring_add_conn(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  return uring_arm_recv(self, c);
+}
+
+void jsmnrpc_server_uring_update(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  uring_conn_update(self, c);
+}
+
+int jsmnrpc_server_uring_poll(jsmnrpc_server_t* self, int timeout_ms)
+{
+  jsmnrpc_server_uring_t* u = self->uring;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned head, tail;
+  int n = 0;
+
+  if (uring_enable(u) != 0)
+  {
+    return -1;
+  }
+  head = *u->cq_head;
+  memset(&arg, 0, sizeof(arg));
+  if (timeout_ms >= 0)
+  {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+  }
+  /* one system call submits everything queued since the last one and waits */
+  if (uring_enter(u->fd, uring_unsubmitted(u), head == JSMNRPC_ATOMIC_LOAD_ACQUIRE(u->cq_tail) ? 1 : 0,
+                  IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+      errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+  {
+    return -1;
+  }
+
+  tail = JSMNRPC_ATOMIC_LOAD_ACQUIRE(u->cq_tail);
+  while (head != tail)
+  {
+    struct io_uring_cqe* cqe = &u->cqes[head & u->cq_mask];
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+    void* ptr = (void*)(uintptr_t)(user_data & ~(uint64_t)uring_op_mask);
+    JSMNRPC_ATOMIC_STORE_RELEASE(u->cq_head, ++head);
+    n++;
+    switch ((int)(user_data & uring_op_mask))
+    {
+    case uring_op_recv:
+      uring_on_recv(self, (jsmnrpc_server_conn_t*)ptr, res, flags);
+      break;
+    case uring_op_send:
+      uring_on_send(self, (jsmnrpc_server_conn_t*)ptr, res);
+      break;
+    case uring_op_accept:
+      uring_on_accept(self, (jsmnrpc_server_handle_t*)ptr, res, flags);
+      break;
+    case uring_op_wakeup:
+      uring_arm_wakeup(self);
+      jsmnrpc_server_complete(self);
+      break;
+    default:
+      break; /* cancellations */
+    }
+    if (head == tail)
+    {
+      tail = JSMNRPC_ATOMIC_LOAD_ACQUIRE(u->cq_tail);
+    }
+  }
+  return n;
+}
+
+#else /* io_uring not available at build time */
+
+int jsmnrpc_server_uring_init(jsmnrpc_server_t* self)
+{
+  (void)self;
+  errno = ENOSYS;
+  return -1;
+}
+
+void jsmnrpc_server_uring_close(jsmnrpc_server_t* self)
+{
+  (void)self;
+}
+
+int jsmnrpc_server_uring_add_listener(jsmnrpc_server_t* self, jsmnrpc_server_handle_t* listener)
+{
+  (void)self;
+  (void)listener;
+  errno = ENOSYS;
+  return -1;
+}
+
+int jsmnrpc_server_uring_add_conn(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  (void)self;
+  (void)c;
+  errno = ENOSYS;
+  return -1;
+}
+
+void jsmnrpc_server_uring_update(jsmnrpc_server_t* self, jsmnrpc_server_conn_t* c)
+{
+  (void)self;
+  (void)c;
+}
+
+int jsmnrpc_server_uring_poll(jsmnrpc_server_t* self, int timeout_ms)
+{
+  (void)self;
+  (void)timeout_ms;
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
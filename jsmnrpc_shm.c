@@ -0,0 +1,368 @@
+/**
+@file    jsmnrpc_shm.c
+@brief   Shared-memory transport (see jsmnrpc_shm.h).
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memfd_create */
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jsmnrpc_atomic.h"
+#include "jsmnrpc_shm.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define SHM_WRAP UINT32_MAX          /* record length marking the unused end of the ring */
+#define SHM_RECORD_HEADER 4          /* uint32_t length in front of each message */
+
+static const char shm_response_too_large[] =
+  "{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32603, \"message\": \"Response too large\"}, \"id\": null}";
+
+/* bytes a record of 'length' takes: header, message, zero, padded to 8 */
+static uint64_t shm_record_size(size_t length)
+{
+  return ((uint64_t)SHM_RECORD_HEADER + length + 1 + 7) & ~(uint64_t)7;
+}
+
+/* processes sharing the segment do not share an address space: no FUTEX_PRIVATE_FLAG */
+static void shm_futex_wait(uint32_t* word, uint32_t expected, int timeout_ms)
+{
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+  syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+}
+
+static void shm_futex_wake(uint32_t* word)
+{
+  syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* bumps a futex word written only by this end, then wakes the peer if it announced
+   that it sleeps on it (the fence orders the bump and the check against the peer's
+   announcement and its check of the ring) */
+static void shm_notify(jsmnrpc_shm_t* self, uint32_t* word, uint32_t* waiting)
+{
+  JSMNRPC_ATOMIC_STORE(word, *word + 1);
+  JSMNRPC_FENCE_SEQ_CST();
+  if (JSMNRPC_ATOMIC_LOAD(waiting))
+  {
+    shm_futex_wake(word);
+    self->counters.wakes++;
+  }
+}
+
+static int shm_readable(jsmnrpc_shm_t* self)
+{
+  return JSMNRPC_ATOMIC_LOAD_ACQUIRE(&self->in->tail) != self->in->head;
+}
+
+/* bytes to skip at the end of the ring before a record of 'need' bytes, or -1 if it does not fit */
+static int64_t shm_room(jsmnrpc_shm_t* self, uint64_t need)
+{
+  uint64_t size = self->mask + 1;
+  uint64_t tail = self->out->tail;
+  uint64_t used = tail - JSMNRPC_ATOMIC_LOAD_ACQUIRE(&self->out->head);
+  uint64_t offset = tail & self->mask;
+  uint64_t skip = size - offset < need ? size - offset : 0;
+  return size - used >= skip + need ? (int64_t)skip : -1;
+}
+
+/* makes the reserved record visible (without waking the peer) */
+static void shm_publish(jsmnrpc_shm_t* self, size_t length)
+{
+  uint64_t tail = self->out->tail;
+  char* record;
+  if (self->out_skip)
+  {
+    *(uint32_t*)(self->out_data + (tail & self->mask)) = SHM_WRAP;
+    tail += self->out_skip;
+  }
+  record = self->out_data + (tail & self->mask);
+  *(uint32_t*)record = (uint32_t)length;
+  record[SHM_RECORD_HEADER + length] = 0;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&self->out->tail, tail + shm_record_size(length));
+  self->out_skip = 0;
+  self->counters.sent++;
+}
+
+/* frees the peeked record (without waking the peer) */
+static void shm_consume(jsmnrpc_shm_t* self)
+{
+  JSMNRPC_ATOMIC_STORE_RELEASE(&self->in->head, self->in->head + self->in_record);
+  self->in_record = 0;
+  self->counters.received++;
+}
+
+static int shm_map(jsmnrpc_shm_t* self, int fd, size_t map_size, int server)
+{
+  char* base = (char*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  jsmnrpc_shm_header_t* header = (jsmnrpc_shm_header_t*)base;
+  char* data = base + sizeof(jsmnrpc_shm_header_t);
+  if (base == (char*)MAP_FAILED)
+  {
+    return -1;
+  }
+  self->header = header;
+  self->map_size = map_size;
+  self->in = &header->rings[server ? 0 : 1];
+  self->out = &header->rings[server ? 1 : 0];
+  self->in_data = server ? data : data + (map_size - sizeof(jsmnrpc_shm_header_t)) / 2;
+  self->out_data = server ? data + (map_size - sizeof(jsmnrpc_shm_header_t)) / 2 : data;
+  return 0;
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_shm_create(jsmnrpc_shm_t* self, size_t ring_size)
+{
+  size_t map_size = sizeof(jsmnrpc_shm_header_t) + 2 * ring_size;
+  memset(self, 0, sizeof(*self));
+  self->fd = -1;
+  if (ring_size < 4096 || ring_size > ((size_t)1 << 30) || (ring_size & (ring_size - 1)) != 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  self->fd = memfd_create("jsmnrpc-shm", MFD_CLOEXEC);
+  if (self->fd < 0 || ftruncate(self->fd, (off_t)map_size) != 0 || shm_map(self, self->fd, map_size, 1) != 0)
+  {
+    int error = errno;
+    jsmnrpc_shm_close(self);
+    errno = error;
+    return -1;
+  }
+  self->header->magic = JSMNRPC_SHM_MAGIC;
+  self->header->version = JSMNRPC_SHM_VERSION;
+  self->header->ring_size = (uint32_t)ring_size;
+  self->mask = ring_size - 1;
+  return 0;
+}
+
+int jsmnrpc_shm_attach(jsmnrpc_shm_t* self, int fd)
+{
+  struct stat st;
+  memset(self, 0, sizeof(*self));
+  self->fd = -1;
+  if (fstat(fd, &st) != 0)
+  {
+    return -1;
+  }
+  if ((size_t)st.st_size < sizeof(jsmnrpc_shm_header_t))
+  {
+    errno = EPROTO;
+    return -1;
+  }
+  if (shm_map(self, fd, (size_t)st.st_size, 0) != 0)
+  {
+    return -1;
+  }
+  if (self->header->magic != JSMNRPC_SHM_MAGIC || self->header->version != JSMNRPC_SHM_VERSION ||
+      (size_t)st.st_size != sizeof(jsmnrpc_shm_header_t) + 2 * (size_t)self->header->ring_size)
+  {
+    munmap(self->header, self->map_size);
+    self->header = NULL;
+    errno = EPROTO;
+    return -1;
+  }
+  self->mask = self->header->ring_size - 1;
+  return 0;
+}
+
+void jsmnrpc_shm_close(jsmnrpc_shm_t* self)
+{
+  if (self->header)
+  {
+    JSMNRPC_ATOMIC_STORE_RELEASE(&self->out->closed, 1);
+    shm_notify(self, &self->out->readable, &self->out->reader_waiting);
+    munmap(self->header, self->map_size);
+    self->header = NULL;
+  }
+  if (self->fd >= 0)
+  {
+    close(self->fd);
+    self->fd = -1;
+  }
+}
+
+char* jsmnrpc_shm_reserve(jsmnrpc_shm_t* self, size_t max_length)
+{
+  uint64_t need = shm_record_size(max_length);
+  int64_t skip;
+  if (need > (self->mask + 1) / 2)
+  {
+    errno = EMSGSIZE;
+    return NULL;
+  }
+  skip = shm_room(self, need);
+  if (skip < 0)
+  {
+    errno = EAGAIN;
+    return NULL;
+  }
+  self->out_skip = (uint64_t)skip;
+  return self->out_data + ((self->out->tail + (uint64_t)skip) & self->mask) + SHM_RECORD_HEADER;
+}
+
+void jsmnrpc_shm_commit(jsmnrpc_shm_t* self, size_t length)
+{
+  shm_publish(self, length);
+  shm_notify(self, &self->out->readable, &self->out->reader_waiting);
+}
+
+int jsmnrpc_shm_send(jsmnrpc_shm_t* self, const char* message, size_t length)
+{
+  char* room = jsmnrpc_shm_reserve(self, length);
+  if (room == NULL)
+  {
+    return -1;
+  }
+  memcpy(room, message, length);
+  jsmnrpc_shm_commit(self, length);
+  return 0;
+}
+
+char* jsmnrpc_shm_peek(jsmnrpc_shm_t* self, size_t* length)
+{
+  uint64_t size = self->mask + 1;
+  uint64_t head = self->in->head;
+  uint64_t used;
+  uint64_t skip = 0;
+  char* record;
+  uint32_t record_length;
+  if (self->broken)
+  {
+    errno = EPROTO;
+    return NULL;
+  }
+  if (!shm_readable(self))
+  {
+    return NULL;
+  }
+  /* the peer wrote the tail and the records: check them before trusting them */
+  used = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&self->in->tail) - head;
+  record = self->in_data + (head & self->mask);
+  record_length = *(uint32_t*)record;
+  if (record_length == SHM_WRAP)
+  {
+    skip = size - (head & self->mask);
+    record = self->in_data;
+    record_length = *(uint32_t*)record;
+  }
+  if (used > size || record_length > size / 2 || skip + shm_record_size(record_length) > used)
+  {
+    self->broken = 1;
+    errno = EPROTO;
+    return NULL;
+  }
+  self->in_record = skip + shm_record_size(record_length);
+  *length = record_length;
+  return record + SHM_RECORD_HEADER;
+}
+
+void jsmnrpc_shm_release(jsmnrpc_shm_t* self)
+{
+  shm_consume(self);
+  shm_notify(self, &self->in->writable, &self->in->writer_waiting);
+}
+
+int jsmnrpc_shm_wait_readable(jsmnrpc_shm_t* self, int timeout_ms)
+{
+  jsmnrpc_shm_ring_t* ring = self->in;
+  if (!shm_readable(self) && !JSMNRPC_ATOMIC_LOAD_ACQUIRE(&ring->closed))
+  {
+    uint32_t seen = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&ring->readable);
+    JSMNRPC_ATOMIC_STORE(&ring->reader_waiting, 1);
+    JSMNRPC_FENCE_SEQ_CST();
+    if (!shm_readable(self) && !JSMNRPC_ATOMIC_LOAD_ACQUIRE(&ring->closed))
+    {
+      shm_futex_wait(&ring->readable, seen, timeout_ms);
+      self->counters.waits++;
+    }
+    JSMNRPC_ATOMIC_STORE(&ring->reader_waiting, 0);
+  }
+  if (self->broken)
+  {
+    errno = EPROTO;
+    return -1;
+  }
+  if (shm_readable(self))
+  {
+    return 1;
+  }
+  if (JSMNRPC_ATOMIC_LOAD_ACQUIRE(&ring->closed))
+  {
+    errno = EPIPE;
+    return -1;
+  }
+  return 0;
+}
+
+int jsmnrpc_shm_wait_writable(jsmnrpc_shm_t* self, size_t max_length, int timeout_ms)
+{
+  jsmnrpc_shm_ring_t* ring = self->out;
+  uint64_t need = shm_record_size(max_length);
+  if (shm_room(self, need) < 0)
+  {
+    uint32_t seen = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&ring->writable);
+    JSMNRPC_ATOMIC_STORE(&ring->writer_waiting, 1);
+    JSMNRPC_FENCE_SEQ_CST();
+    if (shm_room(self, need) < 0)
+    {
+      shm_futex_wait(&ring->writable, seen, timeout_ms);
+      self->counters.waits++;
+    }
+    JSMNRPC_ATOMIC_STORE(&ring->writer_waiting, 0);
+  }
+  return shm_room(self, need) >= 0;
+}
+
+int jsmnrpc_shm_serve(jsmnrpc_shm_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data, size_t max_response)
+{
+  int handled = 0;
+  size_t length;
+  char* request;
+  while ((request = jsmnrpc_shm_peek(self, &length)) != NULL)
+  {
+    char* response = jsmnrpc_shm_reserve(self, max_response);
+    size_t response_length;
+    if (response == NULL)
+    {
+      break; /* the client is not reading its responses: continue once it does */
+    }
+    data->request.data = request;
+    data->request.length = length;
+    data->response.data = response;
+    data->response.capacity = max_response;
+    jsmnrpc_handle_request(rpc, data);
+
+    response_length = data->response.length;
+    if (response_length > max_response)
+    {
+      response_length = sizeof(shm_response_too_large) - 1;
+      memcpy(response, shm_response_too_large, response_length);
+    }
+    if (response_length > 0)
+    {
+      shm_publish(self, response_length);
+    }
+    shm_consume(self);
+    handled++;
+  }
+  if (handled > 0)
+  {
+    /* one wakeup per batch */
+    shm_notify(self, &self->out->readable, &self->out->reader_waiting);
+    shm_notify(self, &self->in->writable, &self->in->writer_waiting);
+  }
+  return handled;
+}
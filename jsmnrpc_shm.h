@@ -0,0 +1,183 @@
+/**
+@file    jsmnrpc_shm.h
+@brief   Shared-memory transport for JSON-RPC between processes on one host
+         (Linux): a memfd segment holding two single-producer/single-consumer
+         byte rings, one for requests (client -> server) and one for responses
+         (server -> client).
+
+         Messages are stored as length-prefixed records that never wrap around
+         the end of a ring, so the server tokenizes each request in place in the
+         request ring and builds its response directly in the response ring; no
+         byte is copied and, while both sides are busy, no system call is made.
+         A side with nothing to do sleeps on a futex in the segment, and the
+         other side only calls futex_wake when it sees a sleeper.
+
+         The server creates the segment (jsmnrpc_shm_create); the client maps it
+         from the memfd (jsmnrpc_shm_attach), inherited across fork, passed over
+         a Unix socket (SCM_RIGHTS) or opened as /proc/<pid>/fd/<fd>.
+*/
+#pragma once
+#ifndef _jsmnrpc_shm_h_
+#define _jsmnrpc_shm_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsmnrpc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSMNRPC_SHM_MAGIC 0x6d687363707240ULL   /* "@rpcshm" */
+#define JSMNRPC_SHM_VERSION 1
+
+/**
+* @brief Control block of one ring, in the shared segment. The producer writes
+*        the first cache line, the consumer the second.
+*/
+typedef struct jsmnrpc_shm_ring
+{
+  uint64_t tail;             /* bytes ever written (producer) */
+  uint32_t readable;         /* futex: bumped by the producer after writing */
+  uint32_t closed;           /* the producer closed its end */
+  char padding1[48];
+  uint64_t head;             /* bytes ever consumed (consumer) */
+  uint32_t writable;         /* futex: bumped by the consumer after consuming */
+  uint32_t padding2;
+  char padding3[48];
+  uint32_t reader_waiting;   /* the consumer sleeps on 'readable' */
+  uint32_t writer_waiting;   /* the producer sleeps on 'writable' */
+  char padding4[56];
+} jsmnrpc_shm_ring_t;
+
+/**
+* @brief Start of the shared segment; the request ring data and then the response
+*        ring data follow it.
+*/
+typedef struct jsmnrpc_shm_header
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t ring_size;        /* bytes of data per ring (a power of 2) */
+  char padding[48];
+  jsmnrpc_shm_ring_t rings[2];   /* [0]: requests, [1]: responses */
+} jsmnrpc_shm_header_t;
+
+typedef struct jsmnrpc_shm_counters
+{
+  uint64_t sent;             /* records written */
+  uint64_t received;         /* records consumed */
+  uint64_t waits;            /* futex_wait calls (the ring was empty or full) */
+  uint64_t wakes;            /* futex_wake calls (the peer was sleeping) */
+} jsmnrpc_shm_counters_t;
+
+/**
+* @brief One end (server or client) of a mapped segment.
+*/
+typedef struct jsmnrpc_shm
+{
+  int fd;                    /* memfd (created segments only, else -1) */
+  jsmnrpc_shm_header_t* header;
+  size_t map_size;
+  uint64_t mask;             /* ring_size - 1 */
+  jsmnrpc_shm_ring_t* in;    /* ring this end reads */
+  char* in_data;
+  jsmnrpc_shm_ring_t* out;   /* ring this end writes */
+  char* out_data;
+  uint64_t in_record;        /* bytes of the record returned by jsmnrpc_shm_peek */
+  uint64_t out_skip;         /* bytes left at the end of the ring by jsmnrpc_shm_reserve */
+  int broken;                /* the peer wrote a malformed record: nothing more is read */
+  jsmnrpc_shm_counters_t counters;
+} jsmnrpc_shm_t;
+
+/**
+* @brief Creates a segment (server end).
+* @param ring_size bytes per ring, a power of 2 of at least 4096; a message may
+*        take up to half of it.
+* @return 0 on success, -1 on error (errno is set).
+*/
+int jsmnrpc_shm_create(jsmnrpc_shm_t* self, size_t ring_size);
+
+/**
+* @brief Maps a segment created by jsmnrpc_shm_create (client end). The fd is not
+*        kept and may be closed afterwards.
+* @return 0 on success, -1 on error (errno is set; EPROTO: not a jsmnrpc segment).
+*/
+int jsmnrpc_shm_attach(jsmnrpc_shm_t* self, int fd);
+
+/**
+* @brief Marks this end closed (the peer's jsmnrpc_shm_wait_readable fails with EPIPE
+*        once it read everything) and unmaps the segment.
+*/
+void jsmnrpc_shm_close(jsmnrpc_shm_t* self);
+
+/**
+* @brief Returns contiguous room for a message of up to 'max_length' bytes (plus a
+*        terminating zero) in the outbound ring, to be written in place and published
+*        with jsmnrpc_shm_commit. Nothing is visible to the peer before that.
+* @return the room, or NULL if the ring is full (errno EAGAIN) or 'max_length'
+*         exceeds half of the ring (EMSGSIZE).
+*/
+char* jsmnrpc_shm_reserve(jsmnrpc_shm_t* self, size_t max_length);
+
+/**
+* @brief Publishes the message written into the reserved room and wakes the peer
+*        if it sleeps.
+* @param length message length, at most the reserved 'max_length'.
+*/
+void jsmnrpc_shm_commit(jsmnrpc_shm_t* self, size_t length);
+
+/**
+* @brief Copies a message into the outbound ring (jsmnrpc_shm_reserve + commit).
+* @return 0 on success, -1 on error (errno as for jsmnrpc_shm_reserve).
+*/
+int jsmnrpc_shm_send(jsmnrpc_shm_t* self, const char* message, size_t length);
+
+/**
+* @brief Returns the oldest message of the inbound ring, in place and zero
+*        terminated. It stays valid until jsmnrpc_shm_release.
+* @return the message, or NULL if the ring is empty or the peer broke the ring
+*         protocol (errno EPROTO: a record longer than half of the ring or past the
+*         tail; the inbound ring is not read any more).
+*/
+char* jsmnrpc_shm_peek(jsmnrpc_shm_t* self, size_t* length);
+
+/**
+* @brief Frees the message returned by jsmnrpc_shm_peek and wakes the peer if it
+*        waits for room.
+*/
+void jsmnrpc_shm_release(jsmnrpc_shm_t* self);
+
+/**
+* @brief Waits until the inbound ring holds a message.
+* @param timeout_ms -1 to wait forever.
+* @return 1 if a message is ready, 0 on timeout (or a signal), -1 if the peer
+*         closed its end and everything was read (errno EPIPE) or broke the ring
+*         protocol (EPROTO).
+*/
+int jsmnrpc_shm_wait_readable(jsmnrpc_shm_t* self, int timeout_ms);
+
+/**
+* @brief Waits until jsmnrpc_shm_reserve(self, max_length) can succeed.
+* @return 1 if there is room, 0 on timeout (or a signal).
+*/
+int jsmnrpc_shm_wait_writable(jsmnrpc_shm_t* self, size_t max_length, int timeout_ms);
+
+/**
+* @brief Server end: handles the requests waiting in the request ring. Each one is
+*        tokenized in place and its response is built directly in the response
+*        ring (responses longer than 'max_response', which must be at least 128,
+*        become an internal error). Stops early while the response ring has no room
+*        for 'max_response' bytes.
+* @param data tokens (and arg) for jsmnrpc_handle_request; its request and response
+*        fields are set here.
+* @return number of requests handled.
+*/
+int jsmnrpc_shm_serve(jsmnrpc_shm_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data, size_t max_response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_shm_h_ */
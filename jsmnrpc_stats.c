@@ -0,0 +1,174 @@
+/**
+@file    jsmnrpc_stats.c
+@brief   Optional per-method instrumentation for jsmnrpc (see jsmnrpc_stats.h).
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "jsmnrpc_atomic.h"
+#include "jsmnrpc_stats.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+/* Next shard handed out to a thread that records its first value */
+static uint64_t jsmnrpc_stats_next_slot = 0;
+static JSMNRPC_THREAD_LOCAL int jsmnrpc_stats_thread_slot = -1;
+
+static int highest_bit(uint64_t value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return (int)index;
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+static int histogram_bucket(uint64_t value)
+{
+  int msb;
+  int index;
+  if (value < JSMNRPC_HIST_SUB_COUNT)
+  {
+    return (int)value;
+  }
+  msb = highest_bit(value);
+  index = (msb - JSMNRPC_HIST_SUB_BITS + 1) * JSMNRPC_HIST_SUB_COUNT +
+    (int)((value >> (msb - JSMNRPC_HIST_SUB_BITS)) & (JSMNRPC_HIST_SUB_COUNT - 1));
+  if (index >= JSMNRPC_HIST_BUCKETS)
+  {
+    index = JSMNRPC_HIST_BUCKETS - 1;
+  }
+  return index;
+}
+
+/* Highest value that falls into the given bucket */
+static uint64_t histogram_bucket_upper(int index)
+{
+  int msb;
+  uint64_t sub;
+  if (index < JSMNRPC_HIST_SUB_COUNT)
+  {
+    return (uint64_t)index;
+  }
+  msb = index / JSMNRPC_HIST_SUB_COUNT + JSMNRPC_HIST_SUB_BITS - 1;
+  sub = (uint64_t)(index % JSMNRPC_HIST_SUB_COUNT);
+  return ((JSMNRPC_HIST_SUB_COUNT + sub + 1) << (msb - JSMNRPC_HIST_SUB_BITS)) - 1;
+}
+
+/* Exported functions ------------------------------------------------------- */
+void jsmnrpc_stats_init(jsmnrpc_stats_t* self, jsmnrpc_stats_shard_t* shards, jsmnrpc_method_stats_t* methods,
+                        int num_of_shards, int max_num_of_handlers)
+{
+  int i;
+  self->shards = shards;
+  self->num_of_shards = num_of_shards;
+  self->max_num_of_handlers = max_num_of_handlers;
+
+  memset(shards, 0, sizeof(jsmnrpc_stats_shard_t) * num_of_shards);
+  memset(methods, 0, sizeof(jsmnrpc_method_stats_t) * num_of_shards * max_num_of_handlers);
+  for (i = 0; i < num_of_shards; i++)
+  {
+    shards[i].methods = methods + i * max_num_of_handlers;
+  }
+}
+
+jsmnrpc_stats_shard_t* jsmnrpc_stats_local_shard(jsmnrpc_stats_t* self)
+{
+  if (jsmnrpc_stats_thread_slot < 0)
+  {
+    jsmnrpc_stats_thread_slot = (int)(JSMNRPC_ATOMIC_ADD(&jsmnrpc_stats_next_slot, 1) & 0x7fffffff);
+  }
+  return self->shards + (jsmnrpc_stats_thread_slot % self->num_of_shards);
+}
+
+void jsmnrpc_stats_set_thread_shard(int index)
+{
+  jsmnrpc_stats_thread_slot = index & 0x7fffffff;
+}
+
+void jsmnrpc_histogram_record(jsmnrpc_histogram_t* self, uint64_t value)
+{
+  JSMNRPC_ATOMIC_ADD(&self->buckets[histogram_bucket(value)], 1);
+  JSMNRPC_ATOMIC_ADD(&self->count, 1);
+  JSMNRPC_ATOMIC_ADD(&self->sum, value);
+  jsmnrpc_atomic_max(&self->max, value);
+}
+
+void jsmnrpc_histogram_merge(jsmnrpc_histogram_t* dst, const jsmnrpc_histogram_t* src)
+{
+  int i;
+  uint64_t max = JSMNRPC_ATOMIC_LOAD(&src->max);
+  for (i = 0; i < JSMNRPC_HIST_BUCKETS; i++)
+  {
+    dst->buckets[i] += JSMNRPC_ATOMIC_LOAD(&src->buckets[i]);
+  }
+  dst->count += JSMNRPC_ATOMIC_LOAD(&src->count);
+  dst->sum += JSMNRPC_ATOMIC_LOAD(&src->sum);
+  if (max > dst->max)
+  {
+    dst->max = max;
+  }
+}
+
+uint64_t jsmnrpc_histogram_percentile(const jsmnrpc_histogram_t* self, double percentile)
+{
+  int i;
+  uint64_t total = 0;
+  uint64_t seen = 0;
+  uint64_t rank;
+  for (i = 0; i < JSMNRPC_HIST_BUCKETS; i++)
+  {
+    total += self->buckets[i];
+  }
+  if (total == 0)
+  {
+    return 0;
+  }
+  rank = (uint64_t)((percentile / 100.0) * (double)total + 0.5);
+  if (rank < 1)
+  {
+    rank = 1;
+  }
+  for (i = 0; i < JSMNRPC_HIST_BUCKETS; i++)
+  {
+    seen += self->buckets[i];
+    if (seen >= rank)
+    {
+      uint64_t upper = histogram_bucket_upper(i);
+      return (self->max && upper > self->max) ? self->max : upper;
+    }
+  }
+  return self->max;
+}
+
+void jsmnrpc_stats_snapshot(jsmnrpc_stats_t* self, jsmnrpc_stats_shard_t* totals)
+{
+  int s;
+  int m;
+  jsmnrpc_method_stats_t* methods = totals->methods;
+  memset(totals, 0, sizeof(*totals));
+  totals->methods = methods;
+  if (methods)
+  {
+    memset(methods, 0, sizeof(jsmnrpc_method_stats_t) * self->max_num_of_handlers);
+  }
+
+  for (s = 0; s < self->num_of_shards; s++)
+  {
+    jsmnrpc_stats_shard_t* shard = self->shards + s;
+    totals->requests += JSMNRPC_ATOMIC_LOAD(&shard->requests);
+    totals->parse_errors += JSMNRPC_ATOMIC_LOAD(&shard->parse_errors);
+    totals->unknown_methods += JSMNRPC_ATOMIC_LOAD(&shard->unknown_methods);
+    jsmnrpc_histogram_merge(&totals->parse_ns, &shard->parse_ns);
+    jsmnrpc_histogram_merge(&totals->response_bytes, &shard->response_bytes);
+    for (m = 0; methods && m < self->max_num_of_handlers; m++)
+    {
+      methods[m].calls += JSMNRPC_ATOMIC_LOAD(&shard->methods[m].calls);
+      methods[m].errors += JSMNRPC_ATOMIC_LOAD(&shard->methods[m].errors);
+      jsmnrpc_histogram_merge(&methods[m].latency_ns, &shard->methods[m].latency_ns);
+    }
+  }
+}
@@ -0,0 +1,115 @@
+/**
+@file    jsmnrpc_stats.h
+@brief   Optional per-method instrumentation for jsmnrpc (enabled with JSMNRPC_STATS=1).
+         Counters are kept in per-thread shards (updated lock-free) and are merged
+         only when a snapshot is taken, so reading them never stops request handling.
+         As the rest of jsmnrpc, this module does not allocate: storage for shards and
+         per-method counters is provided by the caller.
+*/
+#pragma once
+#ifndef _jsmnrpc_stats_h_
+#define _jsmnrpc_stats_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Histogram resolution: each power of two is split into 2^JSMNRPC_HIST_SUB_BITS buckets
+   (5: values within 3%, 7: within 1% like HDR with 2 significant digits, at 4 times the size) */
+#ifndef JSMNRPC_HIST_SUB_BITS
+#define JSMNRPC_HIST_SUB_BITS 5
+#endif
+#define JSMNRPC_HIST_SUB_COUNT (1 << JSMNRPC_HIST_SUB_BITS)
+/* Values below 2^41 are resolved (~36 minutes when recording nanoseconds), larger ones are clamped */
+#define JSMNRPC_HIST_BUCKETS ((42 - JSMNRPC_HIST_SUB_BITS) * JSMNRPC_HIST_SUB_COUNT)
+
+/**
+* @brief HDR-style log-linear histogram (relative error below 1/JSMNRPC_HIST_SUB_COUNT).
+*/
+typedef struct jsmnrpc_histogram
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[JSMNRPC_HIST_BUCKETS];
+} jsmnrpc_histogram_t;
+
+/**
+* @brief Counters kept for each registered handler.
+*/
+typedef struct jsmnrpc_method_stats
+{
+  uint64_t calls;
+  uint64_t errors;           /* calls for which the handler created an error response */
+  jsmnrpc_histogram_t latency_ns;
+} jsmnrpc_method_stats_t;
+
+/**
+* @brief Counters updated by a single thread (or a group of threads when there are
+*        more threads than shards). 'methods' points at max_num_of_handlers entries.
+*/
+typedef struct jsmnrpc_stats_shard
+{
+  jsmnrpc_method_stats_t* methods;
+  uint64_t requests;         /* calls to jsmnrpc_handle_request */
+  uint64_t parse_errors;
+  uint64_t unknown_methods;
+  jsmnrpc_histogram_t parse_ns;
+  jsmnrpc_histogram_t response_bytes;
+  char padding[64];          /* keeps neighbouring shards off the same cache line */
+} jsmnrpc_stats_shard_t;
+
+/**
+* @brief Statistics storage attached to a jsmnrpc_instance_t (see jsmnrpc_set_stats()).
+*/
+typedef struct jsmnrpc_stats
+{
+  jsmnrpc_stats_shard_t* shards;
+  int num_of_shards;
+  int max_num_of_handlers;
+} jsmnrpc_stats_t;
+
+/**
+* @brief initialise statistics storage.
+* @param self pointer to the jsmnrpc_stats_t object.
+* @param shards table of num_of_shards shards (one per thread calling jsmnrpc_handle_request is ideal).
+* @param methods table of (num_of_shards * max_num_of_handlers) per-method counters.
+* @param num_of_shards number of items in the shards table.
+* @param max_num_of_handlers the same value as used for jsmnrpc_init().
+*/
+void jsmnrpc_stats_init(jsmnrpc_stats_t* self, jsmnrpc_stats_shard_t* shards, jsmnrpc_method_stats_t* methods,
+                        int num_of_shards, int max_num_of_handlers);
+
+/**
+* @brief Returns the shard used by the calling thread.
+*/
+jsmnrpc_stats_shard_t* jsmnrpc_stats_local_shard(jsmnrpc_stats_t* self);
+
+/**
+* @brief Makes the calling thread record into shard 'index' (modulo the number
+*        of shards) instead of the next free one, e.g. shard i for event loop i.
+*/
+void jsmnrpc_stats_set_thread_shard(int index);
+
+/**
+* @brief Merges all shards into 'totals' while traffic keeps flowing.
+* @param totals output; totals->methods must point at max_num_of_handlers entries
+*        (or be NULL if only the global counters are needed).
+*/
+void jsmnrpc_stats_snapshot(jsmnrpc_stats_t* self, jsmnrpc_stats_shard_t* totals);
+
+void jsmnrpc_histogram_record(jsmnrpc_histogram_t* self, uint64_t value);
+void jsmnrpc_histogram_merge(jsmnrpc_histogram_t* dst, const jsmnrpc_histogram_t* src);
+
+/**
+* @brief Returns an estimate of the given percentile (0.0 - 100.0) of recorded values.
+*/
+uint64_t jsmnrpc_histogram_percentile(const jsmnrpc_histogram_t* self, double percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_stats_h_ */
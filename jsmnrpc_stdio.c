@@ -0,0 +1,209 @@
+/**
+@file    jsmnrpc_stdio.c
+@brief   JSON-RPC over a pair of blocking file descriptors (see jsmnrpc_stdio.h).
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jsmnrpc_stdio.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+static const char stdio_response_too_large[] =
+  "{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32603, \"message\": \"Response too large\"}, \"id\": null}";
+
+/* send buffer needed for one more response */
+static size_t stdio_reserve(const jsmnrpc_stdio_t* self)
+{
+  return self->max_response + JSMNRPC_FRAME_MAX_PREFIX + JSMNRPC_FRAME_MAX_SUFFIX;
+}
+
+/* whether a read would return at once (only asked after a read that filled the buffer) */
+static int stdio_readable(const jsmnrpc_stdio_t* self)
+{
+  struct pollfd p;
+  p.fd = self->in_fd;
+  p.events = POLLIN;
+  return poll(&p, 1, 0) > 0;
+}
+
+static void stdio_handle_request(jsmnrpc_stdio_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data, char* request,
+                                 size_t length)
+{
+  jsmnrpc_framing_t framing = self->framer.framing;
+  char* message = self->out + self->out_len + jsmnrpc_frame_prefix_size(framing);
+  size_t response_length;
+
+  data->request.data = request;
+  data->request.length = length;
+  data->response.data = message;
+  data->response.capacity = self->max_response;
+  jsmnrpc_handle_request(rpc, data);
+  self->counters.requests++;
+
+  response_length = data->response.length;
+  if (response_length > data->response.capacity)
+  {
+    response_length = sizeof(stdio_response_too_large) - 1;
+    memcpy(message, stdio_response_too_large, response_length);
+  }
+  if (response_length > 0)
+  {
+    self->out_len += jsmnrpc_frame_seal(framing, message, response_length);
+  }
+}
+
+/* frames and handles the buffered requests */
+static int stdio_process(jsmnrpc_stdio_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data)
+{
+  size_t reserve = stdio_reserve(self);
+  for (;;)
+  {
+    jsmnrpc_frame_t frame;
+    int r;
+    if (self->out_cap - self->out_len < reserve && jsmnrpc_stdio_flush(self) != 0)
+    {
+      return -1;
+    }
+    r = jsmnrpc_framer_next(&self->framer, self->in + self->in_start, self->in_len - self->in_start, &frame);
+    if (r == 0)
+    {
+      break;
+    }
+    if (r < 0)
+    {
+      errno = EPROTO;
+      return -1;
+    }
+    if (frame.length > 0)
+    {
+      stdio_handle_request(self, rpc, data, self->in + self->in_start + frame.offset, frame.length);
+    }
+    self->in_start += frame.consumed;
+  }
+  if (self->in_start == self->in_len)
+  {
+    self->in_start = self->in_len = 0;
+  }
+  return 0;
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_stdio_init(jsmnrpc_stdio_t* self, int in_fd, int out_fd, jsmnrpc_framing_t framing, size_t max_request,
+                       size_t max_response)
+{
+  memset(self, 0, sizeof(*self));
+  self->in_fd = in_fd;
+  self->out_fd = out_fd;
+  self->max_response = max_response;
+  jsmnrpc_framer_init(&self->framer, framing, max_request);
+  /* a full buffer always holds a complete request, however it is framed */
+  self->in_cap = max_request + 2 + JSMNRPC_FRAME_MAX_HEADER;
+  if (self->in_cap < JSMNRPC_STDIO_BUFFER_SIZE)
+  {
+    self->in_cap = JSMNRPC_STDIO_BUFFER_SIZE;
+  }
+  self->out_cap = 2 * stdio_reserve(self);
+  if (self->out_cap < JSMNRPC_STDIO_BUFFER_SIZE)
+  {
+    self->out_cap = JSMNRPC_STDIO_BUFFER_SIZE;
+  }
+  self->in = (char*)malloc(self->in_cap);
+  self->out = (char*)malloc(self->out_cap);
+  if (self->in == NULL || self->out == NULL)
+  {
+    jsmnrpc_stdio_close(self);
+    return -1;
+  }
+  return 0;
+}
+
+void jsmnrpc_stdio_close(jsmnrpc_stdio_t* self)
+{
+  free(self->in);
+  free(self->out);
+  self->in = self->out = NULL;
+  self->in_len = self->in_start = self->out_len = 0;
+}
+
+int jsmnrpc_stdio_poll(jsmnrpc_stdio_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data)
+{
+  size_t room;
+  ssize_t n;
+
+  if (self->in_start > 0)
+  {
+    /* only the beginning of a message is left: move it to the front */
+    memmove(self->in, self->in + self->in_start, self->in_len - self->in_start);
+    self->in_len -= self->in_start;
+    self->in_start = 0;
+  }
+  room = self->in_cap - self->in_len;
+  if (room == 0)
+  {
+    errno = EPROTO; /* no complete request in a full buffer */
+    return -1;
+  }
+  do
+  {
+    n = read(self->in_fd, self->in + self->in_len, room);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0)
+  {
+    return -1;
+  }
+  self->counters.reads++;
+  if (n == 0)
+  {
+    return jsmnrpc_stdio_flush(self) == 0 ? 0 : -1; /* a truncated last message is dropped */
+  }
+  self->in_len += (size_t)n;
+  self->counters.bytes_received += (uint64_t)n;
+  if (stdio_process(self, rpc, data) != 0)
+  {
+    return -1;
+  }
+  /* a short read drained the input: answer before the next read blocks */
+  if (self->out_len > 0 && ((size_t)n < room || !stdio_readable(self)) && jsmnrpc_stdio_flush(self) != 0)
+  {
+    return -1;
+  }
+  return 1;
+}
+
+int jsmnrpc_stdio_serve(jsmnrpc_stdio_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data)
+{
+  int r;
+  while ((r = jsmnrpc_stdio_poll(self, rpc, data)) > 0)
+  {
+  }
+  return r;
+}
+
+int jsmnrpc_stdio_flush(jsmnrpc_stdio_t* self)
+{
+  size_t written = 0;
+  while (written < self->out_len)
+  {
+    ssize_t n = write(self->out_fd, self->out + written, self->out_len - written);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      memmove(self->out, self->out + written, self->out_len - written);
+      self->out_len -= written;
+      return -1;
+    }
+    written += (size_t)n;
+    self->counters.writes++;
+    self->counters.bytes_sent += (uint64_t)n;
+  }
+  self->out_len = 0;
+  return 0;
+}
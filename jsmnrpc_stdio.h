@@ -0,0 +1,99 @@
+/**
+@file    jsmnrpc_stdio.h
+@brief   JSON-RPC over a pair of blocking file descriptors (stdin/stdout of a
+         tool, pipes), by default with LSP-style "Content-Length:" framing
+         (jsmnrpc_framing_content_length).
+
+         Input is read in large chunks. Requests are framed and tokenized in place
+         in the read buffer, and a message split across reads is not scanned
+         again. Responses are built in place in the write buffer behind each
+         other and written out together: when the buffer runs full, or when the
+         input is drained, before the next read could block. A busy peer is thus
+         served with one read and one write per buffer, not per message.
+*/
+#pragma once
+#ifndef _jsmnrpc_stdio_h_
+#define _jsmnrpc_stdio_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsmnrpc.h"
+#include "jsmnrpc_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* smallest read buffer, and smallest write buffer (responses are coalesced up to its size) */
+#ifndef JSMNRPC_STDIO_BUFFER_SIZE
+#define JSMNRPC_STDIO_BUFFER_SIZE (64 << 10)
+#endif
+
+typedef struct jsmnrpc_stdio_counters
+{
+  uint64_t requests;         /* framed requests handled */
+  uint64_t reads;            /* read() calls */
+  uint64_t writes;           /* write() calls */
+  uint64_t bytes_received;
+  uint64_t bytes_sent;
+} jsmnrpc_stdio_counters_t;
+
+typedef struct jsmnrpc_stdio
+{
+  int in_fd;
+  int out_fd;
+  size_t max_response;
+  jsmnrpc_framer_t framer;
+  char* in;                  /* read buffer: [in_start, in_len) not yet framed */
+  size_t in_cap;
+  size_t in_start;
+  size_t in_len;
+  char* out;                 /* write buffer: [0, out_len) framed responses */
+  size_t out_cap;
+  size_t out_len;
+  jsmnrpc_stdio_counters_t counters;
+} jsmnrpc_stdio_t;
+
+/**
+* @brief Allocates the buffers. The descriptors stay owned by the caller.
+* @param framing jsmnrpc_framing_content_length, or newline, length_prefix or raw.
+* @param max_request largest request accepted (bytes, without framing).
+* @param max_response largest response produced (at least 128); larger ones become an error.
+* @return 0 on success, -1 if out of memory.
+*/
+int jsmnrpc_stdio_init(jsmnrpc_stdio_t* self, int in_fd, int out_fd, jsmnrpc_framing_t framing, size_t max_request,
+                       size_t max_response);
+
+/**
+* @brief Frees the buffers (unwritten responses are dropped; see jsmnrpc_stdio_flush).
+*/
+void jsmnrpc_stdio_close(jsmnrpc_stdio_t* self);
+
+/**
+* @brief Reads once (blocking), handles all requests that are complete, and writes
+*        the responses unless more input is already waiting.
+* @param data tokens (and arg) for jsmnrpc_handle_request; its request and response
+*        fields are set here.
+* @return 1 after a read, 0 at the end of the input (responses written), -1 on a
+*         read or write error or malformed input (errno EPROTO).
+*/
+int jsmnrpc_stdio_poll(jsmnrpc_stdio_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data);
+
+/**
+* @brief Calls jsmnrpc_stdio_poll until the input ends or fails.
+* @return 0 at the end of the input, -1 on error (errno is set).
+*/
+int jsmnrpc_stdio_serve(jsmnrpc_stdio_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data);
+
+/**
+* @brief Writes the buffered responses.
+* @return 0 on success, -1 on a write error (errno is set).
+*/
+int jsmnrpc_stdio_flush(jsmnrpc_stdio_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_stdio_h_ */
@@ -0,0 +1,155 @@
+/**
+@file    jsmnrpc_trace.c
+@brief   Optional per-request tracing for jsmnrpc (see jsmnrpc_trace.h).
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "jsmnrpc_atomic.h"
+#include "jsmnrpc_clock.h"
+#include "jsmnrpc_trace.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define TRACE_DUMP_CHUNK 64
+
+static jsmnrpc_trace_ring_t* jsmnrpc_trace_rings = NULL;
+static JSMNRPC_THREAD_LOCAL jsmnrpc_trace_ring_t* jsmnrpc_trace_thread_ring = NULL;
+
+static void trace_register(jsmnrpc_trace_ring_t* ring)
+{
+  jsmnrpc_trace_ring_t* head = (jsmnrpc_trace_ring_t*)JSMNRPC_ATOMIC_LOAD_PTR(&jsmnrpc_trace_rings);
+  jsmnrpc_trace_ring_t* it;
+  for (it = head; it; it = it->next)
+  {
+    if (it == ring)
+    {
+      return;
+    }
+  }
+  do
+  {
+    ring->next = head;
+  } while (!JSMNRPC_ATOMIC_CAS_PTR(&jsmnrpc_trace_rings, &head, ring));
+}
+
+static double ticks_to_ns(uint64_t ticks, double ticks_per_ns)
+{
+  return (double)ticks / ticks_per_ns;
+}
+
+/* Exported functions ------------------------------------------------------- */
+void jsmnrpc_trace_ring_init(jsmnrpc_trace_ring_t* self, jsmnrpc_trace_record_t* records, uint64_t capacity)
+{
+  self->records = records;
+  self->capacity = capacity;
+  self->head = 0;
+  self->thread_id = 0;
+  self->next = NULL;
+  memset(records, 0, sizeof(jsmnrpc_trace_record_t) * capacity);
+}
+
+void jsmnrpc_trace_attach(jsmnrpc_trace_ring_t* ring)
+{
+  if (ring)
+  {
+    trace_register(ring);
+  }
+  jsmnrpc_trace_thread_ring = ring;
+}
+
+jsmnrpc_trace_ring_t* jsmnrpc_trace_current(void)
+{
+  return jsmnrpc_trace_thread_ring;
+}
+
+void jsmnrpc_trace_commit(jsmnrpc_trace_ring_t* self, const jsmnrpc_trace_record_t* record)
+{
+  uint64_t n = self->head;
+  jsmnrpc_trace_record_t* slot = self->records + (n & (self->capacity - 1));
+  uint64_t seq = 2 * n + 2;
+
+  JSMNRPC_ATOMIC_STORE(&slot->seq, seq - 1);
+  JSMNRPC_FENCE_RELEASE();
+  slot->t_receive = record->t_receive;
+  slot->t_parsed = record->t_parsed;
+  slot->t_dispatch = record->t_dispatch;
+  slot->t_handler_done = record->t_handler_done;
+  slot->t_complete = record->t_complete;
+  slot->method_id = record->method_id;
+  slot->request_bytes = record->request_bytes;
+  slot->response_bytes = record->response_bytes;
+  slot->info_flags = record->info_flags;
+  JSMNRPC_ATOMIC_STORE_RELEASE(&slot->seq, seq);
+  JSMNRPC_ATOMIC_STORE_RELEASE(&self->head, n + 1);
+}
+
+int jsmnrpc_trace_read(jsmnrpc_trace_ring_t* self, uint64_t* cursor, jsmnrpc_trace_record_t* out, int max_records)
+{
+  int copied = 0;
+  uint64_t head = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&self->head);
+  uint64_t n = *cursor;
+
+  if (head - n > self->capacity)
+  {
+    n = head - self->capacity; /* older records are gone */
+  }
+  for (; n < head && copied < max_records; n++)
+  {
+    const jsmnrpc_trace_record_t* slot = self->records + (n & (self->capacity - 1));
+    uint64_t seq = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&slot->seq);
+    if (seq != 2 * n + 2)
+    {
+      continue; /* overwritten (or being overwritten) by a newer record */
+    }
+    out[copied] = *slot;
+    JSMNRPC_FENCE_ACQUIRE();
+    if (JSMNRPC_ATOMIC_LOAD(&slot->seq) == seq)
+    {
+      copied++;
+    }
+  }
+  *cursor = n;
+  return copied;
+}
+
+void jsmnrpc_trace_dump(FILE* out)
+{
+  static double ticks_per_ns = 0.0;
+  jsmnrpc_trace_record_t records[TRACE_DUMP_CHUNK];
+  jsmnrpc_trace_ring_t* ring;
+
+  if (ticks_per_ns <= 0.0)
+  {
+    ticks_per_ns = jsmnrpc_clock_ticks_per_ns(10000000);
+  }
+  fprintf(out, "# thread method flags req_bytes resp_bytes parse_ns lookup_ns handler_ns response_ns total_ns\n");
+  for (ring = (jsmnrpc_trace_ring_t*)JSMNRPC_ATOMIC_LOAD_PTR(&jsmnrpc_trace_rings); ring; ring = ring->next)
+  {
+    uint64_t cursor = 0;
+    uint64_t end = JSMNRPC_ATOMIC_LOAD_ACQUIRE(&ring->head);
+    int count;
+    int i;
+    /* a chunk may copy nothing when a writer overwrote all of its slots: go on to the head */
+    while (cursor < end)
+    {
+      count = jsmnrpc_trace_read(ring, &cursor, records, TRACE_DUMP_CHUNK);
+      for (i = 0; i < count; i++)
+      {
+        const jsmnrpc_trace_record_t* r = records + i;
+        uint64_t dispatch = r->t_dispatch ? r->t_dispatch : r->t_complete;
+        uint64_t handler_done = r->t_handler_done ? r->t_handler_done : dispatch;
+        uint64_t parsed = r->t_parsed ? r->t_parsed : r->t_receive;
+        fprintf(out, "%llu %d 0x%x %u %u %.0f %.0f %.0f %.0f %.0f\n",
+                (unsigned long long)ring->thread_id, r->method_id, r->info_flags,
+                r->request_bytes, r->response_bytes,
+                ticks_to_ns(parsed - r->t_receive, ticks_per_ns),
+                ticks_to_ns(dispatch - parsed, ticks_per_ns),
+                ticks_to_ns(handler_done - dispatch, ticks_per_ns),
+                ticks_to_ns(r->t_complete - handler_done, ticks_per_ns),
+                ticks_to_ns(r->t_complete - r->t_receive, ticks_per_ns));
+      }
+    }
+  }
+}
@@ -0,0 +1,92 @@
+/**
+@file    jsmnrpc_trace.h
+@brief   Optional per-request tracing for jsmnrpc (enabled with JSMNRPC_TRACE=1).
+         Each thread that wants its requests traced attaches its own fixed-size ring.
+         jsmnrpc_handle_request then writes one record per call (per batch element)
+         with raw clock ticks taken at the main stages of the request. Writing is
+         wait-free and never blocks; readers (e.g. jsmnrpc_trace_dump()) detect and
+         skip records overwritten while they were being copied.
+*/
+#pragma once
+#ifndef _jsmnrpc_trace_h_
+#define _jsmnrpc_trace_h_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Single trace record. Timestamps are jsmnrpc_clock_ticks() values.
+*/
+typedef struct jsmnrpc_trace_record
+{
+  uint64_t seq;              /* odd while the slot is being written */
+  uint64_t t_receive;        /* jsmnrpc_handle_request entered */
+  uint64_t t_parsed;         /* request tokenized */
+  uint64_t t_dispatch;       /* handler found, about to be called */
+  uint64_t t_handler_done;   /* handler returned */
+  uint64_t t_complete;       /* response for this call complete */
+  int32_t method_id;         /* handler id, or -1 if the call was not dispatched */
+  uint32_t request_bytes;
+  uint32_t response_bytes;   /* bytes appended to the response by this call */
+  uint32_t info_flags;
+} jsmnrpc_trace_record_t;
+
+/**
+* @brief Ring of trace records owned by a single writer thread.
+*/
+typedef struct jsmnrpc_trace_ring
+{
+  jsmnrpc_trace_record_t* records;
+  uint64_t capacity;         /* power of two */
+  uint64_t head;             /* number of records ever written */
+  uint64_t thread_id;        /* caller-defined tag printed by jsmnrpc_trace_dump() */
+  struct jsmnrpc_trace_ring* next;
+} jsmnrpc_trace_ring_t;
+
+/**
+* @brief initialise a ring.
+* @param self pointer to the jsmnrpc_trace_ring_t object.
+* @param records storage for 'capacity' records.
+* @param capacity number of records; must be a power of two.
+*/
+void jsmnrpc_trace_ring_init(jsmnrpc_trace_ring_t* self, jsmnrpc_trace_record_t* records, uint64_t capacity);
+
+/**
+* @brief Makes 'ring' the trace destination of the calling thread (NULL stops tracing).
+*        The first time a ring is attached it is also registered for jsmnrpc_trace_dump(),
+*        so it has to stay valid for the lifetime of the process.
+*/
+void jsmnrpc_trace_attach(jsmnrpc_trace_ring_t* ring);
+
+/**
+* @brief Returns the ring attached to the calling thread (or NULL).
+*/
+jsmnrpc_trace_ring_t* jsmnrpc_trace_current(void);
+
+/**
+* @brief Appends a record to the ring (used by jsmnrpc_handle_request).
+*/
+void jsmnrpc_trace_commit(jsmnrpc_trace_ring_t* self, const jsmnrpc_trace_record_t* record);
+
+/**
+* @brief Copies records written after *cursor into 'out' (oldest first) and advances
+*        the cursor. Records overwritten before they could be copied are skipped.
+* @return number of records copied.
+*/
+int jsmnrpc_trace_read(jsmnrpc_trace_ring_t* self, uint64_t* cursor, jsmnrpc_trace_record_t* out, int max_records);
+
+/**
+* @brief Writes all records currently held by every registered ring to 'out',
+*        one line per record, with stage durations converted to nanoseconds.
+*/
+void jsmnrpc_trace_dump(FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_trace_h_ */
@@ -0,0 +1,202 @@
+/**
+@file    jsmnrpc_udp.c
+@brief   JSON-RPC over UDP with batched receives and sends (see jsmnrpc_udp.h).
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* recvmmsg, sendmmsg */
+#endif
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "jsmnrpc_udp.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+struct jsmnrpc_udp_slots
+{
+  struct mmsghdr in[JSMNRPC_UDP_BATCH];
+  struct iovec in_iov[JSMNRPC_UDP_BATCH];
+  struct sockaddr_storage peers[JSMNRPC_UDP_BATCH];
+  struct mmsghdr out[JSMNRPC_UDP_BATCH];
+  struct iovec out_iov[JSMNRPC_UDP_BATCH];
+  char* in_buffers;          /* JSMNRPC_UDP_BATCH * max_datagram */
+  char* out_buffers;         /* JSMNRPC_UDP_BATCH * max_response */
+};
+
+static const char udp_response_too_large[] =
+  "{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32603, \"message\": \"Response too large\"}, \"id\": null}";
+
+/* sends out[0, count), retrying after partial sends; a response that fails is dropped */
+static void udp_send(jsmnrpc_udp_t* self, int count)
+{
+  struct mmsghdr* out = self->slots->out;
+  int sent = 0;
+  while (sent < count)
+  {
+    int n = sendmmsg(self->fd, out + sent, (unsigned)(count - sent), 0);
+    self->counters.send_calls++;
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      self->counters.send_errors++; /* e.g. the peer is unreachable: skip its response */
+      sent++;
+      continue;
+    }
+    self->counters.responses += (uint64_t)n;
+    sent += n;
+  }
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_udp_init(jsmnrpc_udp_t* self, size_t max_datagram, size_t max_response)
+{
+  jsmnrpc_udp_slots_t* slots;
+  int i;
+  memset(self, 0, sizeof(*self));
+  self->fd = -1;
+  self->max_datagram = max_datagram;
+  self->max_response = max_response;
+  slots = (jsmnrpc_udp_slots_t*)calloc(1, sizeof(*slots));
+  if (slots == NULL)
+  {
+    return -1;
+  }
+  slots->in_buffers = (char*)malloc(JSMNRPC_UDP_BATCH * max_datagram);
+  slots->out_buffers = (char*)malloc(JSMNRPC_UDP_BATCH * max_response);
+  self->slots = slots;
+  if (slots->in_buffers == NULL || slots->out_buffers == NULL)
+  {
+    jsmnrpc_udp_close(self);
+    return -1;
+  }
+  for (i = 0; i < JSMNRPC_UDP_BATCH; i++)
+  {
+    slots->in_iov[i].iov_base = slots->in_buffers + i * max_datagram;
+    slots->in_iov[i].iov_len = max_datagram;
+    slots->in[i].msg_hdr.msg_iov = &slots->in_iov[i];
+    slots->in[i].msg_hdr.msg_iovlen = 1;
+    slots->in[i].msg_hdr.msg_name = &slots->peers[i];
+    slots->out[i].msg_hdr.msg_iov = &slots->out_iov[i];
+    slots->out[i].msg_hdr.msg_iovlen = 1;
+  }
+  return 0;
+}
+
+int jsmnrpc_udp_bind(jsmnrpc_udp_t* self, const char* host, int port)
+{
+  struct addrinfo hints, *res;
+  struct sockaddr_storage addr;
+  socklen_t addr_length = sizeof(addr);
+  char service[16];
+  int fd;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE;
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &res) != 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  fd = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    freeaddrinfo(res);
+    return -1;
+  }
+  if (bind(fd, res->ai_addr, res->ai_addrlen) != 0 || getsockname(fd, (struct sockaddr*)&addr, &addr_length) != 0)
+  {
+    freeaddrinfo(res);
+    close(fd);
+    return -1;
+  }
+  freeaddrinfo(res);
+  self->fd = fd;
+  return ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6*)&addr)->sin6_port
+                                          : ((struct sockaddr_in*)&addr)->sin_port);
+}
+
+void jsmnrpc_udp_close(jsmnrpc_udp_t* self)
+{
+  if (self->fd >= 0)
+  {
+    close(self->fd);
+    self->fd = -1;
+  }
+  if (self->slots)
+  {
+    free(self->slots->in_buffers);
+    free(self->slots->out_buffers);
+    free(self->slots);
+    self->slots = NULL;
+  }
+}
+
+int jsmnrpc_udp_poll(jsmnrpc_udp_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data)
+{
+  jsmnrpc_udp_slots_t* slots = self->slots;
+  int received, responses = 0, i;
+
+  for (i = 0; i < JSMNRPC_UDP_BATCH; i++)
+  {
+    slots->in[i].msg_hdr.msg_namelen = sizeof(slots->peers[i]);
+  }
+  received = recvmmsg(self->fd, slots->in, JSMNRPC_UDP_BATCH, MSG_WAITFORONE, NULL);
+  if (received < 0)
+  {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+  }
+  self->counters.receive_calls++;
+  self->counters.datagrams += (uint64_t)received;
+
+  for (i = 0; i < received; i++)
+  {
+    struct mmsghdr* in = &slots->in[i];
+    struct mmsghdr* out = &slots->out[responses];
+    char* response = slots->out_buffers + (size_t)responses * self->max_response;
+    size_t response_length;
+    if (in->msg_hdr.msg_flags & MSG_TRUNC)
+    {
+      self->counters.truncated++;
+      continue;
+    }
+    data->request.data = (char*)slots->in_iov[i].iov_base;
+    data->request.length = in->msg_len;
+    data->response.data = response;
+    data->response.capacity = self->max_response;
+    jsmnrpc_handle_request(rpc, data);
+
+    response_length = data->response.length;
+    if (response_length == 0)
+    {
+      continue; /* notification */
+    }
+    if (response_length > self->max_response)
+    {
+      response_length = sizeof(udp_response_too_large) - 1;
+      memcpy(response, udp_response_too_large, response_length);
+    }
+    slots->out_iov[responses].iov_base = response;
+    slots->out_iov[responses].iov_len = response_length;
+    out->msg_hdr.msg_name = in->msg_hdr.msg_name;
+    out->msg_hdr.msg_namelen = in->msg_hdr.msg_namelen;
+    responses++;
+  }
+  if (responses > 0)
+  {
+    udp_send(self, responses);
+  }
+  return received;
+}
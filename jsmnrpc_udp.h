@@ -0,0 +1,84 @@
+/**
+@file    jsmnrpc_udp.h
+@brief   JSON-RPC over UDP (Linux), meant for fire-and-forget notifications such
+         as telemetry: one datagram per request (or batch), no framing.
+
+         Datagrams are received in batches with recvmmsg into slots preallocated
+         by jsmnrpc_udp_init, and each one is handled in place. Notifications
+         produce nothing. Responses to calls are built in per-slot send buffers
+         and returned to their senders in a batch with sendmmsg. The loop does not
+         allocate, and two system calls serve up to JSMNRPC_UDP_BATCH datagrams.
+*/
+#pragma once
+#ifndef _jsmnrpc_udp_h_
+#define _jsmnrpc_udp_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsmnrpc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* datagrams received (and responses sent) per system call */
+#ifndef JSMNRPC_UDP_BATCH
+#define JSMNRPC_UDP_BATCH 64
+#endif
+
+typedef struct jsmnrpc_udp_counters
+{
+  uint64_t datagrams;        /* datagrams received */
+  uint64_t truncated;        /* datagrams longer than max_datagram (dropped) */
+  uint64_t responses;        /* responses sent */
+  uint64_t send_errors;      /* responses that could not be sent (dropped) */
+  uint64_t receive_calls;    /* recvmmsg calls that returned datagrams */
+  uint64_t send_calls;       /* sendmmsg calls */
+} jsmnrpc_udp_counters_t;
+
+typedef struct jsmnrpc_udp_slots jsmnrpc_udp_slots_t;
+
+typedef struct jsmnrpc_udp
+{
+  int fd;                    /* bound datagram socket (jsmnrpc_udp_bind, or set by the caller) */
+  size_t max_datagram;       /* receive slot size */
+  size_t max_response;       /* send slot size; larger responses become an error */
+  jsmnrpc_udp_slots_t* slots;   /* message headers and buffers, set up once by jsmnrpc_udp_init */
+  jsmnrpc_udp_counters_t counters;
+} jsmnrpc_udp_t;
+
+/**
+* @brief Allocates the receive and send slots.
+* @param max_datagram longest datagram accepted (at most 65507 for UDP over IPv4).
+* @param max_response longest response (at least 128).
+* @return 0 on success, -1 if out of memory.
+*/
+int jsmnrpc_udp_init(jsmnrpc_udp_t* self, size_t max_datagram, size_t max_response);
+
+/**
+* @brief Creates a UDP socket bound to 'host' (NULL: any address) and 'port'.
+* @return the bound port (useful with port 0), or -1 on error (errno is set).
+*/
+int jsmnrpc_udp_bind(jsmnrpc_udp_t* self, const char* host, int port);
+
+/**
+* @brief Closes the socket and frees the slots.
+*/
+void jsmnrpc_udp_close(jsmnrpc_udp_t* self);
+
+/**
+* @brief Receives a batch of datagrams (on a blocking socket, waits for the first
+*        one), handles them and sends the responses.
+* @param data tokens (and arg) for jsmnrpc_handle_request; its request and response
+*        fields are set here.
+* @return number of datagrams received, 0 if none was waiting on a non-blocking
+*         socket or a signal interrupted the wait, -1 on error (errno is set).
+*/
+int jsmnrpc_udp_poll(jsmnrpc_udp_t* self, jsmnrpc_instance_t* rpc, jsmnrpc_data_t* data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_udp_h_ */
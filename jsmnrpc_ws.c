@@ -0,0 +1,453 @@
+/**
+@file    jsmnrpc_ws.c
+@brief   WebSocket framing for JSON-RPC (see jsmnrpc_ws.h).
+*/
+
+#include <string.h>
+#include <strings.h>
+
+#include "jsmnrpc_http.h"
+#include "jsmnrpc_ws.h"
+
+/* Private types and definitions ------------------------------------------------------- */
+
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT 0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+#define WS_FIN 0x80
+#define WS_MASKED 0x80
+#define WS_KEY_LENGTH 24             /* base64 of the 16-byte nonce */
+
+static const char ws_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const char ws_switching[] =
+  "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+static const char ws_protocol_error[] = "\x88\x02\x03\xea";  /* close, status 1002 */
+
+typedef struct ws_sha1
+{
+  uint32_t h[5];
+  unsigned char block[64];
+  size_t length;
+} ws_sha1_t;
+
+#define WS_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void ws_sha1_block(ws_sha1_t* self)
+{
+  uint32_t w[80];
+  uint32_t a = self->h[0], b = self->h[1], c = self->h[2], d = self->h[3], e = self->h[4];
+  int i;
+  for (i = 0; i < 16; i++)
+  {
+    const unsigned char* p = self->block + 4 * i;
+    w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+  }
+  for (; i < 80; i++)
+  {
+    w[i] = WS_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+  for (i = 0; i < 80; i++)
+  {
+    uint32_t f, k, t;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    t = WS_ROL(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = WS_ROL(b, 30);
+    b = a;
+    a = t;
+  }
+  self->h[0] += a;
+  self->h[1] += b;
+  self->h[2] += c;
+  self->h[3] += d;
+  self->h[4] += e;
+}
+
+static void ws_sha1_update(ws_sha1_t* self, const char* data, size_t length)
+{
+  size_t i;
+  for (i = 0; i < length; i++)
+  {
+    self->block[self->length++ % 64] = (unsigned char)data[i];
+    if (self->length % 64 == 0)
+    {
+      ws_sha1_block(self);
+    }
+  }
+}
+
+/* Sec-WebSocket-Accept: base64(SHA-1(key + GUID)), 28 characters */
+static void ws_accept_key(const char* key, size_t key_length, char* out)
+{
+  static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  ws_sha1_t sha = { { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 }, { 0 }, 0 };
+  unsigned char digest[21];
+  uint64_t bits;
+  int i;
+
+  ws_sha1_update(&sha, key, key_length);
+  ws_sha1_update(&sha, ws_guid, sizeof(ws_guid) - 1);
+  bits = (uint64_t)sha.length * 8;
+  ws_sha1_update(&sha, "\x80", 1);
+  while (sha.length % 64 != 56)
+  {
+    ws_sha1_update(&sha, "", 1);
+  }
+  for (i = 7; i >= 0; i--)
+  {
+    char c = (char)(bits >> (8 * i));
+    ws_sha1_update(&sha, &c, 1);
+  }
+  for (i = 0; i < 20; i++)
+  {
+    digest[i] = (unsigned char)(sha.h[i / 4] >> (24 - 8 * (i % 4)));
+  }
+  digest[20] = 0;
+  for (i = 0; i < 7; i++)
+  {
+    uint32_t v = ((uint32_t)digest[3 * i] << 16) | ((uint32_t)digest[3 * i + 1] << 8) | digest[3 * i + 2];
+    out[4 * i] = base64[v >> 18];
+    out[4 * i + 1] = base64[(v >> 12) & 63];
+    out[4 * i + 2] = base64[(v >> 6) & 63];
+    out[4 * i + 3] = base64[v & 63];
+  }
+  out[27] = '='; /* 20 bytes: the last group has 2 */
+}
+
+/* XORs the payload with the 4-byte key, 8 bytes at a time (the compiler can widen the loop further) */
+static void ws_unmask(char* payload, size_t length, const char* key)
+{
+  uint32_t key32;
+  uint64_t key64;
+  size_t i;
+  memcpy(&key32, key, 4);
+  key64 = ((uint64_t)key32 << 32) | key32;
+  for (i = 0; i + 8 <= length; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, payload + i, 8);
+    word ^= key64;
+    memcpy(payload + i, &word, 8);
+  }
+  for (; i < length; i++)
+  {
+    payload[i] ^= key[i & 3];
+  }
+}
+
+/* parses the frame header at 'p' (at least 'avail' bytes); returns its size, 0 if incomplete, -1 if invalid */
+static int ws_frame_header(const unsigned char* p, size_t avail, uint64_t* payload_length)
+{
+  int size = 2 + 4;
+  uint64_t length;
+  if (avail < 2)
+  {
+    return 0;
+  }
+  if ((p[0] & 0x70) != 0 || (p[1] & WS_MASKED) == 0)
+  {
+    return -1; /* no extension was negotiated, and client frames must be masked */
+  }
+  length = p[1] & 0x7f;
+  if (length == 126)
+  {
+    size += 2;
+  }
+  else if (length == 127)
+  {
+    size += 8;
+  }
+  if (avail < (size_t)size)
+  {
+    return 0;
+  }
+  if (length == 126)
+  {
+    length = ((uint64_t)p[2] << 8) | p[3];
+  }
+  else if (length == 127)
+  {
+    int i;
+    for (i = 0, length = 0; i < 8; i++)
+    {
+      length = (length << 8) | p[2 + i];
+    }
+  }
+  *payload_length = length;
+  return size;
+}
+
+/* finds the upgrade request; the frame covers its Sec-WebSocket-Key */
+static int ws_handshake(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  size_t i = self->scanned > 3 ? self->scanned - 3 : 0;
+  const char* line;
+  const char* eol;
+  const char* key = NULL;
+  size_t key_length = 0;
+  int upgrade = 0;
+  for (;;)
+  {
+    const char* nl = (const char*)memchr(buf + i, '\n', len - i);
+    if (nl == NULL)
+    {
+      self->scanned = len;
+      return len > JSMNRPC_HTTP_MAX_HEADER ? -1 : 0;
+    }
+    i = (size_t)(nl - buf) + 1;
+    if (i >= 4 && memcmp(nl - 3, "\r\n\r\n", 4) == 0)
+    {
+      break;
+    }
+  }
+  eol = (const char*)memchr(buf, '\n', i);
+  if (i > JSMNRPC_HTTP_MAX_HEADER || eol - buf < 14 || memcmp(buf, "GET ", 4) != 0 ||
+      memcmp(eol - 10, " HTTP/1.1\r", 10) != 0)
+  {
+    return -1;
+  }
+  for (line = eol + 1; line < buf + i - 2; line = eol + 1)
+  {
+    const char* colon;
+    const char* value;
+    size_t value_length;
+    eol = (const char*)memchr(line, '\n', (size_t)(buf + i - line));
+    colon = (const char*)memchr(line, ':', (size_t)(eol - line));
+    if (colon == NULL || eol[-1] != '\r')
+    {
+      return -1;
+    }
+    for (value = colon + 1; *value == ' ' || *value == '\t'; value++)
+    {
+    }
+    for (value_length = (size_t)(eol - 1 - value);
+         value_length > 0 && (value[value_length - 1] == ' ' || value[value_length - 1] == '\t'); value_length--)
+    {
+    }
+    if (colon - line == 7 && strncasecmp(line, "upgrade", 7) == 0)
+    {
+      upgrade = value_length == 9 && strncasecmp(value, "websocket", 9) == 0;
+    }
+    else if (colon - line == 17 && strncasecmp(line, "sec-websocket-key", 17) == 0)
+    {
+      key = value;
+      key_length = value_length;
+    }
+    else if (colon - line == 21 && strncasecmp(line, "sec-websocket-version", 21) == 0)
+    {
+      if (value_length != 2 || memcmp(value, "13", 2) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+  if (!upgrade || key_length != WS_KEY_LENGTH)
+  {
+    return -1;
+  }
+  self->ws_open = 1;
+  frame->offset = (size_t)(key - buf);
+  frame->length = key_length;
+  frame->consumed = i;
+  frame->flags = jsmnrpc_frame_control | jsmnrpc_frame_upgrade;
+  return 1;
+}
+
+/* Exported functions ------------------------------------------------------- */
+int jsmnrpc_ws_next(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame)
+{
+  size_t pos = self->ws_pos;
+  if (!self->ws_open)
+  {
+    return ws_handshake(self, buf, len, frame);
+  }
+  for (;;)
+  {
+    const unsigned char* p = (const unsigned char*)buf + pos;
+    uint64_t payload_length = 0;
+    int header = pos < len ? ws_frame_header(p, len - pos, &payload_length) : 0;
+    int opcode;
+    if (header < 0)
+    {
+      return -1;
+    }
+    if (header == 0)
+    {
+      return pos - self->ws_length > JSMNRPC_WS_MAX_OVERHEAD ? -1 : 0;
+    }
+    opcode = p[0] & 0x0f;
+    if (opcode & 0x08)
+    {
+      if ((p[0] & WS_FIN) == 0 || payload_length > 125 ||
+          (opcode != WS_OP_CLOSE && opcode != WS_OP_PING && opcode != WS_OP_PONG))
+      {
+        return -1;
+      }
+    }
+    else if ((pos == 0 ? opcode != WS_OP_TEXT && opcode != WS_OP_BINARY : opcode != WS_OP_CONTINUATION) ||
+             payload_length > self->max_frame - self->ws_length)
+    {
+      return -1; /* a message starts with a text or binary frame and goes on with continuation frames */
+    }
+    if (len - pos - (size_t)header < payload_length)
+    {
+      return pos - self->ws_length > JSMNRPC_WS_MAX_OVERHEAD ? -1 : 0;
+    }
+
+    frame->offset = pos + (size_t)header;
+    frame->length = (size_t)payload_length;
+    pos += (size_t)header + (size_t)payload_length;
+    if (opcode & 0x08)
+    {
+      frame->flags = jsmnrpc_frame_control | (opcode == WS_OP_CLOSE ? jsmnrpc_frame_close : 0);
+      if (self->ws_pos > 0)
+      {
+        frame->consumed = 0; /* between fragments: skipped by jsmnrpc_ws_decode */
+        self->ws_pos = pos;
+      }
+      else
+      {
+        frame->consumed = pos;
+      }
+      return 1;
+    }
+    self->ws_length += (size_t)payload_length;
+    if (p[0] & WS_FIN)
+    {
+      if (self->ws_pos > 0)
+      {
+        frame->offset = 0;
+        frame->length = pos;
+        frame->flags = jsmnrpc_frame_fragmented;
+      }
+      else
+      {
+        frame->flags = 0;
+      }
+      frame->consumed = pos;
+      self->ws_pos = 0;
+      self->ws_length = 0;
+      return 1;
+    }
+    self->ws_pos = pos;
+  }
+}
+
+char* jsmnrpc_ws_decode(char* data, size_t* length, unsigned flags)
+{
+  size_t pos = 0;
+  size_t out_length = 0;
+  char* out = NULL;
+  if ((flags & jsmnrpc_frame_fragmented) == 0)
+  {
+    ws_unmask(data, *length, data - 4);
+    return data;
+  }
+  while (pos < *length)
+  {
+    uint64_t payload_length;
+    int header = ws_frame_header((const unsigned char*)data + pos, *length - pos, &payload_length);
+    char* payload = data + pos + header;
+    if ((data[pos] & 0x08) == 0)
+    {
+      ws_unmask(payload, (size_t)payload_length, payload - 4);
+      if (out == NULL)
+      {
+        out = payload; /* the first fragment stays where it is */
+      }
+      else
+      {
+        memmove(out + out_length, payload, (size_t)payload_length);
+      }
+      out_length += (size_t)payload_length;
+    }
+    pos += (size_t)header + (size_t)payload_length;
+  }
+  *length = out_length;
+  return out;
+}
+
+size_t jsmnrpc_ws_reply(char* data, size_t length, unsigned flags, char* out)
+{
+  int opcode;
+  if (flags & jsmnrpc_frame_upgrade)
+  {
+    memcpy(out, ws_switching, sizeof(ws_switching) - 1);
+    ws_accept_key(data, length, out + sizeof(ws_switching) - 1);
+    memcpy(out + sizeof(ws_switching) - 1 + 28, "\r\n\r\n", 4);
+    return sizeof(ws_switching) - 1 + 28 + 4;
+  }
+  opcode = data[-6] & 0x0f; /* control frames have a 2-byte header and the key */
+  ws_unmask(data, length, data - 4);
+  if (opcode == WS_OP_PING)
+  {
+    out[0] = (char)(WS_FIN | WS_OP_PONG);
+    out[1] = (char)length;
+    memcpy(out + 2, data, length);
+    return 2 + length;
+  }
+  if (opcode == WS_OP_CLOSE)
+  {
+    out[0] = (char)(WS_FIN | WS_OP_CLOSE);
+    out[1] = length >= 2 ? 2 : 0;
+    memcpy(out + 2, data, length >= 2 ? 2 : 0);
+    return length >= 2 ? 4 : 2;
+  }
+  return 0;
+}
+
+const char* jsmnrpc_ws_error(const jsmnrpc_framer_t* self)
+{
+  return self->ws_open ? ws_protocol_error : JSMNRPC_HTTP_BAD_REQUEST;
+}
+
+size_t jsmnrpc_ws_seal(char* message, size_t length)
+{
+  unsigned char* header = (unsigned char*)message - JSMNRPC_WS_PREFIX;
+  header[0] = WS_FIN | WS_OP_TEXT;
+  if (length <= 125)
+  {
+    header[1] = (unsigned char)length;
+    memmove(header + 2, message, length);
+    return 2 + length;
+  }
+  if (length <= 0xffff)
+  {
+    header[1] = 126;
+    header[2] = (unsigned char)(length >> 8);
+    header[3] = (unsigned char)length;
+    return 4 + length;
+  }
+  memmove(message + 6, message, length);
+  header[1] = 127;
+  header[2] = header[3] = header[4] = header[5] = 0;
+  header[6] = (unsigned char)(length >> 24);
+  header[7] = (unsigned char)(length >> 16);
+  header[8] = (unsigned char)(length >> 8);
+  header[9] = (unsigned char)length;
+  return 10 + length;
+}
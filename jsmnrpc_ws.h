@@ -0,0 +1,94 @@
+/**
+@file    jsmnrpc_ws.h
+@brief   WebSocket framing (RFC 6455) for JSON-RPC (jsmnrpc_framing_websocket),
+         for browser and dashboard clients.
+
+         A connection starts with the HTTP upgrade handshake. After that, every
+         text or binary message is one JSON-RPC request. Client payloads are
+         unmasked in place, a machine word at a time, and passed to
+         jsmnrpc_handle_request where they lie. A fragmented message is joined in
+         place behind its first fragment. Control frames sent in between
+         fragments are answered when they arrive.
+
+         Each response is sent as a single unmasked text frame. Its header is
+         written in front of the response built in the send buffer.
+*/
+#pragma once
+#ifndef _jsmnrpc_ws_h_
+#define _jsmnrpc_ws_h_
+
+#include <stddef.h>
+
+#include "jsmnrpc_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* receive buffer needed beyond the message: frame headers of fragments, and
+   control frames received while a fragmented message is incomplete */
+#ifndef JSMNRPC_WS_MAX_OVERHEAD
+#define JSMNRPC_WS_MAX_OVERHEAD 8192
+#endif
+
+/* bytes reserved in front of each response (the header of a frame up to 64 KB) */
+#define JSMNRPC_WS_PREFIX 4
+
+/* longest reply to a control frame or to the handshake (jsmnrpc_ws_reply) */
+#define JSMNRPC_WS_MAX_REPLY 160
+
+/**
+* @brief jsmnrpc_framer_next() for jsmnrpc_framing_websocket. Before the handshake
+*        is done it looks for the upgrade request; the frame then covers the
+*        Sec-WebSocket-Key value and has the flags jsmnrpc_frame_control and
+*        jsmnrpc_frame_upgrade. After it, a frame is either a complete message
+*        (pass it to jsmnrpc_ws_decode) or, with jsmnrpc_frame_control, the
+*        payload of a ping, pong or close frame (pass it to jsmnrpc_ws_reply).
+*        A control frame received between the fragments of a message consumes
+*        nothing: the message follows once it is complete.
+* @return 1 if a message or control frame was found, 0 if more data is needed, -1
+*         on a malformed handshake or frame, an unmasked client frame, or a
+*         message longer than max_frame.
+*/
+int jsmnrpc_ws_next(jsmnrpc_framer_t* self, const char* buf, size_t len, jsmnrpc_frame_t* frame);
+
+/**
+* @brief Unmasks a message in place (frame offset, length and flags from
+*        jsmnrpc_ws_next). The fragments of a fragmented message are moved behind
+*        the first one, skipping control frames.
+* @param length in: frame length, out: message length.
+* @return start of the message.
+*/
+char* jsmnrpc_ws_decode(char* data, size_t* length, unsigned flags);
+
+/**
+* @brief Writes the reply to a control frame from jsmnrpc_ws_next: the 101
+*        response to the handshake, a pong for a ping, or a close frame echoing
+*        the status code of a close frame. 'data' is unmasked in place.
+* @param out receives at most JSMNRPC_WS_MAX_REPLY bytes.
+* @return bytes written (0 for a pong).
+*/
+size_t jsmnrpc_ws_reply(char* data, size_t length, unsigned flags, char* out);
+
+/**
+* @brief What to send before closing the connection after jsmnrpc_ws_next failed:
+*        400 Bad Request during the handshake, else a close frame with status
+*        1002 (protocol error).
+*/
+const char* jsmnrpc_ws_error(const jsmnrpc_framer_t* self);
+
+/**
+* @brief Writes the header of a text frame in front of 'message' (in the
+*        JSMNRPC_WS_PREFIX bytes reserved there). The header length depends on
+*        the message length, so messages up to 125 bytes are moved back by 2
+*        bytes and messages over 64 KB forward by 6 (this needs 6 spare bytes
+*        behind the message).
+* @return bytes to send, starting JSMNRPC_WS_PREFIX bytes before 'message'.
+*/
+size_t jsmnrpc_ws_seal(char* message, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _jsmnrpc_ws_h_ */
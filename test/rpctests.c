@@ -0,0 +1,1516 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "../jsmnrpc.h"
+#include "../jsmnrpc_clock.h"
+#include "../jsmnrpc_coalesce.h"
+#include "../jsmnrpc_conn.h"
+#include "../jsmnrpc_frame.h"
+#include "../jsmnrpc_http.h"
+#include "../jsmnrpc_pipeline.h"
+#include "../jsmnrpc_server.h"
+#include "../jsmnrpc_server_group.h"
+#include "../jsmnrpc_shm.h"
+#include "../jsmnrpc_stdio.h"
+#include "../jsmnrpc_udp.h"
+#include "../jsmnrpc_ws.h"
+
+#define MAX_NUM_OF_HANDLERS 8
+#define RESPONSE_BUF_MAX_LEN 256
+#define REQUEST_TOKEN_MAX_LEN 64
+
+static jsmnrpc_handler_t handlers[MAX_NUM_OF_HANDLERS];
+static char response_buffer[RESPONSE_BUF_MAX_LEN];
+static jsmntok_t request_tokens[REQUEST_TOKEN_MAX_LEN];
+
+static void echo(jsmnrpc_request_info_t* info) {
+	jsmnrpc_create_result("\"echo\"", info);
+}
+
+static void fail_always(jsmnrpc_request_info_t* info) {
+	jsmnrpc_create_error(jsmnrpc_err_invalid_params, NULL, info);
+}
+
+static void rpc_setup(jsmnrpc_instance_t *rpc, jsmnrpc_data_t *data) {
+	jsmnrpc_init(rpc, handlers, MAX_NUM_OF_HANDLERS);
+	jsmnrpc_register_handler(rpc, "echo", echo);
+	jsmnrpc_register_handler(rpc, "fail", fail_always);
+	memset(data, 0, sizeof(*data));
+	data->tokens.data = request_tokens;
+	data->tokens.capacity = REQUEST_TOKEN_MAX_LEN;
+	data->response.data = response_buffer;
+	data->response.capacity = RESPONSE_BUF_MAX_LEN;
+}
+
+static void rpc_call(jsmnrpc_instance_t *rpc, jsmnrpc_data_t *data, const char *request) {
+	data->request.data = (char *)request;
+	data->request.length = strlen(request);
+	jsmnrpc_handle_request(rpc, data);
+}
+
+int test_handle_request(void) {
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	rpc_setup(&rpc, &data);
+
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}");
+	check(strcmp(response_buffer, "{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}") == 0);
+
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}");
+	check(data.response.length == 0);
+	check(data.info_flags & jsmnrpc_request_is_notification);
+	return 0;
+}
+
+static void nap(jsmnrpc_request_info_t* info) {
+	usleep(50000);
+	jsmnrpc_create_result("\"nap\"", info);
+}
+
+/* works until its deadline, if it has one */
+static void wait_expired(jsmnrpc_request_info_t* info) {
+	if (info->deadline == 0) {
+		jsmnrpc_create_result("null", info);
+		return;
+	}
+	while (!jsmnrpc_request_expired(info)) {
+		usleep(1000);
+	}
+	jsmnrpc_create_error(jsmnrpc_err_timeout, NULL, info);
+}
+
+int test_deadline(void) {
+	static const char *batch =
+		"[{\"jsonrpc\": \"2.0\", \"method\": \"nap\", \"id\": 1}, {\"jsonrpc\": \"2.0\", \"method\": \"nap\", \"id\": 2}, "
+		"{\"jsonrpc\": \"2.0\", \"method\": \"nap\", \"id\": 3}]";
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 4}";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	uint64_t start;
+	rpc_setup(&rpc, &data);
+	jsmnrpc_register_handler(&rpc, "nap", nap);
+	jsmnrpc_register_handler(&rpc, "wait", wait_expired);
+
+	/* the first call starts in time, the third cannot: it is answered without running */
+	data.request.data = (char *)batch;
+	data.request.length = strlen(batch);
+	jsmnrpc_handle_request_until(&rpc, &data, jsmnrpc_clock_ns() + 75000000u);
+	check(strstr(response_buffer, "[{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"nap\"}, ") == response_buffer);
+	check(strstr(response_buffer,
+		"{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32001, \"message\": \"Request timeout\"}, \"id\": 3}]") != NULL);
+
+	/* past the deadline before dispatch; without one, nothing changes */
+	data.request.data = (char *)request;
+	data.request.length = strlen(request);
+	jsmnrpc_handle_request_until(&rpc, &data, 1);
+	check(strstr(response_buffer, "-32001") != NULL && strstr(response_buffer, "\"id\": 4}") != NULL);
+	jsmnrpc_handle_request_until(&rpc, &data, 0);
+	check(strstr(response_buffer, "\"result\": \"echo\"") != NULL);
+
+	/* long handlers poll the deadline */
+	start = jsmnrpc_clock_ns();
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"wait\", \"id\": 5}");
+	check(strstr(response_buffer, "\"result\": null") != NULL);
+	check(jsmnrpc_parse_request(&rpc, &data));
+	jsmnrpc_dispatch_request_until(&rpc, &data, start + 10000000u);
+	check(jsmnrpc_clock_ns() - start >= 10000000u && strstr(response_buffer, "-32001") != NULL);
+	return 0;
+}
+
+int test_framer(void) {
+	jsmnrpc_framer_t framer;
+	jsmnrpc_frame_t frame;
+	const char *lines = "{\"a\": 1}\r\n\n[2]\n";
+	const char *raw = " {\"s\": \"}\\\"{\"} [1, [2]]";
+	const char prefixed[] = "\0\0\0\3abc\0\0";
+	const char *headed = "Content-Type: x\r\ncontent-length:  3 \r\n\r\n[1]";
+	char sealed[40];
+
+	/* newline: incomplete, then complete across calls */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_newline, 64);
+	check(jsmnrpc_framer_next(&framer, lines, 4, &frame) == 0);
+	check(framer.scanned == 4);
+	check(jsmnrpc_framer_next(&framer, lines, strlen(lines), &frame) == 1);
+	check(frame.offset == 0 && frame.length == 8 && frame.consumed == 10);
+	check(jsmnrpc_framer_next(&framer, lines + 10, strlen(lines) - 10, &frame) == 1);
+	check(frame.length == 0 && frame.consumed == 1);
+	check(jsmnrpc_framer_next(&framer, lines + 11, strlen(lines) - 11, &frame) == 1);
+	check(frame.length == 3);
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_newline, 4);
+	check(jsmnrpc_framer_next(&framer, lines, 8, &frame) == -1);
+
+	/* length prefix */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_length_prefix, 64);
+	check(jsmnrpc_framer_next(&framer, prefixed, 3, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, prefixed, 6, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, prefixed, 7, &frame) == 1);
+	check(frame.offset == 4 && frame.length == 3 && frame.consumed == 7);
+	check(jsmnrpc_framer_next(&framer, prefixed + 7, 2, &frame) == 0);
+
+	/* raw: brackets inside strings and escaped quotes do not count */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_raw, 64);
+	check(jsmnrpc_framer_next(&framer, raw, 10, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, raw, strlen(raw), &frame) == 1);
+	check(frame.offset == 1 && frame.length == 13 && frame.consumed == 14);
+	check(jsmnrpc_framer_next(&framer, raw + 14, strlen(raw) - 14, &frame) == 1);
+	check(frame.offset == 1 && frame.length == 8);
+	check(jsmnrpc_framer_next(&framer, "]", 1, &frame) == -1);
+
+	/* content-length: other header fields are ignored, the length is required */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_content_length, 64);
+	check(jsmnrpc_framer_next(&framer, headed, 20, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, headed, 41, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, headed, strlen(headed), &frame) == 1);
+	check(frame.offset == 40 && frame.length == 3 && frame.consumed == 43);
+	check(jsmnrpc_framer_next(&framer, "Content-Type: x\r\n\r\n", 19, &frame) == -1);
+	check(jsmnrpc_framer_next(&framer, "Content-Length: 65\r\n\r\n", 22, &frame) == -1);
+
+	/* outgoing */
+	check(jsmnrpc_frame_prefix_size(jsmnrpc_framing_length_prefix) == 4);
+	memcpy(sealed + 4, "[]", 2);
+	check(jsmnrpc_frame_seal(jsmnrpc_framing_length_prefix, sealed + 4, 2) == 6);
+	check(memcmp(sealed, "\0\0\0\2[]", 6) == 0);
+	check(jsmnrpc_frame_seal(jsmnrpc_framing_newline, sealed + 4, 2) == 3 && sealed[6] == '\n');
+	check(jsmnrpc_frame_prefix_size(jsmnrpc_framing_content_length) == 30);
+	memcpy(sealed + 30, "[]", 2);
+	check(jsmnrpc_frame_seal(jsmnrpc_framing_content_length, sealed + 30, 2) == 32);
+	check(memcmp(sealed, "Content-Length:          2\r\n\r\n[]", 32) == 0);
+	return 0;
+}
+
+static size_t read_available(int fd, char *buf, size_t cap) {
+	size_t len = 0;
+	ssize_t n;
+	while (len < cap && (n = recv(fd, buf + len, cap - len, MSG_DONTWAIT)) > 0) {
+		len += (size_t)n;
+	}
+	buf[len < cap ? len : cap - 1] = 0;
+	return len;
+}
+
+/* a few loop iterations: io_uring submits what one completion queues on the next one */
+static void server_pump(jsmnrpc_server_t *server) {
+	int i;
+	for (i = 0; i < 4; i++) {
+		jsmnrpc_server_poll(server, 10);
+	}
+}
+
+static int server_session(jsmnrpc_server_backend_t backend) {
+	static const char *part1 = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}\n{\"jsonrpc\": \"2.0\", ";
+	static const char *part2 = "\"method\": \"none\", \"id\": 2}\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}\n";
+	static const char *responses =
+		"{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}\n"
+		"{\"jsonrpc\": \"2.0\", \"error\": {\"code\": -32601, \"message\": \"Method not found\"}, \"id\": 2}\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_t server;
+	jsmnrpc_server_config_t config;
+	char buf[512];
+	size_t len;
+	int sv[2];
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_server_config_init(&config);
+	config.backend = backend;
+	if (jsmnrpc_server_init(&server, &rpc, &config) != 0) {
+		check(backend == jsmnrpc_server_backend_io_uring);
+		return 0; /* not supported by this kernel */
+	}
+	check(server.backend == backend);
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_server_adopt(&server, sv[0]) == 0);
+
+	/* two pipelined requests and a notification, split in the middle of one */
+	check(write(sv[1], part1, strlen(part1)) == (ssize_t)strlen(part1));
+	server_pump(&server);
+	len = read_available(sv[1], buf, sizeof(buf));
+	check(len == (size_t)(strchr(responses, '\n') + 1 - responses));
+	check(write(sv[1], part2, strlen(part2)) == (ssize_t)strlen(part2));
+	server_pump(&server);
+	read_available(sv[1], buf + len, sizeof(buf) - len);
+	check(strcmp(buf, responses) == 0);
+	check(server.counters.requests == 3 && server.num_of_connections == 1);
+
+	/* half-close: remaining output is flushed, then the connection is closed */
+	shutdown(sv[1], SHUT_WR);
+	server_pump(&server);
+	check(server.num_of_connections == 0 && server.counters.closed == 1);
+	close(sv[1]);
+	jsmnrpc_server_close(&server);
+	return 0;
+}
+
+/* more pipelined requests than the receive buffer holds, written as the socket takes them */
+static int server_stream_session(jsmnrpc_server_backend_t backend) {
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_t server;
+	jsmnrpc_server_config_t config;
+	char *stream, buf[4096];
+	size_t n = strlen(request), total, sent = 0, i;
+	int sv[2], responses = 0, count, polls;
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_server_config_init(&config);
+	config.backend = backend;
+	config.max_request = 1024; /* receive buffers of JSMNRPC_CONN_MIN_BUFFER */
+	if (jsmnrpc_server_init(&server, &rpc, &config) != 0) {
+		check(backend == jsmnrpc_server_backend_io_uring);
+		return 0; /* not supported by this kernel */
+	}
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_server_adopt(&server, sv[0]) == 0);
+	count = (int)(3 * JSMNRPC_CONN_MIN_BUFFER / n) + 1;
+	total = (size_t)count * n;
+	stream = (char *)malloc(total);
+	check(stream != NULL);
+	for (i = 0; i < (size_t)count; i++) {
+		memcpy(stream + i * n, request, n);
+	}
+	for (polls = 0; polls < 1000 && responses < count; polls++) {
+		ssize_t r = sent < total ? send(sv[1], stream + sent, total - sent, MSG_DONTWAIT) : 0;
+		sent += r > 0 ? (size_t)r : 0;
+		jsmnrpc_server_poll(&server, 1);
+		while ((r = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+			for (i = 0; i < (size_t)r; i++) {
+				responses += buf[i] == '\n';
+			}
+		}
+	}
+	free(stream);
+	check(sent == total && responses == count && server.counters.requests == (uint64_t)count);
+	close(sv[1]);
+	jsmnrpc_server_close(&server);
+	return 0;
+}
+
+int test_conn(void) {
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}\n";
+	static const char *response = "{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_conn_t conn;
+	char buf[2048];
+	const char *out;
+	size_t length, room, n = strlen(request), i;
+
+	rpc_setup(&rpc, &data);
+	check(jsmnrpc_conn_init(&conn, &rpc, jsmnrpc_framing_newline, 1024, 128, 64) == 0);
+
+	/* a request handled in the caller's buffer, and the start of another one kept */
+	memcpy(buf, request, n);
+	memcpy(buf + n, request, 20);
+	check(jsmnrpc_conn_feed(&conn, buf, n + 20) == n + 20);
+	check(conn.requests == 1 && conn.in_len == 20);
+	memcpy(buf, request + 20, n - 20);
+	check(jsmnrpc_conn_feed(&conn, buf, n - 20) == n - 20);
+	check(conn.requests == 2 && conn.in_len == 0);
+	out = jsmnrpc_conn_next_output(&conn, &length);
+	check(length == 2 * strlen(response) && memcmp(out, response, strlen(response)) == 0);
+	jsmnrpc_conn_output_done(&conn, length);
+	check(jsmnrpc_conn_next_output(&conn, &length) == NULL && length == 0);
+
+	/* the send buffer holds six responses: the other requests wait for it to be written */
+	for (i = 0; i < 10; i++) {
+		memcpy(buf + i * n, request, n);
+	}
+	check(jsmnrpc_conn_feed(&conn, buf, 10 * n) == 10 * n);
+	check(conn.requests == 8 && !jsmnrpc_conn_wants_input(&conn));
+	out = jsmnrpc_conn_next_output(&conn, &length);
+	check(length == 6 * strlen(response));
+	jsmnrpc_conn_output_done(&conn, 10); /* a partial write */
+	check(conn.requests == 8);
+	jsmnrpc_conn_output_done(&conn, length - 10);
+	check(conn.requests == 12 && jsmnrpc_conn_wants_input(&conn));
+
+	/* reading into the receive buffer; buffered requests are still handled after the end of input */
+	out = jsmnrpc_conn_input_buffer(&conn, &room);
+	check(room > n);
+	memcpy((char *)out, request, n);
+	jsmnrpc_conn_eof(&conn);
+	jsmnrpc_conn_input_done(&conn, n);
+	check(conn.requests == 13 && !jsmnrpc_conn_finished(&conn));
+	jsmnrpc_conn_next_output(&conn, &length);
+	jsmnrpc_conn_output_done(&conn, length);
+	check(jsmnrpc_conn_finished(&conn) && jsmnrpc_conn_feed(&conn, buf, n) == n && conn.requests == 13);
+
+	/* reading more than the receive buffer holds, a request split at its end each time */
+	jsmnrpc_conn_reset(&conn);
+	for (length = 0; length < 3 * conn.in_cap; length += room) {
+		check(jsmnrpc_conn_wants_input(&conn));
+		out = jsmnrpc_conn_input_buffer(&conn, &room);
+		check(room > 0);
+		for (i = 0; i < room; i++) {
+			((char *)out)[i] = request[(length + i) % n];
+		}
+		jsmnrpc_conn_input_done(&conn, room);
+		while (jsmnrpc_conn_next_output(&conn, &i) != NULL) {
+			jsmnrpc_conn_output_done(&conn, i);
+		}
+	}
+	check(conn.requests == 13 + length / n && conn.protocol_errors == 0);
+
+	/* a new stream, with malformed framing */
+	jsmnrpc_conn_reset(&conn);
+	check(jsmnrpc_conn_wants_input(&conn));
+	memset(buf, 'x', 1100);
+	check(jsmnrpc_conn_feed(&conn, buf, 1100) == 1100);
+	check(conn.protocol_errors == 1 && jsmnrpc_conn_finished(&conn));
+	jsmnrpc_conn_close(&conn);
+	return 0;
+}
+
+typedef struct conn_submissions {
+	int count;
+	int refuse;
+	int released;
+	uint64_t tags[8];
+} conn_submissions_t;
+
+static int conn_submit(jsmnrpc_conn_t *conn, const char *request, size_t length, uint64_t tag) {
+	conn_submissions_t *s = (conn_submissions_t *)conn->arg;
+	(void)request;
+	(void)length;
+	if (s->refuse) {
+		return -1;
+	}
+	s->tags[s->count++] = tag;
+	return 0;
+}
+
+static void conn_release(jsmnrpc_conn_t *conn, void *token) {
+	(void)token;
+	((conn_submissions_t *)conn->arg)->released++;
+}
+
+int test_conn_concurrent(void) {
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_conn_t conn;
+	conn_submissions_t subs;
+	char buf[512];
+	const char *out;
+	size_t length, n = strlen(request), i;
+
+	rpc_setup(&rpc, &data);
+	memset(&subs, 0, sizeof(subs));
+	check(jsmnrpc_conn_init(&conn, &rpc, jsmnrpc_framing_newline, 1024, 128, 64) == 0);
+	check(jsmnrpc_conn_set_concurrent(&conn, 3, 0, conn_submit, conn_release, &subs) == 0);
+
+	/* three requests in flight, the fourth waits for a slot */
+	for (i = 0; i < 4; i++) {
+		memcpy(buf + i * n, request, n);
+	}
+	check(jsmnrpc_conn_feed(&conn, buf, 4 * n) == 4 * n);
+	check(subs.count == 3 && conn.in_flight == 3 && !jsmnrpc_conn_wants_input(&conn));
+
+	/* responses are written as they complete; a freed slot takes the next request */
+	jsmnrpc_conn_complete(&conn, subs.tags[2], "[3]", 3, NULL);
+	check(subs.count == 4 && subs.released == 1 && conn.requests == 1);
+	out = jsmnrpc_conn_next_output(&conn, &length);
+	check(length == 4 && memcmp(out, "[3]\n", 4) == 0);
+	jsmnrpc_conn_complete(&conn, subs.tags[0], "", 0, NULL); /* a notification */
+	jsmnrpc_conn_complete(&conn, subs.tags[3], "[4]", 3, NULL);
+	out = jsmnrpc_conn_next_output(&conn, &length);
+	check(length == 8 && memcmp(out, "[3]\n[4]\n", 8) == 0);
+	jsmnrpc_conn_output_done(&conn, length);
+
+	/* a refused request is kept until the connection resumes */
+	subs.refuse = 1;
+	check(jsmnrpc_conn_feed(&conn, buf, n) == n);
+	check(conn.held && subs.count == 4 && !jsmnrpc_conn_wants_input(&conn));
+	subs.refuse = 0;
+	jsmnrpc_conn_resume(&conn);
+	check(!conn.held && subs.count == 5 && conn.in_flight == 2);
+
+	/* the end of input waits for the requests in flight */
+	jsmnrpc_conn_eof(&conn);
+	jsmnrpc_conn_complete(&conn, subs.tags[1], "[2]", 3, NULL);
+	check(!jsmnrpc_conn_finished(&conn));
+	jsmnrpc_conn_complete(&conn, subs.tags[4], "[5]", 3, NULL);
+	out = jsmnrpc_conn_next_output(&conn, &length);
+	check(length == 8 && memcmp(out, "[2]\n[5]\n", 8) == 0);
+	jsmnrpc_conn_output_done(&conn, length);
+	check(jsmnrpc_conn_finished(&conn) && subs.released == 5);
+	jsmnrpc_conn_close(&conn);
+
+	/* in order: a response waits for the ones before it */
+	memset(&subs, 0, sizeof(subs));
+	check(jsmnrpc_conn_init(&conn, &rpc, jsmnrpc_framing_newline, 1024, 128, 64) == 0);
+	check(jsmnrpc_conn_set_concurrent(&conn, 3, 1, conn_submit, conn_release, &subs) == 0);
+	check(jsmnrpc_conn_feed(&conn, buf, 2 * n) == 2 * n && subs.count == 2);
+	jsmnrpc_conn_complete(&conn, subs.tags[1], "[2]", 3, NULL);
+	check(jsmnrpc_conn_next_output(&conn, &length) == NULL && subs.released == 0);
+	jsmnrpc_conn_complete(&conn, subs.tags[0], "[1]", 3, NULL);
+	out = jsmnrpc_conn_next_output(&conn, &length);
+	check(length == 8 && memcmp(out, "[1]\n[2]\n", 8) == 0 && subs.released == 2);
+
+	/* aborted: responses still in flight are released and dropped */
+	check(jsmnrpc_conn_feed(&conn, buf, n) == n && conn.in_flight == 1);
+	jsmnrpc_conn_abort(&conn);
+	jsmnrpc_conn_complete(&conn, subs.tags[2], "[3]", 3, NULL);
+	check(jsmnrpc_conn_finished(&conn) && subs.released == 3);
+	check(jsmnrpc_conn_next_output(&conn, &length) == NULL);
+	jsmnrpc_conn_close(&conn);
+	return 0;
+}
+
+static void slow(jsmnrpc_request_info_t* info) {
+	usleep(100000);
+	jsmnrpc_create_result("\"slow\"", info);
+}
+
+/* a slow call and a fast one pipelined on one connection, with handlers on worker threads */
+static int server_workers_session(jsmnrpc_server_backend_t backend, int in_order) {
+	static const char *requests =
+		"{\"jsonrpc\": \"2.0\", \"method\": \"slow\", \"id\": 1}\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 2}\n";
+	static const char *slow_response = "{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"slow\"}\n";
+	static const char *echo_response = "{\"jsonrpc\": \"2.0\", \"id\": 2, \"result\": \"echo\"}\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_t server;
+	jsmnrpc_server_config_t config;
+	char buf[512];
+	size_t len = 0, expected = strlen(slow_response) + strlen(echo_response);
+	int sv[2], i;
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_register_handler(&rpc, "slow", slow);
+	jsmnrpc_server_config_init(&config);
+	config.backend = backend;
+	config.workers = 2;
+	config.in_order = in_order;
+	config.jobs = 8;
+	config.max_request = config.max_response = 1024;
+	config.max_tokens = 64;
+	if (jsmnrpc_server_init(&server, &rpc, &config) != 0) {
+		check(backend == jsmnrpc_server_backend_io_uring);
+		return 0; /* not supported by this kernel */
+	}
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_server_adopt(&server, sv[0]) == 0);
+
+	check(write(sv[1], requests, strlen(requests)) == (ssize_t)strlen(requests));
+	for (i = 0; i < 100 && len < expected; i++) {
+		jsmnrpc_server_poll(&server, 10);
+		len += read_available(sv[1], buf + len, sizeof(buf) - len);
+	}
+	check(len == expected && server.counters.requests == 2);
+	if (in_order) {
+		check(strncmp(buf, slow_response, strlen(slow_response)) == 0);
+	} else {
+		check(strncmp(buf, echo_response, strlen(echo_response)) == 0); /* did not wait for the slow call */
+	}
+
+	/* closed by the peer while a call runs: the slot is released after it */
+	check(write(sv[1], requests, 46) == 46);
+	server_pump(&server);
+	close(sv[1]);
+	for (i = 0; i < 100 && server.num_of_connections > 0; i++) {
+		jsmnrpc_server_poll(&server, 10);
+	}
+	check(server.num_of_connections == 0);
+	jsmnrpc_server_close(&server);
+	return 0;
+}
+
+/* out of descriptors: a pending connection is accepted and closed, not retried in a loop */
+static int server_shed_session(jsmnrpc_server_backend_t backend) {
+	static const char *path = "/tmp/jsmnrpc_test_shed.sock";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_t server;
+	jsmnrpc_server_config_t config;
+	struct sockaddr_un addr;
+	struct rlimit saved, limit;
+	int fds[256];
+	int num_of_fds = 0, client, i;
+	char c;
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_server_config_init(&config);
+	config.backend = backend;
+	if (jsmnrpc_server_init(&server, &rpc, &config) != 0) {
+		check(backend == jsmnrpc_server_backend_io_uring);
+		return 0; /* not supported by this kernel */
+	}
+	check(jsmnrpc_server_listen_unix(&server, path) == 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	client = socket(AF_UNIX, SOCK_STREAM, 0);
+	check(client >= 0 && connect(client, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	check(getrlimit(RLIMIT_NOFILE, &saved) == 0);
+	limit = saved;
+	limit.rlim_cur = 64;
+	check(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+	while (num_of_fds < 256 && (fds[num_of_fds] = dup(client)) >= 0) {
+		num_of_fds++;
+	}
+	server_pump(&server);
+	for (i = 0; i < num_of_fds; i++) {
+		close(fds[i]);
+	}
+	check(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+	check(server.counters.rejected == 1 && server.counters.accepted == 0);
+	check(recv(client, &c, 1, 0) == 0);
+	close(client);
+	jsmnrpc_server_close(&server);
+	unlink(path);
+	return 0;
+}
+
+int test_server(void) {
+	check(server_shed_session(jsmnrpc_server_backend_epoll) == 0);
+	check(server_shed_session(jsmnrpc_server_backend_io_uring) == 0);
+	check(server_session(jsmnrpc_server_backend_epoll) == 0);
+	check(server_session(jsmnrpc_server_backend_io_uring) == 0);
+	check(server_stream_session(jsmnrpc_server_backend_epoll) == 0);
+	check(server_stream_session(jsmnrpc_server_backend_io_uring) == 0);
+	return 0;
+}
+
+int test_server_workers(void) {
+	check(server_workers_session(jsmnrpc_server_backend_epoll, 0) == 0);
+	check(server_workers_session(jsmnrpc_server_backend_epoll, 1) == 0);
+	check(server_workers_session(jsmnrpc_server_backend_io_uring, 0) == 0);
+	return 0;
+}
+
+int test_http(void) {
+	static const char *pipelined =
+		"POST /rpc HTTP/1.1\r\nHost: x\r\nContent-Length: 2\r\n\r\n[]"
+		"\r\nPOST / HTTP/1.0\r\nConnection: keep-alive\r\ncontent-length:0\r\n\r\n";
+	static const char *expect = "POST / HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 2\r\n\r\n";
+	static const char *smuggled = "POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n";
+	static const char *ok =
+		"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length:          2\r\n\r\n[]";
+	static const char *no_content = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+	char chunked[] = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3;x=y\r\n[1,\r\n2\r\n2]\r\n0\r\nX: 1\r\n\r\n";
+	char sealed[256];
+	jsmnrpc_framer_t framer;
+	jsmnrpc_frame_t frame;
+	size_t length;
+	char *body;
+
+	/* Content-Length, pipelined; an empty line between requests is skipped */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_http, 64);
+	check(jsmnrpc_framer_next(&framer, pipelined, 30, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, pipelined, 51, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, pipelined, strlen(pipelined), &frame) == 1);
+	check(frame.offset == 50 && frame.length == 2 && frame.consumed == 52 && frame.flags == 0);
+	check(jsmnrpc_framer_next(&framer, pipelined + 52, strlen(pipelined) - 52, &frame) == 1);
+	check(frame.length == 0 && frame.consumed == strlen(pipelined) - 52 && frame.flags == 0);
+	check(jsmnrpc_framer_next(&framer, "POST / HTTP/1.0\r\n\r\n", 19, &frame) == 1);
+	check(frame.flags == jsmnrpc_frame_close);
+
+	/* chunked: decoded in place, the first chunk is not moved */
+	check(jsmnrpc_framer_next(&framer, chunked, 60, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, chunked, strlen(chunked), &frame) == 1);
+	check(frame.flags == jsmnrpc_frame_chunked && frame.offset == 47 && frame.consumed == strlen(chunked));
+	length = frame.length;
+	body = jsmnrpc_http_dechunk(chunked + frame.offset, &length);
+	check(body == chunked + 54 && length == 5 && memcmp(body, "[1,2]", 5) == 0);
+
+	/* 100-continue is asked for once, while the body is missing */
+	check(jsmnrpc_framer_next(&framer, expect, strlen(expect), &frame) == 0);
+	check(jsmnrpc_http_continue(&framer) != NULL && jsmnrpc_http_continue(&framer) == NULL);
+
+	/* rejected: other methods, ambiguous framing, oversized bodies */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_http, 64);
+	check(jsmnrpc_framer_next(&framer, "GET / HTTP/1.1\r\n\r\n", 18, &frame) == -1);
+	check(jsmnrpc_framer_next(&framer, smuggled, strlen(smuggled), &frame) == -1);
+	check(jsmnrpc_framer_next(&framer, "POST / HTTP/1.1\r\nContent-Length: 65\r\n\r\n", 39, &frame) == -1);
+
+	/* responses: fixed-width Content-Length in front of the message, 204 for notifications */
+	check(jsmnrpc_frame_prefix_size(jsmnrpc_framing_http) == JSMNRPC_HTTP_PREFIX);
+	memcpy(sealed + JSMNRPC_HTTP_PREFIX, "[]", 2);
+	check(jsmnrpc_frame_seal(jsmnrpc_framing_http, sealed + JSMNRPC_HTTP_PREFIX, 2) == strlen(ok));
+	check(memcmp(sealed, ok, strlen(ok)) == 0);
+	length = jsmnrpc_http_seal(sealed + JSMNRPC_HTTP_PREFIX, 0, jsmnrpc_frame_close);
+	check(length == strlen(no_content) && memcmp(sealed, no_content, length) == 0);
+	return 0;
+}
+
+int test_http_server(void) {
+	static const char *requests =
+		"POST / HTTP/1.1\r\nContent-Length: 45\r\n\r\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}"
+		"POST / HTTP/1.1\r\nContent-Length: 36\r\n\r\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}"
+		"POST / HTTP/1.1\r\nConnection: close\r\nTransfer-Encoding: chunked\r\n\r\n"
+		"3\r\n[1]\r\n0\r\n\r\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_t server;
+	jsmnrpc_server_config_t config;
+	char buf[1024];
+	char *p;
+	int sv[2];
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_server_config_init(&config);
+	config.framing = jsmnrpc_framing_http;
+	check(jsmnrpc_server_init(&server, &rpc, &config) == 0);
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_server_adopt(&server, sv[0]) == 0);
+
+	/* pipelined: a call, a notification (204) and a chunked batch; then the connection closes */
+	check(write(sv[1], requests, strlen(requests)) == (ssize_t)strlen(requests));
+	server_pump(&server);
+	read_available(sv[1], buf, sizeof(buf));
+	p = strstr(buf, "\r\n\r\n{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}HTTP/1.1 204 No Content\r\n");
+	check(strncmp(buf, "HTTP/1.1 200 OK\r\n", 17) == 0 && p != NULL);
+	p = strstr(p, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close");
+	check(p != NULL && strstr(p, "\"code\": -32600") != NULL);
+	check(server.counters.requests == 3 && server.num_of_connections == 0);
+	close(sv[1]);
+
+	/* a malformed request is answered with 400 before closing */
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_server_adopt(&server, sv[0]) == 0);
+	check(write(sv[1], "GET / HTTP/1.1\r\n\r\n", 18) == 18);
+	server_pump(&server);
+	read_available(sv[1], buf, sizeof(buf));
+	check(strcmp(buf, JSMNRPC_HTTP_BAD_REQUEST) == 0 && server.num_of_connections == 0);
+	close(sv[1]);
+	jsmnrpc_server_close(&server);
+	return 0;
+}
+
+/* a masked client frame */
+static size_t ws_client_frame(char *out, unsigned char first, const char *payload, size_t length) {
+	static const char key[4] = { 0x12, 0x34, 0x56, 0x78 };
+	size_t i, n = 0;
+	out[n++] = (char)first;
+	if (length < 126) {
+		out[n++] = (char)(0x80 | length);
+	} else {
+		out[n++] = (char)(0x80 | 126);
+		out[n++] = (char)(length >> 8);
+		out[n++] = (char)length;
+	}
+	memcpy(out + n, key, 4);
+	n += 4;
+	for (i = 0; i < length; i++) {
+		out[n + i] = payload[i] ^ key[i & 3];
+	}
+	return n + length;
+}
+
+static const char *ws_upgrade =
+	"GET /rpc HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+
+int test_websocket(void) {
+	static const char *accept = "\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+	jsmnrpc_framer_t framer;
+	jsmnrpc_frame_t frame;
+	char buf[512], long_payload[203], reply[JSMNRPC_WS_MAX_REPLY];
+	size_t n, length;
+	char *message;
+
+	/* handshake */
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_websocket, 256);
+	strcpy(buf, ws_upgrade);
+	check(jsmnrpc_framer_next(&framer, buf, 40, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, buf, strlen(buf), &frame) == 1);
+	check(frame.flags == (jsmnrpc_frame_control | jsmnrpc_frame_upgrade) && frame.consumed == strlen(buf));
+	n = jsmnrpc_ws_reply(buf + frame.offset, frame.length, frame.flags, reply);
+	check(n > strlen(accept) && strncmp(reply, "HTTP/1.1 101 ", 13) == 0);
+	check(memcmp(reply + n - strlen(accept), accept, strlen(accept)) == 0);
+
+	/* a masked frame, unmasked in place (also with a 16-bit length and a tail) */
+	n = ws_client_frame(buf, 0x81, "[1, 2]", 6);
+	check(jsmnrpc_framer_next(&framer, buf, n - 1, &frame) == 0);
+	check(jsmnrpc_framer_next(&framer, buf, n, &frame) == 1);
+	check(frame.offset == 6 && frame.length == 6 && frame.consumed == n && frame.flags == 0);
+	length = frame.length;
+	message = jsmnrpc_ws_decode(buf + frame.offset, &length, frame.flags);
+	check(message == buf + 6 && length == 6 && memcmp(message, "[1, 2]", 6) == 0);
+	memset(long_payload, 'x', sizeof(long_payload));
+	n = ws_client_frame(buf, 0x82, long_payload, sizeof(long_payload));
+	check(jsmnrpc_framer_next(&framer, buf, n, &frame) == 1 && frame.offset == 8);
+	length = frame.length;
+	message = jsmnrpc_ws_decode(buf + frame.offset, &length, frame.flags);
+	check(length == sizeof(long_payload) && memcmp(message, long_payload, length) == 0);
+
+	/* fragments with a ping in between: the ping is answered first, then the message is joined */
+	n = ws_client_frame(buf, 0x01, "[{\"a\"", 5);
+	n += ws_client_frame(buf + n, 0x89, "hi", 2);
+	n += ws_client_frame(buf + n, 0x80, ": 1}]", 5);
+	check(jsmnrpc_framer_next(&framer, buf, n, &frame) == 1);
+	check(frame.flags == jsmnrpc_frame_control && frame.consumed == 0 && frame.length == 2);
+	check(jsmnrpc_ws_reply(buf + frame.offset, frame.length, frame.flags, reply) == 4);
+	check(memcmp(reply, "\x8a\x02hi", 4) == 0);
+	check(jsmnrpc_framer_next(&framer, buf, n, &frame) == 1);
+	check(frame.flags == jsmnrpc_frame_fragmented && frame.offset == 0 && frame.consumed == n);
+	length = frame.length;
+	message = jsmnrpc_ws_decode(buf + frame.offset, &length, frame.flags);
+	check(message == buf + 6 && length == 10 && memcmp(message, "[{\"a\": 1}]", 10) == 0);
+
+	/* close is echoed; unmasked frames and stray continuations are rejected */
+	n = ws_client_frame(buf, 0x88, "\x03\xe8", 2);
+	check(jsmnrpc_framer_next(&framer, buf, n, &frame) == 1);
+	check(frame.flags == (jsmnrpc_frame_control | jsmnrpc_frame_close));
+	check(jsmnrpc_ws_reply(buf + frame.offset, frame.length, frame.flags, reply) == 4);
+	check(memcmp(reply, "\x88\x02\x03\xe8", 4) == 0);
+	check(jsmnrpc_framer_next(&framer, "\x81\x02[]", 4, &frame) == -1);
+	n = ws_client_frame(buf, 0x80, "[]", 2);
+	check(jsmnrpc_framer_next(&framer, buf, n, &frame) == -1);
+	check(memcmp(jsmnrpc_ws_error(&framer), "\x88\x02\x03\xea", 4) == 0);
+	jsmnrpc_framer_init(&framer, jsmnrpc_framing_websocket, 256);
+	check(jsmnrpc_framer_next(&framer, "GET / HTTP/1.1\r\n\r\n", 18, &frame) == -1);
+	check(strcmp(jsmnrpc_ws_error(&framer), JSMNRPC_HTTP_BAD_REQUEST) == 0);
+
+	/* responses: the header length depends on the message length */
+	check(jsmnrpc_frame_prefix_size(jsmnrpc_framing_websocket) == JSMNRPC_WS_PREFIX);
+	memcpy(buf + 4, "[]", 2);
+	check(jsmnrpc_frame_seal(jsmnrpc_framing_websocket, buf + 4, 2) == 4);
+	check(memcmp(buf, "\x81\x02[]", 4) == 0);
+	memcpy(buf + 4, long_payload, sizeof(long_payload));
+	check(jsmnrpc_frame_seal(jsmnrpc_framing_websocket, buf + 4, sizeof(long_payload)) == 4 + sizeof(long_payload));
+	check(memcmp(buf, "\x81\x7e\x00\xcb", 4) == 0 && buf[4] == 'x');
+	return 0;
+}
+
+int test_websocket_server(void) {
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}";
+	static const char *notification = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}";
+	static const char *response = "\x81\x2d{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}\x88\x02\x03\xe8";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_t server;
+	jsmnrpc_server_config_t config;
+	char buf[512];
+	size_t n;
+	int sv[2];
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_server_config_init(&config);
+	config.framing = jsmnrpc_framing_websocket;
+	check(jsmnrpc_server_init(&server, &rpc, &config) == 0);
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_server_adopt(&server, sv[0]) == 0);
+
+	check(write(sv[1], ws_upgrade, strlen(ws_upgrade)) == (ssize_t)strlen(ws_upgrade));
+	server_pump(&server);
+	read_available(sv[1], buf, sizeof(buf));
+	check(strncmp(buf, "HTTP/1.1 101 Switching Protocols\r\n", 34) == 0);
+
+	/* a call, a notification (no reply) and a close frame */
+	n = ws_client_frame(buf, 0x81, request, strlen(request));
+	n += ws_client_frame(buf + n, 0x81, notification, strlen(notification));
+	n += ws_client_frame(buf + n, 0x88, "\x03\xe8", 2);
+	check(write(sv[1], buf, n) == (ssize_t)n);
+	server_pump(&server);
+	n = read_available(sv[1], buf, sizeof(buf));
+	check(n == 2 + 45 + 4 && memcmp(buf, response, n) == 0);
+	check(server.counters.requests == 2 && server.num_of_connections == 0);
+	close(sv[1]);
+	jsmnrpc_server_close(&server);
+	return 0;
+}
+
+int test_stdio(void) {
+	static const char *part1 =
+		"Content-Length: 45\r\n\r\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}Content-Len";
+	static const char *part2 = "gth: 36\r\nContent-Type: application/vscode-jsonrpc\r\n\r\n"
+				   "{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}"
+				   "Content-Length: 45\r\n\r\n{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 2}";
+	static const char *response = "Content-Length:         45\r\n\r\n{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_stdio_t stdio;
+	char buf[512];
+	int sv[2];
+
+	rpc_setup(&rpc, &data);
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_stdio_init(&stdio, sv[0], sv[0], jsmnrpc_framing_content_length, 1024, 1024) == 0);
+
+	/* a request and the beginning of a header; the response is written once the input is drained */
+	check(write(sv[1], part1, strlen(part1)) == (ssize_t)strlen(part1));
+	check(jsmnrpc_stdio_poll(&stdio, &rpc, &data) == 1);
+	read_available(sv[1], buf, sizeof(buf));
+	check(strcmp(buf, response) == 0);
+
+	/* the rest of the header (not scanned again), a notification and a request: one write */
+	check(write(sv[1], part2, strlen(part2)) == (ssize_t)strlen(part2));
+	check(jsmnrpc_stdio_poll(&stdio, &rpc, &data) == 1);
+	read_available(sv[1], buf, sizeof(buf));
+	check(strstr(buf, "\"id\": 2") != NULL && strstr(buf + 1, "Content-Length:") == NULL);
+	check(stdio.counters.requests == 3 && stdio.counters.reads == 2 && stdio.counters.writes == 2);
+
+	/* end of input */
+	shutdown(sv[1], SHUT_WR);
+	check(jsmnrpc_stdio_serve(&stdio, &rpc, &data) == 0);
+
+	/* malformed input */
+	jsmnrpc_stdio_close(&stdio);
+	close(sv[0]);
+	close(sv[1]);
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	check(jsmnrpc_stdio_init(&stdio, sv[0], sv[0], jsmnrpc_framing_content_length, 1024, 1024) == 0);
+	check(write(sv[1], "Content-Length: x\r\n\r\n", 21) == 21);
+	check(jsmnrpc_stdio_poll(&stdio, &rpc, &data) == -1 && errno == EPROTO);
+	jsmnrpc_stdio_close(&stdio);
+	close(sv[0]);
+	close(sv[1]);
+	return 0;
+}
+
+int test_udp(void) {
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}";
+	static const char *notification = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}";
+	static const char *response = "{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_udp_t udp;
+	struct sockaddr_in addr;
+	char buf[300];
+	int fd, port;
+
+	rpc_setup(&rpc, &data);
+	check(jsmnrpc_udp_init(&udp, 256, 256) == 0);
+	port = jsmnrpc_udp_bind(&udp, "127.0.0.1", 0);
+	check(port > 0);
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	check(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	/* one batch: a call, a notification, an oversized datagram and another call */
+	memset(buf, ' ', sizeof(buf));
+	check(send(fd, request, strlen(request), 0) == (ssize_t)strlen(request));
+	check(send(fd, notification, strlen(notification), 0) == (ssize_t)strlen(notification));
+	check(send(fd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf));
+	check(send(fd, request, strlen(request), 0) == (ssize_t)strlen(request));
+	check(jsmnrpc_udp_poll(&udp, &rpc, &data) == 4);
+	check(udp.counters.truncated == 1 && udp.counters.responses == 2);
+	check(udp.counters.receive_calls == 1 && udp.counters.send_calls == 1);
+	check(recv(fd, buf, sizeof(buf), 0) == (ssize_t)strlen(response) && memcmp(buf, response, strlen(response)) == 0);
+	check(recv(fd, buf, sizeof(buf), 0) == (ssize_t)strlen(response) && memcmp(buf, response, strlen(response)) == 0);
+	close(fd);
+	jsmnrpc_udp_close(&udp);
+	return 0;
+}
+
+int test_server_group(void) {
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}\n";
+	static const char *response = "{\"jsonrpc\": \"2.0\", \"id\": 1, \"result\": \"echo\"}\n";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_server_group_t group;
+	jsmnrpc_server_counters_t totals;
+	struct sockaddr_in addr;
+	char buf[128];
+	int fds[4];
+	int i, port;
+
+	rpc_setup(&rpc, &data);
+	check(jsmnrpc_server_group_init(&group, &rpc, NULL, 2) == 0);
+	group.pin_threads = 0;
+	port = jsmnrpc_server_group_listen_tcp(&group, "127.0.0.1", 0);
+	check(port > 0);
+	check(group.shards[0].num_of_listeners == 1 && group.shards[1].num_of_listeners == 1);
+	check(jsmnrpc_server_group_start(&group) == 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	for (i = 0; i < 4; i++) {
+		ssize_t n, len = 0;
+		fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		check(connect(fds[i], (struct sockaddr *)&addr, sizeof(addr)) == 0);
+		check(write(fds[i], request, strlen(request)) == (ssize_t)strlen(request));
+		while (len < (ssize_t)strlen(response) && (n = read(fds[i], buf + len, sizeof(buf) - 1 - len)) > 0) {
+			len += n;
+		}
+		buf[len] = 0;
+		check(strcmp(buf, response) == 0);
+	}
+	for (i = 0; i < 4; i++) {
+		close(fds[i]);
+	}
+
+	jsmnrpc_server_group_stop(&group);
+	check(jsmnrpc_server_group_wait(&group) == 0);
+	jsmnrpc_server_group_counters(&group, &totals);
+	check(totals.accepted == 4 && totals.requests == 4);
+	jsmnrpc_server_group_close(&group);
+	return 0;
+}
+
+int test_queues(void) {
+	void *slots[4];
+	jsmnrpc_mpmc_cell_t cells[4];
+	jsmnrpc_spsc_queue_t spsc;
+	jsmnrpc_mpmc_queue_t mpmc;
+	int items[5];
+	int i, lap;
+
+	jsmnrpc_spsc_init(&spsc, slots, 4);
+	jsmnrpc_mpmc_init(&mpmc, cells, 4);
+	check(jsmnrpc_spsc_pop(&spsc) == NULL && jsmnrpc_mpmc_pop(&mpmc) == NULL);
+	for (lap = 0; lap < 3; lap++) {
+		for (i = 0; i < 4; i++) {
+			check(jsmnrpc_spsc_push(&spsc, &items[i]) == 1);
+			check(jsmnrpc_mpmc_push(&mpmc, &items[i]) == 1);
+		}
+		check(jsmnrpc_spsc_push(&spsc, &items[4]) == 0);
+		check(jsmnrpc_mpmc_push(&mpmc, &items[4]) == 0);
+		check(jsmnrpc_spsc_size(&spsc) == 4 && jsmnrpc_mpmc_size(&mpmc) == 4);
+		for (i = 0; i < 4; i++) {
+			check(jsmnrpc_spsc_pop(&spsc) == &items[i]);
+			check(jsmnrpc_mpmc_pop(&mpmc) == &items[i]);
+		}
+		check(jsmnrpc_spsc_pop(&spsc) == NULL && jsmnrpc_mpmc_pop(&mpmc) == NULL);
+	}
+	return 0;
+}
+
+typedef struct {
+	pthread_mutex_t lock;
+	int responses;
+	int empty;
+	int parse_errors;
+	int busy;
+	int cancelled;
+	uint64_t tags;
+} pipeline_results_t;
+
+static void pipeline_collect(jsmnrpc_pipeline_job_t *job, void *arg) {
+	pipeline_results_t *results = (pipeline_results_t *)arg;
+	pthread_mutex_lock(&results->lock);
+	results->tags += job->tag;
+	if (job->data.response.length == 0) {
+		results->empty++;
+	} else if (strstr(job->data.response.data, "\"echo\"") != NULL) {
+		results->responses++;
+	} else if (strstr(job->data.response.data, "-32700") != NULL && !job->parsed) {
+		results->parse_errors++;
+	} else if (strstr(job->data.response.data, "\"Server busy\"}, \"id\": ") != NULL) {
+		results->busy++;
+		results->tags += strstr(job->data.response.data, "\"id\": \"a\"}") != NULL ? 100 : 0;
+	} else if (strstr(job->data.response.data, "-32800") != NULL) {
+		results->cancelled++;
+	}
+	pthread_mutex_unlock(&results->lock);
+}
+
+typedef struct {
+	int count;
+	uint64_t tags[16];
+} pipeline_order_t;
+
+/* single worker, no writer threads: records the execution order */
+static void pipeline_record(jsmnrpc_pipeline_job_t *job, void *arg) {
+	pipeline_order_t *order = (pipeline_order_t *)arg;
+	if (order->count < 16) {
+		order->tags[order->count++] = job->tag;
+	}
+}
+
+int test_pipeline(void) {
+	static const char request[] = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 7}";
+	static const char notification[] = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\"}";
+	static const char broken[] = "{\"jsonrpc\": ";
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_pipeline_config_t config;
+	jsmnrpc_pipeline_metrics_t m;
+	jsmnrpc_pipeline_t pipeline;
+	pipeline_results_t results;
+	pipeline_order_t order;
+	static const uint64_t expected_order[] = { 0, 7, 8, 4, 1, 9, 10, 5, 2, 6, 3 };
+	uint64_t tags = 0;
+	int i;
+
+	rpc_setup(&rpc, &data);
+	memset(&results, 0, sizeof(results));
+	pthread_mutex_init(&results.lock, NULL);
+	jsmnrpc_pipeline_config_init(&config);
+	config.workers = 2;
+	config.writers = 1;
+	config.jobs = 8;
+	config.max_request = 64;
+	config.max_response = 128;
+	config.max_tokens = 32;
+	check(jsmnrpc_pipeline_init(&pipeline, &rpc, &config, pipeline_collect, &results) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, response_buffer, 65, NULL, 0) == -1 && errno == EMSGSIZE);
+	/* not started yet: the pool runs dry */
+	for (i = 0; i < 8; i++) {
+		check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 1) == 0);
+		tags++;
+	}
+	check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 1) == -1 && errno == EAGAIN);
+	check(jsmnrpc_pipeline_start(&pipeline) == 0);
+	for (i = 0; i < 300; i++) {
+		const char *r = i % 10 == 0 ? broken : i % 10 == 1 ? notification : request;
+		while (jsmnrpc_pipeline_submit(&pipeline, r, strlen(r), NULL, (uint64_t)i) != 0) {
+			check(errno == EAGAIN);
+			usleep(100);
+		}
+		tags += (uint64_t)i;
+	}
+	jsmnrpc_pipeline_stop(&pipeline);
+	jsmnrpc_pipeline_metrics(&pipeline, &m);
+	jsmnrpc_pipeline_close(&pipeline);
+	pthread_mutex_destroy(&results.lock);
+
+	check(results.responses == 8 + 240 && results.empty == 30 && results.parse_errors == 30);
+	check(results.tags == tags);
+	check(m.submitted == 308 && m.written == 308 && m.executed == 278);
+	check(m.parse_errors == 30 && m.rejected >= 1 && m.in_flight == 0);
+	check(m.execute_depth == 0 && m.write_depth == 0);
+	check(m.execute_max_depth >= 4 && m.execute_wait_ns.count == 308);
+
+	/* with max_queued, requests over the limit are answered "Server busy" at once */
+	memset(&results, 0, sizeof(results));
+	pthread_mutex_init(&results.lock, NULL);
+	config.max_queued = 2;
+	check(jsmnrpc_pipeline_init(&pipeline, &rpc, &config, pipeline_collect, &results) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, broken, sizeof(broken) - 1, NULL, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"echo\", \"id\": \"a\"}", 29, NULL, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, "[{\"method\": \"echo\", \"id\": 1}]", 29, NULL, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, notification, sizeof(notification) - 1, NULL, 0) == 0);
+	check(jsmnrpc_pipeline_start(&pipeline) == 0);
+	jsmnrpc_pipeline_stop(&pipeline);
+	jsmnrpc_pipeline_metrics(&pipeline, &m);
+	jsmnrpc_pipeline_close(&pipeline);
+	pthread_mutex_destroy(&results.lock);
+
+	check(results.responses == 2 && results.parse_errors == 1 && results.busy == 2 && results.empty == 1);
+	check(results.tags == 100);
+	check(m.busy == 3 && m.submitted == 6 && m.written == 6 && m.executed == 2 && m.in_flight == 0);
+
+	/* a cancel notification drops a queued request with that id, of the same context only */
+	memset(&results, 0, sizeof(results));
+	pthread_mutex_init(&results.lock, NULL);
+	config.max_queued = 0;
+	config.cancel_method = "$/cancelRequest";
+	check(jsmnrpc_pipeline_init(&pipeline, &rpc, &config, pipeline_collect, &results) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, &results, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"echo\", \"id\": \"x\"}", 29, &results, 1) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"echo\", \"id\": \"x\"}", 29, &pipeline, 0) == 0);
+	check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"$/cancelRequest\", \"params\": {\"id\": \"x\"}}", 52,
+		&results, 0) == 0);
+	check(jsmnrpc_pipeline_cancel(&pipeline, &results, "7", 1, 1) == 0); /* "7" is not 7 */
+	check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"$/cancelRequest\", \"params\": {\"id\": 7}}", 50,
+		&results, 0) == 0);
+	check(jsmnrpc_pipeline_start(&pipeline) == 0);
+	jsmnrpc_pipeline_stop(&pipeline);
+	jsmnrpc_pipeline_metrics(&pipeline, &m);
+	jsmnrpc_pipeline_close(&pipeline);
+	pthread_mutex_destroy(&results.lock);
+
+	check(results.responses == 1 && results.cancelled == 2 && results.empty == 2);
+	check(m.cancelled == 2 && m.executed == 3 && m.written == 5);
+
+	/* priority classes are served in weighted round robin; high ones skip max_queued */
+	jsmnrpc_register_handler_ex(&rpc, "ping", echo, jsmnrpc_priority_high);
+	jsmnrpc_register_handler_ex(&rpc, "bulk", echo, jsmnrpc_priority_bulk);
+	rpc_call(&rpc, &data, "[{\"method\": \"ping\", \"id\": 1}, {\"method\": \"bulk\", \"id\": 2}]");
+	check(jsmnrpc_request_priority(&rpc, &data.tokens) == jsmnrpc_priority_bulk);
+	rpc_call(&rpc, &data, "[]");
+	check(jsmnrpc_request_priority(&rpc, &data.tokens) == jsmnrpc_priority_normal);
+	memset(&order, 0, sizeof(order));
+	config.workers = 1;
+	config.writers = 0;
+	config.jobs = 16;
+	config.max_queued = 6;
+	config.weights[jsmnrpc_priority_high] = 2;
+	config.weights[jsmnrpc_priority_normal] = 1;
+	config.weights[jsmnrpc_priority_bulk] = 0; /* taken as 1 */
+	check(jsmnrpc_pipeline_init(&pipeline, &rpc, &config, pipeline_record, &order) == 0);
+	for (i = 0; i < 3; i++) {
+		check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"bulk\", \"id\": 1}", 27, NULL, 1 + i) == 0);
+		check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 4 + i) == 0);
+	}
+	check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 0) == 0); /* busy */
+	for (i = 0; i < 4; i++) {
+		check(jsmnrpc_pipeline_submit(&pipeline, "{\"method\": \"ping\", \"id\": 1}", 27, NULL, 7 + i) == 0);
+	}
+	check(jsmnrpc_pipeline_start(&pipeline) == 0);
+	jsmnrpc_pipeline_stop(&pipeline);
+	jsmnrpc_pipeline_metrics(&pipeline, &m);
+	jsmnrpc_pipeline_close(&pipeline);
+
+	check(order.count == 11 && memcmp(order.tags, expected_order, sizeof(expected_order)) == 0);
+	check(m.busy == 1 && m.executed == 10 && m.priority_wait_ns[jsmnrpc_priority_high].count == 4);
+	check(m.priority_wait_ns[jsmnrpc_priority_bulk].count == 3 && m.execute_wait_ns.count == 10);
+	return 0;
+}
+
+static void coalesce_response(jsmnrpc_pipeline_job_t *job, void *arg) {
+	char *message = job->data.response.data;
+	size_t length = jsmnrpc_frame_seal(jsmnrpc_framing_length_prefix, message, job->data.response.length);
+	jsmnrpc_coalesce_add((jsmnrpc_coalesce_t *)arg, message - 4, length);
+}
+
+static void coalesce_flush(void *arg) {
+	jsmnrpc_coalesce_flush((jsmnrpc_coalesce_t *)arg);
+}
+
+int test_coalesce(void) {
+	static const char request[] = "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 7}";
+	static char big[1 << 18];
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_coalesce_t out;
+	jsmnrpc_pipeline_config_t config;
+	jsmnrpc_pipeline_t pipeline;
+	char buf[512];
+	size_t received = 0, i;
+	int sv[2], size = 4096;
+
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	/* responses are written together when flushed */
+	jsmnrpc_coalesce_init(&out, sv[0], 0, 0);
+	check(jsmnrpc_coalesce_add(&out, "a\n", 2) == 0);
+	check(jsmnrpc_coalesce_add(&out, "bb\n", 3) == 0);
+	check(jsmnrpc_coalesce_add(&out, "ccc\n", 4) == 0);
+	check(read_available(sv[1], buf, sizeof(buf)) == 0 && out.counters.writes == 0);
+	check(jsmnrpc_coalesce_flush(&out) == 0 && out.counters.writes == 1 && out.counters.responses == 3);
+	check(read_available(sv[1], buf, sizeof(buf)) == 9 && strcmp(buf, "a\nbb\nccc\n") == 0);
+	check(jsmnrpc_coalesce_flush(&out) == 0 && out.counters.writes == 1);
+	jsmnrpc_coalesce_close(&out);
+
+	/* byte threshold */
+	jsmnrpc_coalesce_init(&out, sv[0], 8, 0);
+	check(jsmnrpc_coalesce_add(&out, "aaaa", 4) == 0 && out.counters.writes == 0);
+	check(jsmnrpc_coalesce_add(&out, "bbbb", 4) == 0 && out.counters.writes == 1);
+	check(read_available(sv[1], buf, sizeof(buf)) == 8);
+	jsmnrpc_coalesce_close(&out);
+
+	/* a short write on a non-blocking socket: the rest is copied, the response can be reused */
+	check(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0);
+	check(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0);
+	jsmnrpc_coalesce_init(&out, sv[0], 0, 0);
+	memset(big, 'x', sizeof(big));
+	check(jsmnrpc_coalesce_add(&out, big, sizeof(big)) == 0 && jsmnrpc_coalesce_flush(&out) == 0);
+	check(out.backlog_len > out.backlog_start && out.counters.copied > 0);
+	memset(big, 'y', sizeof(big));
+	while (received < sizeof(big)) {
+		ssize_t n = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT);
+		for (i = 0; n > 0 && i < (size_t)n; i++) {
+			check(buf[i] == 'x');
+		}
+		received += n > 0 ? (size_t)n : 0;
+		check(jsmnrpc_coalesce_flush(&out) == 0);
+	}
+	check(received == sizeof(big) && out.backlog_len == out.backlog_start);
+	check(out.counters.bytes == sizeof(big));
+	jsmnrpc_coalesce_close(&out);
+	close(sv[0]);
+	close(sv[1]);
+
+	/* pipeline writers frame responses in place and flush them after each batch */
+	rpc_setup(&rpc, &data);
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	jsmnrpc_coalesce_init(&out, sv[0], 0, 0);
+	jsmnrpc_pipeline_config_init(&config);
+	config.workers = 1;
+	config.jobs = 8;
+	config.max_request = 64;
+	config.max_response = 128;
+	config.max_tokens = 32;
+	check(jsmnrpc_pipeline_init(&pipeline, &rpc, &config, coalesce_response, &out) == 0);
+	pipeline.flush = coalesce_flush;
+	for (i = 0; i < 8; i++) {
+		check(jsmnrpc_pipeline_submit(&pipeline, request, sizeof(request) - 1, NULL, 0) == 0);
+	}
+	check(jsmnrpc_pipeline_start(&pipeline) == 0);
+	jsmnrpc_pipeline_stop(&pipeline);
+	jsmnrpc_pipeline_close(&pipeline);
+	check(out.counters.responses == 8 && out.counters.writes >= 1 && out.counters.writes <= 8);
+	check(read_available(sv[1], buf, sizeof(buf)) == 8 * (4 + 45));
+	check(buf[3] == 45 && memcmp(buf + 4, "{\"jsonrpc\": \"2.0\", \"id\": 7", 26) == 0);
+	jsmnrpc_coalesce_close(&out);
+	close(sv[0]);
+	close(sv[1]);
+	return 0;
+}
+
+static int shm_client(int fd, int n) {
+	jsmnrpc_shm_t client;
+	char request[80];
+	char *response;
+	size_t length;
+	int sent = 0, received = 0;
+
+	if (jsmnrpc_shm_attach(&client, fd) != 0) {
+		return 1;
+	}
+	while (received < n) {
+		while (sent < n) {
+			int len = sprintf(request, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": %d}", sent);
+			if (jsmnrpc_shm_send(&client, request, (size_t)len) != 0) {
+				break; /* ring full */
+			}
+			sent++;
+		}
+		if (jsmnrpc_shm_wait_readable(&client, 2000) <= 0) {
+			return 2;
+		}
+		while ((response = jsmnrpc_shm_peek(&client, &length)) != NULL) {
+			if (length != strlen(response) || strstr(response, "\"echo\"") == NULL) {
+				return 3;
+			}
+			jsmnrpc_shm_release(&client);
+			received++;
+		}
+	}
+	jsmnrpc_shm_close(&client);
+	return 0;
+}
+
+int test_shm(void) {
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_shm_t server, client;
+	size_t length;
+	int handled = 0, status = -1, r;
+	pid_t child;
+
+	rpc_setup(&rpc, &data);
+	check(jsmnrpc_shm_create(&server, 1000) == -1 && errno == EINVAL);
+	check(jsmnrpc_shm_create(&server, 4096) == 0);
+	check(jsmnrpc_shm_reserve(&server, 4096) == NULL && errno == EMSGSIZE);
+	child = fork();
+	check(child >= 0);
+	if (child == 0) {
+		_exit(shm_client(server.fd, 500));
+	}
+	/* a small ring: requests wrap around and the client is often blocked */
+	while ((r = jsmnrpc_shm_wait_readable(&server, 2000)) > 0) {
+		int n = jsmnrpc_shm_serve(&server, &rpc, &data, RESPONSE_BUF_MAX_LEN);
+		if (n == 0) {
+			jsmnrpc_shm_wait_writable(&server, RESPONSE_BUF_MAX_LEN, 100);
+		}
+		handled += n;
+	}
+	waitpid(child, &status, 0);
+	check(r == -1 && errno == EPIPE);
+	check(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	check(handled == 500 && server.counters.received == 500 && server.counters.sent == 500);
+	jsmnrpc_shm_close(&server);
+
+	/* records are written by the peer: a bad length or tail is a protocol error */
+	check(jsmnrpc_shm_create(&server, 4096) == 0);
+	check(jsmnrpc_shm_attach(&client, server.fd) == 0);
+	check(jsmnrpc_shm_send(&client, "[]", 2) == 0);
+	*(uint32_t *)client.out_data = 4000;
+	check(jsmnrpc_shm_peek(&server, &length) == NULL && errno == EPROTO);
+	check(jsmnrpc_shm_wait_readable(&server, 0) == -1 && errno == EPROTO);
+	jsmnrpc_shm_close(&client);
+	jsmnrpc_shm_close(&server);
+	check(jsmnrpc_shm_create(&server, 4096) == 0);
+	check(jsmnrpc_shm_attach(&client, server.fd) == 0);
+	check(jsmnrpc_shm_send(&client, "[]", 2) == 0);
+	client.out->tail += 4096;
+	check(jsmnrpc_shm_peek(&server, &length) == NULL && errno == EPROTO);
+	jsmnrpc_shm_close(&client);
+	jsmnrpc_shm_close(&server);
+	return 0;
+}
+
+#if JSMNRPC_STATS
+int test_stats(void) {
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_stats_t stats;
+	jsmnrpc_stats_shard_t shards[2];
+	jsmnrpc_method_stats_t methods[2 * MAX_NUM_OF_HANDLERS];
+	jsmnrpc_stats_shard_t totals;
+	jsmnrpc_method_stats_t total_methods[MAX_NUM_OF_HANDLERS];
+	int i;
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_stats_init(&stats, shards, methods, 2, MAX_NUM_OF_HANDLERS);
+	jsmnrpc_set_stats(&rpc, &stats);
+
+	for (i = 0; i < 3; i++) {
+		rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}");
+	}
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"fail\", \"id\": 2}");
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"nope\", \"id\": 3}");
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", ");
+
+	totals.methods = total_methods;
+	jsmnrpc_stats_snapshot(&stats, &totals);
+	check(totals.requests == 6);
+	check(totals.parse_errors == 1);
+	check(totals.unknown_methods == 1);
+	check(totals.parse_ns.count == 5);
+	check(totals.response_bytes.count == 6);
+	check(total_methods[0].calls == 3 && total_methods[0].errors == 0);
+	check(total_methods[1].calls == 1 && total_methods[1].errors == 1);
+	check(total_methods[0].latency_ns.count == 3);
+	check(jsmnrpc_histogram_percentile(&total_methods[0].latency_ns, 99.0) <= total_methods[0].latency_ns.max);
+	return 0;
+}
+
+int test_histogram(void) {
+	jsmnrpc_histogram_t h;
+	uint64_t v;
+	memset(&h, 0, sizeof(h));
+	for (v = 1; v <= 1000; v++) {
+		jsmnrpc_histogram_record(&h, v);
+	}
+	check(h.count == 1000 && h.max == 1000);
+	v = jsmnrpc_histogram_percentile(&h, 50.0);
+	check(v >= 500 && v < 500 + 500 / JSMNRPC_HIST_SUB_COUNT);
+	check(jsmnrpc_histogram_percentile(&h, 100.0) == 1000);
+	return 0;
+}
+#endif
+
+#if JSMNRPC_TRACE
+int test_trace(void) {
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_trace_ring_t ring;
+	jsmnrpc_trace_record_t records[8];
+	jsmnrpc_trace_record_t out[8];
+	uint64_t cursor = 0;
+	int i;
+
+	rpc_setup(&rpc, &data);
+	jsmnrpc_trace_ring_init(&ring, records, 8);
+	jsmnrpc_trace_attach(&ring);
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}");
+	rpc_call(&rpc, &data, "[{\"jsonrpc\": \"2.0\", \"method\": \"fail\", \"id\": 1},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"nope\", \"id\": 2}]");
+	rpc_call(&rpc, &data, "{\"jsonrpc\": ");
+	jsmnrpc_trace_attach(NULL);
+	rpc_call(&rpc, &data, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}");
+
+	check(jsmnrpc_trace_read(&ring, &cursor, out, 8) == 4);
+	check(cursor == 4);
+	check(out[0].method_id == 0 && out[1].method_id == 1);
+	check(out[2].method_id == -1 && out[3].method_id == -1);
+	check(out[0].response_bytes > 0 && out[0].request_bytes > 0);
+	check(out[2].info_flags & jsmnrpc_response_is_error);
+	for (i = 0; i < 2; i++) {
+		check(out[i].t_receive <= out[i].t_parsed);
+		check(out[i].t_parsed <= out[i].t_dispatch);
+		check(out[i].t_dispatch <= out[i].t_handler_done);
+		check(out[i].t_handler_done <= out[i].t_complete);
+	}
+
+	/* overwritten records are skipped */
+	cursor = 0;
+	for (i = 0; i < 10; i++) {
+		jsmnrpc_trace_commit(&ring, &out[0]);
+	}
+	check(jsmnrpc_trace_read(&ring, &cursor, out, 8) == 8);
+	check(cursor == 14);
+	return 0;
+}
+#endif
+
+#if JSMNRPC_CAPTURE
+int test_capture(void) {
+	const char *path = "test_capture.tmp";
+	static const char *requests[] = {
+		"{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"id\": 1}",
+		"{\"jsonrpc\": ",
+	};
+	jsmnrpc_instance_t rpc;
+	jsmnrpc_data_t data;
+	jsmnrpc_capture_t capture;
+	const jsmnrpc_capture_record_t *record;
+	char buffer[512];
+	size_t size, offset;
+	uint64_t last = 0;
+	FILE *f;
+	int i;
+
+	rpc_setup(&rpc, &data);
+	check(jsmnrpc_capture_open(&capture, path) == 0);
+	jsmnrpc_set_capture(&rpc, &capture);
+	for (i = 0; i < 2; i++) {
+		rpc_call(&rpc, &data, requests[i]);
+	}
+	jsmnrpc_set_capture(&rpc, NULL);
+	rpc_call(&rpc, &data, requests[0]);
+	jsmnrpc_capture_close(&capture);
+	check(capture.records == 2 && capture.errors == 0);
+
+	f = fopen(path, "rb");
+	check(f != NULL);
+	size = fread(buffer, 1, sizeof(buffer), f);
+	fclose(f);
+	remove(path);
+	offset = jsmnrpc_capture_first(buffer, size);
+	check(offset == sizeof(jsmnrpc_capture_header_t));
+	for (i = 0; i < 2; i++) {
+		record = jsmnrpc_capture_next(buffer, size, &offset);
+		check(record != NULL && record->length == strlen(requests[i]));
+		check(memcmp(record + 1, requests[i], record->length) == 0);
+		check(record->timestamp_ns >= last && offset % 8 == 0);
+		last = record->timestamp_ns;
+	}
+	check(offset == size && jsmnrpc_capture_next(buffer, size, &offset) == NULL);
+	check(jsmnrpc_capture_first(buffer, 4) == 0);
+	return 0;
+}
+#endif
+
+int main(void) {
+	test(test_handle_request, "test handling of a single request");
+#if JSMNRPC_DEADLINES
+	test(test_deadline, "test request deadlines");
+#endif
+	test(test_framer, "test request framing");
+	test(test_conn, "test sans-IO connection");
+	test(test_conn_concurrent, "test requests in flight on a connection");
+	test(test_server, "test server connection handling");
+	test(test_server_workers, "test server with worker threads");
+	test(test_http, "test HTTP request framing");
+	test(test_http_server, "test server over HTTP");
+	test(test_websocket, "test WebSocket framing");
+	test(test_websocket_server, "test server over WebSocket");
+	test(test_server_group, "test sharded server threads");
+	test(test_queues, "test lock-free queues");
+	test(test_pipeline, "test staged request pipeline");
+	test(test_coalesce, "test write coalescing");
+	test(test_shm, "test shared-memory transport");
+	test(test_stdio, "test stdio transport");
+	test(test_udp, "test UDP transport");
+#if JSMNRPC_STATS
+	test(test_stats, "test per-method statistics");
+	test(test_histogram, "test latency histogram percentiles");
+#endif
+#if JSMNRPC_TRACE
+	test(test_trace, "test request tracing ring");
+#endif
+#if JSMNRPC_CAPTURE
+	test(test_capture, "test request capture");
+#endif
+	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
+	return (test_failed > 0);
+}
@@ -385,6 +385,57 @@ int test_unmatched_brackets(void) {
 	return 0;
 }
 
+int test_stats(void) {
+#if JSMN_STATS
+	const char *js;
+	jsmn_parser p;
+	jsmntok_t t[16];
+	jsmn_stats stats;
+
+	memset(&stats, 0, sizeof(stats));
+	js = "{\"a\": [1, {\"b\\n\\u0041\": true}], \"long string\": null}";
+	jsmn_init(&p);
+	p.stats = &stats;
+	check(jsmn_parse(&p, js, strlen(js), t, 16) == 9);
+	check(stats.parses == 1);
+	check(stats.bytes == strlen(js));
+	check(stats.tokens[JSMN_OBJECT] == 2);
+	check(stats.tokens[JSMN_ARRAY] == 1);
+	check(stats.tokens[JSMN_STRING] == 3);
+	check(stats.tokens[JSMN_PRIMITIVE] == 3);
+	check(stats.max_depth == 3);
+	check(stats.escapes == 2);
+	check(stats.longest_string == 11);
+	check(stats.longest_primitive == 4);
+
+	js = "{\"a\": ";
+	jsmn_init(&p);
+	p.stats = &stats;
+	check(jsmn_parse(&p, js, strlen(js), t, 16) == JSMN_ERROR_PART);
+	jsmn_init(&p);
+	p.stats = &stats;
+	check(jsmn_parse(&p, "[1, 2]", 6, t, 2) == JSMN_ERROR_NOMEM);
+	check(stats.parses == 3);
+	check(stats.errors[-1 - JSMN_ERROR_PART] == 1);
+	check(stats.errors[-1 - JSMN_ERROR_NOMEM] == 1);
+	check(stats.errors[-1 - JSMN_ERROR_INVAL] == 0);
+
+	/* resumed with more tokens after JSMN_ERROR_NOMEM: nothing is counted twice */
+	memset(&stats, 0, sizeof(stats));
+	js = "[[1], [\"ab\"]]";
+	jsmn_init(&p);
+	p.stats = &stats;
+	check(jsmn_parse(&p, js, strlen(js), t, 3) == JSMN_ERROR_NOMEM); /* at the second '[' */
+	check(jsmn_parse(&p, js, strlen(js), t, 16) == 5);
+	check(stats.tokens[JSMN_ARRAY] == 3);
+	check(stats.tokens[JSMN_STRING] == 1);
+	check(stats.tokens[JSMN_PRIMITIVE] == 1);
+	check(stats.longest_string == 2);
+	check(stats.max_depth == 2 && p.depth == 0);
+#endif
+	return 0;
+}
+
 int main(void) {
 	test(test_empty, "test for a empty JSON objects/arrays");
 	test(test_object, "test for a JSON objects");
@@ -402,6 +453,7 @@ int main(void) {
 	test(test_count, "test tokens count estimation");
 	test(test_nonstrict, "test for non-strict mode");
 	test(test_unmatched_brackets, "test for unmatched brackets");
+	test(test_stats, "test parse statistics");
 	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
 	return (test_failed > 0);
 }